@@ -0,0 +1,308 @@
+#include "BackPressure.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "ThreadTopology.hpp"
+
+BackPressureQueue::BackPressureQueue(size_t frame_bytes, size_t header_bytes, int slot_num,
+                                     OverloadPolicy policy, int high_depth, const char *producer_role)
+    : frame_bytes(frame_bytes), header_bytes(header_bytes), slot_num(slot_num),
+      pending(slot_num), free_frames(slot_num), closed(false),
+      write_frame(NULL), write_mode(WRITE_DROP), held(NULL),
+      queued_num(0), merged_num(0), dropped_oldest_num(0), dropped_newest_num(0), blocked_num(0)
+{
+    pool = (char *)malloc(frame_bytes * slot_num);
+    scratch = (char *)malloc(frame_bytes);
+    if (pool == NULL || scratch == NULL)
+    {
+        perror("BackPressureQueue malloc");
+        exit(EXIT_FAILURE);
+    }
+    if (producer_role != NULL)
+    {
+        place_thread_buffer(pool, frame_bytes * slot_num, producer_role);
+        place_thread_buffer(scratch, frame_bytes, producer_role);
+    }
+    // every buffer starts out empty
+    for (int i = 0; i < slot_num; i++)
+    {
+        free_frames.try_push(pool + frame_bytes * i);
+    }
+    set_policy(policy, high_depth);
+}
+
+void BackPressureQueue::set_policy(OverloadPolicy policy, int high_depth)
+{
+    this->high_depth.store((high_depth < 1 || high_depth > slot_num) ? slot_num : high_depth);
+    this->policy.store(policy);
+    // a blocked reader may continue under the new policy
+    released.notify_all();
+}
+
+int BackPressureQueue::depth(OverloadPolicy cur_policy)
+{
+    int cur_depth = high_depth.load();
+    if (cur_policy == OVERLOAD_MERGE && cur_depth > slot_num - 2)
+    {
+        cur_depth = (slot_num > 2) ? slot_num - 2 : 1;
+    }
+    return cur_depth;
+}
+
+void BackPressureQueue::flush_held(int cur_depth, bool is_force)
+{
+    if (held.load() == NULL || (!is_force && (int)pending.size() >= cur_depth))
+        return;
+    // close may take it at the same time, and waits while it is marked busy
+    char *frame = held.load();
+    if (frame != NULL && held.compare_exchange_strong(frame, scratch))
+    {
+        pending.try_push(frame);
+        held.store(NULL);
+    }
+}
+
+char *BackPressureQueue::begin_write()
+{
+    bool is_blocked = false;
+    while (1)
+    {
+        if (closed.load())
+            return NULL;
+        OverloadPolicy cur_policy = policy.load();
+        int cur_depth = depth(cur_policy);
+        // the held frame goes first so that frames stay in read order,
+        // other policies never hold one back (only left over from a policy change)
+        flush_held(cur_depth, cur_policy != OVERLOAD_MERGE);
+        if (held.load() == NULL && (int)pending.size() < cur_depth && free_frames.try_pop(write_frame))
+        {
+            write_mode = WRITE_QUEUE;
+            return write_frame;
+        }
+
+        // the consumer is behind
+        switch (cur_policy)
+        {
+        case OVERLOAD_BLOCK:
+        {
+            uint32_t ticket = released.prepare();
+            if (closed.load() || policy.load() != OVERLOAD_BLOCK ||
+                ((int)pending.size() < cur_depth && free_frames.size() > 0))
+            {
+                released.cancel();
+                continue;
+            }
+            if (!is_blocked)
+            {
+                blocked_num++;
+                is_blocked = true;
+            }
+            released.wait(ticket);
+            continue;
+        }
+        case OVERLOAD_DROP_OLDEST:
+            // the oldest frame is given up, the new one goes to the back of the queue
+            if (pending.try_pop(write_frame))
+            {
+                dropped_oldest_num++;
+                write_mode = WRITE_QUEUE;
+                return write_frame;
+            }
+            // nothing queued, the consumer holds every buffer
+            write_mode = WRITE_DROP;
+            break;
+        case OVERLOAD_DROP_NEWEST:
+            write_mode = WRITE_DROP;
+            break;
+        case OVERLOAD_MERGE:
+            if (held.load() != NULL)
+            {
+                write_mode = WRITE_MERGE;
+            }
+            else if (free_frames.try_pop(write_frame))
+            {
+                // read straight into the frame that is held back, later frames merge into it
+                write_mode = WRITE_HOLD;
+                return write_frame;
+            }
+            else
+            {
+                // only if the consumer keeps more than one popped frame
+                write_mode = WRITE_DROP;
+            }
+            break;
+        }
+        write_frame = scratch;
+        return write_frame;
+    }
+}
+
+void BackPressureQueue::merge_frame(char *dst, const char *src)
+{
+    memcpy(dst, src, header_bytes);
+    size_t i = header_bytes;
+    // 32 pixels at a time : every non-zero 2-bit pixel of src replaces the one in dst
+    for (; i + 8 <= frame_bytes; i += 8)
+    {
+        uint64_t s, d;
+        memcpy(&s, src + i, 8);
+        memcpy(&d, dst + i, 8);
+        uint64_t event = (s | (s >> 1)) & 0x5555555555555555ULL;
+        event |= event << 1;
+        d = (d & ~event) | s;
+        memcpy(dst + i, &d, 8);
+    }
+    for (; i < frame_bytes; i++)
+    {
+        uint8_t s = (uint8_t)src[i];
+        uint8_t event = (s | (s >> 1)) & 0x55;
+        event |= event << 1;
+        dst[i] = (char)(((uint8_t)dst[i] & ~event) | s);
+    }
+}
+
+void BackPressureQueue::commit()
+{
+    switch (write_mode)
+    {
+    case WRITE_QUEUE:
+        // fails only once the queue is closed
+        if (pending.try_push(write_frame))
+            queued_num++;
+        break;
+    case WRITE_DROP:
+        dropped_newest_num++;
+        break;
+    case WRITE_HOLD:
+        held.store(write_frame);
+        queued_num++;
+        flush_held(depth(policy.load()), false);
+        break;
+    case WRITE_MERGE:
+    {
+        // the held frame is not in the pending ring, the consumer never waits for the merge.
+        // it is marked busy for the merge, a concurrent close must not queue it half merged
+        char *frame = held.load();
+        if (frame != NULL && held.compare_exchange_strong(frame, scratch))
+        {
+            merge_frame(frame, scratch);
+            held.store(frame);
+            merged_num++;
+            flush_held(depth(policy.load()), false);
+        }
+        else
+        {
+            // queued by close meanwhile
+            dropped_newest_num++;
+        }
+        break;
+    }
+    }
+    write_frame = NULL;
+}
+
+char *BackPressureQueue::pop()
+{
+    char *frame;
+    if (!pending.pop(frame))
+        return NULL;
+    return frame;
+}
+
+void BackPressureQueue::release(char *frame)
+{
+    free_frames.try_push(frame);
+    // only enters the kernel if the reader sleeps in OVERLOAD_BLOCK
+    released.notify_one();
+}
+
+void BackPressureQueue::close()
+{
+    closed.store(true);
+    // the consumer still gets the frames merged so far, once an in-flight merge is done
+    char *frame = held.load();
+    while (frame == scratch || !held.compare_exchange_weak(frame, NULL))
+    {
+        if (frame == scratch)
+        {
+            std::this_thread::yield();
+            frame = held.load();
+        }
+    }
+    if (frame != NULL)
+        pending.try_push(frame);
+    pending.close();
+    released.notify_all();
+}
+
+BackPressureStats BackPressureQueue::get_stats()
+{
+    BackPressureStats stats;
+    stats.queued_num = queued_num.load(std::memory_order_relaxed);
+    stats.merged_num = merged_num.load(std::memory_order_relaxed);
+    stats.dropped_oldest_num = dropped_oldest_num.load(std::memory_order_relaxed);
+    stats.dropped_newest_num = dropped_newest_num.load(std::memory_order_relaxed);
+    stats.blocked_num = blocked_num.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void BackPressureQueue::print_stats(const char *name)
+{
+    BackPressureStats s = get_stats();
+    OverloadPolicy cur_policy = policy.load();
+    printf("%s : %s above %d queued frames, queued %llu, merged %llu, dropped oldest %llu, dropped newest %llu, reader blocked %llu times\n",
+           name, policy_name(cur_policy), depth(cur_policy),
+           (unsigned long long)s.queued_num, (unsigned long long)s.merged_num,
+           (unsigned long long)s.dropped_oldest_num, (unsigned long long)s.dropped_newest_num,
+           (unsigned long long)s.blocked_num);
+    // pops of the pending ring include frames taken back by drop-oldest
+    pending.print_stats(name);
+}
+
+const char *BackPressureQueue::policy_name(OverloadPolicy policy)
+{
+    switch (policy)
+    {
+    case OVERLOAD_BLOCK:
+        return "block";
+    case OVERLOAD_DROP_OLDEST:
+        return "drop-oldest";
+    case OVERLOAD_DROP_NEWEST:
+        return "drop-newest";
+    case OVERLOAD_MERGE:
+        return "merge";
+    }
+    return "?";
+}
+
+bool BackPressureQueue::parse_policy(const char *text, OverloadPolicy *policy, int *high_depth)
+{
+    const char *colon = strchr(text, ':');
+    size_t name_len = (colon != NULL) ? (size_t)(colon - text) : strlen(text);
+    const OverloadPolicy policies[] = {OVERLOAD_BLOCK, OVERLOAD_DROP_OLDEST, OVERLOAD_DROP_NEWEST, OVERLOAD_MERGE};
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    {
+        const char *name = policy_name(policies[i]);
+        if (strlen(name) != name_len || strncmp(text, name, name_len) != 0)
+            continue;
+        if (colon != NULL)
+        {
+            char *end;
+            long depth = strtol(colon + 1, &end, 10);
+            if (end == colon + 1 || *end != '\0' || depth < 1)
+                return false;
+            *high_depth = (int)depth;
+        }
+        *policy = policies[i];
+        return true;
+    }
+    return false;
+}
+
+BackPressureQueue::~BackPressureQueue()
+{
+    free(scratch);
+    free(pool);
+}
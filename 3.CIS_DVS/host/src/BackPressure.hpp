@@ -0,0 +1,167 @@
+#ifndef BACKPRESSURE_HPP
+#define BACKPRESSURE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "FrameQueue.hpp"
+
+/**
+ * what the reader does with a new frame once the consumer is behind
+ */
+enum OverloadPolicy
+{
+    // wait for the consumer, frames pile up (and get lost) on the card ring instead
+    OVERLOAD_BLOCK,
+    // reuse the oldest queued frame for the new one
+    OVERLOAD_DROP_OLDEST,
+    // read the new frame into a scratch buffer and discard it
+    OVERLOAD_DROP_NEWEST,
+    // merge the new frame into the newest queued frame, its events overwrite older ones
+    OVERLOAD_MERGE
+};
+
+/**
+ * snapshot of the decisions taken by a BackPressureQueue
+ */
+struct BackPressureStats
+{
+    // frames handed to the consumer as read
+    uint64_t queued_num;
+    // frames merged into a queued frame
+    uint64_t merged_num;
+    // queued frames overwritten before the consumer got them
+    uint64_t dropped_oldest_num;
+    // frames discarded right after reading
+    uint64_t dropped_newest_num;
+    // times the reader waited for the consumer
+    uint64_t blocked_num;
+};
+
+/**
+ * raw DVS frame queue between one PCIE reader thread and one consumer thread.
+ *
+ * while fewer than high_depth frames are queued, every frame is handed over as read.
+ * above that (or when the consumer holds every buffer) the overload policy decides,
+ * so a slow consumer sees at most high_depth frames of latency instead of a full ring.
+ * every decision is counted, see print_stats.
+ *
+ * frames move through two lock-free rings (FrameQueue.hpp) : pending (reader -> consumer)
+ * and free (consumer -> reader), so the normal path takes no lock and only wakes a thread
+ * that is actually sleeping. the policies only run on the reader side :
+ * drop-oldest takes the oldest frame back off the pending ring, merge keeps one frame
+ * (held) out of the ring and merges every new frame into it until there is room again.
+ *
+ * reader : buf = begin_write(); read into buf; commit();
+ * consumer : while ((buf = pop()) != NULL) { use buf; release(buf); }
+ */
+class BackPressureQueue
+{
+private:
+    size_t frame_bytes;
+    size_t header_bytes;
+    int slot_num;
+
+    // frame buffers, slot_num of them
+    char *pool;
+    // target of dropped and merged frames
+    char *scratch;
+
+    // queued frames in read order. the reader pops too (drop-oldest), so it is multi-consumer
+    MpmcQueue<char *> pending;
+    // buffers owned by nobody, filled by release
+    SpscQueue<char *> free_frames;
+    // notified by release, a blocking reader sleeps on it
+    QueueWaiter released;
+    std::atomic<bool> closed;
+
+    std::atomic<OverloadPolicy> policy;
+    std::atomic<int> high_depth;
+
+    // buffer handed out by begin_write and what commit does with it, reader only
+    enum WriteMode
+    {
+        WRITE_QUEUE,
+        WRITE_DROP,
+        WRITE_HOLD,
+        WRITE_MERGE
+    };
+    char *write_frame;
+    WriteMode write_mode;
+    // merge target kept out of the pending ring, exchanged by close.
+    // set to scratch while the reader merges into it or queues it, close waits until that is done
+    std::atomic<char *> held;
+
+    std::atomic<uint64_t> queued_num;
+    std::atomic<uint64_t> merged_num;
+    std::atomic<uint64_t> dropped_oldest_num;
+    std::atomic<uint64_t> dropped_newest_num;
+    std::atomic<uint64_t> blocked_num;
+
+    /**
+     * @return queued frames above which the policy applies. merge keeps one buffer back for
+     *         the held frame (a popped frame may still be in use by the consumer)
+     */
+    int depth(OverloadPolicy cur_policy);
+    /**
+     * queues the held frame if the pending ring has room again (or anyway if is_force)
+     */
+    void flush_held(int cur_depth, bool is_force);
+    /**
+     * merges the events of src into dst, dst takes the header of src
+     */
+    void merge_frame(char *dst, const char *src);
+
+public:
+    /**
+     * @param frame_bytes bytes of one raw frame, header included
+     * @param header_bytes header bytes in front of the events, copied as is on a merge
+     * @param slot_num number of frame buffers
+     * @param policy overload policy
+     * @param high_depth queued frames above which the policy applies, at most slot_num
+     * @param producer_role thread role of the reader, the buffers are placed on its NUMA node (see ThreadTopology.hpp)
+     */
+    BackPressureQueue(size_t frame_bytes, size_t header_bytes, int slot_num,
+                      OverloadPolicy policy, int high_depth, const char *producer_role = NULL);
+    /**
+     * changes the overload policy, also while the queue is running
+     */
+    void set_policy(OverloadPolicy policy, int high_depth);
+    /**
+     * @return buffer to read the next frame into, NULL once the queue is closed
+     */
+    char *begin_write();
+    /**
+     * hands the frame read into the begin_write buffer to the policy
+     */
+    void commit();
+    /**
+     * @return oldest queued frame, waits for one. NULL once the queue is closed and drained
+     */
+    char *pop();
+    /**
+     * gives a frame returned by pop back to the reader
+     */
+    void release(char *frame);
+    /**
+     * queues the held frame and wakes up both sides,
+     * begin_write returns NULL from now on and pop once drained
+     */
+    void close();
+    BackPressureStats get_stats();
+    /**
+     * prints the decision counters and the queue occupancy / latency
+     * @param name queue name shown in the lines
+     */
+    void print_stats(const char *name);
+    /**
+     * parses "<policy>[:<high depth>]", policy : block | drop-oldest | drop-newest | merge
+     * @param[out] high_depth unchanged if not given
+     * @return false if text is not a policy
+     */
+    static bool parse_policy(const char *text, OverloadPolicy *policy, int *high_depth);
+    static const char *policy_name(OverloadPolicy policy);
+    ~BackPressureQueue();
+};
+
+#endif // BACKPRESSURE_HPP
@@ -0,0 +1,248 @@
+#include "BinRenderer.hpp"
+
+#include <stdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ThreadTopology.hpp"
+
+BinRenderer::BinRenderer(int frame_h, int frame_w, bool is_header)
+    : frame_h(frame_h), frame_w(frame_w),
+      header_bytes(is_header ? 8 : 0),
+      base(NULL), file_bytes(0), frame_num(0)
+{
+    frame_bytes = (frame_h * frame_w) / 4 + header_bytes;
+}
+
+bool BinRenderer::open(const char *path_to_bin)
+{
+    int fd = ::open(path_to_bin, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Error opening binary file");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < frame_bytes)
+    {
+        fprintf(stderr, "%s holds no complete frame\n", path_to_bin);
+        close(fd);
+        return false;
+    }
+    file_bytes = st.st_size;
+
+    void *addr = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap bin file");
+        return false;
+    }
+    // windows are handed out in file order, so readahead still helps with several readers
+    madvise(addr, file_bytes, MADV_SEQUENTIAL);
+    base = (const char *)addr;
+
+    // an interrupted recording can end with a partial frame, ignore it
+    frame_num = file_bytes / frame_bytes;
+    return true;
+}
+
+int BinRenderer::get_frame_num()
+{
+    return frame_num;
+}
+
+void BinRenderer::render_window(int first, int last, RenderColor color, bool is_flip, cv::Mat &out)
+{
+    int byte_num = (frame_h * frame_w) / 4;
+
+    if (color == RENDER_GRAY)
+    {
+        out.setTo(cv::Scalar(128));
+    }
+    else
+    {
+        out.setTo(cv::Scalar(255, 255, 255));
+    }
+
+    uint8_t *dst = out.data;
+    for (int f = first; f < last; f++)
+    {
+        const uint8_t *src = (const uint8_t *)(base + (size_t)f * frame_bytes + header_bytes);
+        for (int b = 0; b < byte_num; b++)
+        {
+            uint8_t packed = src[b];
+            // most bytes hold no event at all
+            if (packed == 0)
+                continue;
+            for (int j = 0; j < 4; j++)
+            {
+                int pixel = (packed >> (j * 2)) & 0x03;
+                int i = b * 4 + j;
+                if (color == RENDER_GRAY)
+                {
+                    if (pixel == 1)
+                        dst[i] = 255;
+                    else if (pixel == 2)
+                        dst[i] = 0;
+                }
+                else if (pixel == 1)
+                {
+                    dst[i * 3] = 255;
+                    dst[i * 3 + 1] = 0;
+                    dst[i * 3 + 2] = 0;
+                }
+                else if (pixel == 2)
+                {
+                    dst[i * 3] = 0;
+                    dst[i * 3 + 1] = 0;
+                    dst[i * 3 + 2] = 255;
+                }
+            }
+        }
+    }
+
+    if (is_flip)
+    {
+        cv::flip(out, out, 0);
+    }
+}
+
+int BinRenderer::render(const char *output, bool is_video, double output_fps, double sensor_fps,
+                        int window_frames, RenderColor color, bool is_flip, int thread_num)
+{
+    if (base == NULL)
+        return -1;
+
+    // output frame k starts at source frame k * stride
+    int stride = (int)lround(sensor_fps / output_fps);
+    if (stride < 1)
+        stride = 1;
+    if (window_frames < 1)
+        window_frames = 1;
+    int output_num = (frame_num + stride - 1) / stride;
+
+    if (thread_num <= 0)
+    {
+        thread_num = std::thread::hardware_concurrency();
+        if (thread_num <= 0)
+            thread_num = 1;
+    }
+    int mat_type = (color == RENDER_GRAY) ? CV_8UC1 : CV_8UC3;
+
+    cv::VideoWriter video_writer;
+    if (is_video)
+    {
+        video_writer.open(output, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                          output_fps, cv::Size(frame_w, frame_h), color != RENDER_GRAY);
+        if (!video_writer.isOpened())
+        {
+            fprintf(stderr, "Failed to open video %s\n", output);
+            return -1;
+        }
+    }
+
+    // reorder ring for video output : output frame k is rendered into ring[k % ring_num]
+    // and only once frame k - ring_num has been written
+    int ring_num = thread_num * 2;
+    std::vector<cv::Mat> ring(is_video ? ring_num : 0);
+    std::vector<int> ring_ready(is_video ? ring_num : 0, -1);
+    for (auto &m : ring)
+    {
+        m.create(frame_h, frame_w, mat_type);
+    }
+    std::mutex ring_mutex;
+    std::condition_variable ring_cond;
+    int written_num = 0;
+    std::atomic<int> next_job(0);
+
+    auto worker = [&]()
+    {
+        cv::Mat local;
+        if (!is_video)
+        {
+            local.create(frame_h, frame_w, mat_type);
+        }
+        while (1)
+        {
+            int k = next_job.fetch_add(1);
+            if (k >= output_num)
+                break;
+            int first = k * stride;
+            int last = (first + window_frames < frame_num) ? first + window_frames : frame_num;
+
+            if (!is_video)
+            {
+                // png files are named by index, no ordering needed
+                render_window(first, last, color, is_flip, local);
+                char filename[32];
+                snprintf(filename, sizeof(filename), "/frame_%05d.png", k);
+                cv::imwrite(std::string(output) + filename, local);
+                continue;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(ring_mutex);
+                ring_cond.wait(lock, [&]
+                               { return k < written_num + ring_num; });
+            }
+            render_window(first, last, color, is_flip, ring[k % ring_num]);
+            {
+                std::lock_guard<std::mutex> lock(ring_mutex);
+                ring_ready[k % ring_num] = k;
+                ring_cond.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_num; i++)
+    {
+        threads.push_back(start_role_thread("encoder", worker));
+    }
+
+    // reassemble video frames in order
+    if (is_video)
+    {
+        for (int k = 0; k < output_num; k++)
+        {
+            {
+                std::unique_lock<std::mutex> lock(ring_mutex);
+                ring_cond.wait(lock, [&]
+                               { return ring_ready[k % ring_num] == k; });
+            }
+            video_writer.write(ring[k % ring_num]);
+            {
+                std::lock_guard<std::mutex> lock(ring_mutex);
+                written_num = k + 1;
+                ring_cond.notify_all();
+            }
+        }
+        video_writer.release();
+    }
+
+    for (auto &t : threads)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    printf("rendered %d frames from %d source frames with %d threads\n", output_num, frame_num, thread_num);
+    return output_num;
+}
+
+BinRenderer::~BinRenderer()
+{
+    if (base != NULL)
+    {
+        munmap((void *)base, file_bytes);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef BINRENDERER_HPP
+#define BINRENDERER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * colour mode of rendered frames
+ */
+enum RenderColor
+{
+    // gray background, on events white, off events black (like convert2BitTo8Bit_accum)
+    RENDER_GRAY,
+    // white background, on events blue, off events red (like convert2BitToBR_accum)
+    RENDER_RED_BLUE
+};
+
+/**
+ * parallel offline renderer for bin files stored by DVS_STORE mode.
+ *
+ * the bin file is memory mapped and split into accumulation windows,
+ * output frame k stacks source frames [k * stride, k * stride + window_frames).
+ * windows are rendered in parallel, png files are written by the rendering threads,
+ * video frames are reassembled in order and written by the calling thread.
+ */
+class BinRenderer
+{
+private:
+    // DVS frame format
+    int frame_h, frame_w;
+    int frame_bytes;
+    int header_bytes;
+    // mapped bin file
+    const char *base;
+    size_t file_bytes;
+    // number of complete frames in the bin file
+    int frame_num;
+
+    /**
+     * stacks source frames [first, last) into out
+     */
+    void render_window(int first, int last, RenderColor color, bool is_flip, cv::Mat &out);
+
+public:
+    /**
+     * @param frame_h height of DVS frame in pixels
+     * @param frame_w width of DVS frame in pixels
+     * @param is_header true if every frame starts with an 8 byte header
+     */
+    BinRenderer(int frame_h, int frame_w, bool is_header);
+    /**
+     * maps a bin file
+     * @return true on success
+     */
+    bool open(const char *path_to_bin);
+    /**
+     * @return number of complete frames in the mapped bin file
+     */
+    int get_frame_num();
+    /**
+     * renders the whole bin file
+     * @param output folder for png images, or path to MJPG video if is_video
+     * @param is_video write a video instead of png images
+     * @param output_fps frame rate of the output, sets the stride between windows
+     * @param sensor_fps frame rate the bin file was recorded at
+     * @param window_frames number of source frames stacked into one output frame
+     * @param color colour mode
+     * @param is_flip vertically flip output frames
+     * @param thread_num number of rendering threads, 0 for one per core
+     * @return number of output frames, -1 on error
+     */
+    int render(const char *output, bool is_video, double output_fps, double sensor_fps,
+               int window_frames, RenderColor color, bool is_flip, int thread_num = 0);
+    ~BinRenderer();
+};
+
+#endif // BINRENDERER_HPP
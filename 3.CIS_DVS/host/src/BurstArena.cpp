@@ -0,0 +1,174 @@
+#include "BurstArena.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+BurstArena::BurstArena(size_t slot_bytes, int slot_num)
+    : slot_bytes(slot_bytes), slot_num(slot_num),
+      arena_bytes(slot_bytes * slot_num),
+      base(NULL), fd(-1),
+      is_file_backed(false), is_hugepage(false)
+{
+}
+
+bool BurstArena::open(const char *path)
+{
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("Failed to open file for writing.");
+        return false;
+    }
+
+    // write frames directly into the page cache of the output file if possible
+    if (map_file())
+    {
+        return true;
+    }
+    printf("file-backed mapping unavailable, using anonymous arena\n");
+    if (ftruncate(fd, 0) != 0)
+    {
+        perror("ftruncate");
+    }
+    return map_anonymous();
+}
+
+bool BurstArena::map_file()
+{
+    // reserve all blocks up front, so that the filesystem never allocates during capture
+    int rc = posix_fallocate(fd, 0, arena_bytes);
+    if (rc != 0)
+    {
+        // some filesystems don't support fallocate, extending the file is enough for mmap
+        if (ftruncate(fd, arena_bytes) != 0)
+        {
+            perror("ftruncate");
+            return false;
+        }
+    }
+
+    void *addr = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap output file");
+        return false;
+    }
+    madvise(addr, arena_bytes, MADV_SEQUENTIAL);
+
+    base = (char *)addr;
+    is_file_backed = true;
+    return true;
+}
+
+bool BurstArena::map_anonymous()
+{
+    // explicit hugepages need the size rounded up to the hugepage size
+    size_t huge_bytes = (arena_bytes + BURST_HUGEPAGE_BYTES - 1) & ~(BURST_HUGEPAGE_BYTES - 1);
+    void *addr = mmap(NULL, huge_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (addr != MAP_FAILED)
+    {
+        arena_bytes = huge_bytes;
+        base = (char *)addr;
+        is_hugepage = true;
+        return true;
+    }
+
+    // no reserved hugepages, fall back to normal pages and ask for transparent hugepages
+    addr = mmap(NULL, arena_bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap burst arena");
+        return false;
+    }
+    madvise(addr, arena_bytes, MADV_HUGEPAGE);
+    base = (char *)addr;
+    return true;
+}
+
+void BurstArena::prefault()
+{
+    if (base == NULL)
+        return;
+
+    // write one byte per page, so that pages are both present and writable before capture starts
+    long page_bytes = sysconf(_SC_PAGESIZE);
+    volatile char *p = base;
+    for (size_t offset = 0; offset < arena_bytes; offset += page_bytes)
+    {
+        p[offset] = 0;
+    }
+}
+
+char *BurstArena::slot(int idx)
+{
+    return base + slot_bytes * idx;
+}
+
+ssize_t BurstArena::flush(int used_slots)
+{
+    if (base == NULL || fd < 0)
+        return -1;
+
+    size_t used_bytes = slot_bytes * used_slots;
+    if (is_file_backed)
+    {
+        // dirty pages already belong to the file, write them back in one go
+        if (msync(base, used_bytes, MS_SYNC) != 0)
+        {
+            perror("msync");
+            return -1;
+        }
+        if (ftruncate(fd, used_bytes) != 0)
+        {
+            perror("ftruncate");
+            return -1;
+        }
+        return used_bytes;
+    }
+
+    // anonymous arena : one large sequential write
+    size_t count = 0;
+    while (count < used_bytes)
+    {
+        ssize_t rc = write(fd, base + count, used_bytes - count);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("write burst arena");
+            return -1;
+        }
+        count += rc;
+    }
+    return count;
+}
+
+bool BurstArena::file_backed()
+{
+    return is_file_backed;
+}
+
+bool BurstArena::hugepage_backed()
+{
+    return is_hugepage;
+}
+
+BurstArena::~BurstArena()
+{
+    if (base != NULL)
+    {
+        munmap(base, arena_bytes);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef BURSTARENA_HPP
+#define BURSTARENA_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// hugepage size used to round up anonymous arenas
+#define BURST_HUGEPAGE_BYTES (2 * 1024 * 1024UL)
+
+/**
+ * single contiguous memory region holding a fixed number of equally sized frame slots.
+ * used by burst capture modes so that frames are read straight into their final location,
+ * instead of malloc-ing every frame and copying them to the output file afterwards.
+ *
+ * the arena is either
+ *   > a preallocated file-backed mmap of the output file (flushed with msync), or
+ *   > an anonymous hugepage arena (flushed with a single large write)
+ */
+class BurstArena
+{
+private:
+    // size of one frame slot in bytes
+    size_t slot_bytes;
+    // number of frame slots
+    int slot_num;
+    // size of the mapped region in bytes
+    size_t arena_bytes;
+    // start of mapped region
+    char *base;
+    // file descriptor of the output file
+    int fd;
+    // true if base is a mapping of the output file
+    bool is_file_backed;
+    // true if anonymous arena is backed by explicit hugepages
+    bool is_hugepage;
+
+    /**
+     * maps the output file into memory after preallocating its blocks
+     * @return true on success
+     */
+    bool map_file();
+    /**
+     * maps an anonymous arena, trying explicit hugepages first
+     * and falling back to transparent hugepages on normal pages
+     * @return true on success
+     */
+    bool map_anonymous();
+
+public:
+    /**
+     * @param slot_bytes size of one frame slot in bytes
+     * @param slot_num number of frame slots
+     */
+    BurstArena(size_t slot_bytes, int slot_num);
+    /**
+     * creates the output file and maps the arena.
+     * a file-backed mapping is preferred, an anonymous hugepage arena is used if the file cannot be mapped.
+     * @param path path to output file
+     * @return true on success
+     */
+    bool open(const char *path);
+    /**
+     * touches every page of the arena so that no page fault happens during capture.
+     */
+    void prefault();
+    /**
+     * returns the start address of a frame slot
+     * @param idx slot index (0 ~ slot_num - 1)
+     */
+    char *slot(int idx);
+    /**
+     * writes the first used_slots slots to the output file.
+     * file-backed arena : msync, then truncate file to the used size
+     * anonymous arena : single large write to the output file
+     * @param used_slots number of slots filled with valid frames
+     * @return number of bytes flushed, -1 on error
+     */
+    ssize_t flush(int used_slots);
+    /**
+     * @return true if the arena maps the output file
+     */
+    bool file_backed();
+    /**
+     * @return true if the anonymous arena got explicit hugepages (false : normal pages, transparent hugepages requested)
+     */
+    bool hugepage_backed();
+    ~BurstArena();
+};
+
+#endif // BURSTARENA_HPP
@@ -1,4 +1,5 @@
 #include "CIS.hpp"
+#include "EncoderPool.hpp"
 
 // constructor
 CIS::CIS(
@@ -8,15 +9,18 @@ CIS::CIS(
     const char *c2h_dev, const char *h2c_dev,
     MutexManager &display_mutex,
     MutexManager *thread_mutex,
-    Bbox *bbox, bool *terminate) : frame_h(frame_h), frame_w(frame_w),
-                                   rdy_baseaddr(rdy_baseaddr), frame_baseaddr(frame_baseaddr),
+    SharedBbox *bbox, bool *terminate) : pcie(c2h_dev, h2c_dev),
+                                   frame_h(frame_h),
+                                   frame_w(frame_w),
                                    buffer_num(buffer_num),
-                                   pcie(c2h_dev, h2c_dev),
-                                   rd_ptr(0),
+                                   rdy_baseaddr(rdy_baseaddr),
+                                   frame_baseaddr(frame_baseaddr),
                                    display_mutex(display_mutex),
-                                   thread_mutex(thread_mutex),
                                    bbox(bbox),
-                                   terminate(terminate)
+                                   thread_mutex(thread_mutex),
+                                   terminate(terminate),
+                                   replay(NULL),
+                                   presenter(NULL)
 {
     // set total frame bytes
     frame_bytes = frame_h * frame_w * 3;
@@ -33,11 +37,9 @@ CIS::CIS(
     buffer_done = (char *)malloc(1 * sizeof(char));
     buffer_done[0] = 0x00;
 
-    // initialize mutex for PCIE access
-    pcie_mutex = new MutexManager();
-
-    // set mutex cond ready, so that one thread can initially acquire the mutex
-    pcie_mutex->setReady(1);
+    // one token for PCIE access, starting at on-ZCU106 buffer 0
+    pcie_gate = new MpmcQueue<int>(1);
+    pcie_gate->push(0);
 }
 
 CIS::CIS(
@@ -45,15 +47,18 @@ CIS::CIS(
     uintptr_t rdy_baseaddr, uintptr_t frame_baseaddr,
     int buffer_num,
     const char *c2h_dev, const char *h2c_dev,
-    MutexManager &display_mutex) : frame_h(frame_h), frame_w(frame_w),
-                                   rdy_baseaddr(rdy_baseaddr), frame_baseaddr(frame_baseaddr),
+    MutexManager &display_mutex) : pcie(c2h_dev, h2c_dev),
+                                   frame_h(frame_h),
+                                   frame_w(frame_w),
                                    buffer_num(buffer_num),
-                                   pcie(c2h_dev, h2c_dev),
-                                   rd_ptr(0),
+                                   rdy_baseaddr(rdy_baseaddr),
+                                   frame_baseaddr(frame_baseaddr),
                                    display_mutex(display_mutex),
-                                   thread_mutex(NULL),
                                    bbox(NULL),
-                                   terminate(NULL)
+                                   thread_mutex(NULL),
+                                   terminate(NULL),
+                                   replay(NULL),
+                                   presenter(NULL)
 {
     // set total frame bytes
     frame_bytes = frame_h * frame_w * 3;
@@ -71,18 +76,29 @@ CIS::CIS(
     buffer_done = (char *)malloc(1 * sizeof(char));
     buffer_done[0] = 0x00;
 
-    // initialize mutex for PCIE access
-    pcie_mutex = new MutexManager();
-    // set mutex cond ready, so that one thread can initially acquire the mutex
-    pcie_mutex->setReady(1);
+    // one token for PCIE access, starting at on-ZCU106 buffer 0
+    pcie_gate = new MpmcQueue<int>(1);
+    pcie_gate->push(0);
 }
 int CIS::get_frame_h() { return frame_h; }
 int CIS::get_frame_w() { return frame_w; }
 
 void CIS::read_frame(cv::Mat &frame)
 {
-    // acquire mutex
-    pcie_mutex->lock_pipeline();
+    // acquire PCIE token
+    int rd_ptr;
+    pcie_gate->pop(rd_ptr);
+
+    // recorded frames instead of PCIE
+    if (replay != NULL)
+    {
+        if (!replay->read((char *)frame.data) && terminate != NULL)
+        {
+            *terminate = true;
+        }
+        pcie_gate->push(rd_ptr);
+        return;
+    }
 
     // wait for ready flag
     // by polling through PCIE connection
@@ -101,12 +117,43 @@ void CIS::read_frame(cv::Mat &frame)
     // set flag to DONE through PCIE
     pcie.h2c(buffer_done, 1, buffer_rdy_addr[rd_ptr]);
 
-    // change the address for ready flag and DVS frame
-    rd_ptr = (rd_ptr == buffer_num - 1) ? 0 : rd_ptr + 1;
+    // release PCIE token, with the address for the next ready flag and CIS frame
+    pcie_gate->push((rd_ptr == buffer_num - 1) ? 0 : rd_ptr + 1);
+}
+void CIS::set_replay(ReplaySource *replay)
+{
+    this->replay = replay;
+}
 
-    // release mutex
-    pcie_mutex->unlock_pipeline();
+void CIS::set_presenter(Presenter *presenter)
+{
+    this->presenter = presenter;
 }
+
+void CIS::show_frame(const char *window, cv::Mat &img)
+{
+    if (presenter != NULL)
+    {
+        presenter->post(window, img);
+        return;
+    }
+    display_mutex.lock_display();
+    cv::imshow(window, img);
+    display_mutex.unlock_display();
+}
+
+bool CIS::is_esc_pressed()
+{
+    if (presenter != NULL)
+    {
+        return presenter->is_closed();
+    }
+    display_mutex.lock_display();
+    bool is_esc = (cv::waitKey(1) == 27);
+    display_mutex.unlock_display();
+    return is_esc;
+}
+
 void CIS::set_DVS(float x_scale_, float y_scale_, float x_offset_, float y_offset_)
 {
     // set DVS parameters relative to CIS
@@ -117,30 +164,29 @@ void CIS::set_DVS(float x_scale_, float y_scale_, float x_offset_, float y_offse
     y_scale = y_scale_;
 }
 
-bool CIS::scale_bbox(Bbox *b_box)
+bool CIS::scale_bbox(Bbox *b_box, BboxSnapshot *snapshot)
 {
-    // acquire mutex to obtain bounding box info from DVS object
-    thread_mutex->lock_multiple_reader();
-    bool retval;
-    // if ESC is pressed in some thread, keep setting cond_ready to 1 so that all listeners can wake and receive the broadcast from DVS thread
-    if (*terminate)
-        thread_mutex->setReady(1);
-
-    // receive bbox information
-    if (bbox->lx >= 0 && bbox->ly >= 0 && bbox->hx - bbox->lx >= 100 && bbox->hy - bbox->ly >= 100 && bbox->hx - bbox->lx <= frame_w && bbox->hy - bbox->ly <= frame_h)
+    // latest bounding box from DVS object, does not wait for a new one
+    BboxSnapshot latest;
+    bbox->read(latest);
+    if (snapshot != NULL)
     {
-        b_box->lx = bbox->lx;
-        b_box->ly = bbox->ly;
-        b_box->hx = bbox->hx;
-        b_box->hy = bbox->hy;
-        retval = true;
+        *snapshot = latest;
     }
-    else
+
+    // receive bbox information
+    if (is_valid_bbox(latest, frame_w, frame_h))
     {
-        retval = false;
+        *b_box = latest.bbox;
+        return true;
     }
-    thread_mutex->unlock_multiple_reader();
-    return retval;
+    return false;
+}
+
+bool CIS::is_valid_bbox(const BboxSnapshot &snapshot, int frame_w, int frame_h)
+{
+    const Bbox *box = &snapshot.bbox;
+    return snapshot.is_valid && box->lx >= 0 && box->ly >= 0 && box->hx - box->lx >= 100 && box->hy - box->ly >= 100 && box->hx - box->lx <= frame_w && box->hy - box->ly <= frame_h;
 }
 
 void CIS::calc_fps(double &fps, int &frameCount, double &startTime, cv::Mat &frame)
@@ -192,21 +238,17 @@ void CIS::background_subtraction()
                 cv::rectangle(frame, bounding_box, cv::Scalar(255, 255, 0), 2);
             }
         }
-        display_mutex.lock_display();
-
         // Show the different outputs
-        cv::imshow("Subtractor", foreground_mask);
-        cv::imshow("Threshold", threshold_img);
-        cv::imshow("Detection", frame);
+        show_frame("Subtractor", foreground_mask);
+        show_frame("Threshold", threshold_img);
+        show_frame("Detection", frame);
 
         // exit if ESC is pressed
-        if (cv::waitKey(1) == 27)
+        if (is_esc_pressed())
         {
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        display_mutex.unlock_display();
     }
 }
 
@@ -223,19 +265,15 @@ void CIS::display_stream()
         cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
         calc_fps(fps, frameCount, startTime, frame);
 
-        display_mutex.lock_display();
-
         // display frame
-        cv::imshow("CIS camera", frame);
+        show_frame("CIS camera", frame);
 
         // exit if ESC is pressed
-        if (cv::waitKey(1) == 27)
+        if (is_esc_pressed())
         {
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        display_mutex.unlock_display();
     }
 }
 
@@ -243,23 +281,31 @@ void CIS::save_png_stream(char *output_folder_name)
 {
     int frame_count = 0;
 
+    // color conversion and png encoding run on the encoder threads
+    EncoderPool encoder(frame_h, frame_w, CV_8UC3, ENCODER_SLOT_NUM, ENCODE_DROP);
+    encoder.set_color_conversion(cv::COLOR_BGR2RGB);
+    encoder.open_png(output_folder_name, ENCODER_WORKER_NUM);
+
     frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC3);
     while (true)
     {
-        // read frame through PCIE
-        read_frame(frame);
-        cv::cvtColor(frame, frame, cv::COLOR_BGR2RGB);
-
-        // save png, then signal DVS::save_png_stream
-
-        thread_mutex->lock_single_writer();
-        // Generate filename for the PNG image
-        std::ostringstream filename;
-        filename << output_folder_name << "/frame_" << std::setw(5) << std::setfill('0') << frame_count << ".png";
-        // Save the frame as a PNG image
-        cv::imwrite(filename.str(), frame);
-        thread_mutex->unlock_single_writer(1);
-        frame_count++; // Increment frame count
+        cv::Mat *slot = encoder.acquire();
+        if (slot == NULL)
+        {
+            // encoders are behind, read and discard without signaling DVS
+            read_frame(frame);
+        }
+        else
+        {
+            // read frame through PCIE straight into the encoder slot
+            read_frame(*slot);
+
+            // queue png, then signal DVS::save_png_stream
+            thread_mutex->lock_single_writer();
+            encoder.submit(slot, frame_count);
+            thread_mutex->unlock_single_writer(1);
+            frame_count++; // Increment frame count
+        }
 
         // exit if ESC is pressed
         if (cv::waitKey(1) == 27)
@@ -268,6 +314,32 @@ void CIS::save_png_stream(char *output_folder_name)
             break;
         }
     }
+    encoder.close();
+}
+
+void CIS::record_stream(SyncRecorder *recorder)
+{
+    uint32_t frame_count = 0;
+
+    // frames that find no free slot are still read, to keep the ZCU106 buffers moving
+    frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC3);
+    while (!*terminate)
+    {
+        SyncRecorder::Slot *slot = recorder->acquire(RECORD_CIS);
+        if (slot == NULL)
+        {
+            read_frame(frame);
+        }
+        else
+        {
+            // read directly into the slot, no copy and no encoding on this thread
+            cv::Mat slot_frame(frame_h, frame_w, CV_8UC3, slot->payload);
+            read_frame(slot_frame);
+            recorder->commit(slot, frame_count, 0, recorder->now_us());
+        }
+        frame_count++;
+    }
+    frame.release();
 }
 
 void CIS::crop_dvs_roi()
@@ -297,25 +369,21 @@ void CIS::crop_dvs_roi()
         cv::rectangle(frame, DVS_UL, DVS_LR, cv::Scalar(0, 255, 0), 2, cv::LINE_8);
 
         // display frame
-        display_mutex.lock_display();
-        cv::imshow("CIS camera", frame);
+        show_frame("CIS camera", frame);
 
         // terminate if ESC pressed or some other thread terminates
-        if (*terminate || cv::waitKey(1) == 27)
+        if (*terminate || is_esc_pressed())
         {
             *terminate = 1;
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        display_mutex.unlock_display();
     }
 }
-void CIS::resize_dvs(cv::Mat *dvs_frame, cv::Mat *dvs_resize, int width, int height)
+void CIS::resize_dvs(const FrameHandle &dvs_frame, cv::Mat *dvs_resize, int width, int height)
 {
-    thread_mutex->lock_multiple_reader();
-    cv::resize(*dvs_frame, *dvs_resize, cv::Size(width, height));
-    thread_mutex->unlock_multiple_reader();
+    // the handle keeps the pooled frame from being reused, no lock needed
+    cv::resize(dvs_frame.mat(), *dvs_resize, cv::Size(width, height));
 }
 void CIS::set_roi(cv::Rect &dvs_rect, cv::Rect &cis_rect, int &dvs_width, int &dvs_height)
 {
@@ -343,14 +411,13 @@ void CIS::set_roi(cv::Rect &dvs_rect, cv::Rect &cis_rect, int &dvs_width, int &d
     dvs_rect = cv::Rect(dvs_crop_p1, dvs_crop_p2);
     cis_rect = cv::Rect(cis_crop_p1, cis_crop_p2);
 }
-bool CIS::overlay_dvs(cv::Mat *dvs_frame, cv::Rect &dvs_rect, cv::Rect &cis_rect, int dvs_width, int dvs_height, float alpha, int numRegions)
+bool CIS::overlay_dvs(const FrameHandle &dvs_frame, cv::Rect &dvs_rect, cv::Rect &cis_rect, int dvs_width, int dvs_height, float alpha, int numRegions)
 {
 
     frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC3);
     // read frame
     read_frame(frame);
     // receive DVS frmae
-    cv::Mat dvs_resize;
     resize_dvs(dvs_frame, &dvs_resize, dvs_width, dvs_height);
     // crop DVS frame to fit in CIS frame
     cv::Mat dvs_crop = (dvs_resize)(dvs_rect);
@@ -364,18 +431,15 @@ bool CIS::overlay_dvs(cv::Mat *dvs_frame, cv::Rect &dvs_rect, cv::Rect &cis_rect
     // draw grid for calibration
     draw_grid(frame, numRegions);
     // display frame
-    display_mutex.lock_display();
-    cv::imshow("CIS camera", frame);
+    show_frame("CIS camera", frame);
 
     // terminate if ESC pressed or some other thread terminates
-    if (*terminate || cv::waitKey(1) == 27)
+    if (*terminate || is_esc_pressed())
     {
         *terminate = 1;
         frame.release();
-        display_mutex.unlock_display();
         return true;
     }
-    display_mutex.unlock_display();
     return false;
 }
 void CIS::draw_grid(cv::Mat &image, int numRegions)
@@ -403,7 +467,7 @@ void CIS::draw_grid(cv::Mat &image, int numRegions)
 CIS::~CIS()
 {
 
-    delete pcie_mutex;
+    delete pcie_gate;
     free(buffer_rdy);
     free(buffer_done);
 }
\ No newline at end of file
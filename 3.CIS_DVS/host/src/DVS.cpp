@@ -1,22 +1,15 @@
+#include <memory>
 
 #include "bbox.hpp"
 #include "DVS.hpp"
 #include "PCIe.hpp"
 #include "MutexManager.hpp"
-
-void setThreadPriority(std::thread &t)
-{
-    pthread_t handle = t.native_handle();
-
-    // Set scheduling parameters
-    sched_param sch;
-    sch.sched_priority = sched_get_priority_max(SCHED_FIFO); // Highest priority
-
-    if (pthread_setschedparam(handle, SCHED_FIFO, &sch) != 0)
-    {
-        std::cerr << "Failed to set thread priority.\n";
-    }
-}
+#include "RoiWindow.hpp"
+#include "DvsRoi.hpp"
+#include "EventPyramid.hpp"
+#include "BurstArena.hpp"
+#include "SegmentWriter.hpp"
+#include "EncoderPool.hpp"
 
 DVS::DVS( // normal constructor
     int frame_h, int frame_w,
@@ -25,15 +18,26 @@ DVS::DVS( // normal constructor
     int buffer_num,
     const char *c2h_dev, const char *h2c_dev,
     MutexManager &display_mutex, bool double_buffering, int display_downsample_num)
-    : frame_h(frame_h), frame_w(frame_w), accum_num(accum_num),
-      is_header(is_header), header_bytes(8),
-      rdy_baseaddr(rdy_baseaddr), frame_baseaddr(frame_baseaddr),
+    : pcie(c2h_dev, h2c_dev),
+      frame_h(frame_h),
+      frame_w(frame_w),
+      is_header(is_header),
+      header_bytes(8),
+      accum_num(accum_num),
+      display_downsample_num(display_downsample_num),
       buffer_num(buffer_num),
-      pcie(c2h_dev, h2c_dev),
+      rdy_baseaddr(rdy_baseaddr),
+      frame_baseaddr(frame_baseaddr),
       rd_ptr(0),
       display_mutex(display_mutex),
+      roi_min_density(0),
+      send_pool(NULL),
+      read_frame_num(0),
       terminate(NULL),
-      display_downsample_num(display_downsample_num)
+      replay(NULL),
+      broadcast(NULL),
+      broadcast_id(-1),
+      presenter(NULL)
 {
     // set total frame bytes
     frame_bytes = (is_header) ? (frame_h * frame_w) / 4 + 8 : (frame_h * frame_w) / 4;
@@ -59,19 +63,16 @@ DVS::DVS( // normal constructor
     // set data pointer behind header
     frame_start = (is_header) ? buffer + header_bytes : buffer;
 
-    // allocate mutex and buffer for double buffering
+    // allocate the frame queue for double buffering, filled by the PCIE reader thread
     if (!double_buffering)
     {
-        dbuf_mutex[0] = NULL;
-        dbuf_mutex[1] = NULL;
-        double_buffer = NULL;
+        dbuf = NULL;
     }
     else
     {
-        double_buffer = (char *)malloc(frame_bytes * sizeof(char));
-        dbuf_mutex[0] = new MutexManager();
-        dbuf_mutex[1] = new MutexManager();
-        terminate = new bool;
+        dbuf = new BackPressureQueue(frame_bytes, is_header ? header_bytes : 0, DBUF_FRAME_NUM,
+                                     OVERLOAD_DROP_NEWEST, DBUF_FRAME_NUM, "dvs_reader");
+        terminate = new bool(false);
     }
 
     // don't init CIS related params right now
@@ -84,19 +85,30 @@ DVS::DVS( // crop_roi constructor
     uintptr_t rdy_baseaddr, uintptr_t frame_baseaddr,
     int buffer_num,
     const char *c2h_dev, const char *h2c_dev,
-    MutexManager &display_mutex, Bbox *bbox, MutexManager *thread_mutex,
+    MutexManager &display_mutex, SharedBbox *bbox, MutexManager *thread_mutex,
     bool *terminate, int display_downsample_num)
-    : frame_h(frame_h), frame_w(frame_w), accum_num(accum_num),
-      is_header(is_header), header_bytes(8),
-      rdy_baseaddr(rdy_baseaddr), frame_baseaddr(frame_baseaddr),
+    : pcie(c2h_dev, h2c_dev),
+      frame_h(frame_h),
+      frame_w(frame_w),
+      is_header(is_header),
+      header_bytes(8),
+      accum_num(accum_num),
+      display_downsample_num(display_downsample_num),
       buffer_num(buffer_num),
-      pcie(c2h_dev, h2c_dev),
+      rdy_baseaddr(rdy_baseaddr),
+      frame_baseaddr(frame_baseaddr),
       rd_ptr(0),
       display_mutex(display_mutex),
-      bbox(bbox),
       thread_mutex(thread_mutex),
+      roi_min_density(0),
+      send_pool(NULL),
+      bbox(bbox),
+      read_frame_num(0),
       terminate(terminate),
-      display_downsample_num(display_downsample_num)
+      replay(NULL),
+      broadcast(NULL),
+      broadcast_id(-1),
+      presenter(NULL)
 {
     // set total frame bytes
     frame_bytes = (is_header) ? (frame_h * frame_w) / 4 + 8 : (frame_h * frame_w) / 4;
@@ -122,9 +134,7 @@ DVS::DVS( // crop_roi constructor
     frame_start = (is_header) ? buffer + header_bytes : buffer;
 
     // disable double buffering
-    double_buffer = NULL;
-    dbuf_mutex[0] = NULL;
-    dbuf_mutex[1] = NULL;
+    dbuf = NULL;
 
     // don't init CIS related params right now
     convert_cis = false;
@@ -266,8 +276,70 @@ void DVS::decode_header(const char *buffer, int &frame_num, uint32_t &timestamp)
                  static_cast<unsigned char>(buffer[0]));
 }
 
+void DVS::set_replay(ReplaySource *replay)
+{
+    this->replay = replay;
+}
+
+void DVS::set_broadcast(FrameBroadcast *broadcast, int subscriber)
+{
+    this->broadcast = broadcast;
+    broadcast_id = subscriber;
+}
+
+void DVS::set_presenter(Presenter *presenter)
+{
+    this->presenter = presenter;
+}
+
+void DVS::show_frame(const char *window, cv::Mat &img)
+{
+    if (presenter != NULL)
+    {
+        presenter->post(window, img);
+        return;
+    }
+    display_mutex.lock_display();
+    cv::imshow(window, img);
+    display_mutex.unlock_display();
+}
+
+bool DVS::is_esc_pressed()
+{
+    if (presenter != NULL)
+    {
+        return presenter->is_closed();
+    }
+    display_mutex.lock_display();
+    bool is_esc = (cv::waitKey(1) == 27);
+    display_mutex.unlock_display();
+    return is_esc;
+}
+
 void DVS::read_frame(char *dvs_buffer)
 {
+    // frames already read by the shared PCIE reader
+    if (broadcast != NULL)
+    {
+        if (!broadcast->read(broadcast_id, dvs_buffer) && terminate != NULL)
+        {
+            *terminate = true;
+        }
+        read_frame_num++;
+        return;
+    }
+
+    // recorded frames instead of PCIE
+    if (replay != NULL)
+    {
+        if (!replay->read(dvs_buffer) && terminate != NULL)
+        {
+            *terminate = true;
+        }
+        read_frame_num++;
+        return;
+    }
+
     // wait for ready flag
     // by polling through PCIE connection
     while (true)
@@ -287,6 +359,7 @@ void DVS::read_frame(char *dvs_buffer)
 
     // change the address for ready flag and DVS frame
     rd_ptr = (rd_ptr == buffer_num - 1) ? 0 : rd_ptr + 1;
+    read_frame_num++;
 }
 
 void DVS::calc_fps(double &fps, int &frameCount, double &startTime, cv::Mat &frame)
@@ -308,12 +381,8 @@ void DVS::calc_fps(double &fps, int &frameCount, double &startTime, cv::Mat &fra
     cv::putText(frame, oss.str(), cv::Point(10, 30), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(0, 255, 0), 2);
 }
 
-void DVS::display_stream(bool is_flip)//, bool fix_display_rate, double display_fps)
+void DVS::display_stream(bool is_flip)
 {
-    // double fps = 0.0;
-    // int frameCount = 0;
-    // double startTime = cv::getTickCount();
-    // int display_count = 0;
     while (true)
     {
         // initialize cv::Mat frame
@@ -338,33 +407,17 @@ void DVS::display_stream(bool is_flip)//, bool fix_display_rate, double display_
         {
             cv::flip(frame, frame, 0);
         }
-        // calc_fps(fps, frameCount, startTime, frame);
-
-        // display using mutex locking
-        display_mutex.lock_display();
-
-        // if(fix_display_rate){
-        //     int display_thresh = (fps / display_fps);
-        //     if(display_count + accum_num >= display_thresh){
-        //         display_count = display_count + accum_num - display_thresh;
-        //         cv::imshow("DVS camera", frame);
-        //     }else{
-        //         display_count = display_coun 
-        //     }
-        // }else{
-            cv::imshow("DVS camera", frame);
-        // }
+
+        // display, through the presenter if set
+        show_frame("DVS camera", frame);
 
         // press ESC to quit
-        if (cv::waitKey(1) == 27)
+        if (is_esc_pressed())
         {
-            display_mutex.unlock_display();
-
             // free frame
             frame.release();
             break;
         }
-        display_mutex.unlock_display();
     }
 }
 
@@ -375,6 +428,10 @@ void DVS::save_png_stream(char *output_folder_name, bool is_flip)
     // double startTime = cv::getTickCount();
     int frame_count = 0;
 
+    // png encoding runs on the encoder threads, frames are dropped if they fall behind
+    EncoderPool encoder(frame_h, frame_w, CV_8UC1, ENCODER_SLOT_NUM, ENCODE_DROP);
+    encoder.open_png(output_folder_name, ENCODER_WORKER_NUM);
+
     while (true)
     {
         // initialize cv::Mat frame
@@ -400,13 +457,16 @@ void DVS::save_png_stream(char *output_folder_name, bool is_flip)
         }
         if (thread_mutex->try_lock_reader() == 1)
         {
-            // Save the frame as a PNG image
-            std::ostringstream filename;
-            filename << output_folder_name << "/frame_" << std::setw(5) << std::setfill('0') << frame_count << ".png";
-            cv::imwrite(filename.str(), frame);
+            // only copy the frame here, keep the index even if it is dropped
+            // so that file names stay paired with CIS::save_png_stream
+            cv::Mat *slot = encoder.acquire();
+            if (slot != NULL)
+            {
+                frame.copyTo(*slot);
+                encoder.submit(slot, frame_count);
+            }
             thread_mutex->unlock_multiple_reader();
             frame_count++;
-            // Generate filename for the PNG image
         }
         // press ESC to quit
         if (cv::waitKey(1) == 27)
@@ -417,16 +477,146 @@ void DVS::save_png_stream(char *output_folder_name, bool is_flip)
             break;
         }
     }
+    encoder.close();
+}
+
+void DVS::record_stream(SyncRecorder *recorder)
+{
+    int frame_num;
+    uint32_t timestamp;
+
+    while (!*terminate)
+    {
+        SyncRecorder::Slot *slot = recorder->acquire(RECORD_DVS);
+        if (slot == NULL)
+        {
+            // no free slot, read and discard so that the ZCU106 buffers keep moving
+            read_frame(buffer);
+            continue;
+        }
+        // read directly into the slot, decoding is left to export_recording
+        read_frame(slot->payload);
+        int64_t arrival_us = recorder->now_us();
+        decode_header(slot->payload, frame_num, timestamp);
+        recorder->commit(slot, frame_num, timestamp, arrival_us);
+    }
+}
+
+void DVS::export_recording(char *path_to_recording, char *cis_output, char *dvs_output, bool is_video, bool is_flip)
+{
+    RecordingReader reader;
+    const RecordHeader *record;
+    const char *payload;
+
+    if (!reader.open(path_to_recording))
+    {
+        return;
+    }
+    const RecordingHeader *header = reader.header();
+    if ((int)header->dvs_frame_bytes != frame_bytes || (int)header->dvs_frame_h != frame_h || (int)header->dvs_frame_w != frame_w)
+    {
+        std::cerr << "DVS frame format of recording does not match" << std::endl;
+        return;
+    }
+
+    // first pass : timestamps to csv, CIS rate for the videos
+    std::string csv_name = std::string(path_to_recording) + ".csv";
+    std::ofstream csv_file(csv_name);
+    csv_file << "type,frame_num,timestamp,arrival_us\n";
+    int cis_num = 0;
+    int64_t first_cis_us = 0, last_cis_us = 0;
+    while (reader.next(record, payload))
+    {
+        csv_file << (record->type == RECORD_CIS ? "CIS" : "DVS") << ","
+                 << record->frame_num << "," << record->timestamp << "," << record->arrival_us << "\n";
+        if (record->type == RECORD_CIS)
+        {
+            if (cis_num == 0)
+                first_cis_us = record->arrival_us;
+            last_cis_us = record->arrival_us;
+            cis_num++;
+        }
+    }
+    csv_file.close();
+    // videos play at the recorded CIS rate
+    double fps = (cis_num > 1 && last_cis_us > first_cis_us) ? (cis_num - 1) * 1e6 / (last_cis_us - first_cis_us) : 10;
+    printf("%d CIS frames, %.2f fps\n", cis_num, fps);
+
+    cv::VideoWriter cis_writer, dvs_writer;
+    if (is_video)
+    {
+        cis_writer.open(cis_output, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                        fps, cv::Size(header->cis_frame_w, header->cis_frame_h), true);
+        dvs_writer.open(dvs_output, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
+                        fps, cv::Size(frame_w, frame_h), false);
+    }
+
+    // second pass : stack DVS frames until the next CIS frame arrives
+    int frame_count = 0;
+    bool has_dvs = false;
+    cv::Mat cis_frame;
+    frame = cv::Mat(frame_h, frame_w, CV_8UC1, cv::Scalar(128));
+    reader.rewind();
+    while (reader.next(record, payload))
+    {
+        if (record->type == RECORD_DVS)
+        {
+            memcpy(buffer, payload, frame_bytes);
+            if (!has_dvs)
+            {
+                convert2BitTo8Bit();
+            }
+            else
+            {
+                convert2BitTo8Bit_accum();
+            }
+            has_dvs = true;
+            continue;
+        }
+
+        // CIS frame closes the current group
+        cv::Mat cis_raw(header->cis_frame_h, header->cis_frame_w, CV_8UC3, (void *)payload);
+        cv::cvtColor(cis_raw, cis_frame, cv::COLOR_BGR2RGB);
+        if (!has_dvs)
+        {
+            frame.setTo(128);
+        }
+        if (is_flip)
+        {
+            cv::flip(frame, frame, 0);
+        }
+
+        if (is_video)
+        {
+            cis_writer.write(cis_frame);
+            dvs_writer.write(frame);
+        }
+        else
+        {
+            std::ostringstream cis_name, dvs_name;
+            cis_name << cis_output << "/frame_" << std::setw(5) << std::setfill('0') << frame_count << ".png";
+            dvs_name << dvs_output << "/frame_" << std::setw(5) << std::setfill('0') << frame_count << ".png";
+            cv::imwrite(cis_name.str(), cis_frame);
+            cv::imwrite(dvs_name.str(), frame);
+        }
+        has_dvs = false;
+        frame_count++;
+    }
+
+    if (is_video)
+    {
+        cis_writer.release();
+        dvs_writer.release();
+    }
+    printf("exported %d frame pairs, timestamps in %s\n", frame_count, csv_name.c_str());
 }
 
 void DVS::double_buf_display_fps_writer()
-// note : thread_mutex needs to be an array like thread_mutex[2]
 {
     int prev_frame_num;
     int prev_timestamp;
     int check_init = 0;
     int error_num = 0;
-    int double_buffer_idx = 0;
     int frame_num;
     uint32_t timestamp;
     char *dvs_buffer;
@@ -437,17 +627,10 @@ void DVS::double_buf_display_fps_writer()
         {
             check_init++;
         }
-        // maintain 2 buffers and 2 mutexes for double buffering
-        if (double_buffer_idx == 0)
-        {
-            dbuf_mutex[0]->lock_single_writer();
-            dvs_buffer = buffer;
-        }
-        else
-        {
-            dbuf_mutex[1]->lock_single_writer();
-            dvs_buffer = double_buffer;
-        }
+        // buffer picked by the overload policy, NULL once the display thread is gone
+        dvs_buffer = dbuf->begin_write();
+        if (dvs_buffer == NULL)
+            break;
         for (int i = 0; i < display_downsample_num; i++)
         {
             // read raw data
@@ -468,20 +651,13 @@ void DVS::double_buf_display_fps_writer()
             prev_timestamp = timestamp;
         }
 
-        // alternate between the two per every loop
-        if (double_buffer_idx == 0)
-        {
-            dbuf_mutex[0]->unlock_single_writer(1);
-            double_buffer_idx = 1;
-        }
-        else
-        {
-            dbuf_mutex[1]->unlock_single_writer(1);
-            double_buffer_idx = 0;
-        }
+        // hand the frame over to the display thread
+        dbuf->commit();
         if (*terminate)
             break;
     }
+    // wake up the display thread
+    dbuf->close();
 }
 
 void DVS::double_buf_display_fps_reader(bool is_flip)
@@ -489,6 +665,7 @@ void DVS::double_buf_display_fps_reader(bool is_flip)
     double fps = 0.0;
     int frameCount = 0;
     double startTime = cv::getTickCount();
+    char *dvs_buffer;
     while (1)
     {
 
@@ -496,11 +673,16 @@ void DVS::double_buf_display_fps_reader(bool is_flip)
         frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
 
         // stack frames using member functions
-        for (int frame_grp_num = 0; frame_grp_num < (accum_num / (2)); frame_grp_num++)
+        for (int frame_grp_num = 0; frame_grp_num < accum_num; frame_grp_num++)
         {
-            // lock mutex, write from buffer 0
-            dbuf_mutex[0]->lock_multiple_reader();
-
+            // wait for the next frame, stop once the writer is gone
+            dvs_buffer = dbuf->pop();
+            if (dvs_buffer == NULL)
+            {
+                *terminate = true;
+                break;
+            }
+            frame_start = (is_header) ? dvs_buffer + header_bytes : dvs_buffer;
             if (frame_grp_num == 0)
             {
                 convert2BitTo8Bit();
@@ -509,14 +691,8 @@ void DVS::double_buf_display_fps_reader(bool is_flip)
             {
                 convert2BitTo8Bit_accum();
             }
-            dbuf_mutex[0]->unlock_multiple_reader();
-
-            // lock mutex, write from buffer 1
-            dbuf_mutex[1]->lock_multiple_reader();
-            frame_start = (is_header) ? double_buffer + header_bytes : double_buffer;
-            convert2BitTo8Bit_accum();
             frame_start = (is_header) ? buffer + header_bytes : buffer;
-            dbuf_mutex[1]->unlock_multiple_reader();
+            dbuf->release(dvs_buffer);
         }
 
         // show image
@@ -526,20 +702,17 @@ void DVS::double_buf_display_fps_reader(bool is_flip)
         }
         calc_fps(fps, frameCount, startTime, frame);
 
-        // display using mutex locking
-        display_mutex.lock_display();
+        show_frame("DVS camera", frame);
 
-        cv::imshow("DVS camera", frame);
-
-        if (*terminate || cv::waitKey(1) == 27)
+        if (*terminate || is_esc_pressed())
         {
             *terminate = true;
+            // a blocked writer gives up
+            dbuf->close();
             // cleanup
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        display_mutex.unlock_display();
     }
 }
 void DVS::check_frame_drop()
@@ -616,13 +789,11 @@ void DVS::fps_count()
     }
 }
 void *DVS::double_buf_reader()
-// note : thread_mutex needs to be an array like thread_mutex[2]
 {
     int prev_frame_num;
     int prev_timestamp;
     int check_init = 0;
     int error_num = 0;
-    int double_buffer_idx = 0;
     int frame_num;
     uint32_t timestamp;
     char *dvs_buffer;
@@ -635,18 +806,10 @@ void *DVS::double_buf_reader()
     // while reading raw sensor data, check frame num consistency too
     while (1)
     {
-
-        // maintain 2 buffers and 2 mutexes for double buffering
-        if (double_buffer_idx == 0)
-        {
-            dbuf_mutex[0]->lock_single_writer();
-            dvs_buffer = buffer;
-        }
-        else
-        {
-            dbuf_mutex[1]->lock_single_writer();
-            dvs_buffer = double_buffer;
-        }
+        // buffer picked by the overload policy, NULL once the queue is closed
+        dvs_buffer = dbuf->begin_write();
+        if (dvs_buffer == NULL)
+            break;
         // read raw data
         read_frame(dvs_buffer);
 
@@ -661,21 +824,21 @@ void *DVS::double_buf_reader()
         prev_frame_num = frame_num;
         prev_timestamp = timestamp;
 
-        // alternate between the two per every loop
-        if (double_buffer_idx == 0)
-        {
-            dbuf_mutex[0]->unlock_single_writer(1);
-            double_buffer_idx = 1;
-        }
-        else
-        {
-            dbuf_mutex[1]->unlock_single_writer(1);
-            double_buffer_idx = 0;
-        }
+        // hand the frame over to the writer thread
+        dbuf->commit();
+        if (*terminate)
+            break;
     }
+    // let the writer drain the queue and finish
+    dbuf->close();
+    return nullptr;
 }
 
-void *DVS::double_buf_bin_writer()
+/**
+ * @param extension appended to the name, "" for the prefix of segmented recordings
+ * @return ./bin_files/data_<current time><extension>, allocated with malloc, NULL on error
+ */
+static char *make_bin_name(const char *extension = ".bin")
 {
     char *bin_name = NULL;
 
@@ -685,15 +848,28 @@ void *DVS::double_buf_bin_writer()
     // based on current time, determine the name of output file
     time(&current_time);
     local_time = localtime(&current_time);
-    if (asprintf(&bin_name, "./bin_files/data_%04d-%02d-%02d_%02d-%02d-%02d.bin",
+    if (asprintf(&bin_name, "./bin_files/data_%04d-%02d-%02d_%02d-%02d-%02d%s",
                  local_time->tm_year + 1900,
                  local_time->tm_mon + 1,
                  local_time->tm_mday,
                  local_time->tm_hour,
                  local_time->tm_min,
-                 local_time->tm_sec) == -1)
+                 local_time->tm_sec,
+                 extension) == -1)
     {
         perror("Error creating bin file name");
+        return NULL;
+    }
+    return bin_name;
+}
+
+void *DVS::double_buf_bin_writer()
+{
+    char *bin_name = make_bin_name();
+    if (bin_name == NULL)
+    {
+        // a blocked reader gives up
+        dbuf->close();
         return nullptr;
     }
 
@@ -702,20 +878,16 @@ void *DVS::double_buf_bin_writer()
     if (!file.is_open())
     {
         perror("Failed to open file for writing.");
+        dbuf->close();
+        free(bin_name);
         return nullptr;
     }
 
-    while (1)
+    char *dvs_buffer;
+    while ((dvs_buffer = dbuf->pop()) != NULL)
     {
-        // lock mutex, write from buffer 0
-        dbuf_mutex[0]->lock_multiple_reader();
-        file.write(buffer, frame_bytes);
-        dbuf_mutex[0]->unlock_multiple_reader();
-
-        // lock mutex, write from buffer 1
-        dbuf_mutex[1]->lock_multiple_reader();
-        file.write(double_buffer, frame_bytes);
-        dbuf_mutex[1]->unlock_multiple_reader();
+        file.write(dvs_buffer, frame_bytes);
+        dbuf->release(dvs_buffer);
     }
 
     file.close();
@@ -723,25 +895,35 @@ void *DVS::double_buf_bin_writer()
     return nullptr;
 }
 
-void *DVS::double_buf_bin_writer_no_drop(int total_read_frame_num)
+void *DVS::broadcast_reader(FrameBroadcast *broadcast)
 {
-    char *bin_name = NULL;
-
-    time_t current_time;
-    struct tm *local_time;
+    char *dvs_buffer;
+    while (terminate == NULL || !*terminate)
+    {
+        // waits only while a no-drop subscriber is a full ring behind
+        dvs_buffer = broadcast->begin_write();
+        if (dvs_buffer == NULL)
+        {
+            break;
+        }
+        read_frame(dvs_buffer);
+        // a finished replay leaves the slot unfilled
+        if (terminate != NULL && *terminate)
+        {
+            break;
+        }
+        broadcast->commit();
+    }
+    // subscribers drain what is left and stop
+    broadcast->close();
+    return nullptr;
+}
 
-    // based on current time, determine the name of output file
-    time(&current_time);
-    local_time = localtime(&current_time);
-    if (asprintf(&bin_name, "./bin_files/data_%04d-%02d-%02d_%02d-%02d-%02d.bin",
-                 local_time->tm_year + 1900,
-                 local_time->tm_mon + 1,
-                 local_time->tm_mday,
-                 local_time->tm_hour,
-                 local_time->tm_min,
-                 local_time->tm_sec) == -1)
+void *DVS::broadcast_bin_writer()
+{
+    char *bin_name = make_bin_name();
+    if (bin_name == NULL)
     {
-        perror("Error creating bin file name");
         return nullptr;
     }
 
@@ -750,24 +932,87 @@ void *DVS::double_buf_bin_writer_no_drop(int total_read_frame_num)
     if (!file.is_open())
     {
         perror("Failed to open file for writing.");
+        free(bin_name);
         return nullptr;
     }
 
-    int prev_frame_num;
-    int prev_timestamp;
-    int check_init = 0;
-    int error_num = 0;
+    // false once the reader closed the broadcast and every frame was written
+    while (broadcast->read(broadcast_id, buffer))
+    {
+        file.write(buffer, frame_bytes);
+    }
+
+    file.close();
+    printf("recorded DVS frames to %s\n", bin_name);
+    free(bin_name);
+    return nullptr;
+}
+
+void *DVS::double_buf_segment_writer(double segment_sec, uint64_t segment_bytes, uint64_t quota_bytes)
+{
     int frame_num;
     uint32_t timestamp;
-    char *dvs_buffer = (char *)malloc(frame_bytes * sizeof(char));
 
-    std::vector<char *> frame_buffers(total_read_frame_num);
+    // prefix of output segments, SegmentWriter appends the segment number and extension
+    char *bin_prefix = make_bin_name("");
+    if (bin_prefix == NULL)
+    {
+        // a blocked reader gives up
+        dbuf->close();
+        return nullptr;
+    }
 
-    for (int i = 0; i < total_read_frame_num; ++i)
+    // segments are opened, preallocated, closed and deleted by the writer's own rotation thread
+    SegmentWriter writer(bin_prefix, frame_bytes, segment_sec, segment_bytes, quota_bytes);
+    if (!writer.start())
     {
-        frame_buffers[i] = (char *)malloc(frame_bytes * sizeof(char));
+        dbuf->close();
+        free(bin_prefix);
+        return nullptr;
     }
 
+    char *dvs_buffer;
+    while ((dvs_buffer = dbuf->pop()) != NULL)
+    {
+        decode_header(dvs_buffer, frame_num, timestamp);
+        writer.write_frame(dvs_buffer, frame_num, timestamp);
+        dbuf->release(dvs_buffer);
+    }
+
+    writer.stop();
+    free(bin_prefix);
+    return nullptr;
+}
+
+void *DVS::double_buf_bin_writer_no_drop(int total_read_frame_num)
+{
+    char *bin_name = make_bin_name();
+    if (bin_name == NULL)
+    {
+        return nullptr;
+    }
+
+    // map one arena holding the whole burst, backed by the output file itself
+    BurstArena arena(frame_bytes, total_read_frame_num);
+    if (!arena.open(bin_name))
+    {
+        free(bin_name);
+        return nullptr;
+    }
+    printf("burst arena : %d frames in %s\n", total_read_frame_num,
+           arena.file_backed() ? "the mapped output file"
+           : arena.hugepage_backed() ? "explicit hugepages"
+                                     : "normal pages (transparent hugepages requested)");
+    // fault in every page now, so that capture never stalls on the page allocator
+    arena.prefault();
+
+    int prev_frame_num;
+    int prev_timestamp;
+    int check_init = 0;
+    int error_num = 0;
+    int frame_num;
+    uint32_t timestamp;
+
     while (check_init < 3000)
     {
         read_frame(buffer);
@@ -776,10 +1021,12 @@ void *DVS::double_buf_bin_writer_no_drop(int total_read_frame_num)
 
     for (int read_frame_num = 0; read_frame_num < total_read_frame_num; read_frame_num++)
     {
-        read_frame(frame_buffers[read_frame_num]);
+        // read directly into the frame's final location
+        char *frame_slot = arena.slot(read_frame_num);
+        read_frame(frame_slot);
 
         // check frame num consistency
-        decode_header(frame_buffers[read_frame_num], frame_num, timestamp);
+        decode_header(frame_slot, frame_num, timestamp);
         if ((prev_frame_num + 1 != frame_num) && (prev_frame_num != (frame_num + 255)))
         {
             error_num++;
@@ -788,12 +1035,13 @@ void *DVS::double_buf_bin_writer_no_drop(int total_read_frame_num)
     }
 
     std::cout << "ERROR NUM: " << std::dec << error_num << std::endl;
-    for (int read_frame_num = 0; read_frame_num < total_read_frame_num; read_frame_num++)
+
+    // single msync (file-backed) or single large write (anonymous arena)
+    if (arena.flush(total_read_frame_num) < 0)
     {
-        file.write(frame_buffers[read_frame_num], frame_bytes);
+        fprintf(stderr, "failed to flush %s\n", bin_name);
     }
 
-    file.close();
     free(bin_name);
 
     return nullptr;
@@ -814,8 +1062,13 @@ void DVS::bin_to_vid(char *path_to_bin, char *output_vid_name)
     //     perror("Failed to open file for writing.");
     //     return nullptr;
     // }
-    cv::VideoWriter videoWriter(output_vid_name, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'),
-                                10, cv::Size(frame_w, frame_h), false);
+    // video encoding runs on the encoder thread, no frame is dropped
+    EncoderPool encoder(frame_h, frame_w, CV_8UC1, ENCODER_SLOT_NUM, ENCODE_BLOCK);
+    if (!encoder.open_video(output_vid_name, cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 10, false))
+    {
+        return;
+    }
+    int frame_count = 0;
     while (bin_file.read(buffer, frame_bytes))
     {
         std::streamsize bytesRead = bin_file.gcount(); // Get actual bytes read
@@ -834,17 +1087,20 @@ void DVS::bin_to_vid(char *path_to_bin, char *output_vid_name)
         else
         {
             // std::cout << "Read " << bytesRead << " bytes successfully.\n";
-            frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
+            // convert straight into an encoder slot
+            cv::Mat *slot = encoder.acquire();
+            frame = *slot;
             convert2BitTo8Bit();
 
             // If the format is BGR but needs conversion
             // cv::cvtColor(frame, frame, cv::COLOR_RGB2BGR);
 
-            videoWriter.write(frame);
+            encoder.submit(slot, frame_count++);
         }
     }
     bin_file.close();
-    videoWriter.release();
+    encoder.close();
+    frame.release();
 }
 
 void DVS::bin_to_png(char *path_to_bin, char *output_folder_name)
@@ -891,10 +1147,16 @@ void DVS::bin_to_png(char *path_to_bin, char *output_folder_name)
     // }
     // bin_file.close();
 
+    // png encoding runs on the encoder threads, no frame is dropped
+    EncoderPool encoder(frame_h, frame_w, CV_8UC1, ENCODER_SLOT_NUM, ENCODE_BLOCK);
+    encoder.open_png(output_folder_name, ENCODER_WORKER_NUM);
+
     int frame_count = 0; // Counter for frame naming
     while (!bin_file.eof())
     {
-        frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
+        // accumulate straight into an encoder slot
+        cv::Mat *slot = encoder.acquire();
+        frame = *slot;
         for (int frame_grp_num = 0; frame_grp_num < accum_num; frame_grp_num++)
         {
             bin_file.read(buffer, frame_bytes);
@@ -926,14 +1188,12 @@ void DVS::bin_to_png(char *path_to_bin, char *output_folder_name)
 
         cv::flip(frame, frame, 0);
 
-        // Generate filename for the PNG image
-        std::ostringstream filename;
-        filename << output_folder_name << "/frame_" << std::setw(5) << std::setfill('0') << frame_count << ".png";
-
-        // Save the frame as a PNG image
-        cv::imwrite(filename.str(), frame);
+        // Save the frame as a PNG image, named after frame_count
+        encoder.submit(slot, frame_count);
         frame_count++; // Increment frame count
     }
+    encoder.close();
+    frame.release();
 }
 
 void DVS::dvs_roi_average_based(int img_show, int is_update, bool is_flip, bool print_latency)
@@ -942,112 +1202,123 @@ void DVS::dvs_roi_average_based(int img_show, int is_update, bool is_flip, bool
     int frame_cnt = 0;
     std::chrono::high_resolution_clock::time_point algorithm_start, algorithm_end, frame_read_start, frame_read_end;
     std::chrono::duration<double, std::milli> algorithm_elapsed, frame_read_elapsed;
+    // event counters per column and row over the last accum_num frames
+    RoiWindow window(frame_w, frame_h, accum_num);
+    // event counts of the same window for the ROI density check, only kept while it is enabled
+    std::unique_ptr<EventPyramid> pyramid;
+    if (roi_min_density > 0)
+    {
+        pyramid.reset(new EventPyramid(frame_w, frame_h, accum_num));
+        if (!pyramid->is_allocated())
+        {
+            fprintf(stderr, "ROI density check disabled, event counters could not be allocated\n");
+            pyramid.reset();
+        }
+    }
+    Bbox b_box_dvs, b_box_cis;
+    // true if the latest window had a ROI
+    int is_roi = 0;
+    // position of the current frame in the stacked display image
+    int frame_grp_num = 0;
     while (true)
     {
-        if (print_latency)
+        if (print_latency && frame_grp_num == 0)
         {
             frame_read_start = std::chrono::high_resolution_clock::now();
         }
-        frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
-        // buffers to count the number of events per column and row
-        int *x_count = (int *)calloc(frame_w, sizeof(int));
-        int *y_count = (int *)calloc(frame_h, sizeof(int));
-
-        // total number of events accumulated throughout several frames
-        int sum = 0;
-
-        // stack several frames and count their number of events
-        for (int frame_grp_num = 0; frame_grp_num < accum_num; frame_grp_num++)
+        read_frame(buffer);
+        if (img_show)
         {
-            read_frame(buffer);
             if (frame_grp_num == 0)
             {
+                frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
                 convert2BitTo8Bit();
             }
             else
             {
                 convert2BitTo8Bit_accum();
             }
-            if (print_latency)
-            {
-                algorithm_start = std::chrono::high_resolution_clock::now();
-            }
-            sum += roi_count_average(x_count, y_count, is_flip);
-            if (print_latency)
-            {
-                algorithm_end = std::chrono::high_resolution_clock::now();
-                algorithm_elapsed = algorithm_end - algorithm_start;
-                algorithm_avg += algorithm_elapsed.count();
-            }
         }
-        Bbox b_box_dvs, b_box_cis;
         if (print_latency)
         {
             algorithm_start = std::chrono::high_resolution_clock::now();
         }
-        // calculate event ROI in the form of a bounding box
-        int is_roi = roi_alg_average_based(x_count, y_count, sum, &b_box_dvs, &b_box_cis);
+        // count the new frame only, the one leaving the window is subtracted
+        int sum = roi_count_average(window.frame_x_count(), window.frame_y_count(), is_flip);
+        window.push(sum);
+        if (pyramid)
+        {
+            pyramid->push((const uint8_t *)frame_start, is_flip);
+        }
+
+        // calculate event ROI in the form of a bounding box, after every frame once the window is full
+        if (window.is_full())
+        {
+            is_roi = roi_alg_average_based(window.x_count(), window.y_count(), window.sum(), &b_box_dvs, &b_box_cis);
+            // a ROI with too few events inside is not sent to CIS
+            if (is_roi && pyramid && pyramid->density(b_box_dvs) < roi_min_density)
+            {
+                is_roi = 0;
+            }
+
+            // if there are enough events to draw a ROI, publish the bounding box
+            // readers never block on this, and see the frame number it was calculated from
+            if (is_roi)
+            {
+                bbox->publish(b_box_cis, true, read_frame_num);
+            }
+            else if (!is_update)
+            {
+                bbox->invalidate(read_frame_num);
+            }
+        }
         if (print_latency)
         {
             algorithm_end = std::chrono::high_resolution_clock::now();
             algorithm_elapsed = algorithm_end - algorithm_start;
             algorithm_avg += algorithm_elapsed.count();
         }
-        // cleanup
-        free(x_count);
-        free(y_count);
-        x_count = NULL;
-        y_count = NULL;
 
-        // acquire mutex
-        thread_mutex->lock_single_writer();
-
-        // if there are enough events to draw a ROI
-        // write bounding box information in a shared struct variable
-        if (is_roi)
+        if (*terminate)
         {
-            bbox->lx = b_box_cis.lx;
-            bbox->ly = b_box_cis.ly;
-            bbox->hx = b_box_cis.hx;
-            bbox->hy = b_box_cis.hy;
+            // wake up any waiting threads
+            thread_mutex->terminate();
+            frame.release();
+            break;
         }
-        else if (!is_update)
+        if (++frame_grp_num < accum_num)
         {
-            bbox->lx = -1;
-            bbox->ly = -1;
-            bbox->hx = -1;
-            bbox->hy = -1;
+            continue;
         }
-        thread_mutex->unlock_single_writer(1); // is_roi || is_update);
+        frame_grp_num = 0;
 
-        // display DVS video and ROI if img_show == 1
-        display_mutex.lock_display();
+        // display DVS video and the latest ROI if img_show == 1
         if (img_show)
         {
             if (is_flip)
             {
                 cv::flip(frame, frame, 0);
             }
-            cv::Point p1(b_box_dvs.lx, b_box_dvs.ly);
-            cv::Point p2(b_box_dvs.hx, b_box_dvs.hy);
-            cv::rectangle(frame, p1, p2, cv::Scalar(255), 2, cv::LINE_8);
-            cv::imshow("DVS camera", frame);
+            if (is_roi)
+            {
+                cv::Point p1(b_box_dvs.lx, b_box_dvs.ly);
+                cv::Point p2(b_box_dvs.hx, b_box_dvs.hy);
+                cv::rectangle(frame, p1, p2, cv::Scalar(255), 2, cv::LINE_8);
+            }
+            show_frame("DVS camera", frame);
         }
 
         // if ESC pressed, exit...
         // or some other thread detects ESC press, exit.
-        if (*terminate || cv::waitKey(1) == 27)
+        if (is_esc_pressed())
         {
             *terminate = true;
             // wake up any waiting threads
             thread_mutex->terminate();
             // cleanup
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        frame.release();
-        display_mutex.unlock_display();
         if (print_latency)
         {
             frame_read_end = std::chrono::high_resolution_clock::now();
@@ -1068,9 +1339,20 @@ void DVS::dvs_roi_average_based(int img_show, int is_update, bool is_flip, bool
     }
 }
 
-void DVS::send_frame(cv::Mat *dest_frame, bool is_flip)
+void DVS::send_frame(FrameHandle &dest_frame, bool is_flip)
 {
-    frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC3);
+    if (send_pool == NULL)
+    {
+        send_pool = new FramePool(frame_h, frame_w, CV_8UC3, DVS_SEND_FRAME_NUM);
+    }
+    // waits only if the receiver still holds every pooled frame
+    if (!send_pool->acquire(dest_frame))
+    {
+        return;
+    }
+    // convert straight into the pooled frame
+    frame = dest_frame.mat();
+    frame.setTo(cv::Scalar::all(0));
     // stack several frames and count their number of events
     for (int frame_grp_num = 0; frame_grp_num < accum_num; frame_grp_num++)
     {
@@ -1088,10 +1370,8 @@ void DVS::send_frame(cv::Mat *dest_frame, bool is_flip)
     {
         cv::flip(frame, frame, 0);
     }
-    thread_mutex->lock_single_writer();
-    // clone image to send to CIs
-    *dest_frame = frame.clone();
-    thread_mutex->unlock_single_writer(1);
+    // detach the header, so no later write to frame lands in a frame CIS holds
+    frame.release();
 }
 
 int DVS::roi_count_average(int *x_count, int *y_count, bool is_flip)
@@ -1250,302 +1530,49 @@ void DVS::set_DVS_ROI(int roi_event_score_, int row_score_threshold_, int roi_he
     roi_min_size = roi_min_size_;
     roi_inflation_ratio = roi_inflation_ratio_;
 }
+void DVS::set_ROI_density(float roi_min_density_)
+{
+    roi_min_density = roi_min_density_;
+}
 void DVS::draw_square_roi(Bbox *b_box, int x_min, int y_min, int x_max, int y_max, int width, int height)
 {
-    // draw square ROI around given x and y coordinate ranges
-    // while making sure ROI doesn't exceed the entire frame
-
-    // move coordinates to inside the frame
-    if (x_min < 0)
-        x_min = 0;
-    if (y_min < 0)
-        y_min = 0;
-    if (x_max >= width)
-        x_max = width - 1;
-    if (y_max >= height)
-        y_max = height - 1;
-
-    // determine square ROI size
-    int inflated_size = (int)(roi_inflation_ratio * (x_max - x_min));
-    if (inflated_size > height)
-    {
-        inflated_size = height;
-    }
-    else if (inflated_size < roi_min_size)
-    {
-        inflated_size = roi_min_size;
-    }
-
-    int inflated_size_y = (int)(roi_inflation_ratio * (y_max - y_min));
-    if (inflated_size_y > height)
-    {
-        inflated_size_y = height;
-    }
-    else if (inflated_size_y < roi_min_size)
-    {
-        inflated_size_y = roi_min_size;
-    }
-
-    // give margin around x_max and x_min to determine ROI position
-    int min_offset = (inflated_size - (x_max - x_min)) >> 1;
-
-    // if ROI exceeds frame, move it inside
-    if (x_min - min_offset < 0)
-    {
-        b_box->lx = 0;
-        b_box->hx = inflated_size - 1;
-    }
-    else if (x_min + inflated_size - min_offset >= width)
-    {
-        b_box->hx = width;
-        b_box->lx = width - inflated_size + 1;
-    }
-    else
-    {
-        b_box->lx = x_min - min_offset;
-        b_box->hx = x_min - min_offset + inflated_size - 1;
-    }
-
-    // give margin around y_max and y_min to determine ROI position
-    int min_offset_y = (inflated_size_y - (y_max - y_min)) >> 1;
-
-    // if ROI exceeds frame, move it inside
-    if (y_min - min_offset_y < 0)
-    {
-        b_box->ly = 0;
-        b_box->hy = inflated_size_y - 1;
-    }
-    else if (y_min + inflated_size_y - min_offset_y >= height)
-    {
-        b_box->hy = height;
-        b_box->ly = height - inflated_size_y + 1;
-    }
-    else
-    {
-        b_box->ly = y_min - min_offset_y;
-        b_box->hy = y_min - min_offset_y + inflated_size_y - 1;
-    }
+    dvs_draw_square_roi(b_box, x_min, y_min, x_max, y_max, width, height, roi_min_size, roi_inflation_ratio);
 }
 
 int DVS::pixel_count(uint8_t x)
 {
-    // calculate how many 2-bit events happen inside 8-bit word
-    int cnt = 0;
-    for (int i = 0; i < 4; i++)
-    {
-        if (x && 0x03)
-            cnt++;
-        x = x >> 2;
-    }
-    return cnt;
+    return dvs_pixel_count(x);
 }
 void DVS::convert2BitTo8Bit_count(bool is_flip)
 {
-    for (int h = 0; h < frame_h; h++)
-    {
-        for (int byteIndex = 0; byteIndex < (frame_w >> 2); ++byteIndex)
-        {
-            // apply a simple spatial filter before written to frame.
-            // 8-bit word that includes current pixel U 8-bit word 1 row before.
-            // if these 8 pixels contain less than 2 pixels, current pixel not written to frame.
-            uint8_t prev_pixel = (h == 0) ? 0 : (frame_start[(h - 1) * (frame_w >> 2) + byteIndex]);
-            uint8_t cur_pixel = frame_start[h * (frame_w >> 2) + byteIndex];
-            uint8_t pixel_count_val = pixel_count(prev_pixel) + pixel_count(cur_pixel);
-
-            for (int bitOffset = 0; bitOffset < 8; bitOffset += 2)
-            {
-                uint8_t pixel = (cur_pixel >> bitOffset) & 0x03; // Extract 2 bits
-                int frame_idx;
-                // if DVS flipped, write to frame upside down
-                if (is_flip)
-                {
-                    frame_idx = (frame_h - h - 1) * frame_w + (byteIndex << 2) + (bitOffset >> 1);
-                }
-                else
-                {
-                    frame_idx = h * frame_w + (byteIndex << 2) + (bitOffset >> 1);
-                }
-                // write gray pixel values
-                if (pixel_count_val >= 2 && pixel == 1)
-                {
-                    frame.data[frame_idx] = 224;
-                }
-                else if (pixel_count_val >= 2 && pixel == 2)
-                {
-                    frame.data[frame_idx] = 32;
-                }
-                else
-                {
-                    frame.data[frame_idx] = 128;
-                }
-            }
-        }
-    }
+    dvs_decode_count(frame_start, frame, frame_w, frame_h, true, is_flip);
 }
 
 void DVS::convert2BitTo8Bit_count_accum(bool is_flip)
 {
-    for (int h = 0; h < frame_h; h++)
-    {
-        for (int byteIndex = 0; byteIndex < (frame_w >> 2); ++byteIndex)
-        {
-            // apply a simple spatial filter before written to frame.
-            // 8-bit word that includes current pixel U 8-bit word 1 row before.
-            // if these 8 pixels contain less than 2 pixels, current pixel not written to frame.
-            uint8_t prev_pixel = (h == 0) ? 0 : (frame_start[(h - 1) * (frame_w >> 2) + byteIndex]);
-            uint8_t cur_pixel = frame_start[h * (frame_w >> 2) + byteIndex];
-            uint8_t pixel_count_val = pixel_count(prev_pixel) + pixel_count(cur_pixel);
-            if (pixel_count_val >= 2)
-            {
-                for (int bitOffset = 0; bitOffset < 8; bitOffset += 2)
-                {
-                    uint8_t pixel = (cur_pixel >> bitOffset) & 0x03; // Extract 2 bits
-                    int frame_idx;
-                    // if DVS flipped, write to frame upside down
-                    if (is_flip)
-                    {
-                        frame_idx = (frame_h - h - 1) * frame_w + (byteIndex << 2) + (bitOffset >> 1);
-                    }
-                    else
-                    {
-                        frame_idx = h * frame_w + (byteIndex << 2) + (bitOffset >> 1);
-                    }
-                    // accumulate to gray pixels (functionality not used for now)
-                    if (frame.data[frame_idx] > 128)
-                    {
-                        if (pixel != 0)
-                            frame.data[frame_idx] += 1;
-                    }
-                    else if (frame.data[frame_idx] < 128)
-                    {
-                        if (pixel != 0)
-                            frame.data[frame_idx] -= 1;
-                    }
-                    // stack frames, overwriting pixels with no events
-                    else if (pixel == 1)
-                    {
-                        frame.data[frame_idx] = 224;
-                    }
-                    else if (pixel == 2)
-                    {
-                        frame.data[frame_idx] = 32;
-                    }
-                }
-            }
-        }
-    }
+    dvs_decode_count(frame_start, frame, frame_w, frame_h, false, is_flip);
+}
+DvsRoiParams DVS::get_roi_params()
+{
+    DvsRoiParams params;
+    params.roi_event_score = roi_event_score;
+    params.row_score_threshold = row_score_threshold;
+    params.roi_height_min_threshold = roi_height_min_threshold;
+    params.roi_min_size = roi_min_size;
+    params.roi_inflation_ratio = roi_inflation_ratio;
+    params.convert_cis = convert_cis;
+    params.cis_x_scale = cis_x_scale;
+    params.cis_y_scale = cis_y_scale;
+    params.cis_x_offset = cis_x_offset;
+    params.cis_y_offset = cis_y_offset;
+    params.cis_frame_w = cis_frame_w;
+    params.cis_frame_h = cis_frame_h;
+    return params;
 }
+
 int DVS::roi_alg_proposed(Bbox *dvs, Bbox *cis)
 {
-    int row_start_idx = 0;
-    // final roi values
-    int global_x_min = frame_w, global_x_max = 0;
-    int global_y_min = 0, global_y_max = -1;
-    // height-wise line width threshold apply
-    int roi_row_streak = 0;
-    // calculate x-direction min, max for a few rows
-    int candidate_x_min, candidate_x_max;
-    candidate_x_min = frame_w;
-    candidate_x_max = 0;
-    // calculate max sum of consecutive partial sequence
-    // where some values are -1 and others are roi_event_score(currently 5)
-    for (int h = 0; h < frame_h; h++)
-    {
-        int local_max_score = 0, local_cur_score = 0;
-        int local_max_left = frame_w, local_max_right = 0;
-        int local_cur_score_left = 0;
-        // incremental algorithm
-        for (int w = 0; w < frame_w; w++)
-        {
-            // cur_val : current score of sequence element
-            int cur_val;
-            int pix_val = frame.data[row_start_idx + w];
-            if (pix_val > 128)
-            {
-                cur_val = roi_event_score; // 2+width_count;//((pix_val-128)>>2)+width_count;
-            }
-            else if (pix_val < 128)
-            {
-                cur_val = roi_event_score; // 2+width_count;//((128-pix_val)>>2)+width_count;
-            }
-            else
-            {
-                cur_val = -1;
-            }
-            // local_cur_score : max value of partial sequence whose right end is w
-            local_cur_score = local_cur_score + cur_val;
-            // if local_cur_score < 0, 0(no elements in partial sequence) is larger, empty sequence corresponding to local_cur_score
-            if (local_cur_score < 0)
-            {
-                local_cur_score = 0;
-                // set the left end of partial sequence to current sequence element
-                local_cur_score_left = w;
-            }
-            // record maximum partial consecutive sequence
-            // and its left & right ends
-            if (local_cur_score > local_max_score)
-            {
-                local_max_score = local_cur_score;
-                local_max_left = local_cur_score_left;
-                local_max_right = w;
-            }
-        }
-        // printf("row %d min %d max %d local_max_score = %d\n", h,local_max_left, local_max_right, local_max_score );
-        // if max score exceeds threshold
-        if (local_max_score >= row_score_threshold)
-        {
-            roi_row_streak++;
-            // union max & min with few adjacent rows
-            if (local_max_left < candidate_x_min)
-                candidate_x_min = local_max_left;
-            if (local_max_right > candidate_x_max)
-                candidate_x_max = local_max_right;
-            // if consecutive rows' max score exceed row_score_threshold
-            // modify final ROI
-            if (roi_row_streak >= roi_height_min_threshold)
-            {
-                if (global_y_min == 0)
-                    global_y_min = h - roi_height_min_threshold + 1;
-                global_y_max = h;
-                if (candidate_x_min < global_x_min)
-                    global_x_min = candidate_x_min;
-                if (candidate_x_max > global_x_max)
-                    global_x_max = candidate_x_max;
-            }
-        }
-        else
-        {
-            // if consecutive rows don't exist
-            // initialize max, min and row count
-            candidate_x_min = frame_w;
-            candidate_x_max = 0;
-            roi_row_streak = 0;
-        }
-        row_start_idx += frame_w;
-    }
-    if (global_y_max != -1)
-    {
-        // if valid ROI is detected
-        //  printf("%d %d %d %d\n", global_x_min, global_y_min, global_x_max, global_y_max);
-        // draw dvs ROI
-        draw_square_roi(dvs, global_x_min, global_y_min, global_x_max, global_y_max, frame_w, frame_h);
-        if (convert_cis)
-        {
-            // convert DVS coordinates to CIS
-            int x_min = (int)(cis_x_scale * global_x_min) + cis_x_offset;
-            int y_min = (int)(cis_y_scale * global_y_min) + cis_y_offset;
-            int x_max = (int)(cis_x_scale * global_x_max) + cis_x_offset;
-            int y_max = (int)(cis_y_scale * global_y_max) + cis_y_offset;
-            // draw ROI for CIS
-            draw_square_roi(cis, x_min, y_min, x_max, y_max, cis_frame_w, cis_frame_h);
-        }
-        // return if valid ROI detected
-        return 1;
-    }
-    else
-    {
-        return 0;
-    }
+    return dvs_roi_alg_proposed(frame, get_roi_params(), dvs, cis);
 }
 void DVS::dvs_roi_proposed(int img_show, int is_update, bool is_flip, bool print_latency)
 {
@@ -1553,6 +1580,17 @@ void DVS::dvs_roi_proposed(int img_show, int is_update, bool is_flip, bool print
     int frame_cnt = 0;
     std::chrono::high_resolution_clock::time_point algorithm_start, algorithm_end, frame_read_start, frame_read_end;
     std::chrono::duration<double, std::milli> algorithm_elapsed, frame_read_elapsed;
+    // event counts of the accumulated frames for the ROI density check, only kept while it is enabled
+    std::unique_ptr<EventPyramid> pyramid;
+    if (roi_min_density > 0)
+    {
+        pyramid.reset(new EventPyramid(frame_w, frame_h, accum_num));
+        if (!pyramid->is_allocated())
+        {
+            fprintf(stderr, "ROI density check disabled, event counters could not be allocated\n");
+            pyramid.reset();
+        }
+    }
     while (true)
     {
         if (print_latency)
@@ -1563,6 +1601,10 @@ void DVS::dvs_roi_proposed(int img_show, int is_update, bool is_flip, bool print
         for (int frame_grp_num = 0; frame_grp_num < accum_num; frame_grp_num++)
         {
             read_frame(buffer);
+            if (pyramid)
+            {
+                pyramid->push((const uint8_t *)frame_start, is_flip);
+            }
             // generate DVS frame
             if (frame_grp_num == 0)
             {
@@ -1581,36 +1623,29 @@ void DVS::dvs_roi_proposed(int img_show, int is_update, bool is_flip, bool print
         }
         // calculate event ROI in the form of a bounding box
         int is_roi = roi_alg_proposed(&b_box_dvs, &b_box_cis);
+        // a ROI with too few events inside is not sent to CIS
+        if (is_roi && pyramid && pyramid->density(b_box_dvs) < roi_min_density)
+        {
+            is_roi = 0;
+        }
         if (print_latency)
         {
             algorithm_end = std::chrono::high_resolution_clock::now();
             algorithm_elapsed = algorithm_end - algorithm_start;
             algorithm_avg += algorithm_elapsed.count();
         }
-        // acquire mutex
-        thread_mutex->lock_single_writer();
-
-        // if there are enough events to draw a ROI
-        // write bounding box information in a shared struct variable
+        // if there are enough events to draw a ROI, publish the bounding box
+        // readers never block on this, and see the frame number it was calculated from
         if (is_roi)
         {
-            bbox->lx = b_box_cis.lx;
-            bbox->ly = b_box_cis.ly;
-            bbox->hx = b_box_cis.hx;
-            bbox->hy = b_box_cis.hy;
-            // printf("%d %d %d %d\n", bbox->lx, bbox->ly, bbox->hx, bbox->hy);
+            bbox->publish(b_box_cis, true, read_frame_num);
         }
         else if (!is_update)
         {
-            bbox->lx = -1;
-            bbox->ly = -1;
-            bbox->hx = -1;
-            bbox->hy = -1;
+            bbox->invalidate(read_frame_num);
         }
-        thread_mutex->unlock_single_writer(1); // is_roi || is_update);
 
         // display DVS video and ROI if img_show == 1
-        display_mutex.lock_display();
         if (img_show)
         {
             if (is_roi)
@@ -1619,23 +1654,20 @@ void DVS::dvs_roi_proposed(int img_show, int is_update, bool is_flip, bool print
                 cv::Point p2(b_box_dvs.hx, b_box_dvs.hy);
                 cv::rectangle(frame, p1, p2, cv::Scalar(255), 2, cv::LINE_8);
             }
-            cv::imshow("DVS camera", frame);
+            show_frame("DVS camera", frame);
         }
 
         // if ESC pressed, exit...
         // or some other thread detects ESC press, exit.
-        if (*terminate || cv::waitKey(1) == 27)
+        if (*terminate || is_esc_pressed())
         {
             *terminate = true;
             // wake up any waiting threads
             thread_mutex->terminate();
             // cleanup
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        frame.release();
-        display_mutex.unlock_display();
         if (print_latency)
         {
             frame_read_end = std::chrono::high_resolution_clock::now();
@@ -1655,18 +1687,41 @@ void DVS::dvs_roi_proposed(int img_show, int is_update, bool is_flip, bool print
         }
     }
 }
+
+
+void DVS::set_overload_policy(OverloadPolicy policy, int high_depth)
+{
+    if (dbuf != NULL)
+        dbuf->set_policy(policy, high_depth);
+}
+
+void DVS::request_terminate()
+{
+    if (terminate != NULL)
+        *terminate = true;
+}
+
+int DVS::get_frame_bytes()
+{
+    return frame_bytes;
+}
+
 DVS::~DVS()
 {
-    if (double_buffer != NULL)
+    if (dbuf != NULL)
     {
-        free(double_buffer);
-        delete dbuf_mutex[0];
-        delete dbuf_mutex[1];
+        dbuf->print_stats("DVS frame queue");
+        delete dbuf;
         if (terminate != NULL)
         {
             delete terminate;
         }
     }
+    if (send_pool != NULL)
+    {
+        send_pool->print_stats("DVS send frames");
+        delete send_pool;
+    }
     free(buffer);
     free(buffer_rdy);
     free(buffer_done);
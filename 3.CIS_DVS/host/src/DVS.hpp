@@ -28,13 +28,22 @@
 #include <condition_variable>
 #include "PCIe.hpp"
 #include "MutexManager.hpp"
+#include "FrameQueue.hpp"
+#include "SyncRecorder.hpp"
+#include "ReplaySource.hpp"
+#include "Presenter.hpp"
 #include "bbox.hpp"
+#include "DvsRoi.hpp"
+#include "SharedBbox.hpp"
+#include "FramePool.hpp"
+#include "FrameBroadcast.hpp"
+#include "ThreadTopology.hpp"
+#include "BackPressure.hpp"
 
-/**
- * Function to set thread priority to highest.
- * @param t : thread alias to set priority to
- */
-void setThreadPriority(std::thread &t);
+// number of frame buffers between the PCIE reader and the consumer thread
+#define DBUF_FRAME_NUM 8
+// number of pooled frames handed out by send_frame
+#define DVS_SEND_FRAME_NUM 4
 
 // class to manage DVS object
 class DVS
@@ -55,8 +64,6 @@ private:
     // Frame data
     // raw sensor data buffer
     char *buffer;
-    // double buffering raw sensor data buffer
-    char *double_buffer;
     // frame for opencv display
     cv::Mat frame;
     // pointer to skip header and go to actual sensor data
@@ -85,18 +92,44 @@ private:
     int roi_height_min_threshold;
     int roi_min_size;
     float roi_inflation_ratio;
+    // minimum events per pixel inside the DVS ROI over the accumulation window, 0 : not checked
+    float roi_min_density;
 
     // if true, calculate ROI bbox from CIS viewpoint
     bool convert_cis;
 
-    // bounding box shared memory
-    Bbox *bbox;
+    // BGR frames handed to CIS by send_frame, allocated on first use
+    FramePool *send_pool;
+
+    // ROI bounding box published to CIS threads
+    SharedBbox *bbox;
+    // DVS frames read so far, stamps every published bounding box
+    uint64_t read_frame_num;
 
     // pointer to multithreading termination flag
     bool *terminate;
 
-    // mutex for write-to-bin file double buffering
-    MutexManager *dbuf_mutex[2];
+    // recorded frame source replacing PCIE, NULL for live sensor
+    ReplaySource *replay;
+
+    // shared PCIE reader feeding this object, NULL to read the sensor directly
+    FrameBroadcast *broadcast;
+    // subscription of this object in broadcast
+    int broadcast_id;
+
+    // display thread showing posted frames, NULL to call cv::imshow directly
+    Presenter *presenter;
+    /**
+     * shows img in window, through the presenter if set
+     */
+    void show_frame(const char *window, cv::Mat &img);
+    /**
+     * @return true if ESC was pressed
+     */
+    bool is_esc_pressed();
+
+    // frames handed from the PCIE reader thread to the consumer thread, NULL without double buffering
+    BackPressureQueue *dbuf;
 
     // DVS to CIS relative frame size scale (0~1)
     float cis_x_scale;
@@ -123,7 +156,7 @@ public:
      * @param c2h_dev ("/dev/xdma_dvs0_c2h_0") c2h port alias of xdma driver
      * @param h2c_dev ("/dev/xdma_dvs0_h2c_0") h2c port alias of xdma driver
      * @param display_mutex mutex object for opencv display
-     * @param double_buffering true if double buffering is enabled for write-to-bin purposes
+     * @param double_buffering true to allocate a frame queue between reader and writer threads (DBUF_FRAME_NUM buffers, see set_overload_policy)
      */
     DVS(
         int frame_h, int frame_w,
@@ -144,7 +177,7 @@ public:
      * @param c2h_dev ("/dev/xdma_dvs0_c2h_0") c2h port alias of xdma driver
      * @param h2c_dev ("/dev/xdma_dvs0_h2c_0") h2c port alias of xdma driver
      * @param display_mutex mutex object for opencv display
-     * @param bbox bounding box shared memory between CIS and DVS
+     * @param bbox ROI bounding box published to CIS
      * @param thread_mutex mutex object for DVS-CIS multithreading
      * @param terminate pointer to shared terminate flag for terminating multithreading properly
      */
@@ -154,7 +187,7 @@ public:
         uintptr_t rdy_baseaddr, uintptr_t frame_baseaddr,
         int buffer_num,
         const char *c2h_dev, const char *h2c_dev,
-        MutexManager &display_mutex, Bbox *bbox, MutexManager *thread_mutex = NULL,
+        MutexManager &display_mutex, SharedBbox *bbox, MutexManager *thread_mutex = NULL,
         bool *terminate = NULL,
         int display_downsample_num = 1);
 
@@ -228,6 +261,16 @@ public:
     void set_CIS(float x_scale, float y_scale, float x_offset, float y_offset, int frame_w, int frame_h, int roi_event_score_, int row_score_threshold_,
                  int roi_height_min_threshold_, int roi_min_size_, float roi_inflation_ratio_);
 
+    /**
+     * set the event density a ROI needs to be published to CIS.
+     * ROI loops started after this keep an EventPyramid of the accumulation window and drop ROIs
+     * whose events per pixel (one O(1) query) are below roi_min_density_.
+     * with the check disabled no pyramid is allocated
+     *
+     * @param roi_min_density_ minimum events per pixel inside the DVS ROI, 0 disables the check
+     */
+    void set_ROI_density(float roi_min_density_);
+
     /**
      * calculate DVS fps and display on opencv frame
      * @param[out] fps val of FPS, needs to be live variable when calc_fps repeatedly called
@@ -252,13 +295,32 @@ public:
      */
     void save_png_stream(char *output_folder_name, bool is_flip);
     /**
-     * writes sensor data to double buffer
-     * skips 1 frame for every 2 frames to match convert2bitto8bit latency
+     * @brief for use with CIS::record_stream
+     * Reads every DVS frame straight into a SyncRecorder slot, without decoding.
+     * runs until *terminate is set.
+     * @param recorder recorder shared with CIS::record_stream
+     */
+    void record_stream(SyncRecorder *recorder);
+    /**
+     * Exports a recording made by CIS::record_stream and DVS::record_stream.
+     * all DVS frames arriving between two CIS frames are stacked into one DVS image,
+     * so that CIS and DVS outputs have the same frame index.
+     * per-frame timestamps are written to <path_to_recording>.csv
+     * @param path_to_recording path to input recording
+     * @param cis_output folder for CIS png images, or CIS video file if is_video
+     * @param dvs_output folder for DVS png images, or DVS video file if is_video
+     * @param is_video write MJPG videos instead of png images
+     * @param is_flip flip DVS images like save_png_stream
+     */
+    void export_recording(char *path_to_recording, char *cis_output, char *dvs_output, bool is_video, bool is_flip);
+    /**
+     * writes sensor data to the frame queue
+     * keeps 1 frame for every display_downsample_num frames to match convert2bitto8bit latency
      */
     void double_buf_display_fps_writer();
 
     /**
-     * reads data from double buffer and displays DVS screen.
+     * reads data from the frame queue and displays DVS screen.
      * @param is_flip horizontal flip image.
      */
     void double_buf_display_fps_reader(bool is_flip = false);
@@ -274,6 +336,36 @@ public:
      * @param dvs_buffer buffer to write sensor data to
      */
     void read_frame(char *dvs_buffer);
+    /**
+     * replaces the PCIE connection with a recorded frame source.
+     * once a non-looping replay is finished, *terminate is set (if available)
+     * @param replay opened replay source, NULL to go back to the live sensor
+     */
+    void set_replay(ReplaySource *replay);
+    /**
+     * reads frames from a subscription of a shared PCIE reader (see broadcast_reader) instead of the sensor.
+     * once the broadcast is closed and drained, *terminate is set (if available)
+     * @param broadcast broadcast filled by another DVS object, NULL to go back to the live sensor
+     * @param subscriber subscriber id returned by broadcast->subscribe
+     */
+    void set_broadcast(FrameBroadcast *broadcast, int subscriber);
+    /**
+     * routes every window of this object through a presenter thread
+     * @param presenter started presenter, NULL to display from the calling thread
+     */
+    void set_presenter(Presenter *presenter);
+    /**
+     * sets what the reader thread does once the consumer thread is behind (double buffering only).
+     * default : OVERLOAD_DROP_NEWEST once all DBUF_FRAME_NUM buffers are taken
+     * @param policy overload policy
+     * @param high_depth queued frames above which the policy applies, at most DBUF_FRAME_NUM
+     */
+    void set_overload_policy(OverloadPolicy policy, int high_depth);
+    /**
+     * asks the reader threads to stop after the current frame (sets *terminate).
+     * only stores a flag, so it may be called from a signal handler
+     */
+    void request_terminate();
     /**
      prints error message to console whenever DVS experiences a frame drop.
      */
@@ -283,19 +375,39 @@ public:
      */
     void fps_count();
     /**
-     * thread to put DVS sensor data in 2 buffers using double buffering
+     * thread to put DVS sensor data in the frame queue.
+     * once the consumer is behind, the overload policy decides (see set_overload_policy)
      */
     void *double_buf_reader();
     /*
-     * thread to read from double buffer and write to bin file
+     * thread to read from the frame queue and write to bin file
      * inside directory ./bin_files
      */
     void *double_buf_bin_writer();
     /*
-     * Save total_read_frame_num to DRAM and save it after.
+     * thread to read from the frame queue and write to segmented bin files
+     * inside directory ./bin_files, each segment has an index file (.idx) next to it
+     * @param segment_sec start a new segment after this many seconds, 0 to disable
+     * @param segment_bytes start a new segment before exceeding this size
+     * @param quota_bytes delete oldest segments above this total size, 0 to disable
+     */
+    void *double_buf_segment_writer(double segment_sec, uint64_t segment_bytes, uint64_t quota_bytes);
+    /*
+     * Capture total_read_frame_num frames into one preallocated BurstArena and save it after.
      * inside directory ./bin_files
      */
     void *double_buf_bin_writer_no_drop(int total_read_frame_num);
+    /**
+     * thread reading every DVS frame once and publishing it to all subscribers of broadcast.
+     * runs until *terminate is set, then closes the broadcast
+     * @param broadcast broadcast to fill, must have the frame size of this object
+     */
+    void *broadcast_reader(FrameBroadcast *broadcast);
+    /*
+     * thread to write every frame of the broadcast subscription (set_broadcast) to bin file
+     * inside directory ./bin_files, the subscription should be BROADCAST_NO_DROP
+     */
+    void *broadcast_bin_writer();
     /**
      * Reconstructs a video file from the bin file stored by DVS_STORE mode (double_buf_reader and double_buf_bin_writer)
      * @param path_to_bin path to input bin file
@@ -323,6 +435,8 @@ public:
     void draw_square_roi(Bbox *b_box, int x_min, int y_min, int x_max, int y_max, int width, int height);
     /**
      * Calculates and displays ROI bounding box along with DVS opencv video.
+     * the ROI is updated after every DVS frame from the event counts of the last accum_num frames,
+     * the video shows one stacked image every accum_num frames.
      *
      * @param img_show displays opencv video, 0 when used only for multithreading purposes
      * @param is_update if 1, wakes up listener threads only if valid ROI bbox appears
@@ -331,11 +445,12 @@ public:
      */
     void dvs_roi_average_based(int img_show = 1, int is_update = 0, bool is_flip = false, bool print_latency = false);
     /**
-     *sends DVS frame data to dest_frame.
-     *@param[out] dest_frame pointer to write DVS frame to
+     *reads DVS frames straight into a pooled BGR frame and hands it over without copying.
+     *the frame returns to the pool once every handle to it is released.
+     *@param[out] dest_frame receives the new frame, its previous frame is released
      *@param is_flip send horizontally flipped image to CIS
      */
-    void send_frame(cv::Mat *dest_frame, bool is_flip = false);
+    void send_frame(FrameHandle &dest_frame, bool is_flip = false);
     /**
      * counts the number of events per frame row and column.
      *
@@ -378,6 +493,10 @@ public:
      * @return if there is detected roi, 1. else, 0.
      */
     int roi_alg_proposed(Bbox *dvs, Bbox *cis);
+    /**
+     * @return the ROI parameters set by set_CIS / set_DVS_ROI, for dvs_roi_alg_proposed (DvsRoi.hpp)
+     */
+    DvsRoiParams get_roi_params();
     /**
      * displays cropped ROI for DVS and sends bbox information through shared struct between classes
      * @param img_show whether to show DVS video.
@@ -386,6 +505,10 @@ public:
      * @param print_latency prints average algorithm and per-frame latency to terminal
      */
     void dvs_roi_proposed(int img_show = 1, int is_update = 0, bool is_flip = false, bool print_latency = false);
+    /**
+     * @return size of one raw frame including the header
+     */
+    int get_frame_bytes();
     ~DVS();
 };
 
@@ -0,0 +1,656 @@
+#include "Dataflow.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ThreadTopology.hpp"
+
+void StageParams::set(const char *key, const char *value)
+{
+    values[key] = value;
+}
+
+bool StageParams::has(const char *key) const
+{
+    return values.find(key) != values.end();
+}
+
+const char *StageParams::get_str(const char *key, const char *default_value) const
+{
+    std::map<std::string, std::string>::const_iterator it = values.find(key);
+    return (it == values.end()) ? default_value : it->second.c_str();
+}
+
+int StageParams::get_int(const char *key, int default_value) const
+{
+    std::map<std::string, std::string>::const_iterator it = values.find(key);
+    return (it == values.end()) ? default_value : atoi(it->second.c_str());
+}
+
+double StageParams::get_double(const char *key, double default_value) const
+{
+    std::map<std::string, std::string>::const_iterator it = values.find(key);
+    return (it == values.end()) ? default_value : atof(it->second.c_str());
+}
+
+Stage::~Stage()
+{
+}
+
+bool Stage::open()
+{
+    return true;
+}
+
+void Stage::close()
+{
+}
+
+bool Stage::is_source()
+{
+    return false;
+}
+
+static void update_max(std::atomic<uint64_t> &max, uint64_t value)
+{
+    uint64_t prev = max.load(std::memory_order_relaxed);
+    while (value > prev && !max.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+DataflowGraph::DataflowGraph(size_t raw_bytes, bool *terminate)
+    : raw_bytes(raw_bytes), packet_num(DATAFLOW_PACKET_NUM),
+      node_num(0), worker_num(0),
+      terminate(terminate), is_aborted(false)
+{
+}
+
+void DataflowGraph::set_packet_num(int packet_num)
+{
+    this->packet_num = packet_num;
+}
+
+void DataflowGraph::set_worker_num(int worker_num)
+{
+    // a negative count would leave the pooled stages without any thread
+    this->worker_num = (worker_num > 0) ? worker_num : 0;
+}
+
+int DataflowGraph::find_node(const char *name)
+{
+    for (int i = 0; i < node_num; i++)
+    {
+        if (nodes[i]->name == name)
+            return i;
+    }
+    return -1;
+}
+
+int DataflowGraph::add_stage(const char *name, const char *type, Stage *stage, int packet_num)
+{
+    if (node_num == DATAFLOW_MAX_STAGES || find_node(name) >= 0)
+    {
+        return -1;
+    }
+    Node *node = new Node();
+    node->name = name;
+    node->type = type;
+    node->stage = stage;
+    node->is_source = stage->is_source();
+    node->next_input = 0;
+    node->output_num = 0;
+    node->pending = NULL;
+    node->pending_output = 0;
+    node->packet_num = (packet_num > 0) ? packet_num : this->packet_num;
+    node->packets = NULL;
+    node->raw_memory = NULL;
+    node->free_packets = NULL;
+    node->busy.store(false);
+    node->finished.store(false);
+    node->is_open = false;
+    node->is_blocked.store(false);
+    node->waiter = &node->own_waiter;
+    node->processed_num.store(0);
+    node->filtered_num.store(0);
+    node->busy_us_sum.store(0);
+    node->busy_us_max.store(0);
+    node->blocked_num.store(0);
+    node->starved_num.store(0);
+    node->latency_us_sum.store(0);
+    node->latency_us_max.store(0);
+    nodes[node_num] = node;
+    return node_num++;
+}
+
+bool DataflowGraph::connect(int from, int to, int queue_size, bool is_drop)
+{
+    if (from < 0 || from >= node_num || to < 0 || to >= node_num || from == to)
+        return false;
+    if (nodes[to]->is_source || nodes[from]->output_num == DATAFLOW_MAX_OUTPUTS)
+        return false;
+    Edge *edge = new Edge();
+    edge->from = from;
+    edge->to = to;
+    edge->is_drop = is_drop;
+    edge->queue = new MpmcQueue<DataPacket *>(queue_size);
+    edge->pushed_num.store(0);
+    edge->dropped_num.store(0);
+    edge->max_occupancy.store(0);
+    edges.push_back(edge);
+    nodes[from]->outputs[nodes[from]->output_num++] = edge;
+    nodes[to]->inputs.push_back(edge);
+    return true;
+}
+
+bool DataflowGraph::load(const char *path, StageFactory factory, void *context)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror("Failed to open dataflow graph");
+        return false;
+    }
+
+    char line[512];
+    int line_num = 0;
+    bool is_ok = true;
+    while (is_ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_num++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char *save = NULL;
+        const char *delim = " \t\r\n";
+        char *keyword = strtok_r(line, delim, &save);
+        if (keyword == NULL)
+            continue;
+
+        if (strcmp(keyword, "packets") == 0)
+        {
+            char *num = strtok_r(NULL, delim, &save);
+            is_ok = (num != NULL && atoi(num) > 0);
+            if (is_ok)
+                packet_num = atoi(num);
+        }
+        else if (strcmp(keyword, "threads") == 0)
+        {
+            char *num = strtok_r(NULL, delim, &save);
+            is_ok = (num != NULL && (strcmp(num, "stage") == 0 || atoi(num) > 0));
+            if (is_ok)
+                worker_num = (strcmp(num, "stage") == 0) ? 0 : atoi(num);
+        }
+        else if (strcmp(keyword, "stage") == 0)
+        {
+            char *name = strtok_r(NULL, delim, &save);
+            char *type = strtok_r(NULL, delim, &save);
+            is_ok = (name != NULL && type != NULL);
+            StageParams params;
+            char *token;
+            while (is_ok && (token = strtok_r(NULL, delim, &save)) != NULL)
+            {
+                char *eq = strchr(token, '=');
+                if (eq == NULL)
+                {
+                    is_ok = false;
+                    break;
+                }
+                *eq = '\0';
+                params.set(token, eq + 1);
+            }
+            Stage *stage = is_ok ? factory(type, params, context) : NULL;
+            if (is_ok && stage == NULL)
+            {
+                fprintf(stderr, "%s:%d: unknown stage type or invalid parameters : %s\n", path, line_num, type);
+                is_ok = false;
+                break;
+            }
+            if (is_ok && add_stage(name, type, stage, params.get_int("packets", 0)) < 0)
+            {
+                delete stage;
+                is_ok = false;
+            }
+        }
+        else if (strcmp(keyword, "edge") == 0)
+        {
+            char *from = strtok_r(NULL, delim, &save);
+            char *to = strtok_r(NULL, delim, &save);
+            int queue_size = DATAFLOW_QUEUE_SIZE;
+            bool is_drop = false;
+            char *token;
+            while ((token = strtok_r(NULL, delim, &save)) != NULL)
+            {
+                if (strcmp(token, "drop") == 0)
+                    is_drop = true;
+                else if (strncmp(token, "queue=", 6) == 0)
+                    queue_size = atoi(token + 6);
+            }
+            is_ok = (from != NULL && to != NULL && queue_size > 0 &&
+                     connect(find_node(from), find_node(to), queue_size, is_drop));
+        }
+        else
+        {
+            is_ok = false;
+        }
+        if (!is_ok)
+        {
+            fprintf(stderr, "%s:%d: invalid statement\n", path, line_num);
+        }
+    }
+    fclose(file);
+    return is_ok;
+}
+
+void DataflowGraph::wake(Node *node)
+{
+    node->waiter->notify_one();
+}
+
+void DataflowGraph::wake_sources()
+{
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        wake(sources[i]);
+    }
+}
+
+void DataflowGraph::finish(Node *node)
+{
+    node->finished.store(true);
+    for (int i = 0; i < node->output_num; i++)
+    {
+        wake(nodes[node->outputs[i]->to]);
+    }
+}
+
+void DataflowGraph::unref(DataPacket *packet)
+{
+    // acq_rel : every stage is done with the packet before a source refills it
+    if (packet->ref_num.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        Node *source = nodes[packet->source];
+        source->free_packets->try_push(packet);
+        // only its source may be asleep on this, out of packets
+        wake(source);
+    }
+}
+
+bool DataflowGraph::forward(Node *node, DataPacket *packet, int first_output)
+{
+    bool is_moved = false;
+    for (int i = first_output; i < node->output_num; i++)
+    {
+        Edge *edge = node->outputs[i];
+        bool is_pushed = edge->queue->try_push(packet);
+        if (!is_pushed && !edge->is_drop)
+        {
+            // announce the wait before the last try, a stage popping after it sees the flag
+            node->is_blocked.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            is_pushed = edge->queue->try_push(packet);
+            if (is_pushed)
+                node->is_blocked.store(false);
+        }
+        if (is_pushed)
+        {
+            edge->pushed_num.fetch_add(1, std::memory_order_relaxed);
+            update_max(edge->max_occupancy, edge->queue->size());
+            wake(nodes[edge->to]);
+            is_moved = true;
+            continue;
+        }
+        if (edge->is_drop)
+        {
+            edge->dropped_num.fetch_add(1, std::memory_order_relaxed);
+            unref(packet);
+            continue;
+        }
+        // keep it, the stage takes no new packet until every output got this one
+        node->pending = packet;
+        node->pending_output = i;
+        node->blocked_num.fetch_add(1, std::memory_order_relaxed);
+        return is_moved;
+    }
+    node->pending = NULL;
+    node->is_blocked.store(false);
+    return true;
+}
+
+bool DataflowGraph::step(Node *node)
+{
+    if (node->pending != NULL)
+    {
+        return forward(node, node->pending, node->pending_output);
+    }
+
+    DataPacket *packet = NULL;
+    if (node->is_source)
+    {
+        if (*terminate || is_aborted.load())
+        {
+            node->stage->close();
+            finish(node);
+            return true;
+        }
+        if (!node->free_packets->try_pop(packet))
+        {
+            node->starved_num.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        packet->ref_num.store(1, std::memory_order_relaxed);
+        packet->has_bbox = false;
+        packet->seq = node->processed_num.load(std::memory_order_relaxed);
+        packet->source_us = QueueCounters::now_us();
+    }
+    else
+    {
+        size_t input_num = node->inputs.size();
+        Edge *edge = NULL;
+        for (size_t i = 0; i < input_num && packet == NULL; i++)
+        {
+            edge = node->inputs[node->next_input];
+            node->next_input = (node->next_input + 1) % input_num;
+            if (!edge->queue->try_pop(packet))
+                packet = NULL;
+        }
+        if (packet == NULL)
+        {
+            return try_finish(node);
+        }
+        // room on the edge, wake its upstream stage only if it waits for that
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (nodes[edge->from]->is_blocked.load())
+        {
+            wake(nodes[edge->from]);
+        }
+    }
+
+    int64_t start_us = QueueCounters::now_us();
+    bool is_passed = node->stage->process(packet);
+    int64_t end_us = QueueCounters::now_us();
+    node->processed_num.fetch_add(1, std::memory_order_relaxed);
+    node->busy_us_sum.fetch_add(end_us - start_us, std::memory_order_relaxed);
+    update_max(node->busy_us_max, end_us - start_us);
+
+    if (!is_passed)
+    {
+        node->filtered_num.fetch_add(1, std::memory_order_relaxed);
+        unref(packet);
+        if (node->is_source)
+        {
+            // end of stream : stop every other source too, the graph drains and ends
+            *terminate = true;
+            node->stage->close();
+            finish(node);
+            wake_sources();
+        }
+        return true;
+    }
+    if (node->output_num == 0)
+    {
+        uint64_t latency_us = end_us - packet->source_us;
+        node->latency_us_sum.fetch_add(latency_us, std::memory_order_relaxed);
+        update_max(node->latency_us_max, latency_us);
+        unref(packet);
+        return true;
+    }
+    // the reference held by this stage goes to the first output
+    packet->ref_num.fetch_add(node->output_num - 1, std::memory_order_relaxed);
+    forward(node, packet, 0);
+    return true;
+}
+
+bool DataflowGraph::try_finish(Node *node)
+{
+    if (node->pending != NULL)
+        return false;
+    // an upstream stage sets finished after its last push, check the queues after it
+    for (size_t i = 0; i < node->inputs.size(); i++)
+    {
+        if (!nodes[node->inputs[i]->from]->finished.load())
+            return false;
+    }
+    for (size_t i = 0; i < node->inputs.size(); i++)
+    {
+        if (node->inputs[i]->queue->size() != 0)
+            return false;
+    }
+    if (node->is_open)
+        node->stage->close();
+    finish(node);
+    return true;
+}
+
+void DataflowGraph::run_stage(Node *node)
+{
+    // a stage is placed by its name, or by its type if its name has no profile
+    apply_thread_role(node->name.c_str(), node->type.c_str());
+    node->is_open = node->stage->open();
+    if (!node->is_open)
+    {
+        fprintf(stderr, "dataflow stage %s failed to open\n", node->name.c_str());
+        is_aborted.store(true);
+        *terminate = true;
+        // downstream stages still drain what is queued
+        finish(node);
+        wake_sources();
+        return;
+    }
+    while (!node->finished.load())
+    {
+        uint32_t ticket = node->waiter->prepare();
+        if (step(node))
+        {
+            node->waiter->cancel();
+            continue;
+        }
+        node->waiter->wait(ticket);
+    }
+}
+
+bool DataflowGraph::is_pool_finished()
+{
+    for (int i = 0; i < node_num; i++)
+    {
+        if (!nodes[i]->is_source && !nodes[i]->finished.load())
+            return false;
+    }
+    return true;
+}
+
+void DataflowGraph::run_worker()
+{
+    apply_thread_role("dataflow_worker");
+    while (!is_pool_finished())
+    {
+        uint32_t ticket = pool_waiter.prepare();
+        bool is_progress = false;
+        for (int i = 0; i < node_num; i++)
+        {
+            Node *node = nodes[i];
+            if (node->is_source || node->finished.load())
+                continue;
+            // one worker per stage at a time keeps its packets in order
+            if (node->busy.exchange(true, std::memory_order_acquire))
+                continue;
+            if (!node->is_open && !node->finished.load())
+            {
+                node->is_open = node->stage->open();
+                if (!node->is_open)
+                {
+                    fprintf(stderr, "dataflow stage %s failed to open\n", node->name.c_str());
+                    is_aborted.store(true);
+                    *terminate = true;
+                    finish(node);
+                    wake_sources();
+                    is_progress = true;
+                }
+            }
+            if (node->is_open && !node->finished.load())
+            {
+                is_progress |= step(node);
+            }
+            node->busy.store(false, std::memory_order_release);
+        }
+        if (is_progress)
+        {
+            pool_waiter.cancel();
+            continue;
+        }
+        pool_waiter.wait(ticket);
+    }
+    // a worker leaving may be the one the others wait for
+    pool_waiter.notify_all();
+}
+
+bool DataflowGraph::alloc_packets(int source)
+{
+    Node *node = nodes[source];
+    // every raw frame on its own cache lines
+    size_t raw_stride = (raw_bytes + 63) & ~(size_t)63;
+    if (raw_stride > 0)
+    {
+        node->raw_memory = (char *)malloc(raw_stride * node->packet_num);
+        if (node->raw_memory == NULL)
+        {
+            perror("DataflowGraph malloc");
+            return false;
+        }
+    }
+    node->packets = new DataPacket[node->packet_num];
+    node->free_packets = new MpmcQueue<DataPacket *>(node->packet_num);
+    for (int i = 0; i < node->packet_num; i++)
+    {
+        DataPacket *packet = &node->packets[i];
+        packet->raw = (node->raw_memory != NULL) ? node->raw_memory + raw_stride * i : NULL;
+        packet->has_bbox = false;
+        packet->seq = 0;
+        packet->source_us = 0;
+        packet->ref_num.store(0);
+        packet->source = source;
+        node->free_packets->push(packet);
+    }
+    return true;
+}
+
+bool DataflowGraph::start()
+{
+    bool has_source = false;
+    for (int i = 0; i < node_num; i++)
+    {
+        if (nodes[i]->is_source)
+        {
+            has_source = true;
+        }
+        else if (nodes[i]->inputs.empty())
+        {
+            fprintf(stderr, "dataflow stage %s has no input\n", nodes[i]->name.c_str());
+            return false;
+        }
+    }
+    if (!has_source)
+    {
+        fprintf(stderr, "dataflow graph has no source\n");
+        return false;
+    }
+
+    sources.clear();
+    for (int i = 0; i < node_num; i++)
+    {
+        if (nodes[i]->is_source)
+        {
+            if (!alloc_packets(i))
+                return false;
+            sources.push_back(nodes[i]);
+        }
+        // a stage is woken only by the stages around it, on the thread that runs it
+        nodes[i]->waiter = (nodes[i]->is_source || worker_num == 0) ? &nodes[i]->own_waiter : &pool_waiter;
+    }
+    for (int i = 0; i < node_num; i++)
+    {
+        if (nodes[i]->is_source || worker_num == 0)
+        {
+            Node *node = nodes[i];
+            threads.emplace_back([this, node]()
+                                 { run_stage(node); });
+        }
+    }
+    for (int i = 0; i < worker_num; i++)
+    {
+        threads.emplace_back([this]()
+                             { run_worker(); });
+    }
+    return true;
+}
+
+void DataflowGraph::wait()
+{
+    for (auto &t : threads)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    threads.clear();
+}
+
+void DataflowGraph::print_stats()
+{
+    printf("dataflow graph : %d stages, %s\n", node_num,
+           (worker_num == 0) ? "one thread per stage" : "shared workers");
+    for (int i = 0; i < node_num; i++)
+    {
+        Node *node = nodes[i];
+        uint64_t processed = node->processed_num.load();
+        printf("  stage %s (%s) : processed %llu, filtered %llu, avg %.1f us, max %llu us, blocked %llu",
+               node->name.c_str(), node->type.c_str(),
+               (unsigned long long)processed,
+               (unsigned long long)node->filtered_num.load(),
+               processed ? (double)node->busy_us_sum.load() / processed : 0.0,
+               (unsigned long long)node->busy_us_max.load(),
+               (unsigned long long)node->blocked_num.load());
+        if (node->is_source)
+        {
+            printf(", %d packets, no free packet %llu", node->packet_num, (unsigned long long)node->starved_num.load());
+        }
+        if (node->output_num == 0)
+        {
+            uint64_t passed = processed - node->filtered_num.load();
+            printf(", source to sink avg %.1f us, max %llu us",
+                   passed ? (double)node->latency_us_sum.load() / passed : 0.0,
+                   (unsigned long long)node->latency_us_max.load());
+        }
+        printf("\n");
+    }
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        Edge *edge = edges[i];
+        printf("  edge %s -> %s%s : pushed %llu, dropped %llu, max occupancy %llu\n",
+               nodes[edge->from]->name.c_str(), nodes[edge->to]->name.c_str(),
+               edge->is_drop ? " (drop)" : "",
+               (unsigned long long)edge->pushed_num.load(),
+               (unsigned long long)edge->dropped_num.load(),
+               (unsigned long long)edge->max_occupancy.load());
+    }
+}
+
+DataflowGraph::~DataflowGraph()
+{
+    wait();
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        delete edges[i]->queue;
+        delete edges[i];
+    }
+    for (int i = 0; i < node_num; i++)
+    {
+        delete nodes[i]->stage;
+        delete nodes[i]->free_packets;
+        delete[] nodes[i]->packets;
+        free(nodes[i]->raw_memory);
+        delete nodes[i];
+    }
+}
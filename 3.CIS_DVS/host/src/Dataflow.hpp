@@ -0,0 +1,263 @@
+#ifndef DATAFLOW_HPP
+#define DATAFLOW_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FrameQueue.hpp"
+#include "bbox.hpp"
+
+// maximum number of stages in one graph
+#define DATAFLOW_MAX_STAGES 32
+// maximum number of outputs of one stage
+#define DATAFLOW_MAX_OUTPUTS 8
+// default number of packets circulating in a graph
+#define DATAFLOW_PACKET_NUM 64
+// default capacity of an edge queue
+#define DATAFLOW_QUEUE_SIZE 8
+
+/**
+ * one item flowing through a dataflow graph.
+ * every source has its own packets, they return to it after the last stage is done with them,
+ * so a packet only ever carries one kind of frame and its image buffer is reused as is.
+ *
+ * once a stage has several outputs, the branches after it run concurrently on the same packet :
+ *   raw, seq and source_us are read-only after the fan-out,
+ *   image, bbox and has_bbox belong to at most one branch, the only one writing or reading them.
+ * e.g. dvs -> rec (reads raw) and dvs -> stack -> roi (writes image, then bbox).
+ */
+struct DataPacket
+{
+    // raw sensor frame of the graph's raw_bytes
+    char *raw;
+    // decoded / accumulated / camera image
+    cv::Mat image;
+    // ROI in image coordinates, valid if has_bbox
+    Bbox bbox;
+    bool has_bbox;
+    // per-source frame order
+    uint64_t seq;
+    // monotonic time the source produced the packet, in microseconds
+    int64_t source_us;
+    // outputs still holding the packet
+    std::atomic<int> ref_num;
+    // index of the source stage owning the packet
+    int source;
+};
+
+/**
+ * key=value parameters of a stage, from the graph config file
+ */
+class StageParams
+{
+private:
+    std::map<std::string, std::string> values;
+
+public:
+    void set(const char *key, const char *value);
+    bool has(const char *key) const;
+    const char *get_str(const char *key, const char *default_value) const;
+    int get_int(const char *key, int default_value) const;
+    double get_double(const char *key, double default_value) const;
+};
+
+/**
+ * one step of a dataflow graph : source, transform or sink.
+ * a stage is only ever called by one thread at a time, so it can keep state between packets.
+ */
+class Stage
+{
+public:
+    virtual ~Stage();
+    /**
+     * called once before the first packet, from the thread running the stage
+     * @return false to abort the graph
+     */
+    virtual bool open();
+    /**
+     * source : fills packet, returns false at the end of the stream (packet is discarded).
+     * transform / sink : works on packet, returns false to stop it here (filtered).
+     * @param packet packet to fill or process
+     */
+    virtual bool process(DataPacket *packet) = 0;
+    /**
+     * called once after the last packet, from the thread running the stage
+     */
+    virtual void close();
+    /**
+     * @return true if the stage produces packets and has no inputs.
+     * sources always get their own thread, they usually wait on a sensor
+     */
+    virtual bool is_source();
+};
+
+/**
+ * creates a stage from its config type and parameters
+ * @return new stage, NULL if the type is unknown or the parameters are invalid
+ */
+typedef Stage *(*StageFactory)(const char *type, const StageParams &params, void *context);
+
+/**
+ * directed graph of stages connected by bounded queues.
+ *
+ * every source reads packets from its own fixed pool, every edge is a bounded queue.
+ * a full edge makes the upstream stage wait (default) or drops the packet on that edge only (drop edges, for display).
+ * stages run on one thread each, or transforms / sinks share a pool of worker threads ;
+ * either way a stage handles its packets one at a time, in arrival order.
+ * every stage and edge counts its work, print_stats shows where the time goes.
+ *
+ * config file, one statement per line, # starts a comment :
+ *   packets <num>                               packets of each source, default for the stages below
+ *   threads stage | <num>                       one thread per stage, or <num> shared workers
+ *   stage <name> <type> [key=value ...]         adds a stage, see the factory for types,
+ *                                               packets=<num> sets the pool of a source
+ *   edge <from> <to> [queue=<num>] [drop]       connects two stages
+ */
+class DataflowGraph
+{
+private:
+    struct Edge
+    {
+        int from;
+        int to;
+        bool is_drop;
+        MpmcQueue<DataPacket *> *queue;
+        // statistics
+        std::atomic<uint64_t> pushed_num;
+        std::atomic<uint64_t> dropped_num;
+        std::atomic<uint64_t> max_occupancy;
+    };
+
+    struct Node
+    {
+        std::string name;
+        std::string type;
+        Stage *stage;
+        bool is_source;
+        // incoming edges, polled round robin
+        std::vector<Edge *> inputs;
+        size_t next_input;
+        Edge *outputs[DATAFLOW_MAX_OUTPUTS];
+        int output_num;
+        // packet whose outputs were full, and the first output still to push to
+        DataPacket *pending;
+        int pending_output;
+        // claimed by the thread running the stage (pool mode)
+        std::atomic<bool> busy;
+        std::atomic<bool> finished;
+        bool is_open;
+        // packets of a source, returned to free_packets by the last stage using them
+        int packet_num;
+        DataPacket *packets;
+        char *raw_memory;
+        MpmcQueue<DataPacket *> *free_packets;
+        // set while pending waits for room on a full edge, the stage popping from it wakes us
+        std::atomic<bool> is_blocked;
+        // the thread running the stage sleeps on it : own_waiter, or the pool's in pool mode
+        QueueWaiter own_waiter;
+        QueueWaiter *waiter;
+        // statistics
+        std::atomic<uint64_t> processed_num;
+        std::atomic<uint64_t> filtered_num;
+        std::atomic<uint64_t> busy_us_sum;
+        std::atomic<uint64_t> busy_us_max;
+        std::atomic<uint64_t> blocked_num;
+        std::atomic<uint64_t> starved_num;
+        std::atomic<uint64_t> latency_us_sum;
+        std::atomic<uint64_t> latency_us_max;
+    };
+
+    size_t raw_bytes;
+    // pool size of the sources added without their own
+    int packet_num;
+
+    Node *nodes[DATAFLOW_MAX_STAGES];
+    int node_num;
+    std::vector<Edge *> edges;
+    // 0 for one thread per stage
+    int worker_num;
+
+    std::vector<std::thread> threads;
+    // set by an ended source, ESC or a stage failing to open, sources stop producing
+    bool *terminate;
+    std::atomic<bool> is_aborted;
+    // shared by the worker threads, woken for any stage they run
+    QueueWaiter pool_waiter;
+    std::vector<Node *> sources;
+
+    int find_node(const char *name);
+    /**
+     * wakes the thread running node, enters the kernel only if it sleeps
+     */
+    void wake(Node *node);
+    void wake_sources();
+    bool alloc_packets(int source);
+    /**
+     * marks node finished and wakes the stages after it
+     */
+    void finish(Node *node);
+    void unref(DataPacket *packet);
+    bool forward(Node *node, DataPacket *packet, int first_output);
+    bool step(Node *node);
+    bool try_finish(Node *node);
+    void run_stage(Node *node);
+    void run_worker();
+    bool is_pool_finished();
+
+public:
+    /**
+     * @param raw_bytes size of DataPacket::raw, 0 if no stage uses raw frames
+     * @param terminate flag stopping the sources, also set when a source ends or the graph aborts
+     */
+    DataflowGraph(size_t raw_bytes, bool *terminate);
+    /**
+     * @param packet_num packets of each source added afterwards without its own, allocated by start()
+     */
+    void set_packet_num(int packet_num);
+    /**
+     * @param worker_num 0 for one thread per stage, else transforms / sinks share worker_num threads
+     */
+    void set_worker_num(int worker_num);
+    /**
+     * adds a stage, the graph deletes it
+     * @param packet_num packets of a source, 0 for the set_packet_num value
+     * @return stage index, -1 on error
+     */
+    int add_stage(const char *name, const char *type, Stage *stage, int packet_num = 0);
+    /**
+     * connects two stages
+     * @param queue_size capacity of the edge queue
+     * @param is_drop drop packets on this edge when full instead of waiting
+     * @return false on error
+     */
+    bool connect(int from, int to, int queue_size, bool is_drop);
+    /**
+     * builds the graph described by a config file (see the class comment)
+     * @param path config file
+     * @param factory creates stages from their type
+     * @param context passed to factory
+     * @return false on a syntax error, unknown stage or invalid edge (reported with its line)
+     */
+    bool load(const char *path, StageFactory factory, void *context);
+    /**
+     * allocates the packets and launches the threads
+     * @return false if the graph has no source or a stage without inputs
+     */
+    bool start();
+    /**
+     * waits until every source ended (or *terminate was set) and every packet was drained
+     */
+    void wait();
+    /**
+     * prints per-stage and per-edge counters
+     */
+    void print_stats();
+    ~DataflowGraph();
+};
+
+#endif // DATAFLOW_HPP
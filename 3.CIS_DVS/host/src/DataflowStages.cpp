@@ -0,0 +1,300 @@
+#include "DataflowStages.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include "config.hpp"
+#include "CIS.hpp"
+#include "DVS.hpp"
+#include "DvsRoi.hpp"
+#include "ReplaySource.hpp"
+
+/**
+ * @return opened replay source, NULL if path is NULL or holds no frames of record_type
+ */
+static ReplaySource *open_replay(const StageParams &params, int frame_bytes, int record_type)
+{
+    const char *path = params.get_str("replay", NULL);
+    if (path == NULL)
+        return NULL;
+    ReplaySource *replay = new ReplaySource(frame_bytes);
+    if (!replay->open(path, record_type, DVS_TIMESTAMP_TICK_US, DVS_FPS))
+    {
+        printf("no frames to replay in %s, stage stays live\n", path);
+        delete replay;
+        return NULL;
+    }
+    replay->set_speed(params.get_double("speed", 1.0));
+    return replay;
+}
+
+// raw DVS frames from PCIE or a replay
+class DvsSourceStage : public Stage
+{
+private:
+    DVS *dvs;
+    ReplaySource *replay;
+    // set by the DVS object once the replay is finished
+    bool is_ended;
+
+public:
+    DvsSourceStage(DataflowContext *ctx, const StageParams &params) : is_ended(false)
+    {
+        dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, *ctx->display_mutex, NULL, NULL, &is_ended);
+        replay = open_replay(params, dvs->get_frame_bytes(), RECORD_DVS);
+        dvs->set_replay(replay);
+    }
+    bool is_source() { return true; }
+    bool process(DataPacket *packet)
+    {
+        dvs->read_frame(packet->raw);
+        return !is_ended;
+    }
+    ~DvsSourceStage()
+    {
+        delete dvs;
+        delete replay;
+    }
+};
+
+// BGR CIS frames from PCIE or a replay
+class CisSourceStage : public Stage
+{
+private:
+    CIS *cis;
+    ReplaySource *replay;
+    // set by the CIS object once the replay is finished
+    bool is_ended;
+
+public:
+    CisSourceStage(DataflowContext *ctx, const StageParams &params) : is_ended(false)
+    {
+        cis = new CIS(CIS_FRAME_H, CIS_FRAME_W, CIS_FRAME_RDY_BASEADDR, CIS_FRAME_BASEADDR, CIS_BUFFER_NUM, C2H_DEVICE_CIS, H2C_DEVICE_CIS, *ctx->display_mutex, NULL, NULL, &is_ended);
+        replay = open_replay(params, CIS_FRAME_H * CIS_FRAME_W * 3, RECORD_CIS);
+        cis->set_replay(replay);
+    }
+    bool is_source() { return true; }
+    bool process(DataPacket *packet)
+    {
+        // the packets of this source only carry CIS frames : after the first round create keeps the buffer.
+        // a cis_bbox crop leaves a view of it, widened back to the whole frame first
+        if (!packet->image.empty())
+        {
+            cv::Size whole;
+            cv::Point offset;
+            packet->image.locateROI(whole, offset);
+            packet->image.adjustROI(offset.y, whole.height - offset.y - packet->image.rows,
+                                    offset.x, whole.width - offset.x - packet->image.cols);
+        }
+        packet->image.create(CIS_FRAME_H, CIS_FRAME_W, CV_8UC3);
+        cis->read_frame(packet->image);
+        return !is_ended;
+    }
+    ~CisSourceStage()
+    {
+        delete cis;
+        delete replay;
+    }
+};
+
+// stacks raw DVS frames into one 8-bit image
+class AccumulateStage : public Stage
+{
+private:
+    int frame_num;
+    bool is_flip;
+    // frames stacked so far
+    int count;
+    // stacked image, copied to the packet every frame_num frames
+    cv::Mat frame;
+
+public:
+    AccumulateStage(const StageParams &params)
+        : frame_num(params.get_int("frames", DVS_FPS / DISPLAY_FPS)),
+          is_flip(params.get_int("flip", 0) != 0), count(0)
+    {
+    }
+    bool process(DataPacket *packet)
+    {
+        // decoded the way DVS::dvs_roi_proposed does, without a DVS (and its PCIE devices)
+        dvs_decode_count(packet->raw + FRAME_HEADER_BYTES, frame, DVS_FRAME_W, DVS_FRAME_H, count == 0, is_flip);
+        if (++count < frame_num)
+            return false;
+        count = 0;
+        frame.copyTo(packet->image);
+        return true;
+    }
+};
+
+// proposed ROI algorithm on a stacked DVS image
+class RoiStage : public Stage
+{
+private:
+    SharedBbox *bbox;
+    DvsRoiParams roi_params;
+
+public:
+    RoiStage(DataflowContext *ctx, const StageParams &params)
+        : bbox(params.get_int("publish", 1) ? ctx->bbox : NULL)
+    {
+        // same values as DVS::set_CIS in ./main -b
+        roi_params.roi_event_score = ROI_EVENT_SCORE;
+        roi_params.row_score_threshold = ROW_SCORE_THRESHOLD;
+        roi_params.roi_height_min_threshold = ROI_HEIGHT_MIN_THRESHOLD;
+        roi_params.roi_min_size = CIS_ROI_MIN_SIZE;
+        roi_params.roi_inflation_ratio = ROI_INFLATION;
+        roi_params.convert_cis = true;
+        roi_params.cis_x_scale = CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W;
+        roi_params.cis_y_scale = CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H;
+        roi_params.cis_x_offset = (int)(CIS_DVS_OFFSET_X * CIS_FRAME_W);
+        roi_params.cis_y_offset = (int)(CIS_DVS_OFFSET_Y * CIS_FRAME_H);
+        roi_params.cis_frame_w = CIS_FRAME_W;
+        roi_params.cis_frame_h = CIS_FRAME_H;
+    }
+    bool process(DataPacket *packet)
+    {
+        Bbox b_box_dvs, b_box_cis;
+        packet->has_bbox = dvs_roi_alg_proposed(packet->image, roi_params, &b_box_dvs, &b_box_cis) != 0;
+        packet->bbox = b_box_dvs;
+        if (bbox != NULL)
+        {
+            if (packet->has_bbox)
+                bbox->publish(b_box_cis, true, packet->seq);
+            else
+                bbox->invalidate(packet->seq);
+        }
+        return true;
+    }
+};
+
+// attaches the shared ROI to CIS frames, optionally cropping it out
+class CisBboxStage : public Stage
+{
+private:
+    SharedBbox *bbox;
+    bool is_crop;
+
+public:
+    CisBboxStage(DataflowContext *ctx, const StageParams &params)
+        : bbox(ctx->bbox), is_crop(params.get_int("crop", 0) != 0)
+    {
+    }
+    bool process(DataPacket *packet)
+    {
+        // what CIS::scale_bbox does, without a CIS (and its PCIE devices)
+        BboxSnapshot latest;
+        bbox->read(latest);
+        Bbox b_box = latest.bbox;
+        packet->has_bbox = CIS::is_valid_bbox(latest, CIS_FRAME_W, CIS_FRAME_H);
+        if (!is_crop)
+        {
+            packet->bbox = b_box;
+            return true;
+        }
+        if (!packet->has_bbox)
+            return false;
+        cv::Rect rect(b_box.lx, b_box.ly, b_box.hx - b_box.lx, b_box.hy - b_box.ly);
+        rect &= cv::Rect(0, 0, packet->image.cols, packet->image.rows);
+        if (rect.area() == 0)
+            return false;
+        // a view, the cis source widens it back when the packet returns
+        packet->image = packet->image(rect);
+        packet->has_bbox = false;
+        return true;
+    }
+};
+
+// shows the image and its bbox through the presenter
+class DisplayStage : public Stage
+{
+private:
+    Presenter *presenter;
+    std::string window;
+    // the packet may be shared with other stages, draw on a copy
+    cv::Mat view;
+
+public:
+    DisplayStage(DataflowContext *ctx, const StageParams &params)
+        : presenter(ctx->presenter), window(params.get_str("window", "dataflow"))
+    {
+    }
+    bool open()
+    {
+        if (presenter == NULL)
+            fprintf(stderr, "display stage %s needs a presenter\n", window.c_str());
+        return presenter != NULL;
+    }
+    bool process(DataPacket *packet)
+    {
+        if (packet->image.empty())
+            return true;
+        if (!packet->has_bbox)
+        {
+            presenter->post(window.c_str(), packet->image);
+            return true;
+        }
+        packet->image.copyTo(view);
+        cv::Point p1(packet->bbox.lx, packet->bbox.ly);
+        cv::Point p2(packet->bbox.hx, packet->bbox.hy);
+        cv::Scalar color = (view.channels() == 1) ? cv::Scalar(255) : cv::Scalar(255, 0, 0);
+        cv::rectangle(view, p1, p2, color, 2, cv::LINE_8);
+        presenter->post(window.c_str(), view);
+        return true;
+    }
+};
+
+// appends raw DVS frames to a bin file
+class StoreStage : public Stage
+{
+private:
+    std::string path;
+    std::ofstream file;
+    size_t frame_bytes;
+
+public:
+    StoreStage(const StageParams &params)
+        : path(params.get_str("path", "")),
+          frame_bytes((DVS_FRAME_H * DVS_FRAME_W) / 4 + FRAME_HEADER_BYTES)
+    {
+    }
+    bool open()
+    {
+        file.open(path.c_str(), std::ios::binary | std::ios::app);
+        if (!file.is_open())
+        {
+            perror("Failed to open file for writing.");
+            return false;
+        }
+        return true;
+    }
+    bool process(DataPacket *packet)
+    {
+        file.write(packet->raw, frame_bytes);
+        return true;
+    }
+    void close()
+    {
+        file.close();
+        printf("recorded DVS frames to %s\n", path.c_str());
+    }
+};
+
+Stage *create_dataflow_stage(const char *type, const StageParams &params, void *context)
+{
+    DataflowContext *ctx = (DataflowContext *)context;
+    if (strcmp(type, "dvs") == 0)
+        return new DvsSourceStage(ctx, params);
+    if (strcmp(type, "cis") == 0)
+        return new CisSourceStage(ctx, params);
+    if (strcmp(type, "accumulate") == 0)
+        return (params.get_int("frames", 1) > 0) ? new AccumulateStage(params) : NULL;
+    if (strcmp(type, "roi") == 0)
+        return new RoiStage(ctx, params);
+    if (strcmp(type, "cis_bbox") == 0)
+        return new CisBboxStage(ctx, params);
+    if (strcmp(type, "display") == 0)
+        return new DisplayStage(ctx, params);
+    if (strcmp(type, "store") == 0)
+        return params.has("path") ? new StoreStage(params) : NULL;
+    return NULL;
+}
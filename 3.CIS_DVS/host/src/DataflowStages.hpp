@@ -0,0 +1,44 @@
+#ifndef DATAFLOWSTAGES_HPP
+#define DATAFLOWSTAGES_HPP
+
+#include "Dataflow.hpp"
+#include "MutexManager.hpp"
+#include "SharedBbox.hpp"
+#include "Presenter.hpp"
+
+/**
+ * objects shared by the stages of one graph, owned by the caller
+ */
+struct DataflowContext
+{
+    // display mutex handed to the DVS / CIS objects of the sources
+    MutexManager *display_mutex;
+    // ROI published by roi stages, read by cis_bbox stages
+    SharedBbox *bbox;
+    // display thread used by display stages, NULL if the graph has no display
+    Presenter *presenter;
+};
+
+/**
+ * StageFactory for the CIS / DVS stages, context is a DataflowContext.
+ * only the sources open the PCIE devices, transforms and sinks work on the packets alone.
+ *
+ * the fields each stage writes / reads are given for the fan-out rules of DataPacket.
+ *
+ * sources :
+ *   dvs [replay=<file>] [speed=<x>]          raw DVS frames (PCIE or replayed bin / recording)       writes raw
+ *   cis [replay=<file>] [speed=<x>]          BGR CIS frames (PCIE or replayed recording)             writes image
+ * transforms :
+ *   accumulate [frames=<n>] [flip=<0|1>]     stacks n raw DVS frames into one 8-bit image,           reads raw, writes image
+ *                                            passes every n-th packet
+ *   roi [publish=<0|1>]                      proposed ROI on the stacked image, publishes it to      reads image, writes bbox
+ *                                            the shared bbox
+ *   cis_bbox [crop=<0|1>]                    attaches the shared bbox scaled to CIS, crop=1 cuts     writes bbox, image if crop
+ *                                            it out and filters frames without ROI
+ * sinks :
+ *   display [window=<name>]                  shows the image and its bbox through the presenter     reads image, bbox
+ *   store path=<file>                        appends raw DVS frames to a bin file (./main -w format) reads raw
+ */
+Stage *create_dataflow_stage(const char *type, const StageParams &params, void *context);
+
+#endif // DATAFLOWSTAGES_HPP
@@ -0,0 +1,310 @@
+#include "DvsRoi.hpp"
+
+void dvs_draw_square_roi(Bbox *b_box, int x_min, int y_min, int x_max, int y_max, int width, int height,
+                         int roi_min_size, float roi_inflation_ratio)
+{
+    // draw square ROI around given x and y coordinate ranges
+    // while making sure ROI doesn't exceed the entire frame
+
+    // move coordinates to inside the frame
+    if (x_min < 0)
+        x_min = 0;
+    if (y_min < 0)
+        y_min = 0;
+    if (x_max >= width)
+        x_max = width - 1;
+    if (y_max >= height)
+        y_max = height - 1;
+
+    // determine square ROI size
+    int inflated_size = (int)(roi_inflation_ratio * (x_max - x_min));
+    if (inflated_size > height)
+    {
+        inflated_size = height;
+    }
+    else if (inflated_size < roi_min_size)
+    {
+        inflated_size = roi_min_size;
+    }
+
+    int inflated_size_y = (int)(roi_inflation_ratio * (y_max - y_min));
+    if (inflated_size_y > height)
+    {
+        inflated_size_y = height;
+    }
+    else if (inflated_size_y < roi_min_size)
+    {
+        inflated_size_y = roi_min_size;
+    }
+
+    // give margin around x_max and x_min to determine ROI position
+    int min_offset = (inflated_size - (x_max - x_min)) >> 1;
+
+    // if ROI exceeds frame, move it inside
+    if (x_min - min_offset < 0)
+    {
+        b_box->lx = 0;
+        b_box->hx = inflated_size - 1;
+    }
+    else if (x_min + inflated_size - min_offset >= width)
+    {
+        b_box->hx = width;
+        b_box->lx = width - inflated_size + 1;
+    }
+    else
+    {
+        b_box->lx = x_min - min_offset;
+        b_box->hx = x_min - min_offset + inflated_size - 1;
+    }
+
+    // give margin around y_max and y_min to determine ROI position
+    int min_offset_y = (inflated_size_y - (y_max - y_min)) >> 1;
+
+    // if ROI exceeds frame, move it inside
+    if (y_min - min_offset_y < 0)
+    {
+        b_box->ly = 0;
+        b_box->hy = inflated_size_y - 1;
+    }
+    else if (y_min + inflated_size_y - min_offset_y >= height)
+    {
+        b_box->hy = height;
+        b_box->ly = height - inflated_size_y + 1;
+    }
+    else
+    {
+        b_box->ly = y_min - min_offset_y;
+        b_box->hy = y_min - min_offset_y + inflated_size_y - 1;
+    }
+}
+
+int dvs_pixel_count(uint8_t x)
+{
+    // calculate how many 2-bit events happen inside 8-bit word
+    int cnt = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (x && 0x03)
+            cnt++;
+        x = x >> 2;
+    }
+    return cnt;
+}
+
+void dvs_decode_count(const char *frame_start, cv::Mat &frame, int frame_w, int frame_h, bool is_first, bool is_flip)
+{
+    if (is_first)
+    {
+        // every pixel is written below, the frame is only allocated once
+        frame.create(frame_h, frame_w, CV_8UC1);
+        for (int h = 0; h < frame_h; h++)
+        {
+            for (int byteIndex = 0; byteIndex < (frame_w >> 2); ++byteIndex)
+            {
+                // apply a simple spatial filter before written to frame.
+                // 8-bit word that includes current pixel U 8-bit word 1 row before.
+                // if these 8 pixels contain less than 2 pixels, current pixel not written to frame.
+                uint8_t prev_pixel = (h == 0) ? 0 : (frame_start[(h - 1) * (frame_w >> 2) + byteIndex]);
+                uint8_t cur_pixel = frame_start[h * (frame_w >> 2) + byteIndex];
+                uint8_t pixel_count_val = dvs_pixel_count(prev_pixel) + dvs_pixel_count(cur_pixel);
+
+                for (int bitOffset = 0; bitOffset < 8; bitOffset += 2)
+                {
+                    uint8_t pixel = (cur_pixel >> bitOffset) & 0x03; // Extract 2 bits
+                    int frame_idx;
+                    // if DVS flipped, write to frame upside down
+                    if (is_flip)
+                    {
+                        frame_idx = (frame_h - h - 1) * frame_w + (byteIndex << 2) + (bitOffset >> 1);
+                    }
+                    else
+                    {
+                        frame_idx = h * frame_w + (byteIndex << 2) + (bitOffset >> 1);
+                    }
+                    // write gray pixel values
+                    if (pixel_count_val >= 2 && pixel == 1)
+                    {
+                        frame.data[frame_idx] = 224;
+                    }
+                    else if (pixel_count_val >= 2 && pixel == 2)
+                    {
+                        frame.data[frame_idx] = 32;
+                    }
+                    else
+                    {
+                        frame.data[frame_idx] = 128;
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        for (int h = 0; h < frame_h; h++)
+        {
+            for (int byteIndex = 0; byteIndex < (frame_w >> 2); ++byteIndex)
+            {
+                // apply a simple spatial filter before written to frame.
+                // 8-bit word that includes current pixel U 8-bit word 1 row before.
+                // if these 8 pixels contain less than 2 pixels, current pixel not written to frame.
+                uint8_t prev_pixel = (h == 0) ? 0 : (frame_start[(h - 1) * (frame_w >> 2) + byteIndex]);
+                uint8_t cur_pixel = frame_start[h * (frame_w >> 2) + byteIndex];
+                uint8_t pixel_count_val = dvs_pixel_count(prev_pixel) + dvs_pixel_count(cur_pixel);
+                if (pixel_count_val >= 2)
+                {
+                    for (int bitOffset = 0; bitOffset < 8; bitOffset += 2)
+                    {
+                        uint8_t pixel = (cur_pixel >> bitOffset) & 0x03; // Extract 2 bits
+                        int frame_idx;
+                        // if DVS flipped, write to frame upside down
+                        if (is_flip)
+                        {
+                            frame_idx = (frame_h - h - 1) * frame_w + (byteIndex << 2) + (bitOffset >> 1);
+                        }
+                        else
+                        {
+                            frame_idx = h * frame_w + (byteIndex << 2) + (bitOffset >> 1);
+                        }
+                        // accumulate to gray pixels (functionality not used for now)
+                        if (frame.data[frame_idx] > 128)
+                        {
+                            if (pixel != 0)
+                                frame.data[frame_idx] += 1;
+                        }
+                        else if (frame.data[frame_idx] < 128)
+                        {
+                            if (pixel != 0)
+                                frame.data[frame_idx] -= 1;
+                        }
+                        // stack frames, overwriting pixels with no events
+                        else if (pixel == 1)
+                        {
+                            frame.data[frame_idx] = 224;
+                        }
+                        else if (pixel == 2)
+                        {
+                            frame.data[frame_idx] = 32;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+int dvs_roi_alg_proposed(const cv::Mat &frame, const DvsRoiParams &params, Bbox *dvs, Bbox *cis)
+{
+    const int frame_w = frame.cols;
+    const int frame_h = frame.rows;
+    int row_start_idx = 0;
+    // final roi values
+    int global_x_min = frame_w, global_x_max = 0;
+    int global_y_min = 0, global_y_max = -1;
+    // height-wise line width threshold apply
+    int roi_row_streak = 0;
+    // calculate x-direction min, max for a few rows
+    int candidate_x_min, candidate_x_max;
+    candidate_x_min = frame_w;
+    candidate_x_max = 0;
+    // calculate max sum of consecutive partial sequence
+    // where some values are -1 and others are roi_event_score(currently 5)
+    for (int h = 0; h < frame_h; h++)
+    {
+        int local_max_score = 0, local_cur_score = 0;
+        int local_max_left = frame_w, local_max_right = 0;
+        int local_cur_score_left = 0;
+        // incremental algorithm
+        for (int w = 0; w < frame_w; w++)
+        {
+            // cur_val : current score of sequence element
+            int cur_val;
+            int pix_val = frame.data[row_start_idx + w];
+            if (pix_val > 128)
+            {
+                cur_val = params.roi_event_score; // 2+width_count;//((pix_val-128)>>2)+width_count;
+            }
+            else if (pix_val < 128)
+            {
+                cur_val = params.roi_event_score; // 2+width_count;//((128-pix_val)>>2)+width_count;
+            }
+            else
+            {
+                cur_val = -1;
+            }
+            // local_cur_score : max value of partial sequence whose right end is w
+            local_cur_score = local_cur_score + cur_val;
+            // if local_cur_score < 0, 0(no elements in partial sequence) is larger, empty sequence corresponding to local_cur_score
+            if (local_cur_score < 0)
+            {
+                local_cur_score = 0;
+                // set the left end of partial sequence to current sequence element
+                local_cur_score_left = w;
+            }
+            // record maximum partial consecutive sequence
+            // and its left & right ends
+            if (local_cur_score > local_max_score)
+            {
+                local_max_score = local_cur_score;
+                local_max_left = local_cur_score_left;
+                local_max_right = w;
+            }
+        }
+        // printf("row %d min %d max %d local_max_score = %d\n", h,local_max_left, local_max_right, local_max_score );
+        // if max score exceeds threshold
+        if (local_max_score >= params.row_score_threshold)
+        {
+            roi_row_streak++;
+            // union max & min with few adjacent rows
+            if (local_max_left < candidate_x_min)
+                candidate_x_min = local_max_left;
+            if (local_max_right > candidate_x_max)
+                candidate_x_max = local_max_right;
+            // if consecutive rows' max score exceed params.row_score_threshold
+            // modify final ROI
+            if (roi_row_streak >= params.roi_height_min_threshold)
+            {
+                if (global_y_min == 0)
+                    global_y_min = h - params.roi_height_min_threshold + 1;
+                global_y_max = h;
+                if (candidate_x_min < global_x_min)
+                    global_x_min = candidate_x_min;
+                if (candidate_x_max > global_x_max)
+                    global_x_max = candidate_x_max;
+            }
+        }
+        else
+        {
+            // if consecutive rows don't exist
+            // initialize max, min and row count
+            candidate_x_min = frame_w;
+            candidate_x_max = 0;
+            roi_row_streak = 0;
+        }
+        row_start_idx += frame_w;
+    }
+    if (global_y_max != -1)
+    {
+        // if valid ROI is detected
+        //  printf("%d %d %d %d\n", global_x_min, global_y_min, global_x_max, global_y_max);
+        // draw dvs ROI
+        dvs_draw_square_roi(dvs, global_x_min, global_y_min, global_x_max, global_y_max, frame_w, frame_h,
+                            params.roi_min_size, params.roi_inflation_ratio);
+        if (params.convert_cis)
+        {
+            // convert DVS coordinates to CIS
+            int x_min = (int)(params.cis_x_scale * global_x_min) + params.cis_x_offset;
+            int y_min = (int)(params.cis_y_scale * global_y_min) + params.cis_y_offset;
+            int x_max = (int)(params.cis_x_scale * global_x_max) + params.cis_x_offset;
+            int y_max = (int)(params.cis_y_scale * global_y_max) + params.cis_y_offset;
+            // draw ROI for CIS
+            dvs_draw_square_roi(cis, x_min, y_min, x_max, y_max, params.cis_frame_w, params.cis_frame_h,
+                                params.roi_min_size, params.roi_inflation_ratio);
+        }
+        // return if valid ROI detected
+        return 1;
+    }
+    else
+    {
+        return 0;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef DVSROI_HPP
+#define DVSROI_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+
+#include "bbox.hpp"
+
+/**
+ * parameters of the proposed DVS ROI algorithm, see DVS::set_CIS and DVS::set_DVS_ROI
+ */
+struct DvsRoiParams
+{
+    // score of a pixel with an event, pixels without events score -1
+    int roi_event_score;
+    // min score for considering particular row as part of final ROI
+    int row_score_threshold;
+    // required number of consecutive rows with high scores
+    int roi_height_min_threshold;
+    // minimum ROI bounding box size (in pixels)
+    int roi_min_size;
+    // enlarge bounding box size to center and zoom out ROI
+    float roi_inflation_ratio;
+    // if true, the ROI is also converted to CIS coordinates with the values below
+    bool convert_cis;
+    float cis_x_scale;
+    float cis_y_scale;
+    int cis_x_offset;
+    int cis_y_offset;
+    int cis_frame_w;
+    int cis_frame_h;
+};
+
+/*
+ * DVS frame decoding and the proposed ROI algorithm, without a sensor connection.
+ * DVS runs them on the frames it reads, dataflow stages on frames read by a source stage.
+ */
+
+/**
+ * draws a square ROI around the given coordinate ranges, moved to inside the frame
+ * @param[out] b_box bounding box
+ * @param width width of target frame
+ * @param height height of target frame
+ * @param roi_min_size minimum ROI bounding box size (in pixels)
+ * @param roi_inflation_ratio enlarge bounding box size to center and zoom out ROI
+ */
+void dvs_draw_square_roi(Bbox *b_box, int x_min, int y_min, int x_max, int y_max, int width, int height,
+                         int roi_min_size, float roi_inflation_ratio);
+/**
+ * @return number of events in 8-bit word of the 2-bit frame
+ */
+int dvs_pixel_count(uint8_t x);
+/**
+ * converts a raw 2-bit DVS frame to an 8-bit grayscale frame with a simple spatial filter
+ * (pixels with less than 2 events in their word and the word above are dropped)
+ * @param frame_start 2-bit frame, header excluded
+ * @param[in,out] frame 8-bit frame, allocated once if is_first
+ * @param is_first true to overwrite frame, false to stack onto it (pixels with events only)
+ * @param is_flip if the DVS is flipped upside down using a mirror.
+ */
+void dvs_decode_count(const char *frame_start, cv::Mat &frame, int frame_w, int frame_h, bool is_first, bool is_flip);
+/**
+ * incremental algorithm to obtain ROI
+ * @param frame 8-bit frame from dvs_decode_count, only read
+ * @param[out] dvs ROI that fits inside DVS frame
+ * @param[out] cis ROI that fits inside CIS frame, only written if params.convert_cis
+ * @return if there is detected roi, 1. else, 0.
+ */
+int dvs_roi_alg_proposed(const cv::Mat &frame, const DvsRoiParams &params, Bbox *dvs, Bbox *cis);
+
+#endif // DVSROI_HPP
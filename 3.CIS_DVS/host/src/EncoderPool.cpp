@@ -0,0 +1,164 @@
+#include "EncoderPool.hpp"
+
+#include <stdio.h>
+#include "ThreadTopology.hpp"
+
+EncoderPool::EncoderPool(int frame_h, int frame_w, int mat_type, int slot_num, EncodePolicy policy)
+    : policy(policy),
+      is_video(false), color_code(-1),
+      stop_workers(false),
+      submitted_num(0), dropped_num(0)
+{
+    // allocate every frame up front
+    slots.resize(slot_num);
+    free_slots.reserve(slot_num);
+    for (int i = 0; i < slot_num; i++)
+    {
+        slots[i].create(frame_h, frame_w, mat_type);
+        free_slots.push_back(&slots[i]);
+    }
+}
+
+void EncoderPool::set_color_conversion(int code)
+{
+    color_code = code;
+}
+
+bool EncoderPool::open_png(const char *output_folder, int worker_num)
+{
+    this->output_folder = output_folder;
+    is_video = false;
+    for (int i = 0; i < worker_num; i++)
+    {
+        workers.push_back(start_role_thread("encoder", [this]()
+                                            { worker_loop(); }));
+    }
+    return true;
+}
+
+bool EncoderPool::open_video(const char *output_vid_name, int fourcc, double fps, bool is_color)
+{
+    video_writer.open(output_vid_name, fourcc, fps, cv::Size(slots[0].cols, slots[0].rows), is_color);
+    if (!video_writer.isOpened())
+    {
+        fprintf(stderr, "Failed to open video %s\n", output_vid_name);
+        return false;
+    }
+    is_video = true;
+    // a single writer keeps the frames in submit order
+    workers.push_back(start_role_thread("encoder", [this]()
+                                        { worker_loop(); }));
+    return true;
+}
+
+cv::Mat *EncoderPool::acquire()
+{
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    if (free_slots.empty())
+    {
+        if (policy == ENCODE_DROP)
+        {
+            dropped_num++;
+            return NULL;
+        }
+        slot_cond.wait(lock, [this]
+                       { return !free_slots.empty(); });
+    }
+    cv::Mat *slot = free_slots.back();
+    free_slots.pop_back();
+    return slot;
+}
+
+void EncoderPool::submit(cv::Mat *slot, int frame_idx)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    Job job;
+    job.slot = slot;
+    job.frame_idx = frame_idx;
+    jobs.push_back(job);
+    submitted_num++;
+    job_cond.notify_one();
+}
+
+void EncoderPool::release(cv::Mat *slot)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    free_slots.push_back(slot);
+    slot_cond.notify_one();
+}
+
+void EncoderPool::encode(const Job &job, cv::Mat &converted)
+{
+    const cv::Mat *out = job.slot;
+    if (color_code >= 0)
+    {
+        cv::cvtColor(*job.slot, converted, color_code);
+        out = &converted;
+    }
+
+    if (is_video)
+    {
+        video_writer.write(*out);
+        return;
+    }
+
+    // Generate filename for the PNG image
+    char filename[32];
+    snprintf(filename, sizeof(filename), "/frame_%05d.png", job.frame_idx);
+    cv::imwrite(output_folder + filename, *out);
+}
+
+void EncoderPool::worker_loop()
+{
+    // per-worker conversion buffer, allocated once
+    cv::Mat converted;
+
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    while (1)
+    {
+        job_cond.wait(lock, [this]
+                      { return stop_workers || !jobs.empty(); });
+        if (jobs.empty())
+            break;
+
+        Job job = jobs.front();
+        jobs.pop_front();
+        lock.unlock();
+
+        encode(job, converted);
+
+        lock.lock();
+        free_slots.push_back(job.slot);
+        slot_cond.notify_one();
+    }
+}
+
+void EncoderPool::close()
+{
+    if (workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        stop_workers = true;
+        job_cond.notify_all();
+    }
+    for (auto &t : workers)
+    {
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+    workers.clear();
+    if (is_video)
+    {
+        video_writer.release();
+    }
+    printf("encoded frames : %d, dropped frames : %d\n", submitted_num, dropped_num);
+}
+
+EncoderPool::~EncoderPool()
+{
+    close();
+}
@@ -0,0 +1,136 @@
+#ifndef ENCODERPOOL_HPP
+#define ENCODERPOOL_HPP
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// default number of png encoding threads
+#define ENCODER_WORKER_NUM 4
+// default number of preallocated frames waiting to be encoded
+#define ENCODER_SLOT_NUM 16
+
+/**
+ * what acquire() does when every frame slot is waiting to be encoded
+ */
+enum EncodePolicy
+{
+    // wait for a free slot, no frame is lost (offline conversion)
+    ENCODE_BLOCK,
+    // return NULL immediately and count the frame as dropped (live capture)
+    ENCODE_DROP
+};
+
+/**
+ * bounded pool of encoder threads that owns png / video encoding and file writes.
+ *
+ * the producer takes a preallocated frame slot with acquire(), fills it
+ * (reading or converting directly into it, or copying into it), and hands it over with submit().
+ * png frames are written in parallel, each to a file named after the index given to submit().
+ * video frames are written by a single thread in submit order.
+ */
+class EncoderPool
+{
+private:
+    /**
+     * frame waiting to be encoded
+     */
+    struct Job
+    {
+        cv::Mat *slot;
+        int frame_idx;
+    };
+
+    // preallocated frames
+    std::vector<cv::Mat> slots;
+    // slots not in use
+    std::vector<cv::Mat *> free_slots;
+    // submitted frames, in submit order
+    std::deque<Job> jobs;
+    EncodePolicy policy;
+
+    // png output folder
+    std::string output_folder;
+    // video output, used instead of png files if opened
+    cv::VideoWriter video_writer;
+    bool is_video;
+    // color conversion applied before writing, -1 for none
+    int color_code;
+
+    std::mutex pool_mutex;
+    // signaled when a job is submitted
+    std::condition_variable job_cond;
+    // signaled when a slot is freed
+    std::condition_variable slot_cond;
+    bool stop_workers;
+    std::vector<std::thread> workers;
+
+    // statistics
+    int submitted_num;
+    int dropped_num;
+
+    /**
+     * worker thread : encodes and writes submitted frames
+     */
+    void worker_loop();
+    /**
+     * encodes and writes one frame, called without holding pool_mutex
+     */
+    void encode(const Job &job, cv::Mat &converted);
+
+public:
+    /**
+     * @param frame_h height of frames
+     * @param frame_w width of frames
+     * @param mat_type opencv type of frames (CV_8UC1, CV_8UC3, ...)
+     * @param slot_num number of preallocated frames
+     * @param policy behavior of acquire() when no slot is free
+     */
+    EncoderPool(int frame_h, int frame_w, int mat_type, int slot_num, EncodePolicy policy);
+    /**
+     * sets a cv::cvtColor code the workers apply before writing (e.g. cv::COLOR_BGR2RGB)
+     * must be called before open_png / open_video
+     */
+    void set_color_conversion(int code);
+    /**
+     * starts png workers, frame i is written to <output_folder>/frame_<i>.png
+     * @param output_folder existing folder for png images
+     * @param worker_num number of encoding threads
+     */
+    bool open_png(const char *output_folder, int worker_num = ENCODER_WORKER_NUM);
+    /**
+     * opens a video file and starts a single worker writing frames in submit order
+     * @param output_vid_name path to output video
+     * @param fourcc codec of output video
+     * @param fps frame rate of output video
+     * @param is_color true for 3 channel frames
+     * @return true if the video file could be opened
+     */
+    bool open_video(const char *output_vid_name, int fourcc, double fps, bool is_color);
+    /**
+     * takes a free frame slot
+     * @return frame slot, or NULL with ENCODE_DROP when every slot is in use
+     */
+    cv::Mat *acquire();
+    /**
+     * hands a filled slot to the workers
+     * @param slot slot from acquire(), must not be touched afterwards
+     * @param frame_idx index used in the png file name
+     */
+    void submit(cv::Mat *slot, int frame_idx);
+    /**
+     * returns an acquired slot without encoding it
+     */
+    void release(cv::Mat *slot);
+    /**
+     * encodes all submitted frames and stops the workers
+     */
+    void close();
+    ~EncoderPool();
+};
+
+#endif // ENCODERPOOL_HPP
@@ -0,0 +1,231 @@
+#include "EventPyramid.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+EventPyramid::EventPyramid(int frame_w, int frame_h, int window_num, int level_num)
+    : frame_w(frame_w), frame_h(frame_h),
+      window_num((window_num < 1) ? 1 : window_num),
+      cell_w(frame_w >> 2), cell_num((frame_w >> 2) * frame_h),
+      total_sum(0), is_dirty(false), next_idx(0), frame_num(0)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        // a 2-bit pixel is an event if it is not 0
+        event_lut[i] = ((i & 0x03) != 0) + ((i & 0x0c) != 0) + ((i & 0x30) != 0) + ((i & 0xc0) != 0);
+    }
+    frame_cells = (uint8_t *)calloc((size_t)this->window_num * cell_num, sizeof(uint8_t));
+    frame_sums.assign(this->window_num, 0);
+    total_cells = (int *)calloc(cell_num, sizeof(int));
+    sat = (int *)calloc((size_t)(cell_w + 1) * (frame_h + 1), sizeof(int));
+    if (frame_cells == NULL || total_cells == NULL || sat == NULL)
+    {
+        // the frame ring alone is window_num x frame_w / 4 x frame_h bytes
+        perror("EventPyramid calloc");
+        free(frame_cells);
+        free(total_cells);
+        free(sat);
+        frame_cells = NULL;
+        total_cells = NULL;
+        sat = NULL;
+        return;
+    }
+
+    levels.resize((level_num < 0) ? 0 : level_num);
+    for (int l = 0; l < (int)levels.size(); l++)
+    {
+        levels[l].assign(level_w(l) * level_h(l), 0);
+    }
+}
+
+int EventPyramid::count_cells(int cx0, int y0, int cx1, int y1) const
+{
+    const int stride = cell_w + 1;
+    return sat[y1 * stride + cx1] - sat[y0 * stride + cx1] - sat[y1 * stride + cx0] + sat[y0 * stride + cx0];
+}
+
+void EventPyramid::push(const uint8_t *packed, bool is_flip)
+{
+    uint8_t *cells = frame_cells + (size_t)next_idx * cell_num;
+    // the slot holds the oldest frame once the window is full, its counts are replaced below
+    if (frame_num == window_num)
+    {
+        total_sum -= frame_sums[next_idx];
+    }
+    else
+    {
+        frame_num++;
+    }
+
+    // count the new frame and update the window totals in one pass
+    int sum = 0;
+    for (int h = 0; h < frame_h; h++)
+    {
+        const uint8_t *src = packed + h * cell_w;
+        const int row = is_flip ? frame_h - 1 - h : h;
+        uint8_t *dst = cells + row * cell_w;
+        int *total = total_cells + row * cell_w;
+        for (int c = 0; c < cell_w; c++)
+        {
+            int n = event_lut[src[c]];
+            total[c] += n - dst[c];
+            dst[c] = n;
+            sum += n;
+        }
+    }
+    frame_sums[next_idx] = sum;
+    total_sum += sum;
+    next_idx = (next_idx + 1) % window_num;
+    is_dirty = true;
+}
+
+void EventPyramid::refresh() const
+{
+    if (!is_dirty)
+    {
+        return;
+    }
+    is_dirty = false;
+
+    // summed-area table, row by row from the row above
+    const int stride = cell_w + 1;
+    for (int y = 0; y < frame_h; y++)
+    {
+        const int *total = total_cells + y * cell_w;
+        const int *above = sat + y * stride;
+        int *out = sat + (y + 1) * stride;
+        int row_sum = 0;
+        for (int c = 0; c < cell_w; c++)
+        {
+            row_sum += total[c];
+            out[c + 1] = above[c + 1] + row_sum;
+        }
+    }
+
+    update_levels();
+}
+
+void EventPyramid::update_levels() const
+{
+    for (int l = 0; l < (int)levels.size(); l++)
+    {
+        const int side = block_size(l);
+        const int w = level_w(l), h = level_h(l);
+        int *out = levels[l].data();
+        for (int by = 0; by < h; by++)
+        {
+            const int y0 = by * side;
+            const int y1 = (y0 + side < frame_h) ? y0 + side : frame_h;
+            for (int bx = 0; bx < w; bx++)
+            {
+                const int cx0 = (bx * side) >> 2;
+                const int cx1 = (cx0 + (side >> 2) < cell_w) ? cx0 + (side >> 2) : cell_w;
+                out[by * w + bx] = count_cells(cx0, y0, cx1, y1);
+            }
+        }
+    }
+}
+
+int EventPyramid::count(int x_min, int y_min, int x_max, int y_max) const
+{
+    // move coordinates to inside the frame
+    if (x_min < 0)
+        x_min = 0;
+    if (y_min < 0)
+        y_min = 0;
+    if (x_max >= frame_w)
+        x_max = frame_w - 1;
+    if (y_max >= frame_h)
+        y_max = frame_h - 1;
+    if (x_min > x_max || y_min > y_max)
+        return 0;
+    refresh();
+    return count_cells(x_min >> 2, y_min, (x_max >> 2) + 1, y_max + 1);
+}
+
+int EventPyramid::count(const Bbox &b_box) const
+{
+    return count(b_box.lx, b_box.ly, b_box.hx, b_box.hy);
+}
+
+float EventPyramid::density(const Bbox &b_box) const
+{
+    int x_min = (b_box.lx < 0) ? 0 : b_box.lx;
+    int y_min = (b_box.ly < 0) ? 0 : b_box.ly;
+    int x_max = (b_box.hx >= frame_w) ? frame_w - 1 : b_box.hx;
+    int y_max = (b_box.hy >= frame_h) ? frame_h - 1 : b_box.hy;
+    if (x_min > x_max || y_min > y_max)
+        return 0.0;
+    // area of the rectangle widened to whole cells
+    int area = (((x_max >> 2) + 1 - (x_min >> 2)) << 2) * (y_max - y_min + 1);
+    refresh();
+    return (float)count_cells(x_min >> 2, y_min, (x_max >> 2) + 1, y_max + 1) / area;
+}
+
+int EventPyramid::get_level_num() const
+{
+    return (int)levels.size();
+}
+
+int EventPyramid::block_size(int level) const
+{
+    return 8 << level;
+}
+
+int EventPyramid::level_w(int level) const
+{
+    return (frame_w + block_size(level) - 1) / block_size(level);
+}
+
+int EventPyramid::level_h(int level) const
+{
+    return (frame_h + block_size(level) - 1) / block_size(level);
+}
+
+const int *EventPyramid::level_counts(int level) const
+{
+    refresh();
+    return levels[level].data();
+}
+
+int EventPyramid::densest_block(int level, Bbox *b_box) const
+{
+    refresh();
+    const std::vector<int> &counts = levels[level];
+    int best = 0;
+    for (int i = 1; i < (int)counts.size(); i++)
+    {
+        if (counts[i] > counts[best])
+            best = i;
+    }
+    const int side = block_size(level);
+    const int w = level_w(level);
+    b_box->lx = (best % w) * side;
+    b_box->ly = (best / w) * side;
+    b_box->hx = (b_box->lx + side <= frame_w) ? b_box->lx + side - 1 : frame_w - 1;
+    b_box->hy = (b_box->ly + side <= frame_h) ? b_box->ly + side - 1 : frame_h - 1;
+    return counts.empty() ? 0 : counts[best];
+}
+
+int EventPyramid::sum() const
+{
+    return total_sum;
+}
+
+bool EventPyramid::is_full() const
+{
+    return frame_num == window_num;
+}
+
+bool EventPyramid::is_allocated() const
+{
+    return frame_cells != NULL;
+}
+
+EventPyramid::~EventPyramid()
+{
+    free(frame_cells);
+    free(total_cells);
+    free(sat);
+}
@@ -0,0 +1,123 @@
+#ifndef EVENTPYRAMID_HPP
+#define EVENTPYRAMID_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "bbox.hpp"
+
+/**
+ * event counts of the last window_num DVS frames, for O(1) rectangle queries.
+ *
+ * every packed frame is counted per cell of 4 pixels x 1 row (one byte of the 2-bit frame).
+ * push only adds the new frame to the window totals and subtracts the frame leaving the window.
+ * the summed-area table of the totals (a rectangle count is 4 lookups) and the levels are
+ * rebuilt on the first query after a push, so frames between two queries cost one pass each.
+ * level l holds the event count of every square block of (8 << l) pixels, for coarse
+ * multi-scale searches.
+ * queries rebuild shared tables, call them from the thread that pushes.
+ * rectangles are widened to whole cells, so queried columns are rounded to multiples of 4.
+ *
+ * usage : push(frame_start, is_flip) after every read_frame -> count(b_box) / density(b_box) ...
+ */
+class EventPyramid
+{
+private:
+    int frame_w, frame_h;
+    int window_num;
+    // cells per row, cells per frame
+    int cell_w;
+    int cell_num;
+    // events of every byte value of the 2-bit frame
+    uint8_t event_lut[256];
+
+    // cell counts of the frames in the window, a ring of window_num frames
+    uint8_t *frame_cells;
+    std::vector<int> frame_sums;
+    // cell counts over the window
+    int *total_cells;
+    int total_sum;
+    // summed-area table of total_cells, (cell_w + 1) x (frame_h + 1) with a zero first row / column
+    mutable int *sat;
+
+    // block counts of every level
+    mutable std::vector<std::vector<int>> levels;
+    // true once a frame was pushed after the last rebuild of sat and levels
+    mutable bool is_dirty;
+
+    // ring position of the next frame
+    int next_idx;
+    // frames in the window
+    int frame_num;
+
+    /**
+     * events in the cells [cx0, cx1) x [y0, y1)
+     */
+    int count_cells(int cx0, int y0, int cx1, int y1) const;
+    /**
+     * rebuilds sat and levels from total_cells if a frame was pushed since the last query
+     */
+    void refresh() const;
+    void update_levels() const;
+
+public:
+    /**
+     * @param frame_w width of DVS frame (multiple of 4)
+     * @param frame_h height of DVS frame
+     * @param window_num number of frames in the window
+     * @param level_num number of block levels, blocks of 8, 16, 32 ... pixels
+     */
+    EventPyramid(int frame_w, int frame_h, int window_num, int level_num = 4);
+    /**
+     * @return false if the counters could not be allocated, the pyramid must not be used then
+     */
+    bool is_allocated() const;
+    EventPyramid(const EventPyramid &) = delete;
+    EventPyramid &operator=(const EventPyramid &) = delete;
+
+    /**
+     * adds a frame to the window, the oldest frame leaves it once the window is full
+     * @param packed 2-bit frame, frame_w / 4 bytes per row
+     * @param is_flip if true, row h is counted as row frame_h - 1 - h (like roi_count_average)
+     */
+    void push(const uint8_t *packed, bool is_flip = false);
+
+    /**
+     * @return events over the window in (x_min, y_min) - (x_max, y_max), inclusive and clamped to the frame
+     */
+    int count(int x_min, int y_min, int x_max, int y_max) const;
+    int count(const Bbox &b_box) const;
+    /**
+     * @return events per pixel over the window inside b_box (area of the widened rectangle), 0 if empty
+     */
+    float density(const Bbox &b_box) const;
+
+    int get_level_num() const;
+    /**
+     * @return block side of level in pixels
+     */
+    int block_size(int level) const;
+    int level_w(int level) const;
+    int level_h(int level) const;
+    /**
+     * @return events of every block of level, level_w x level_h in row order
+     */
+    const int *level_counts(int level) const;
+    /**
+     * @param[out] b_box block of level with the most events (the first one on ties)
+     * @return events in that block
+     */
+    int densest_block(int level, Bbox *b_box) const;
+
+    /**
+     * @return events over the window
+     */
+    int sum() const;
+    /**
+     * @return true once window_num frames were pushed
+     */
+    bool is_full() const;
+    ~EventPyramid();
+};
+
+#endif // EVENTPYRAMID_HPP
@@ -0,0 +1,220 @@
+#include "FrameBroadcast.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ThreadTopology.hpp"
+
+// slot_frame value while the producer fills a slot
+#define SLOT_WRITING UINT64_MAX
+
+FrameBroadcast::FrameBroadcast(size_t frame_bytes, int slot_num, const char *producer_role)
+    : frame_bytes(frame_bytes), slot_num(slot_num),
+      head(0), closed(false), producer_wait_num(0)
+{
+    slot_bytes = (frame_bytes + 63) & ~(size_t)63;
+    ring = (char *)malloc(slot_bytes * slot_num);
+    if (ring == NULL)
+    {
+        perror("FrameBroadcast malloc");
+        exit(EXIT_FAILURE);
+    }
+    if (producer_role != NULL)
+    {
+        place_thread_buffer(ring, slot_bytes * slot_num, producer_role);
+    }
+    slot_frame = new std::atomic<uint64_t>[slot_num];
+    for (int i = 0; i < slot_num; i++)
+    {
+        slot_frame[i].store(SLOT_WRITING);
+    }
+    for (int i = 0; i < BROADCAST_MAX_SUBSCRIBERS; i++)
+    {
+        subscribers[i].active.store(false);
+        subscribers[i].policy = BROADCAST_LATEST;
+        subscribers[i].name = NULL;
+        subscribers[i].cursor.store(0);
+        subscribers[i].delivered_num.store(0);
+        subscribers[i].dropped_num.store(0);
+        subscribers[i].max_lag.store(0);
+    }
+}
+
+int FrameBroadcast::subscribe(BroadcastPolicy policy, const char *name)
+{
+    std::lock_guard<std::mutex> lock(subscribe_mutex);
+    for (int i = 0; i < BROADCAST_MAX_SUBSCRIBERS; i++)
+    {
+        Subscriber &sub = subscribers[i];
+        if (sub.active.load())
+            continue;
+        sub.policy = policy;
+        sub.name = name;
+        sub.delivered_num.store(0);
+        sub.dropped_num.store(0);
+        sub.max_lag.store(0);
+        // the frame being written (if any) is the first one this subscriber may read,
+        // so the producer never overwrites a frame this subscriber still needs
+        sub.cursor.store(head.load());
+        sub.active.store(true);
+        return i;
+    }
+    printf("FrameBroadcast : no free subscriber slot for %s\n", name);
+    return -1;
+}
+
+void FrameBroadcast::unsubscribe(int id)
+{
+    std::lock_guard<std::mutex> lock(subscribe_mutex);
+    subscribers[id].active.store(false);
+    // the producer may be waiting for this subscriber
+    slot_free.notify_all();
+}
+
+bool FrameBroadcast::is_writable(uint64_t frame)
+{
+    if (frame < (uint64_t)slot_num)
+        return true;
+    for (int i = 0; i < BROADCAST_MAX_SUBSCRIBERS; i++)
+    {
+        Subscriber &sub = subscribers[i];
+        if (!sub.active.load(std::memory_order_acquire) || sub.policy != BROADCAST_NO_DROP)
+            continue;
+        // acquire : the subscriber finished copying every frame before its cursor
+        if (frame - sub.cursor.load(std::memory_order_acquire) >= (uint64_t)slot_num)
+            return false;
+    }
+    return true;
+}
+
+char *FrameBroadcast::begin_write()
+{
+    uint64_t frame = head.load(std::memory_order_relaxed);
+    if (!is_writable(frame))
+    {
+        producer_wait_num.fetch_add(1, std::memory_order_relaxed);
+        while (true)
+        {
+            uint32_t ticket = slot_free.prepare();
+            if (closed.load())
+            {
+                slot_free.cancel();
+                return NULL;
+            }
+            if (is_writable(frame))
+            {
+                slot_free.cancel();
+                break;
+            }
+            slot_free.wait(ticket);
+        }
+    }
+    if (closed.load(std::memory_order_relaxed))
+        return NULL;
+
+    int slot = frame % slot_num;
+    // latest-only readers still copying this slot see the change and retry
+    slot_frame[slot].store(SLOT_WRITING, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return ring + slot_bytes * slot;
+}
+
+void FrameBroadcast::commit()
+{
+    uint64_t frame = head.load(std::memory_order_relaxed);
+    slot_frame[frame % slot_num].store(frame, std::memory_order_release);
+    head.store(frame + 1, std::memory_order_release);
+    frame_ready.notify_all();
+}
+
+bool FrameBroadcast::read(int id, char *dst)
+{
+    Subscriber &sub = subscribers[id];
+    while (true)
+    {
+        uint64_t cursor = sub.cursor.load(std::memory_order_relaxed);
+        uint64_t committed = head.load(std::memory_order_acquire);
+        if (cursor >= committed)
+        {
+            uint32_t ticket = frame_ready.prepare();
+            if (cursor < head.load(std::memory_order_acquire))
+            {
+                frame_ready.cancel();
+                continue;
+            }
+            if (closed.load())
+            {
+                frame_ready.cancel();
+                return false;
+            }
+            frame_ready.wait(ticket);
+            continue;
+        }
+
+        uint64_t lag = committed - cursor;
+        if (lag > sub.max_lag.load(std::memory_order_relaxed))
+            sub.max_lag.store(lag, std::memory_order_relaxed);
+
+        if (sub.policy == BROADCAST_NO_DROP)
+        {
+            // the producer does not touch this slot until the cursor moves past it
+            memcpy(dst, ring + slot_bytes * (cursor % slot_num), frame_bytes);
+            sub.cursor.store(cursor + 1, std::memory_order_release);
+            sub.delivered_num.fetch_add(1, std::memory_order_relaxed);
+            slot_free.notify_one();
+            return true;
+        }
+
+        // latest only : skip to the newest frame, retry if it is overwritten while copying
+        uint64_t frame = committed - 1;
+        std::atomic<uint64_t> &tag = slot_frame[frame % slot_num];
+        if (tag.load(std::memory_order_acquire) != frame)
+            continue;
+        memcpy(dst, ring + slot_bytes * (frame % slot_num), frame_bytes);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (tag.load(std::memory_order_relaxed) != frame)
+            continue;
+        sub.dropped_num.fetch_add(frame - cursor, std::memory_order_relaxed);
+        sub.cursor.store(frame + 1, std::memory_order_relaxed);
+        sub.delivered_num.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+}
+
+void FrameBroadcast::close()
+{
+    closed.store(true);
+    frame_ready.notify_all();
+    slot_free.notify_all();
+}
+
+size_t FrameBroadcast::get_frame_bytes()
+{
+    return frame_bytes;
+}
+
+void FrameBroadcast::print_stats(const char *name)
+{
+    printf("%s : %llu frames read once, producer waited %llu times for no-drop sinks\n",
+           name,
+           (unsigned long long)head.load(),
+           (unsigned long long)producer_wait_num.load());
+    for (int i = 0; i < BROADCAST_MAX_SUBSCRIBERS; i++)
+    {
+        Subscriber &sub = subscribers[i];
+        if (sub.name == NULL)
+            continue;
+        printf("  %s (%s) : delivered %llu, dropped %llu, max lag %llu frames\n",
+               sub.name,
+               (sub.policy == BROADCAST_NO_DROP) ? "no drop" : "latest only",
+               (unsigned long long)sub.delivered_num.load(),
+               (unsigned long long)sub.dropped_num.load(),
+               (unsigned long long)sub.max_lag.load());
+    }
+}
+
+FrameBroadcast::~FrameBroadcast()
+{
+    delete[] slot_frame;
+    free(ring);
+}
@@ -0,0 +1,132 @@
+#ifndef FRAMEBROADCAST_HPP
+#define FRAMEBROADCAST_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include "FrameQueue.hpp"
+
+// maximum number of sinks attached to one broadcast
+#define BROADCAST_MAX_SUBSCRIBERS 8
+
+/**
+ * what a subscriber does when it falls behind the producer
+ */
+enum BroadcastPolicy
+{
+    // every frame is delivered, the producer waits for this subscriber when the ring is full (recording)
+    BROADCAST_NO_DROP,
+    // only the newest frame is delivered, older frames are skipped and counted (display, ROI)
+    BROADCAST_LATEST
+};
+
+/**
+ * single-producer multi-consumer ring of raw frames.
+ *
+ * one reader thread fills the ring (frames are read from the sensor once),
+ * each subscriber has its own cursor and copies frames out at its own pace.
+ * subscribers can be added and removed while the producer is running,
+ * a new subscriber starts at the next committed frame.
+ */
+class FrameBroadcast
+{
+private:
+    struct Subscriber
+    {
+        // slot taken, cursor and policy are valid
+        std::atomic<bool> active;
+        BroadcastPolicy policy;
+        const char *name;
+        // index of the next frame to deliver
+        std::atomic<uint64_t> cursor;
+        // statistics
+        std::atomic<uint64_t> delivered_num;
+        std::atomic<uint64_t> dropped_num;
+        std::atomic<uint64_t> max_lag;
+    };
+
+    size_t frame_bytes;
+    int slot_num;
+    // slot_num frames of frame_bytes, each starting on its own cache line
+    char *ring;
+    size_t slot_bytes;
+    // frame index held by each slot, UINT64_MAX while the producer writes it
+    std::atomic<uint64_t> *slot_frame;
+
+    char pad0[64];
+    // number of committed frames
+    std::atomic<uint64_t> head;
+    char pad1[64];
+    std::atomic<bool> closed;
+
+    Subscriber subscribers[BROADCAST_MAX_SUBSCRIBERS];
+    // serializes subscribe / unsubscribe, never taken by the frame path
+    std::mutex subscribe_mutex;
+
+    // consumers waiting for a new frame
+    QueueWaiter frame_ready;
+    // producer waiting for no-drop subscribers
+    QueueWaiter slot_free;
+
+    // statistics
+    std::atomic<uint64_t> producer_wait_num;
+
+    /**
+     * @return true if the slot of frame can be overwritten
+     */
+    bool is_writable(uint64_t frame);
+
+public:
+    /**
+     * @param frame_bytes size of one raw frame
+     * @param slot_num number of frames kept in the ring, the lag a no-drop subscriber may build up
+     * @param producer_role thread role of the producer, the ring is placed on its NUMA node (see ThreadTopology.hpp)
+     */
+    FrameBroadcast(size_t frame_bytes, int slot_num, const char *producer_role = NULL);
+    /**
+     * attaches a sink, it receives frames committed after this call
+     * @param policy lag policy of the sink
+     * @param name name shown in print_stats
+     * @return subscriber id, -1 if BROADCAST_MAX_SUBSCRIBERS sinks are attached
+     */
+    int subscribe(BroadcastPolicy policy, const char *name);
+    /**
+     * detaches a sink, the producer stops waiting for it
+     * @param id subscriber id returned by subscribe
+     */
+    void unsubscribe(int id);
+    /**
+     * producer only : returns the slot for the next frame,
+     * waiting while a no-drop subscriber still has to read it
+     * @return slot of frame_bytes to fill, NULL if the broadcast was closed
+     */
+    char *begin_write();
+    /**
+     * producer only : publishes the slot returned by begin_write to every subscriber
+     */
+    void commit();
+    /**
+     * copies the next frame of a subscriber, waiting until one is committed
+     * @param id subscriber id returned by subscribe
+     * @param[out] dst buffer of frame_bytes
+     * @return false once the broadcast is closed and every frame of this subscriber was delivered
+     */
+    bool read(int id, char *dst);
+    /**
+     * ends the stream, wakes the producer and every subscriber
+     */
+    void close();
+    /**
+     * @return size of one frame
+     */
+    size_t get_frame_bytes();
+    /**
+     * prints producer and per-subscriber counters
+     * @param name broadcast name shown in the first line
+     */
+    void print_stats(const char *name);
+    ~FrameBroadcast();
+};
+
+#endif // FRAMEBROADCAST_HPP
@@ -0,0 +1,120 @@
+#ifndef FRAMEPOOL_HPP
+#define FRAMEPOOL_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "FrameQueue.hpp"
+
+class FramePool;
+
+/**
+ * reference-counted handle to one frame of a FramePool.
+ *
+ * copies share the same frame, the frame goes back to the pool when the last handle is released.
+ * mat() wraps the pool memory without copying, so the returned cv::Mat
+ * must not be used after every handle to the frame was released.
+ */
+class FrameHandle
+{
+private:
+    // owning pool, NULL for an empty handle
+    FramePool *pool;
+    // frame slot in the pool
+    int idx;
+
+    friend class FramePool;
+
+public:
+    FrameHandle();
+    FrameHandle(const FrameHandle &other);
+    FrameHandle &operator=(const FrameHandle &other);
+    ~FrameHandle();
+    /**
+     * drops this reference, the frame is returned to the pool if it was the last one
+     */
+    void release();
+    /**
+     * @return true if the handle holds no frame
+     */
+    bool empty() const;
+    /**
+     * @return cv::Mat header over the pool memory of this frame (no copy),
+     *         an empty cv::Mat for an empty handle
+     */
+    cv::Mat mat() const;
+};
+
+/**
+ * fixed number of equally sized frames allocated once, handed out as FrameHandle.
+ * frames are shared between threads by copying handles instead of cloning cv::Mat,
+ * so capture and display loops do no heap allocation once the pool exists.
+ */
+class FramePool
+{
+private:
+    struct Slot
+    {
+        // header over this slot's part of memory
+        cv::Mat mat;
+        // number of handles holding this slot
+        std::atomic<int> ref_num;
+    };
+
+    // single allocation holding every frame
+    char *memory;
+    size_t frame_bytes;
+    Slot *slots;
+    int slot_num;
+    // indices of slots without handles
+    MpmcQueue<int> *free_slots;
+
+    // statistics
+    std::atomic<uint64_t> acquire_num;
+    std::atomic<uint64_t> exhausted_num;
+
+    friend class FrameHandle;
+    void retain(int idx);
+    void unref(int idx);
+
+public:
+    /**
+     * @param frame_h height of frames
+     * @param frame_w width of frames
+     * @param mat_type opencv type of frames (CV_8UC1, CV_8UC3, ...)
+     * @param slot_num number of frames
+     */
+    FramePool(int frame_h, int frame_w, int mat_type, int slot_num);
+    /**
+     * takes a free frame, never waits
+     * @param[out] handle receives the frame, its previous frame is released
+     * @return false if every frame is in use
+     */
+    bool try_acquire(FrameHandle &handle);
+    /**
+     * takes a free frame, waiting until one is released
+     * @param[out] handle receives the frame, its previous frame is released
+     * @return false if the pool was closed
+     */
+    bool acquire(FrameHandle &handle);
+    /**
+     * wakes threads waiting in acquire()
+     */
+    void close();
+    /**
+     * @return number of frames currently without handles
+     */
+    size_t available();
+    /**
+     * prints acquire counters in one line
+     * @param name pool name shown in the line
+     */
+    void print_stats(const char *name);
+    /**
+     * every handle must be released before the pool is destroyed
+     */
+    ~FramePool();
+};
+
+#endif // FRAMEPOOL_HPP
@@ -0,0 +1,439 @@
+#ifndef FRAMEQUEUE_HPP
+#define FRAMEQUEUE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+
+/**
+ * snapshot of the counters kept by every queue
+ */
+struct QueueStats
+{
+    // items handed over
+    uint64_t push_num;
+    uint64_t pop_num;
+    // try_push calls rejected because the queue was full
+    uint64_t full_num;
+    // times a producer slept on a full queue / a consumer slept on an empty queue
+    uint64_t push_wait_num;
+    uint64_t pop_wait_num;
+    // highest number of queued items seen after a push
+    uint64_t max_occupancy;
+    // time between push and pop in microseconds
+    uint64_t latency_sum_us;
+    uint64_t latency_max_us;
+};
+
+/**
+ * occupancy and latency counters of one queue.
+ * updated with relaxed atomics, so they can be read while the queue is running.
+ */
+class QueueCounters
+{
+private:
+    std::atomic<uint64_t> push_num;
+    std::atomic<uint64_t> pop_num;
+    std::atomic<uint64_t> full_num;
+    std::atomic<uint64_t> push_wait_num;
+    std::atomic<uint64_t> pop_wait_num;
+    std::atomic<uint64_t> max_occupancy;
+    std::atomic<uint64_t> latency_sum_us;
+    std::atomic<uint64_t> latency_max_us;
+
+public:
+    QueueCounters();
+    void on_push(uint64_t occupancy);
+    void on_pop(int64_t push_us);
+    void on_full();
+    void on_push_wait();
+    void on_pop_wait();
+    QueueStats snapshot();
+    /**
+     * prints counters in one line
+     * @param name queue name shown in the line
+     */
+    void print(const char *name);
+    /**
+     * @return monotonic time in microseconds, used to stamp queued items
+     */
+    static int64_t now_us();
+};
+
+/**
+ * futex based sleep / wake-up used by the queues.
+ * threads only sleep when the queue is empty or full,
+ * and notify only enters the kernel when a thread is actually sleeping.
+ *
+ * usage on the waiting side :
+ *   ticket = prepare(); recheck the queue; then either cancel() or wait(ticket)
+ */
+class QueueWaiter
+{
+private:
+    // bumped by every notify, the futex word
+    std::atomic<uint32_t> seq;
+    // threads between prepare() and the end of wait() / cancel()
+    std::atomic<int> waiter_num;
+
+public:
+    QueueWaiter();
+    uint32_t prepare();
+    void cancel();
+    /**
+     * sleeps unless notify was called since prepare returned ticket
+     */
+    void wait(uint32_t ticket);
+    void notify_one();
+    void notify_all();
+};
+
+/**
+ * bounded single-producer single-consumer ring queue.
+ * push and pop are lock-free, blocking variants sleep on a futex only when full / empty.
+ * capacity is rounded up to a power of two.
+ */
+template <typename T>
+class SpscQueue
+{
+private:
+    struct Cell
+    {
+        T value;
+        int64_t push_us;
+    };
+    Cell *cells;
+    size_t mask;
+    // producer and consumer positions, on separate cache lines
+    char pad0[64];
+    std::atomic<size_t> tail;
+    char pad1[64];
+    std::atomic<size_t> head;
+    char pad2[64];
+    std::atomic<bool> closed;
+    QueueWaiter not_empty;
+    QueueWaiter not_full;
+    QueueCounters counters;
+
+public:
+    /**
+     * @param capacity maximum number of queued items
+     */
+    SpscQueue(size_t capacity) : tail(0), head(0), closed(false)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        cells = new Cell[size];
+        mask = size - 1;
+    }
+    /**
+     * @return false if the queue is full or closed
+     */
+    bool try_push(const T &value)
+    {
+        if (closed.load(std::memory_order_relaxed))
+            return false;
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask)
+        {
+            counters.on_full();
+            return false;
+        }
+        cells[t & mask].value = value;
+        cells[t & mask].push_us = QueueCounters::now_us();
+        tail.store(t + 1, std::memory_order_release);
+        counters.on_push(t + 1 - head.load(std::memory_order_relaxed));
+        not_empty.notify_one();
+        return true;
+    }
+    /**
+     * @return false if the queue is empty
+     */
+    bool try_pop(T &value)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = cells[h & mask].value;
+        counters.on_pop(cells[h & mask].push_us);
+        head.store(h + 1, std::memory_order_release);
+        not_full.notify_one();
+        return true;
+    }
+    /**
+     * pushes, sleeping while the queue is full
+     * @return false if the queue was closed
+     */
+    bool push(const T &value)
+    {
+        while (!try_push(value))
+        {
+            if (closed.load())
+                return false;
+            uint32_t ticket = not_full.prepare();
+            if (closed.load() || tail.load() - head.load() <= mask)
+            {
+                not_full.cancel();
+                continue;
+            }
+            counters.on_push_wait();
+            not_full.wait(ticket);
+        }
+        return true;
+    }
+    /**
+     * pops, sleeping while the queue is empty
+     * @return false once the queue is closed and drained
+     */
+    bool pop(T &value)
+    {
+        while (!try_pop(value))
+        {
+            uint32_t ticket = not_empty.prepare();
+            if (head.load() != tail.load())
+            {
+                not_empty.cancel();
+                continue;
+            }
+            if (closed.load())
+            {
+                not_empty.cancel();
+                return false;
+            }
+            counters.on_pop_wait();
+            not_empty.wait(ticket);
+        }
+        return true;
+    }
+    /**
+     * rejects further pushes and wakes every sleeping thread,
+     * queued items can still be popped
+     */
+    void close()
+    {
+        closed.store(true);
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+    /**
+     * @return number of queued items
+     */
+    size_t size()
+    {
+        return tail.load() - head.load();
+    }
+    size_t capacity()
+    {
+        return mask + 1;
+    }
+    QueueStats stats()
+    {
+        return counters.snapshot();
+    }
+    void print_stats(const char *name)
+    {
+        counters.print(name);
+    }
+    ~SpscQueue()
+    {
+        delete[] cells;
+    }
+};
+
+/**
+ * bounded multi-producer multi-consumer ring queue (per-cell sequence numbers).
+ * push and pop are lock-free, blocking variants sleep on a futex only when full / empty.
+ * capacity is rounded up to a power of two, at least 2.
+ */
+template <typename T>
+class MpmcQueue
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T value;
+        int64_t push_us;
+    };
+    Cell *cells;
+    size_t mask;
+    // producer and consumer positions, on separate cache lines
+    char pad0[64];
+    std::atomic<size_t> enqueue_pos;
+    char pad1[64];
+    std::atomic<size_t> dequeue_pos;
+    char pad2[64];
+    std::atomic<bool> closed;
+    QueueWaiter not_empty;
+    QueueWaiter not_full;
+    QueueCounters counters;
+
+public:
+    /**
+     * @param capacity maximum number of queued items
+     */
+    MpmcQueue(size_t capacity) : enqueue_pos(0), dequeue_pos(0), closed(false)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        cells = new Cell[size];
+        for (size_t i = 0; i < size; i++)
+        {
+            cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+    }
+    /**
+     * @return false if the queue is full or closed
+     */
+    bool try_push(const T &value)
+    {
+        if (closed.load(std::memory_order_relaxed))
+            return false;
+        Cell *cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (1)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                counters.on_full();
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->push_us = QueueCounters::now_us();
+        cell->seq.store(pos + 1, std::memory_order_release);
+        counters.on_push(pos + 1 - dequeue_pos.load(std::memory_order_relaxed));
+        not_empty.notify_one();
+        return true;
+    }
+    /**
+     * @return false if the queue is empty
+     */
+    bool try_pop(T &value)
+    {
+        Cell *cell;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (1)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = cell->value;
+        counters.on_pop(cell->push_us);
+        cell->seq.store(pos + mask + 1, std::memory_order_release);
+        not_full.notify_one();
+        return true;
+    }
+    /**
+     * pushes, sleeping while the queue is full
+     * @return false if the queue was closed
+     */
+    bool push(const T &value)
+    {
+        while (!try_push(value))
+        {
+            if (closed.load())
+                return false;
+            uint32_t ticket = not_full.prepare();
+            if (closed.load() || size() <= mask)
+            {
+                not_full.cancel();
+                continue;
+            }
+            counters.on_push_wait();
+            not_full.wait(ticket);
+        }
+        return true;
+    }
+    /**
+     * pops, sleeping while the queue is empty
+     * @return false once the queue is closed and drained
+     */
+    bool pop(T &value)
+    {
+        while (!try_pop(value))
+        {
+            uint32_t ticket = not_empty.prepare();
+            if (size() > 0)
+            {
+                not_empty.cancel();
+                continue;
+            }
+            if (closed.load())
+            {
+                not_empty.cancel();
+                return false;
+            }
+            counters.on_pop_wait();
+            not_empty.wait(ticket);
+        }
+        return true;
+    }
+    /**
+     * rejects further pushes and wakes every sleeping thread,
+     * queued items can still be popped
+     */
+    void close()
+    {
+        closed.store(true);
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+    /**
+     * @return number of queued items (approximate while producers / consumers are active)
+     */
+    size_t size()
+    {
+        size_t enq = enqueue_pos.load();
+        size_t deq = dequeue_pos.load();
+        return (enq > deq) ? enq - deq : 0;
+    }
+    size_t capacity()
+    {
+        return mask + 1;
+    }
+    QueueStats stats()
+    {
+        return counters.snapshot();
+    }
+    void print_stats(const char *name)
+    {
+        counters.print(name);
+    }
+    ~MpmcQueue()
+    {
+        delete[] cells;
+    }
+};
+
+#endif // FRAMEQUEUE_HPP
@@ -0,0 +1,96 @@
+#ifndef REPLAYSOURCE_HPP
+#define REPLAYSOURCE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include "RecordingFormat.hpp"
+
+/**
+ * frame source replaying a recorded file in place of the PCIE connection.
+ * attach it with DVS::set_replay / CIS::set_replay, read_frame then copies frames from the file.
+ *
+ * supported files :
+ *   > bin file from DVS_STORE mode (DVS only), paced by the header timestamps
+ *   > recording from CIS_DVS_RECORD mode (CIS or DVS), paced by the recorded arrival times
+ *
+ * speed 1 replays at the original rate, N replays N times faster, 0 replays as fast as possible.
+ */
+class ReplaySource
+{
+private:
+    // mapped file
+    const char *base;
+    size_t file_bytes;
+    // bytes copied per frame
+    int frame_bytes;
+    // file offset of every frame
+    std::vector<size_t> offsets;
+    // presentation time of every frame in microseconds, relative to the first frame
+    std::vector<int64_t> times_us;
+
+    // replay state
+    std::mutex replay_mutex;
+    size_t read_idx;
+    double speed;
+    bool is_loop;
+    bool is_finished;
+    std::chrono::steady_clock::time_point start_time;
+    bool is_started;
+
+    // statistics
+    uint64_t delivered_num;
+    int loop_num;
+
+    /**
+     * indexes a DVS_STORE bin file
+     */
+    bool index_bin(int header_bytes, double timestamp_tick_us, double nominal_fps);
+    /**
+     * indexes the records of one type in a CIS_DVS_RECORD recording
+     */
+    bool index_recording(int record_type);
+
+public:
+    /**
+     * @param frame_bytes size of one frame as expected by read_frame
+     */
+    ReplaySource(int frame_bytes);
+    /**
+     * maps a bin file or recording and builds the frame index
+     * @param path path to replayed file
+     * @param record_type RECORD_CIS or RECORD_DVS, plain bin files only hold DVS frames
+     * @param timestamp_tick_us duration of one header timestamp tick (bin files only)
+     * @param nominal_fps frame rate used where header timestamps are unusable (bin files only)
+     * @return true if the file holds at least one frame of the requested type
+     */
+    bool open(const char *path, int record_type, double timestamp_tick_us, double nominal_fps);
+    /**
+     * @param speed 1 for original rate, N for N times faster, 0 for no pacing
+     */
+    void set_speed(double speed);
+    /**
+     * @param loop restart from the first frame at the end instead of finishing
+     */
+    void set_loop(bool loop);
+    /**
+     * copies the next frame, waiting until its presentation time.
+     * multithreading-safe
+     * @param[out] dst buffer of frame_bytes bytes
+     * @return false once the file is finished (never when looping)
+     */
+    bool read(char *dst);
+    /**
+     * @return true if every frame has been delivered and looping is off
+     */
+    bool finished();
+    /**
+     * @return number of frames in the file
+     */
+    int get_frame_num();
+    ~ReplaySource();
+};
+
+#endif // REPLAYSOURCE_HPP
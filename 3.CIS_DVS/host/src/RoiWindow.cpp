@@ -0,0 +1,103 @@
+#include "RoiWindow.hpp"
+
+#include <stdlib.h>
+
+RoiWindow::RoiWindow(int frame_w, int frame_h, int window_num)
+    : frame_w(frame_w), frame_h(frame_h),
+      window_num((window_num < 1) ? 1 : window_num),
+      total_sum(0), next_idx(0), frame_num(0)
+{
+    next_x = (int *)calloc(frame_w, sizeof(int));
+    next_y = (int *)calloc(frame_h, sizeof(int));
+    total_x = (int *)calloc(frame_w, sizeof(int));
+    total_y = (int *)calloc(frame_h, sizeof(int));
+    frames.resize(this->window_num);
+    // a frame never has more entries than columns / rows, so push never allocates
+    for (int i = 0; i < this->window_num; i++)
+    {
+        frames[i].cols.reserve(frame_w);
+        frames[i].rows.reserve(frame_h);
+        frames[i].sum = 0;
+    }
+}
+
+int *RoiWindow::frame_x_count()
+{
+    return next_x;
+}
+
+int *RoiWindow::frame_y_count()
+{
+    return next_y;
+}
+
+void RoiWindow::collect(int *count, int *total, int len, std::vector<SparseCount> &sparse)
+{
+    sparse.clear();
+    for (int i = 0; i < len; i++)
+    {
+        if (count[i] == 0)
+            continue;
+        SparseCount entry = {(uint16_t)i, (uint16_t)count[i]};
+        sparse.push_back(entry);
+        total[i] += count[i];
+        count[i] = 0;
+    }
+}
+
+void RoiWindow::expire(int *total, const std::vector<SparseCount> &sparse)
+{
+    for (size_t i = 0; i < sparse.size(); i++)
+    {
+        total[sparse[i].idx] -= sparse[i].count;
+    }
+}
+
+void RoiWindow::push(int sum)
+{
+    FrameCounts &slot = frames[next_idx];
+    // the slot holds the oldest frame once the window is full
+    if (frame_num == window_num)
+    {
+        expire(total_x, slot.cols);
+        expire(total_y, slot.rows);
+        total_sum -= slot.sum;
+    }
+    else
+    {
+        frame_num++;
+    }
+    collect(next_x, total_x, frame_w, slot.cols);
+    collect(next_y, total_y, frame_h, slot.rows);
+    slot.sum = sum;
+    total_sum += sum;
+    next_idx = (next_idx + 1) % window_num;
+}
+
+int *RoiWindow::x_count()
+{
+    return total_x;
+}
+
+int *RoiWindow::y_count()
+{
+    return total_y;
+}
+
+int RoiWindow::sum()
+{
+    return total_sum;
+}
+
+bool RoiWindow::is_full()
+{
+    return frame_num == window_num;
+}
+
+RoiWindow::~RoiWindow()
+{
+    free(next_x);
+    free(next_y);
+    free(total_x);
+    free(total_y);
+}
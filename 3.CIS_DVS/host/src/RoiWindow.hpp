@@ -0,0 +1,100 @@
+#ifndef ROIWINDOW_HPP
+#define ROIWINDOW_HPP
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * per-column / per-row event counts of the last window_num DVS frames.
+ *
+ * each frame is counted once into frame_x_count / frame_y_count, then push adds it to the
+ * window totals and subtracts the frame leaving the window, using the non-zero counts kept
+ * for every frame. the totals are valid after every frame at a cost independent of window_num.
+ *
+ * usage : roi_count_average(window.frame_x_count(), window.frame_y_count()) -> push(sum) -> x_count() ...
+ */
+class RoiWindow
+{
+private:
+    // non-zero count of one column / row in one frame
+    struct SparseCount
+    {
+        uint16_t idx;
+        uint16_t count;
+    };
+    // contribution of one frame to the window
+    struct FrameCounts
+    {
+        std::vector<SparseCount> cols;
+        std::vector<SparseCount> rows;
+        int sum;
+    };
+
+    int frame_w, frame_h;
+    int window_num;
+
+    // counters of the next frame, all zero between push calls
+    int *next_x;
+    int *next_y;
+
+    // window totals
+    int *total_x;
+    int *total_y;
+    int total_sum;
+
+    // contributions of the frames in the window, a ring of window_num entries
+    std::vector<FrameCounts> frames;
+    // ring position of the next frame
+    int next_idx;
+    // frames in the window
+    int frame_num;
+
+    /**
+     * moves the non-zero entries of count into sparse and adds them to total, count is zeroed
+     */
+    static void collect(int *count, int *total, int len, std::vector<SparseCount> &sparse);
+    /**
+     * subtracts sparse from total
+     */
+    static void expire(int *total, const std::vector<SparseCount> &sparse);
+
+public:
+    /**
+     * @param frame_w width of DVS frame
+     * @param frame_h height of DVS frame
+     * @param window_num number of frames in the window
+     */
+    RoiWindow(int frame_w, int frame_h, int window_num);
+    /**
+     * @return zeroed per-column counters to count the next frame into
+     */
+    int *frame_x_count();
+    /**
+     * @return zeroed per-row counters to count the next frame into
+     */
+    int *frame_y_count();
+    /**
+     * adds the counted frame to the window, the oldest frame leaves it once the window is full
+     * @param sum number of events counted in the frame
+     */
+    void push(int sum);
+    /**
+     * @return events per column over the window
+     */
+    int *x_count();
+    /**
+     * @return events per row over the window
+     */
+    int *y_count();
+    /**
+     * @return events over the window
+     */
+    int sum();
+    /**
+     * @return true once window_num frames were pushed
+     */
+    bool is_full();
+    ~RoiWindow();
+};
+
+#endif // ROIWINDOW_HPP
@@ -0,0 +1,339 @@
+#include "SegmentWriter.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "ThreadTopology.hpp"
+
+/**
+ * writes the whole buffer, retrying on short writes
+ * @return true on success
+ */
+static bool write_all(int fd, const char *buf, size_t len)
+{
+    size_t count = 0;
+    while (count < len)
+    {
+        ssize_t rc = write(fd, buf + count, len - count);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        count += rc;
+    }
+    return true;
+}
+
+SegmentWriter::SegmentWriter(const char *prefix, size_t frame_bytes,
+                             double segment_sec, uint64_t segment_bytes, uint64_t quota_bytes)
+    : prefix(prefix), frame_bytes(frame_bytes),
+      segment_sec(segment_sec), segment_bytes(segment_bytes), quota_bytes(quota_bytes),
+      index_num(0),
+      next_ready(false), is_open_failed(false), next_seq(0),
+      closed_bytes(0), stop_rotation(false),
+      stall_num(0), open_fail_num(0), is_overrun(false), deleted_num(0)
+{
+    // a segment always holds a whole number of frames, and at least one
+    if (this->segment_bytes < frame_bytes)
+        this->segment_bytes = frame_bytes;
+    this->segment_bytes -= this->segment_bytes % frame_bytes;
+
+    cur.fd = -1;
+    cur.idx_fd = -1;
+    next.fd = -1;
+    next.idx_fd = -1;
+}
+
+bool SegmentWriter::open_segment(int seq, Segment &seg)
+{
+    char suffix[32];
+
+    seg.seq = seq;
+    seg.bytes = 0;
+    snprintf(suffix, sizeof(suffix), "_seg%05d", seq);
+    seg.bin_name = prefix + suffix + ".bin";
+    seg.idx_name = prefix + suffix + ".idx";
+
+    seg.fd = open(seg.bin_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (seg.fd < 0)
+    {
+        perror("Failed to open segment for writing.");
+        return false;
+    }
+    seg.idx_fd = open(seg.idx_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (seg.idx_fd < 0)
+    {
+        perror("Failed to open segment index for writing.");
+        close(seg.fd);
+        seg.fd = -1;
+        return false;
+    }
+
+    // reserve all blocks of the segment, so that the writer never allocates blocks
+    // filesystems without fallocate support still work, just without the reservation
+    int rc = posix_fallocate(seg.fd, 0, segment_bytes);
+    if (rc != 0)
+    {
+        fprintf(stderr, "posix_fallocate %s: %s\n", seg.bin_name.c_str(), strerror(rc));
+    }
+    return true;
+}
+
+void SegmentWriter::close_segment(Segment &seg)
+{
+    // drop the unused part of the preallocation
+    if (ftruncate(seg.fd, seg.bytes) != 0)
+    {
+        perror("ftruncate segment");
+    }
+    fdatasync(seg.fd);
+    close(seg.fd);
+    fdatasync(seg.idx_fd);
+    close(seg.idx_fd);
+    seg.fd = -1;
+    seg.idx_fd = -1;
+}
+
+void SegmentWriter::enforce_quota()
+{
+    if (quota_bytes == 0)
+        return;
+
+    // the segment being written and the prepared one count as full
+    while (!closed_segments.empty() && closed_bytes + 2 * segment_bytes > quota_bytes)
+    {
+        Segment &oldest = closed_segments.front();
+        if (unlink(oldest.bin_name.c_str()) != 0)
+        {
+            perror("unlink segment");
+        }
+        unlink(oldest.idx_name.c_str());
+        closed_bytes -= oldest.bytes;
+        deleted_num++;
+        closed_segments.pop_front();
+    }
+}
+
+void SegmentWriter::rotation_loop()
+{
+    int retry_ms = SEGMENT_RETRY_MIN_MS;
+    std::unique_lock<std::mutex> lock(rot_mutex);
+    while (1)
+    {
+        rot_cond.wait(lock, [this]
+                      { return stop_rotation || !retire_queue.empty() || !next_ready; });
+
+        // finalize segments handed over by the writer
+        while (!retire_queue.empty())
+        {
+            Segment seg = retire_queue.front();
+            retire_queue.pop_front();
+            lock.unlock();
+            close_segment(seg);
+            lock.lock();
+            closed_segments.push_back(seg);
+            closed_bytes += seg.bytes;
+            enforce_quota();
+        }
+
+        if (stop_rotation)
+            break;
+
+        // prepare the next segment outside the lock, the writer keeps writing meanwhile
+        if (!next_ready)
+        {
+            Segment seg;
+            int seq = next_seq;
+            lock.unlock();
+            bool ok = open_segment(seq, seg);
+            lock.lock();
+            if (!ok)
+            {
+                // the writer stays on its current segment, retry later without spinning on a broken disk
+                open_fail_num++;
+                is_open_failed = true;
+                rot_cond.notify_all();
+                rot_cond.wait_for(lock, std::chrono::milliseconds(retry_ms), [this]
+                                  { return stop_rotation || !retire_queue.empty(); });
+                retry_ms = std::min(2 * retry_ms, SEGMENT_RETRY_MAX_MS);
+                continue;
+            }
+            retry_ms = SEGMENT_RETRY_MIN_MS;
+            is_open_failed = false;
+            next = seg;
+            next_seq++;
+            next_ready = true;
+            rot_cond.notify_all();
+        }
+    }
+
+    // prepared segment was never used
+    if (next_ready)
+    {
+        close(next.fd);
+        close(next.idx_fd);
+        unlink(next.bin_name.c_str());
+        unlink(next.idx_name.c_str());
+        next_ready = false;
+    }
+}
+
+bool SegmentWriter::start()
+{
+    rotation_thread = start_role_thread("writer", [this]()
+                                        { rotation_loop(); });
+
+    // first segment is opened by the rotation thread as well
+    std::unique_lock<std::mutex> lock(rot_mutex);
+    rot_cond.wait(lock, [this]
+                  { return next_ready || is_open_failed; });
+    if (!next_ready)
+    {
+        // nothing to record into, do not keep retrying
+        stop_rotation = true;
+        rot_cond.notify_all();
+        lock.unlock();
+        rotation_thread.join();
+        return false;
+    }
+    cur = next;
+    next_ready = false;
+    cur_start = std::chrono::steady_clock::now();
+    rot_cond.notify_all();
+    return true;
+}
+
+void SegmentWriter::flush_index()
+{
+    if (index_num == 0)
+        return;
+    if (!write_all(cur.idx_fd, (const char *)index_buf, index_num * sizeof(SegmentIndexEntry)))
+    {
+        perror("write segment index");
+    }
+    index_num = 0;
+}
+
+void SegmentWriter::rotate()
+{
+    std::unique_lock<std::mutex> lock(rot_mutex);
+    if (!next_ready && !is_open_failed)
+    {
+        // the rotation thread is behind, this is the only place the writer can block
+        stall_num++;
+        printf("segment %d not ready, waiting\n", next_seq);
+        rot_cond.wait(lock, [this]
+                      { return next_ready || is_open_failed; });
+    }
+    if (!next_ready)
+    {
+        // next segment cannot be opened : keep appending to cur, the next frame tries again
+        if (!is_overrun)
+            printf("segment %d cannot be opened, segment %d grows past its limit\n", next_seq, cur.seq);
+        is_overrun = true;
+        return;
+    }
+    lock.unlock();
+
+    flush_index();
+    lock.lock();
+    retire_queue.push_back(cur);
+    cur = next;
+    next_ready = false;
+    is_overrun = false;
+    rot_cond.notify_all();
+    lock.unlock();
+
+    cur_start = std::chrono::steady_clock::now();
+}
+
+bool SegmentWriter::write_frame(const char *frame, int frame_num, uint32_t timestamp)
+{
+    if (cur.fd < 0)
+        return false;
+
+    // rotate on size or duration
+    bool is_full = cur.bytes + frame_bytes > segment_bytes;
+    bool is_old = false;
+    if (segment_sec > 0 && cur.bytes > 0)
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - cur_start;
+        is_old = elapsed.count() >= segment_sec;
+    }
+    if (is_full || is_old)
+    {
+        rotate();
+    }
+
+    if (!write_all(cur.fd, frame, frame_bytes))
+    {
+        perror("write segment");
+        return false;
+    }
+
+    // append index entry
+    SegmentIndexEntry &entry = index_buf[index_num++];
+    entry.frame_num = frame_num;
+    entry.timestamp = timestamp;
+    entry.offset = cur.bytes;
+    entry.host_time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+    cur.bytes += frame_bytes;
+    if (index_num == SEGMENT_INDEX_FLUSH_NUM)
+    {
+        flush_index();
+    }
+    return true;
+}
+
+void SegmentWriter::stop()
+{
+    // never started, or already stopped
+    if (!rotation_thread.joinable() && cur.fd < 0)
+        return;
+
+    if (cur.fd >= 0)
+    {
+        flush_index();
+    }
+    {
+        std::lock_guard<std::mutex> lock(rot_mutex);
+        if (cur.fd >= 0)
+        {
+            retire_queue.push_back(cur);
+            cur.fd = -1;
+            cur.idx_fd = -1;
+        }
+        stop_rotation = true;
+        rot_cond.notify_all();
+    }
+    if (rotation_thread.joinable())
+    {
+        rotation_thread.join();
+    }
+    // the rotation thread is gone, finalize whatever it did not
+    while (!retire_queue.empty())
+    {
+        Segment seg = retire_queue.front();
+        retire_queue.pop_front();
+        close_segment(seg);
+        closed_segments.push_back(seg);
+        closed_bytes += seg.bytes;
+    }
+
+    printf("segments kept : %d, deleted by quota : %d, writer stalls : %d, failed opens : %d\n",
+           (int)closed_segments.size(), deleted_num, stall_num, open_fail_num);
+}
+
+SegmentWriter::~SegmentWriter()
+{
+    stop();
+}
@@ -0,0 +1,178 @@
+#ifndef SEGMENTWRITER_HPP
+#define SEGMENTWRITER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// number of index entries buffered before they are appended to the index file
+#define SEGMENT_INDEX_FLUSH_NUM 256
+// first and longest wait before the rotation thread retries a segment it failed to open
+#define SEGMENT_RETRY_MIN_MS 100
+#define SEGMENT_RETRY_MAX_MS 5000
+
+/**
+ * one entry of a per-segment index file (<segment>.idx)
+ * frames are stored back to back, so offset is always a multiple of the frame size,
+ * but it is kept explicitly so that the index can be read without knowing the frame format.
+ */
+struct SegmentIndexEntry
+{
+    // frame number from DVS header
+    uint32_t frame_num;
+    // timestamp from DVS header
+    uint32_t timestamp;
+    // byte offset of the frame inside the segment
+    uint64_t offset;
+    // host wall clock time when the frame was written, in microseconds
+    int64_t host_time_us;
+};
+
+/**
+ * continuous recorder that splits the output into fixed size / fixed duration segments
+ *   <prefix>_seg00000.bin, <prefix>_seg00000.idx, <prefix>_seg00001.bin, ...
+ *
+ * the writing thread only writes frames and swaps file descriptors.
+ * opening, preallocating, truncating, closing and deleting segments
+ * is done by a separate rotation thread, so that the writer never waits on filesystem metadata.
+ * if the next segment cannot be opened, the rotation thread retries with backoff and
+ * the writer keeps appending to its current segment past the size / duration limit.
+ */
+class SegmentWriter
+{
+private:
+    /**
+     * files belonging to a single segment
+     */
+    struct Segment
+    {
+        // segment sequence number
+        int seq;
+        // file descriptor of frame data
+        int fd;
+        // file descriptor of index
+        int idx_fd;
+        // number of valid bytes in the data file
+        uint64_t bytes;
+        // path to data file
+        std::string bin_name;
+        // path to index file
+        std::string idx_name;
+    };
+
+    // output file prefix, segment number and extension are appended
+    std::string prefix;
+    // size of one frame in bytes
+    size_t frame_bytes;
+    // rotate after this much time, 0 to disable
+    double segment_sec;
+    // rotate before exceeding this size, also the preallocated size of each segment
+    uint64_t segment_bytes;
+    // total size of segments kept on disk, oldest ones are deleted above this. 0 to disable
+    uint64_t quota_bytes;
+
+    // segment currently being written
+    Segment cur;
+    // time when cur started
+    std::chrono::steady_clock::time_point cur_start;
+    // index entries not yet written to cur.idx_fd
+    SegmentIndexEntry index_buf[SEGMENT_INDEX_FLUSH_NUM];
+    // number of entries in index_buf
+    int index_num;
+
+    // mutex and cond shared with the rotation thread
+    std::mutex rot_mutex;
+    std::condition_variable rot_cond;
+    // segment prepared in advance by the rotation thread
+    Segment next;
+    // true if next is opened and preallocated
+    bool next_ready;
+    // true while the last attempt to open next failed, the rotation thread retries
+    bool is_open_failed;
+    // sequence number of the next segment to prepare
+    int next_seq;
+    // segments handed over by the writer to be finalized
+    std::deque<Segment> retire_queue;
+    // finalized segments still on disk, oldest first
+    std::deque<Segment> closed_segments;
+    // total bytes of closed_segments
+    uint64_t closed_bytes;
+    // stops the rotation thread
+    bool stop_rotation;
+    std::thread rotation_thread;
+
+    // number of times the writer had to wait for the next segment
+    int stall_num;
+    // number of failed segment opens
+    int open_fail_num;
+    // cur went past its limit because no next segment could be opened
+    bool is_overrun;
+    // number of segments deleted to stay under quota
+    int deleted_num;
+
+    /**
+     * rotation thread : prepares the next segment, finalizes retired segments and enforces the quota
+     */
+    void rotation_loop();
+    /**
+     * opens data and index file of segment seq and preallocates the data file
+     * @param[out] seg opened segment
+     * @return true on success
+     */
+    bool open_segment(int seq, Segment &seg);
+    /**
+     * truncates the data file to its valid size and closes both files
+     */
+    void close_segment(Segment &seg);
+    /**
+     * deletes the oldest closed segments until the quota is met
+     */
+    void enforce_quota();
+    /**
+     * appends the buffered index entries to the index file of the current segment
+     */
+    void flush_index();
+    /**
+     * hands the current segment to the rotation thread and continues on the prepared one,
+     * or stays on the current segment while the next one cannot be opened
+     */
+    void rotate();
+
+public:
+    /**
+     * @param prefix output path prefix (e.g. ./bin_files/data_2024-01-01_00-00-00)
+     * @param frame_bytes size of one frame in bytes
+     * @param segment_sec maximum duration of one segment in seconds, 0 to disable
+     * @param segment_bytes maximum size of one segment in bytes
+     * @param quota_bytes maximum total size of all segments in bytes, 0 to disable
+     */
+    SegmentWriter(const char *prefix, size_t frame_bytes,
+                  double segment_sec, uint64_t segment_bytes, uint64_t quota_bytes);
+    /**
+     * starts the rotation thread and opens the first segment
+     * @return true on success, false if the first segment cannot be opened
+     */
+    bool start();
+    /**
+     * appends one frame to the current segment, rotating to the next segment if needed
+     * @param frame frame data of frame_bytes bytes
+     * @param frame_num frame number from header
+     * @param timestamp timestamp from header
+     * @return true on success
+     */
+    bool write_frame(const char *frame, int frame_num, uint32_t timestamp);
+    /**
+     * finalizes the current segment and stops the rotation thread,
+     * segments the rotation thread did not finalize are closed here
+     */
+    void stop();
+    ~SegmentWriter();
+};
+
+#endif // SEGMENTWRITER_HPP
@@ -0,0 +1,92 @@
+#include "SharedBbox.hpp"
+
+#include <stdio.h>
+#include <chrono>
+
+SharedBbox::SharedBbox()
+    : seq(0), lx(-1), ly(-1), hx(-1), hy(-1),
+      is_valid(false), frame_num(0), timestamp_us(0), version(0),
+      read_num(0), retry_num(0)
+{
+}
+
+int64_t SharedBbox::now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void SharedBbox::publish(const Bbox &bbox, bool is_valid, uint64_t frame_num)
+{
+    // taken before the write section, keeps the window readers retry on short
+    int64_t now = now_us();
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    // odd : readers retry until the payload is complete
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    lx.store(bbox.lx, std::memory_order_relaxed);
+    ly.store(bbox.ly, std::memory_order_relaxed);
+    hx.store(bbox.hx, std::memory_order_relaxed);
+    hy.store(bbox.hy, std::memory_order_relaxed);
+    this->is_valid.store(is_valid, std::memory_order_relaxed);
+    this->frame_num.store(frame_num, std::memory_order_relaxed);
+    timestamp_us.store(now, std::memory_order_relaxed);
+    version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    seq.store(s + 2, std::memory_order_release);
+}
+
+void SharedBbox::invalidate(uint64_t frame_num)
+{
+    Bbox bbox;
+    bbox.lx = -1;
+    bbox.ly = -1;
+    bbox.hx = -1;
+    bbox.hy = -1;
+    publish(bbox, false, frame_num);
+}
+
+void SharedBbox::read(BboxSnapshot &snapshot)
+{
+    read_num.fetch_add(1, std::memory_order_relaxed);
+    while (true)
+    {
+        uint32_t s1 = seq.load(std::memory_order_acquire);
+        if (s1 & 1)
+        {
+            retry_num.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        snapshot.bbox.lx = lx.load(std::memory_order_relaxed);
+        snapshot.bbox.ly = ly.load(std::memory_order_relaxed);
+        snapshot.bbox.hx = hx.load(std::memory_order_relaxed);
+        snapshot.bbox.hy = hy.load(std::memory_order_relaxed);
+        snapshot.is_valid = is_valid.load(std::memory_order_relaxed);
+        snapshot.frame_num = frame_num.load(std::memory_order_relaxed);
+        snapshot.timestamp_us = timestamp_us.load(std::memory_order_relaxed);
+        snapshot.version = version.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // a publish started while copying, the copy may be torn
+        if (seq.load(std::memory_order_relaxed) == s1)
+            return;
+        retry_num.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+int64_t SharedBbox::age_us(const BboxSnapshot &snapshot)
+{
+    if (snapshot.version == 0)
+        return -1;
+    return now_us() - snapshot.timestamp_us;
+}
+
+void SharedBbox::print_stats(const char *name)
+{
+    printf("%s : published %llu, read %llu, read retries %llu\n",
+           name,
+           (unsigned long long)version.load(),
+           (unsigned long long)read_num.load(),
+           (unsigned long long)retry_num.load());
+}
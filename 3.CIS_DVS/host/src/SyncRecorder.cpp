@@ -0,0 +1,280 @@
+#include "SyncRecorder.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "ThreadTopology.hpp"
+
+SyncRecorder::SyncRecorder(int cis_frame_h, int cis_frame_w, int cis_slot_num,
+                           int dvs_frame_h, int dvs_frame_w, int dvs_frame_bytes, int dvs_slot_num)
+    : fd(-1),
+      pending_head(0), pending_num(0),
+      stop_writer(false)
+{
+    int slot_num[RECORD_TYPE_NUM];
+
+    frame_bytes[RECORD_CIS] = (size_t)cis_frame_h * cis_frame_w * 3;
+    frame_bytes[RECORD_DVS] = dvs_frame_bytes;
+    slot_num[RECORD_CIS] = cis_slot_num;
+    slot_num[RECORD_DVS] = dvs_slot_num;
+
+    // allocate every slot up front, nothing is allocated while recording
+    for (int type = 0; type < RECORD_TYPE_NUM; type++)
+    {
+        slot_memory[type] = (char *)malloc(frame_bytes[type] * slot_num[type]);
+        if (slot_memory[type] == NULL)
+        {
+            // open() refuses to record, acquire never finds a slot
+            perror("SyncRecorder malloc");
+            slot_num[type] = 0;
+        }
+        // filled by the capture thread of the sensor
+        place_thread_buffer(slot_memory[type], frame_bytes[type] * slot_num[type], (type == RECORD_DVS) ? "dvs_reader" : "cis");
+        slots[type].resize(slot_num[type]);
+        free_slots[type].reserve(slot_num[type]);
+        for (int i = 0; i < slot_num[type]; i++)
+        {
+            slots[type][i].header.type = type;
+            slots[type][i].header.payload_bytes = frame_bytes[type];
+            slots[type][i].payload = slot_memory[type] + frame_bytes[type] * i;
+            free_slots[type].push_back(&slots[type][i]);
+        }
+        written_num[type] = 0;
+        dropped_num[type] = 0;
+    }
+    pending.resize(cis_slot_num + dvs_slot_num);
+
+    memset(&file_header, 0, sizeof(file_header));
+    memcpy(file_header.magic, RECORDING_MAGIC, sizeof(file_header.magic));
+    file_header.version = RECORDING_VERSION;
+    file_header.cis_frame_h = cis_frame_h;
+    file_header.cis_frame_w = cis_frame_w;
+    file_header.cis_frame_bytes = frame_bytes[RECORD_CIS];
+    file_header.dvs_frame_h = dvs_frame_h;
+    file_header.dvs_frame_w = dvs_frame_w;
+    file_header.dvs_frame_bytes = frame_bytes[RECORD_DVS];
+}
+
+bool SyncRecorder::open(const char *path)
+{
+    if (slot_memory[RECORD_CIS] == NULL || slot_memory[RECORD_DVS] == NULL)
+    {
+        fprintf(stderr, "SyncRecorder : frame slots could not be allocated, not recording\n");
+        return false;
+    }
+    fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("Failed to open file for writing.");
+        return false;
+    }
+
+    // header describes both frame formats, so that the exporter needs no configuration
+    if (write(fd, &file_header, sizeof(file_header)) != sizeof(file_header))
+    {
+        perror("write recording header");
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    start_time = std::chrono::steady_clock::now();
+    writer_thread = start_role_thread("writer", [this]()
+                                      { writer_loop(); });
+    return true;
+}
+
+int64_t SyncRecorder::now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start_time)
+        .count();
+}
+
+SyncRecorder::Slot *SyncRecorder::acquire(int type)
+{
+    std::lock_guard<std::mutex> lock(rec_mutex);
+    if (free_slots[type].empty())
+    {
+        dropped_num[type]++;
+        return NULL;
+    }
+    Slot *slot = free_slots[type].back();
+    free_slots[type].pop_back();
+    return slot;
+}
+
+void SyncRecorder::commit(Slot *slot, uint32_t frame_num, uint32_t timestamp, int64_t arrival_us)
+{
+    slot->header.frame_num = frame_num;
+    slot->header.timestamp = timestamp;
+    slot->header.arrival_us = arrival_us;
+
+    std::lock_guard<std::mutex> lock(rec_mutex);
+    pending[(pending_head + pending_num) % pending.size()] = slot;
+    pending_num++;
+    rec_cond.notify_one();
+}
+
+void SyncRecorder::writer_loop()
+{
+    std::unique_lock<std::mutex> lock(rec_mutex);
+    while (1)
+    {
+        rec_cond.wait(lock, [this]
+                      { return stop_writer || pending_num > 0; });
+        if (pending_num == 0)
+            break;
+
+        Slot *slot = pending[pending_head];
+        pending_head = (pending_head + 1) % pending.size();
+        pending_num--;
+        lock.unlock();
+
+        // record header and frame in one system call
+        struct iovec iov[2];
+        iov[0].iov_base = &slot->header;
+        iov[0].iov_len = sizeof(RecordHeader);
+        iov[1].iov_base = slot->payload;
+        iov[1].iov_len = slot->header.payload_bytes;
+        size_t total = iov[0].iov_len + iov[1].iov_len;
+        size_t count = 0;
+        while (count < total)
+        {
+            ssize_t rc = writev(fd, iov, 2);
+            if (rc < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                perror("write recording");
+                break;
+            }
+            count += rc;
+            // advance iovecs past a short write
+            for (int i = 0; i < 2; i++)
+            {
+                size_t step = ((size_t)rc < iov[i].iov_len) ? rc : iov[i].iov_len;
+                iov[i].iov_base = (char *)iov[i].iov_base + step;
+                iov[i].iov_len -= step;
+                rc -= step;
+            }
+        }
+
+        lock.lock();
+        written_num[slot->header.type]++;
+        free_slots[slot->header.type].push_back(slot);
+    }
+}
+
+void SyncRecorder::close()
+{
+    if (!writer_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(rec_mutex);
+        stop_writer = true;
+        rec_cond.notify_one();
+    }
+    writer_thread.join();
+    ::close(fd);
+    fd = -1;
+
+    printf("CIS frames written : %llu, dropped : %llu\n",
+           (unsigned long long)written_num[RECORD_CIS], (unsigned long long)dropped_num[RECORD_CIS]);
+    printf("DVS frames written : %llu, dropped : %llu\n",
+           (unsigned long long)written_num[RECORD_DVS], (unsigned long long)dropped_num[RECORD_DVS]);
+}
+
+SyncRecorder::~SyncRecorder()
+{
+    close();
+    for (int type = 0; type < RECORD_TYPE_NUM; type++)
+    {
+        free(slot_memory[type]);
+    }
+}
+
+RecordingReader::RecordingReader()
+    : base(NULL), file_bytes(0), offset(0)
+{
+}
+
+bool RecordingReader::open(const char *path)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Error opening recording");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RecordingHeader))
+    {
+        fprintf(stderr, "Recording is too short\n");
+        ::close(fd);
+        return false;
+    }
+    file_bytes = st.st_size;
+
+    void *addr = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap recording");
+        return false;
+    }
+    madvise(addr, file_bytes, MADV_SEQUENTIAL);
+    base = (const char *)addr;
+
+    if (memcmp(header()->magic, RECORDING_MAGIC, sizeof(header()->magic)) != 0 ||
+        header()->version != RECORDING_VERSION)
+    {
+        fprintf(stderr, "%s is not a CIS-DVS recording\n", path);
+        munmap((void *)base, file_bytes);
+        base = NULL;
+        return false;
+    }
+    rewind();
+    return true;
+}
+
+const RecordingHeader *RecordingReader::header()
+{
+    return (const RecordingHeader *)base;
+}
+
+bool RecordingReader::next(const RecordHeader *&record, const char *&payload)
+{
+    if (base == NULL || offset + sizeof(RecordHeader) > file_bytes)
+        return false;
+
+    record = (const RecordHeader *)(base + offset);
+    if (offset + sizeof(RecordHeader) + record->payload_bytes > file_bytes)
+    {
+        // recording was interrupted in the middle of a frame
+        return false;
+    }
+    payload = base + offset + sizeof(RecordHeader);
+    offset += sizeof(RecordHeader) + record->payload_bytes;
+    return true;
+}
+
+void RecordingReader::rewind()
+{
+    offset = sizeof(RecordingHeader);
+}
+
+RecordingReader::~RecordingReader()
+{
+    if (base != NULL)
+    {
+        munmap((void *)base, file_bytes);
+    }
+}
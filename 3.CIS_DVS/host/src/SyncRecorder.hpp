@@ -0,0 +1,147 @@
+#ifndef SYNCRECORDER_HPP
+#define SYNCRECORDER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "RecordingFormat.hpp"
+
+/**
+ * records raw CIS and DVS frames into a single file.
+ *
+ * capture threads read frames straight into preallocated slots (acquire -> read_frame -> commit),
+ * and a writer thread appends committed slots to the file in arrival order.
+ * when the disk falls behind and no slot is free, the frame is dropped and counted
+ * instead of stalling the capture thread.
+ */
+class SyncRecorder
+{
+public:
+    /**
+     * preallocated frame buffer
+     */
+    struct Slot
+    {
+        RecordHeader header;
+        char *payload;
+    };
+
+private:
+    // output file descriptor
+    int fd;
+    // file header, describes both frame formats
+    RecordingHeader file_header;
+    // frame size in bytes per record type
+    size_t frame_bytes[RECORD_TYPE_NUM];
+    // backing memory of all slots per record type
+    char *slot_memory[RECORD_TYPE_NUM];
+    // all slots per record type
+    std::vector<Slot> slots[RECORD_TYPE_NUM];
+    // free slots per record type, used as a stack
+    std::vector<Slot *> free_slots[RECORD_TYPE_NUM];
+    // committed slots waiting for the writer, ring buffer in arrival order
+    std::vector<Slot *> pending;
+    int pending_head;
+    int pending_num;
+
+    std::mutex rec_mutex;
+    std::condition_variable rec_cond;
+    bool stop_writer;
+    std::thread writer_thread;
+    // origin of arrival_us
+    std::chrono::steady_clock::time_point start_time;
+
+    // statistics per record type
+    uint64_t written_num[RECORD_TYPE_NUM];
+    uint64_t dropped_num[RECORD_TYPE_NUM];
+
+    /**
+     * writer thread : appends committed slots to the output file
+     */
+    void writer_loop();
+
+public:
+    /**
+     * @param cis_frame_h height of CIS frame in pixels
+     * @param cis_frame_w width of CIS frame in pixels
+     * @param cis_slot_num number of preallocated CIS frames
+     * @param dvs_frame_h height of DVS frame in pixels
+     * @param dvs_frame_w width of DVS frame in pixels
+     * @param dvs_frame_bytes size of raw DVS frame including header
+     * @param dvs_slot_num number of preallocated DVS frames
+     */
+    SyncRecorder(int cis_frame_h, int cis_frame_w, int cis_slot_num,
+                 int dvs_frame_h, int dvs_frame_w, int dvs_frame_bytes, int dvs_slot_num);
+    /**
+     * creates the output file, writes the file header and starts the writer thread
+     * @param path path to output file
+     * @return true on success, false also if the frame slots could not be allocated
+     */
+    bool open(const char *path);
+    /**
+     * @return microseconds elapsed since open(), to be stored as arrival time
+     */
+    int64_t now_us();
+    /**
+     * takes a free slot to read a frame into. never blocks.
+     * @param type RECORD_CIS or RECORD_DVS
+     * @return free slot, NULL if all slots are in use (the frame is counted as dropped)
+     */
+    Slot *acquire(int type);
+    /**
+     * queues a filled slot for writing
+     * @param slot slot returned by acquire
+     * @param frame_num frame number
+     * @param timestamp sensor timestamp
+     * @param arrival_us arrival time from now_us()
+     */
+    void commit(Slot *slot, uint32_t frame_num, uint32_t timestamp, int64_t arrival_us);
+    /**
+     * writes all pending frames, stops the writer thread and closes the file
+     */
+    void close();
+    ~SyncRecorder();
+};
+
+/**
+ * sequential reader for files written by SyncRecorder, the file is memory mapped.
+ */
+class RecordingReader
+{
+private:
+    // mapped file
+    const char *base;
+    size_t file_bytes;
+    // read position
+    size_t offset;
+
+public:
+    RecordingReader();
+    /**
+     * maps a recording and checks its header
+     * @return true on success
+     */
+    bool open(const char *path);
+    /**
+     * @return file header, valid after open()
+     */
+    const RecordingHeader *header();
+    /**
+     * returns the next record. a truncated last record is ignored.
+     * @param[out] record record header
+     * @param[out] payload frame data following the record header
+     * @return false at the end of the recording
+     */
+    bool next(const RecordHeader *&record, const char *&payload);
+    /**
+     * restarts reading from the first record
+     */
+    void rewind();
+    ~RecordingReader();
+};
+
+#endif // SYNCRECORDER_HPP
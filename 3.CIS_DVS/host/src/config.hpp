@@ -29,11 +29,48 @@
 #define DVS_BUFFER_NUM 70
 #define DVS_FRAME_RDY_BASEADDR (DDR_BASEADDR + 0x2000000)
 #define DVS_FRAME_BASEADDR (DDR_BASEADDR + 0x30000000)
+// duration of one header timestamp tick, used to pace replayed bin files
+#define DVS_TIMESTAMP_TICK_US 1.0
+
+/******************* Segmented Store Setting **********************/
+#define SEGMENT_DURATION_SEC 600
+#define SEGMENT_MAX_BYTES (4UL * 1024 * 1024 * 1024)
+#define SEGMENT_DISK_QUOTA_BYTES (200UL * 1024 * 1024 * 1024)
+
+/******************* CIS-DVS Record Setting **********************/
+// preallocated frames buffered between capture threads and the disk writer
+#define RECORD_CIS_SLOT_NUM 32
+#define RECORD_DVS_SLOT_NUM 4096
+
+/******************* DVS Overload Setting *************************/
+// what the DVS reader thread does once its consumer thread is behind (see BackPressure.hpp) :
+// OVERLOAD_BLOCK | OVERLOAD_DROP_OLDEST | OVERLOAD_DROP_NEWEST | OVERLOAD_MERGE,
+// applied above the given number of queued frames (at most DBUF_FRAME_NUM), overridden by --overload
+// display (./main -p) : late frames are merged, the image stays at most 2 frames behind the sensor
+#define DVS_DISPLAY_OVERLOAD_POLICY OVERLOAD_MERGE
+#define DVS_DISPLAY_OVERLOAD_DEPTH 2
+// store (./main -W) : every stored frame is a sensor frame, the ones the disk cannot take are counted
+#define DVS_STORE_OVERLOAD_POLICY OVERLOAD_DROP_NEWEST
+#define DVS_STORE_OVERLOAD_DEPTH 8
+
+/******************* DVS Broadcast Setting ***********************/
+// frames kept by the single PCIE reader of ./main -B, the lag the no-drop recorder may build up
+#define BROADCAST_SLOT_NUM 512
+
+/******************* Offline Render Setting ***********************/
+// output frame rate of ./main -n, one output frame every DVS_FPS / RENDER_OUTPUT_FPS source frames
+#define RENDER_OUTPUT_FPS 30
+// number of source frames stacked into one output frame
+#define RENDER_WINDOW_FRAMES (DVS_FPS / RENDER_OUTPUT_FPS)
+// number of rendering threads, 0 for one per core
+#define RENDER_THREAD_NUM 0
 
 /******************* DISPLAY Setting ******************************/
 #define DVS_FPS 1500
 #define DISPLAY_FPS 3
 #define DISPLAY_DOWNSAMPLE_NUM 100
+// rate of the display presenter thread, DISPLAY_FPS above sets the DVS accumulation
+#define PRESENT_FPS 30
 #define SAVE_FPS 20
 #define ROI_EVENT_SCORE 5
 #define ROW_SCORE_THRESHOLD 25
@@ -41,6 +78,8 @@
 #define ROI_INFLATION (float)(1)
 #define DVS_ROI_MIN_SIZE 100
 #define CIS_ROI_MIN_SIZE 224
+// minimum events per pixel inside the DVS ROI over the accumulation window, 0 : not checked
+#define ROI_MIN_DENSITY (float)(0)
 // #define CIS_DVS_OFFSET_X 0.315
 // #define CIS_DVS_OFFSET_Y -0.1
 // #define CIS_DVS_SCALE_X 0.8
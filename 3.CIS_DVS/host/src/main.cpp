@@ -12,6 +12,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
 #include <time.h>
 #include <dirent.h>
 #include <sys/mman.h>
@@ -22,6 +23,9 @@
 #include "config.hpp"
 #include "CIS.hpp" // Include CIS class
 #include "DVS.hpp" // Include DVS class
+#include "BinRenderer.hpp"
+#include "DataflowStages.hpp"
+#include "ThreadTopology.hpp"
 
 using namespace cv;
 using namespace std;
@@ -41,13 +45,35 @@ enum Mode
     CIS_ONLY_ROI,
     DVS_BIN_TO_VID,
     DVS_BIN_TO_PNG,
-    CIS_DVS_STORE_PNG
+    CIS_DVS_STORE_PNG,
+    DVS_STORE_SEGMENTED,
+    CIS_DVS_RECORD,
+    CIS_DVS_EXPORT,
+    DVS_BIN_RENDER,
+    CIS_DVS_BBOX_RECORD,
+    DATAFLOW_GRAPH
 };
 
+// replay options, set by --replay and --replay-speed
+static const char *replay_path = NULL;
+static double replay_speed = 1.0;
+// dataflow graph config, set by --graph
+static const char *graph_path = NULL;
+// DVS reader overload policy, set by --overload
+static bool is_overload_set = false;
+static OverloadPolicy overload_policy;
+static int overload_depth = 0;
+// DVS stopped by SIGINT / SIGTERM, set while a mode without an ESC window is running
+static DVS *signal_dvs = NULL;
+
 // Function declarations
 void printBanner();
 void handleMode(Mode mode);
 Mode parseArguments(int argc, char *argv[]);
+void attachReplay(CIS *cis, DVS *dvs, ReplaySource *&cis_replay, ReplaySource *&dvs_replay, bool is_loop);
+void attachPresenter(CIS *cis, DVS *dvs, Presenter *&presenter, bool *terminate);
+void setOverloadPolicy(DVS *dvs, OverloadPolicy policy, int high_depth);
+void catchTerminate(DVS *dvs);
 
 int main(int argc, char *argv[])
 {
@@ -76,21 +102,35 @@ void printBanner()
 
 void handleMode(Mode mode)
 {
+    apply_thread_role("main");
     MutexManager mutexManager; // Initialize mutex manager
     // Create pointers for CIS and DVS objects
     CIS *cis = nullptr;
     DVS *dvs = nullptr;
-    Bbox bbox;
-    bool terminate;
+    SharedBbox bbox;
+    bool terminate = false;
     MutexManager bbox_mutex;
     // Declare the vector outside the switch block
     std::vector<std::thread>
         threads;
-    cv::Mat frame_shared;
+    FrameHandle frame_shared;
     cv::Rect dvs_rect, cis_rect;
     int dvs_width, dvs_height;
     char bin_file_name[100];
     char vid_file_name[100];
+    char rec_file_name[100];
+    char export_format[100];
+    char render_color[100];
+    SyncRecorder *recorder = nullptr;
+    BinRenderer *renderer = nullptr;
+    ReplaySource *cis_replay = nullptr;
+    ReplaySource *dvs_replay = nullptr;
+    Presenter *presenter = nullptr;
+    DVS *dvs_reader = nullptr;
+    DVS *dvs_recorder = nullptr;
+    FrameBroadcast *broadcast = nullptr;
+    DataflowGraph *graph = nullptr;
+    DataflowContext graph_context;
     switch (mode)
     {
     case CIS_DISPLAY:
@@ -101,6 +141,7 @@ void handleMode(Mode mode)
             CIS_BUFFER_NUM,
             C2H_DEVICE_CIS, H2C_DEVICE_CIS,
             mutexManager);
+        attachPresenter(cis, dvs, presenter, NULL);
         cis->display_stream(); // Call CIS display stream
         delete cis;            // Cleanup
         cis = NULL;
@@ -109,6 +150,8 @@ void handleMode(Mode mode)
     case DVS_DISPLAY:
         printf("DVS only display mode\n");
         dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, (DVS_FPS / DISPLAY_FPS), DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager);
+        attachReplay(cis, dvs, cis_replay, dvs_replay, true);
+        attachPresenter(cis, dvs, presenter, NULL);
         dvs->display_stream(true); // Call DVS display stream
         delete dvs;                // Cleanup
         dvs = NULL;
@@ -117,11 +160,11 @@ void handleMode(Mode mode)
     case DVS_CHECK_FRAME_DROP:
         printf("DVS only check mode\n");
         dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager);
+        attachReplay(cis, dvs, cis_replay, dvs_replay, true);
         if (dvs)
         {
-            threads.emplace_back([dvs]()
-                                 { dvs->check_frame_drop(); });
-            setThreadPriority(threads.back());
+            threads.push_back(start_role_thread("dvs_reader", [dvs]()
+                                                              { dvs->check_frame_drop(); }));
         }
         for (auto &t : threads)
         {
@@ -138,18 +181,20 @@ void handleMode(Mode mode)
         printf("CIS and DVS display mode\n");
         cis = new CIS(CIS_FRAME_H, CIS_FRAME_W, CIS_FRAME_RDY_BASEADDR, CIS_FRAME_BASEADDR, CIS_BUFFER_NUM, C2H_DEVICE_CIS, H2C_DEVICE_CIS, mutexManager);
         dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, /*(DVS_FPS / (DISPLAY_FPS))*/ 1 , DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager);
+        attachReplay(cis, dvs, cis_replay, dvs_replay, true);
+        attachPresenter(cis, dvs, presenter, NULL);
 
         // Start threads for CIS and DVS
         if (cis)
         {
-            threads.emplace_back([cis]()
-                                 { cis->display_stream(); });
+            threads.push_back(start_role_thread("cis", [cis]()
+                                                       { cis->display_stream(); }));
         }
 
         if (dvs)
         {
-            threads.emplace_back([dvs]()
-                                 { dvs->display_stream(true); });
+            threads.push_back(start_role_thread("dvs", [dvs]()
+                                                       { dvs->display_stream(true); }));
         }
 
         // Wait for all threads to complete
@@ -202,6 +247,9 @@ void handleMode(Mode mode)
         printf("DVS ROI mode\n ");
         dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, (DVS_FPS / DISPLAY_FPS), DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, &bbox, &bbox_mutex, &terminate);
         dvs->set_DVS_ROI(ROI_EVENT_SCORE, ROW_SCORE_THRESHOLD, ROI_HEIGHT_MIN_THRESHOLD, DVS_ROI_MIN_SIZE, 1.0);
+        dvs->set_ROI_density(ROI_MIN_DENSITY);
+        attachReplay(cis, dvs, cis_replay, dvs_replay, false);
+        attachPresenter(cis, dvs, presenter, &terminate);
         // run old algorithm
         // dvs->dvs_roi_average_based(1, 1, true, true);
         // run new algorithm
@@ -219,17 +267,20 @@ void handleMode(Mode mode)
         // set relative parameters between the two sensors
         cis->set_DVS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y);
         dvs->set_CIS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y, CIS_FRAME_W, CIS_FRAME_H, ROI_EVENT_SCORE, ROW_SCORE_THRESHOLD, ROI_HEIGHT_MIN_THRESHOLD, CIS_ROI_MIN_SIZE, ROI_INFLATION);
+        dvs->set_ROI_density(ROI_MIN_DENSITY);
+        attachReplay(cis, dvs, cis_replay, dvs_replay, false);
+        attachPresenter(cis, dvs, presenter, &terminate);
         // Start threads for CIS and DVS
         if (cis)
         {
-            threads.emplace_back([cis]()
-                                 { cis->crop_dvs_roi(); });
+            threads.push_back(start_role_thread("cis", [cis]()
+                                                       { cis->crop_dvs_roi(); }));
         }
 
         if (dvs)
         {
-            threads.emplace_back([dvs]()
-                                 { dvs->dvs_roi_proposed(1, 1, true); });
+            threads.push_back(start_role_thread("roi", [dvs]()
+                                                       { dvs->dvs_roi_proposed(1, 1, true); }));
         }
 
         // Wait for all threads to complete
@@ -240,11 +291,62 @@ void handleMode(Mode mode)
                 t.join();
             }
         }
+        bbox.print_stats("DVS ROI bbox");
         delete cis;
         delete dvs;
         dvs = NULL;
         cis = NULL;
         break;
+    case CIS_DVS_BBOX_RECORD:
+        printf("CIS DVS BBOX mode while recording every DVS frame, DVS is read once for all sinks\n");
+
+        cis = new CIS(CIS_FRAME_H, CIS_FRAME_W, CIS_FRAME_RDY_BASEADDR, CIS_FRAME_BASEADDR, CIS_BUFFER_NUM, C2H_DEVICE_CIS, H2C_DEVICE_CIS, mutexManager, &bbox_mutex, &bbox, &terminate);
+        dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, (DVS_FPS / DISPLAY_FPS), DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, &bbox, &bbox_mutex, &terminate);
+        dvs_reader = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, &bbox, &bbox_mutex, &terminate);
+        dvs_recorder = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, &bbox, &bbox_mutex, &terminate);
+
+        // set relative parameters between the two sensors
+        cis->set_DVS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y);
+        dvs->set_CIS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y, CIS_FRAME_W, CIS_FRAME_H, ROI_EVENT_SCORE, ROW_SCORE_THRESHOLD, ROI_HEIGHT_MIN_THRESHOLD, CIS_ROI_MIN_SIZE, ROI_INFLATION);
+        dvs->set_ROI_density(ROI_MIN_DENSITY);
+
+        // only dvs_reader touches PCIE, ROI / display follow the newest frame, the recorder gets every frame
+        broadcast = new FrameBroadcast((DVS_FRAME_H * DVS_FRAME_W) / 4 + FRAME_HEADER_BYTES, BROADCAST_SLOT_NUM, "dvs_reader");
+        dvs->set_broadcast(broadcast, broadcast->subscribe(BROADCAST_LATEST, "DVS ROI / display"));
+        dvs_recorder->set_broadcast(broadcast, broadcast->subscribe(BROADCAST_NO_DROP, "DVS recorder"));
+        attachReplay(cis, dvs_reader, cis_replay, dvs_replay, false);
+        attachPresenter(cis, dvs, presenter, &terminate);
+
+        threads.push_back(start_role_thread("dvs_reader", [dvs_reader, broadcast]()
+                                                          { dvs_reader->broadcast_reader(broadcast); }));
+        threads.push_back(start_role_thread("writer", [dvs_recorder]()
+                                                      { dvs_recorder->broadcast_bin_writer(); }));
+        threads.push_back(start_role_thread("cis", [cis]()
+                                                   { cis->crop_dvs_roi(); }));
+        threads.push_back(start_role_thread("roi", [dvs]()
+                                                   { dvs->dvs_roi_proposed(1, 1, true); }));
+
+        // ESC stops the reader, the recorder writes the remaining frames before it returns
+        for (auto &t : threads)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+        broadcast->print_stats("DVS broadcast");
+        bbox.print_stats("DVS ROI bbox");
+        delete cis;
+        delete dvs;
+        delete dvs_reader;
+        delete dvs_recorder;
+        delete broadcast;
+        dvs_reader = NULL;
+        dvs_recorder = NULL;
+        broadcast = NULL;
+        dvs = NULL;
+        cis = NULL;
+        break;
     case CIS_DVS_OVERLAY:
         printf("CIS DVS overlay mode for tuning\n");
         printf("when red grid shows up, use it to estimate scale between DVS and CIS images\n");
@@ -254,23 +356,26 @@ void handleMode(Mode mode)
         printf("if grid has 10 regions horizontally, width of each region = 0.1\n");
         printf("if DVS image is shunted left from CIS image by 3 regions, increase CIS_DVS_OFFSET_X by 0.3\n");
         printf("if DVS image is shunted down from CIS image by 2 regions, decrease CIS_DVS_OFFSET_Y by 0.2\n");
-        frame_shared = cv::Mat::zeros(DVS_FRAME_H, DVS_FRAME_W, CV_8UC1);
         cis = new CIS(CIS_FRAME_H, CIS_FRAME_W, CIS_FRAME_RDY_BASEADDR, CIS_FRAME_BASEADDR, CIS_BUFFER_NUM, C2H_DEVICE_CIS, H2C_DEVICE_CIS, mutexManager, &bbox_mutex, &bbox, &terminate);
         dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, (DVS_FPS / DISPLAY_FPS), DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, &bbox, &bbox_mutex, &terminate);
 
         // set relative parameters between the two sensors
         cis->set_DVS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y);
         dvs->set_CIS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y, CIS_FRAME_W, CIS_FRAME_H, ROI_EVENT_SCORE, ROW_SCORE_THRESHOLD, ROI_HEIGHT_MIN_THRESHOLD, CIS_ROI_MIN_SIZE, ROI_INFLATION);
+        dvs->set_ROI_density(ROI_MIN_DENSITY);
         // Start threads for CIS and DVS
 
         cis->set_roi(dvs_rect, cis_rect, dvs_width, dvs_height);
+        attachPresenter(cis, dvs, presenter, &terminate);
         while (true)
         {
-            dvs->send_frame((cv::Mat *)(&frame_shared), true);
-            bool retval = cis->overlay_dvs((cv::Mat *)(&frame_shared), dvs_rect, cis_rect, dvs_width, dvs_height, DVS_WEIGHT_ALPHA, CIS_DVS_CALIBRATION_GRID_NUM);
+            dvs->send_frame(frame_shared, true);
+            bool retval = cis->overlay_dvs(frame_shared, dvs_rect, cis_rect, dvs_width, dvs_height, DVS_WEIGHT_ALPHA, CIS_DVS_CALIBRATION_GRID_NUM);
             if (retval)
                 break;
         }
+        // hand the last frame back before its pool goes away with dvs
+        frame_shared.release();
 
         delete cis;
         delete dvs;
@@ -280,6 +385,7 @@ void handleMode(Mode mode)
     case DVS_FPS_CHECK:
         printf("DVS FPS check mode\n");
         dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager);
+        attachReplay(cis, dvs, cis_replay, dvs_replay, true);
         dvs->fps_count();
         delete dvs; // Cleanup
         dvs = NULL;
@@ -288,19 +394,21 @@ void handleMode(Mode mode)
         printf("CIS DVS display with fps check mode\n");
         cis = new CIS(CIS_FRAME_H, CIS_FRAME_W, CIS_FRAME_RDY_BASEADDR, CIS_FRAME_BASEADDR, CIS_BUFFER_NUM, C2H_DEVICE_CIS, H2C_DEVICE_CIS, mutexManager);
         dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, (DVS_FPS / (DISPLAY_FPS * DISPLAY_DOWNSAMPLE_NUM)), DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, true, DISPLAY_DOWNSAMPLE_NUM);
+        setOverloadPolicy(dvs, DVS_DISPLAY_OVERLOAD_POLICY, DVS_DISPLAY_OVERLOAD_DEPTH);
+        attachPresenter(cis, dvs, presenter, NULL);
         // Start threads for CIS and DVS
         if (cis)
         {
-            threads.emplace_back([cis]()
-                                 { cis->display_stream(); });
+            threads.push_back(start_role_thread("cis", [cis]()
+                                                       { cis->display_stream(); }));
         }
 
         if (dvs)
         {
-            threads.emplace_back([dvs]()
-                                 { dvs->double_buf_display_fps_writer(); });
-            threads.emplace_back([dvs]()
-                                 { dvs->double_buf_display_fps_reader(true); });
+            threads.push_back(start_role_thread("dvs_reader", [dvs]()
+                                                              { dvs->double_buf_display_fps_writer(); }));
+            threads.push_back(start_role_thread("dvs", [dvs]()
+                                                       { dvs->double_buf_display_fps_reader(true); }));
         }
 
         // Wait for all threads to complete
@@ -325,6 +433,7 @@ void handleMode(Mode mode)
             CIS_BUFFER_NUM,
             C2H_DEVICE_CIS, H2C_DEVICE_CIS,
             mutexManager);
+        attachPresenter(cis, dvs, presenter, NULL);
         cis->background_subtraction(); // Call CIS display stream
         delete cis;                    // Cleanup
         cis = NULL;
@@ -357,6 +466,7 @@ void handleMode(Mode mode)
         // set relative parameters between the two sensors
         cis->set_DVS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y);
         dvs->set_CIS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y, CIS_FRAME_W, CIS_FRAME_H, ROI_EVENT_SCORE, ROW_SCORE_THRESHOLD, ROI_HEIGHT_MIN_THRESHOLD, CIS_ROI_MIN_SIZE, ROI_INFLATION);
+        dvs->set_ROI_density(ROI_MIN_DENSITY);
         cout << "Path to folder that will contain CIS images:\n";
         cin.getline(bin_file_name, 100);
         cout << "Path to folder that will contain DVS images:\n";
@@ -364,14 +474,14 @@ void handleMode(Mode mode)
         // Start threads for CIS and DVS
         if (cis)
         {
-            threads.emplace_back([cis, bin_file_name]()
-                                 { cis->save_png_stream((char *)bin_file_name); });
+            threads.push_back(start_role_thread("cis", [cis, bin_file_name]()
+                                                       { cis->save_png_stream((char *)bin_file_name); }));
         }
 
         if (dvs)
         {
-            threads.emplace_back([dvs, vid_file_name]()
-                                 { dvs->save_png_stream((char *)vid_file_name, true); });
+            threads.push_back(start_role_thread("dvs", [dvs, vid_file_name]()
+                                                       { dvs->save_png_stream((char *)vid_file_name, true); }));
         }
 
         // Wait for all threads to complete
@@ -387,10 +497,172 @@ void handleMode(Mode mode)
         dvs = NULL;
         cis = NULL;
         break;
+    case DVS_STORE_SEGMENTED:
+        printf("DVS segmented store mode\n");
+
+        dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, true);
+        setOverloadPolicy(dvs, DVS_STORE_OVERLOAD_POLICY, DVS_STORE_OVERLOAD_DEPTH);
+        // there is no window to press ESC in, Ctrl-C stops the reader so that the writer
+        // drains the queue and trims the last segment and its index
+        catchTerminate(dvs);
+        printf("press Ctrl-C to stop recording\n");
+        // Start threads for reading and writing DVS
+        if (dvs)
+        {
+            threads.push_back(start_role_thread("writer", [dvs]()
+                                                          { dvs->double_buf_segment_writer(SEGMENT_DURATION_SEC, SEGMENT_MAX_BYTES, SEGMENT_DISK_QUOTA_BYTES); }));
+        }
+        if (dvs)
+        {
+            threads.push_back(start_role_thread("dvs_reader", [dvs]()
+                                                              { dvs->double_buf_reader(); }));
+        }
+        // Wait for all threads to complete
+        for (auto &t : threads)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+        catchTerminate(NULL);
+        delete dvs;
+        dvs = NULL;
+        break;
+    case CIS_DVS_RECORD:
+        printf("Record raw CIS and DVS frames into a single file, at full sensor rate\n");
+        terminate = false;
+        cis = new CIS(CIS_FRAME_H, CIS_FRAME_W, CIS_FRAME_RDY_BASEADDR, CIS_FRAME_BASEADDR, CIS_BUFFER_NUM, C2H_DEVICE_CIS, H2C_DEVICE_CIS, mutexManager, &bbox_mutex, &bbox, &terminate);
+        dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, &bbox, &bbox_mutex, &terminate);
+        recorder = new SyncRecorder(CIS_FRAME_H, CIS_FRAME_W, RECORD_CIS_SLOT_NUM,
+                                    DVS_FRAME_H, DVS_FRAME_W, (DVS_FRAME_H * DVS_FRAME_W) / 4 + FRAME_HEADER_BYTES, RECORD_DVS_SLOT_NUM);
+        cout << "Path to recording file:\n";
+        cin.getline(rec_file_name, 100);
+        if (recorder->open(rec_file_name))
+        {
+            // Start threads for CIS and DVS
+            threads.push_back(start_role_thread("cis", [cis, recorder]()
+                                                       { cis->record_stream(recorder); }));
+            threads.push_back(start_role_thread("dvs_reader", [dvs, recorder]()
+                                                              { dvs->record_stream(recorder); }));
+
+            cout << "Recording, press Enter to stop\n";
+            cin.get();
+            terminate = true;
+
+            // Wait for all threads to complete
+            for (auto &t : threads)
+            {
+                if (t.joinable())
+                {
+                    t.join();
+                }
+            }
+            recorder->close();
+        }
+        delete recorder;
+        delete cis;
+        delete dvs;
+        recorder = NULL;
+        dvs = NULL;
+        cis = NULL;
+        break;
+    case CIS_DVS_EXPORT:
+        printf("export a recording from CIS_DVS_RECORD mode to PNG images or videos\n");
+        dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, 1, DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, mutexManager, true);
+        cout << "Path to recording file:\n";
+        cin.getline(rec_file_name, 100);
+        cout << "Output format (png / vid):\n";
+        cin.getline(export_format, 100);
+        cout << "Path to CIS output (folder for png, file for vid):\n";
+        cin.getline(bin_file_name, 100);
+        cout << "Path to DVS output (folder for png, file for vid):\n";
+        cin.getline(vid_file_name, 100);
+        dvs->export_recording(rec_file_name, bin_file_name, vid_file_name, strcmp(export_format, "vid") == 0, true);
+        delete dvs;
+        dvs = NULL;
+        break;
+    case DVS_BIN_RENDER:
+        printf("render the bin file from DVS_STORE mode in parallel, at %d fps\n", RENDER_OUTPUT_FPS);
+        renderer = new BinRenderer(DVS_FRAME_H, DVS_FRAME_W, true);
+        cout << "Path to bin file:\n";
+        cin.getline(bin_file_name, 100);
+        cout << "Output format (png / vid):\n";
+        cin.getline(export_format, 100);
+        cout << "Path to output (folder for png, file for vid):\n";
+        cin.getline(vid_file_name, 100);
+        cout << "Colour mode (gray / rb):\n";
+        cin.getline(render_color, 100);
+        if (renderer->open(bin_file_name))
+        {
+            renderer->render(vid_file_name, strcmp(export_format, "vid") == 0, RENDER_OUTPUT_FPS, DVS_FPS,
+                             RENDER_WINDOW_FRAMES, strcmp(render_color, "rb") == 0 ? RENDER_RED_BLUE : RENDER_GRAY,
+                             true, RENDER_THREAD_NUM);
+        }
+        delete renderer;
+        renderer = NULL;
+        break;
+    case DATAFLOW_GRAPH:
+        printf("dataflow graph mode, stages and edges from %s\n", graph_path);
+        attachPresenter(NULL, NULL, presenter, &terminate);
+        graph_context.display_mutex = &mutexManager;
+        graph_context.bbox = &bbox;
+        graph_context.presenter = presenter;
+        graph = new DataflowGraph((DVS_FRAME_H * DVS_FRAME_W) / 4 + FRAME_HEADER_BYTES, &terminate);
+        if (graph->load(graph_path, create_dataflow_stage, &graph_context) && graph->start())
+        {
+            // ends with ESC or once a source runs out of frames
+            graph->wait();
+            graph->print_stats();
+            bbox.print_stats("DVS ROI bbox");
+        }
+        delete graph;
+        graph = NULL;
+        break;
     default:
         fprintf(stderr, "Error: Unknown mode\n");
         exit(EXIT_FAILURE);
     }
+    delete cis_replay;
+    delete dvs_replay;
+    delete presenter;
+    print_thread_topology();
+}
+
+void attachReplay(CIS *cis, DVS *dvs, ReplaySource *&cis_replay, ReplaySource *&dvs_replay, bool is_loop)
+{
+    if (replay_path == NULL)
+        return;
+
+    // modes without a terminate flag never end on their own, so they loop the replay
+    if (dvs)
+    {
+        dvs_replay = new ReplaySource((DVS_FRAME_H * DVS_FRAME_W) / 4 + FRAME_HEADER_BYTES);
+        if (dvs_replay->open(replay_path, RECORD_DVS, DVS_TIMESTAMP_TICK_US, DVS_FPS))
+        {
+            dvs_replay->set_speed(replay_speed);
+            dvs_replay->set_loop(is_loop);
+            dvs->set_replay(dvs_replay);
+        }
+        else
+        {
+            printf("no DVS frames to replay, DVS stays live\n");
+        }
+    }
+    if (cis)
+    {
+        cis_replay = new ReplaySource(CIS_FRAME_H * CIS_FRAME_W * 3);
+        if (cis_replay->open(replay_path, RECORD_CIS, DVS_TIMESTAMP_TICK_US, DVS_FPS))
+        {
+            cis_replay->set_speed(replay_speed);
+            cis_replay->set_loop(is_loop);
+            cis->set_replay(cis_replay);
+        }
+        else
+        {
+            printf("no CIS frames to replay, CIS stays live\n");
+        }
+    }
 }
 
 Mode parseArguments(int argc, char *argv[])
@@ -413,11 +685,21 @@ Mode parseArguments(int argc, char *argv[])
         {"dvs-bin-to-vid", no_argument, nullptr, 'v'},
         {"dvs-bin-to-png", no_argument, nullptr, 'g'},
         {"cis-dvs-store-png", no_argument, nullptr, 't'},
+        {"write-dvs-segmented", no_argument, nullptr, 'W'},
+        {"cis-dvs-record", no_argument, nullptr, 'R'},
+        {"cis-dvs-export", no_argument, nullptr, 'e'},
+        {"dvs-bin-render", no_argument, nullptr, 'n'},
+        {"bbox-record", no_argument, nullptr, 'B'},
+        {"graph", required_argument, nullptr, 'G'},
+        {"topology", required_argument, nullptr, 'T'},
+        {"overload", required_argument, nullptr, 'O'},
+        {"replay", required_argument, nullptr, 'y'},
+        {"replay-speed", required_argument, nullptr, 'z'},
         {nullptr, 0, nullptr, 0}};
 
     // Parse command-line arguments
     int opt;
-    while ((opt = getopt_long(argc, argv, "cdxswrbofpivgt", long_options, nullptr)) != -1)
+    while ((opt = getopt_long(argc, argv, "cdxswrbofpivgtWRenBG:T:O:y:z:", long_options, nullptr)) != -1)
     {
         switch (opt)
         {
@@ -491,11 +773,119 @@ Mode parseArguments(int argc, char *argv[])
             // the path to CIS, and the path to DVS image folders are required.
             mode = CIS_DVS_STORE_PNG;
             break;
+        case 'W':
+            // subdirectory bin_files must reside under CIS_DVS
+            // continuous recording split into segments by duration or size, see config.hpp
+            // oldest segments are deleted once SEGMENT_DISK_QUOTA_BYTES is exceeded
+            mode = DVS_STORE_SEGMENTED;
+            break;
+        case 'R':
+            // records raw CIS frames and every DVS frame with arrival times into one file
+            // no encoding while capturing, convert afterwards with ./main -e
+            mode = CIS_DVS_RECORD;
+            break;
+        case 'e':
+            // exports a recording from ./main -R to png images or videos
+            // the path to the recording and the output paths are required
+            mode = CIS_DVS_EXPORT;
+            break;
+        case 'n':
+            // renders a bin file from ./main -w on all cores
+            // output fps and accumulation window are set in config.hpp (RENDER_*)
+            mode = DVS_BIN_RENDER;
+            break;
+        case 'B':
+            // same as ./main -b while recording every DVS frame into ./bin_files like ./main -w
+            // the sensor is read once, display / ROI skip to the newest frame, the recording never drops
+            mode = CIS_DVS_BBOX_RECORD;
+            break;
+        case 'G':
+            // runs the stages and edges of a dataflow graph file instead of a fixed mode
+            // see graphs/*.graph and DataflowStages.hpp for the stage types
+            graph_path = optarg;
+            mode = DATAFLOW_GRAPH;
+            break;
+        case 'T':
+            // CPU affinity, scheduler and NUMA node per thread role, see ThreadTopology.hpp
+            if (!load_thread_topology(optarg))
+                exit(EXIT_FAILURE);
+            break;
+        case 'O':
+            // what the DVS reader does once its consumer is behind, for -p and -W
+            // <block | drop-oldest | drop-newest | merge>[:<queued frames>]
+            if (!BackPressureQueue::parse_policy(optarg, &overload_policy, &overload_depth))
+            {
+                fprintf(stderr, "Invalid overload policy %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            is_overload_set = true;
+            break;
+        case 'y':
+            // replays a bin file from ./main -w or a recording from ./main -R instead of the sensors
+            // works with -d, -x, -s, -r, -b, -f, -B
+            replay_path = optarg;
+            break;
+        case 'z':
+            // replay speed : 1 original rate, N times faster, 0 as fast as possible
+            replay_speed = atof(optarg);
+            break;
         default:
-            fprintf(stderr, "Usage: %s [--cis | --dvs | --check | --cis-dvs | --write-dvs | --roi | --bbox | --overlay | --dvs-fps | --cis-dvs-fps | --cis-roi | --dvs-bin-to-vid | --dvs-bin-to-png | --cis-dvs-store-png ]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [--cis | --dvs | --check | --cis-dvs | --write-dvs | --roi | --bbox | --overlay | --dvs-fps | --cis-dvs-fps | --cis-roi | --dvs-bin-to-vid | --dvs-bin-to-png | --cis-dvs-store-png | --write-dvs-segmented | --cis-dvs-record | --cis-dvs-export | --dvs-bin-render | --bbox-record | --graph <file> ] [--replay <file> [--replay-speed <x>]] [--topology <file>] [--overload <policy>[:<depth>]]\n", argv[0]);
             exit(EXIT_FAILURE);
         }
     }
 
     return mode;
 }
+
+void attachPresenter(CIS *cis, DVS *dvs, Presenter *&presenter, bool *terminate)
+{
+    // one thread owns every window, capture threads only post frames
+    presenter = new Presenter(PRESENT_FPS, terminate);
+    presenter->start();
+    if (cis)
+        cis->set_presenter(presenter);
+    if (dvs)
+        dvs->set_presenter(presenter);
+}
+
+void setOverloadPolicy(DVS *dvs, OverloadPolicy policy, int high_depth)
+{
+    // --overload replaces the default of the mode
+    if (is_overload_set)
+    {
+        policy = overload_policy;
+        high_depth = (overload_depth > 0) ? overload_depth : DBUF_FRAME_NUM;
+    }
+    dvs->set_overload_policy(policy, high_depth);
+}
+
+static void onTerminateSignal(int signum)
+{
+    (void)signum;
+    if (signal_dvs != NULL)
+    {
+        signal_dvs->request_terminate();
+    }
+}
+
+void catchTerminate(DVS *dvs)
+{
+    struct sigaction action;
+
+    signal_dvs = dvs;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    if (dvs != NULL)
+    {
+        action.sa_handler = onTerminateSignal;
+        // a second Ctrl-C kills the process if the reader is stuck waiting for the board
+        action.sa_flags = SA_RESETHAND;
+    }
+    else
+    {
+        action.sa_handler = SIG_DFL;
+    }
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
@@ -3,8 +3,13 @@
 
 #include <opencv2/opencv.hpp>
 #include "MutexManager.hpp"
+#include "FrameQueue.hpp"
+#include "ReplaySource.hpp"
+#include "Presenter.hpp"
 #include "PCIe.hpp"
 #include "bbox.hpp"
+#include "SharedBbox.hpp"
+#include "FramePool.hpp"
 
 class CIS
 {
@@ -28,19 +33,31 @@ private:
     uintptr_t *buffer_rdy_addr;
     uintptr_t *buffer_addr;
 
-    // controls which on-ZCU106 frame buffer to access
-    int rd_ptr;
-    
-    //mutex for PCIE transaction
-    MutexManager *pcie_mutex;
+    //PCIE transaction token : holds the on-ZCU106 frame buffer to access next,
+    //popped by the reading thread and pushed back once the frame is read
+    MpmcQueue<int> *pcie_gate;
     //mutex for opencv display
     MutexManager &display_mutex;
-    //bounding box shared memory
-    Bbox *bbox;
+    //resized DVS frame for overlay_dvs, reused every call
+    cv::Mat dvs_resize;
+    //ROI bounding box published by DVS
+    SharedBbox *bbox;
     //mutex for multithreading
     MutexManager *thread_mutex;
     //pointer to multithreading termination flag
     bool* terminate;
+    //recorded frame source replacing PCIE, NULL for live sensor
+    ReplaySource* replay;
+    //display thread showing posted frames, NULL to call cv::imshow directly
+    Presenter* presenter;
+    /**
+    * shows img in window, through the presenter if set
+    */
+    void show_frame(const char* window, cv::Mat& img);
+    /**
+    * @return true if ESC was pressed
+    */
+    bool is_esc_pressed();
     //DVS to CIS relative frame size scale (0~1)
     float x_scale;
     float y_scale;
@@ -79,7 +96,7 @@ public:
     * @param h2c_dev ("/dev/xdma_dvs0_h2c_0") h2c port alias of xdma driver
     * @param display_mutex mutex object for opencv display
     * @param thread_mutex mutex object for DVS-CIS multithreading
-    * @param bbox bounding box shared memory between CIS and DVS
+    * @param bbox ROI bounding box published by DVS
     * @param terminate pointer to shared terminate flag for terminating multithreading properly
     */
     CIS(
@@ -87,7 +104,7 @@ public:
         uintptr_t rdy_baseaddr, uintptr_t frame_baseaddr,
         int buffer_num,
         const char *c2h_dev, const char *h2c_dev,
-        MutexManager &display_mutex, MutexManager *thread_mutex, Bbox *bbox, bool* terminate);
+        MutexManager &display_mutex, MutexManager *thread_mutex, SharedBbox *bbox, bool* terminate);
    /**
     * calculate fps and display on frame
     */
@@ -109,6 +126,17 @@ public:
     * @param[out] frame frame to store CIS sensor data
     */
     void read_frame(cv::Mat &frame);
+   /**
+    * replaces the PCIE connection with a recorded frame source.
+    * once a non-looping replay is finished, *terminate is set (if available)
+    * @param replay opened replay source, NULL to go back to the live sensor
+    */
+    void set_replay(ReplaySource* replay);
+   /**
+    * routes every window of this object through a presenter thread
+    * @param presenter started presenter, NULL to display from the calling thread
+    */
+    void set_presenter(Presenter* presenter);
    /**
     * get CIS frame height
     * @return frame height
@@ -134,12 +162,13 @@ public:
     */
     void set_DVS( float x_scale_, float y_scale_, float x_offset_, float y_offset_);
    /**
-    * read shared ROI bounding box from shared memory to a struct pointer bbox.
-    * multithreading-safe
+    * read the latest ROI bounding box published by DVS to a struct pointer bbox.
+    * multithreading-safe, never blocks
     * @param[out] bbox pointer to output struct Bbox
+    * @param[out] snapshot if not NULL, receives the published box with its DVS frame number and timestamp
     * @return true if ROI exists, false if otherwise
     */
-    bool scale_bbox(Bbox *bbox);
+    bool scale_bbox(Bbox *bbox, BboxSnapshot *snapshot = NULL);
    /**
     * Displays ROI data calculated from DVS object on CIS opencv video.
     * 
@@ -151,12 +180,12 @@ public:
     /**
     *resizes dvs_frame to dvs_resize.
     *dvs_resize has width x height dimensions
-    *@param dvs_frame input frame
+    *@param dvs_frame input frame, kept alive by its handle while resizing
     *@param[out] dvs_resize output frame
     *@param width width of dvs_reize
     *@param height height of dvs_resize
     */
-    void resize_dvs(cv::Mat* dvs_frame, cv::Mat* dvs_resize, int width, int height);
+    void resize_dvs(const FrameHandle& dvs_frame, cv::Mat* dvs_resize, int width, int height);
     /**
     *initializes cv::Rect objects for clipping resized dvs frame to fit CIS frame
     * and cropping CIS frame to obtain region that needs to be overlayed.
@@ -168,7 +197,7 @@ public:
     void set_roi(cv::Rect &dvs_rect, cv::Rect &cis_rect, int& dvs_width, int& dvs_height);
     /**
     *overlays DVS frame on CIS frame.
-    *@param dvs_frame DVS frame pointer
+    *@param dvs_frame DVS frame from DVS::send_frame
     *@param dvs_rect region on resized DVS frame to be cropped and overlayed on CIS frame
     *@param cis_rect region on CIS frame to be cropped and overlayed with dvs_rect region
     *@param dvs_width resizing target width for DVS frame, not width of dvs_rect
@@ -176,7 +205,7 @@ public:
     *@param alpha overlay weight for DVS frame, default = 0.5
     *@param numRegions number of segmented regions for calibration grid, default : 10
     */
-    bool overlay_dvs(cv::Mat* dvs_frame, cv::Rect &dvs_rect, cv::Rect &cis_rect, int dvs_width, int dvs_height, float alpha=0.5, int numRegions=10);
+    bool overlay_dvs(const FrameHandle& dvs_frame, cv::Rect &dvs_rect, cv::Rect &cis_rect, int dvs_width, int dvs_height, float alpha=0.5, int numRegions=10);
     /**
     * draws red grid on cv::Mat image.
     *@param image image to draw red grid on
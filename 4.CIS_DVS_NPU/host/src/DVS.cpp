@@ -12,14 +12,22 @@ DVS::DVS( //normal constructor
     int buffer_num,
     const char *c2h_dev, const char *h2c_dev,
     MutexManager &display_mutex, bool double_buffering)
-    : frame_h(frame_h), frame_w(frame_w), accum_num(accum_num),
-      is_header(is_header), header_bytes(8),
-      rdy_baseaddr(rdy_baseaddr), frame_baseaddr(frame_baseaddr),
+    : pcie(c2h_dev, h2c_dev),
+      frame_h(frame_h),
+      frame_w(frame_w),
+      is_header(is_header),
+      header_bytes(8),
+      accum_num(accum_num),
       buffer_num(buffer_num),
-      pcie(c2h_dev, h2c_dev),
+      rdy_baseaddr(rdy_baseaddr),
+      frame_baseaddr(frame_baseaddr),
       rd_ptr(0),
       display_mutex(display_mutex),
-      terminate(NULL)
+      send_pool(NULL),
+      read_frame_num(0),
+      terminate(NULL),
+      replay(NULL),
+      presenter(NULL)
 {
     //set total frame bytes
     frame_bytes = (is_header) ? (frame_h * frame_w) / 4 + 8 : (frame_h * frame_w) / 4;
@@ -45,16 +53,21 @@ DVS::DVS( //normal constructor
     //set data pointer behind header
     frame_start = (is_header) ? buffer + header_bytes : buffer;
     
-    //allocate mutex and buffer for double buffering 
+    //allocate frame queues and buffers for double buffering 
+    dbuf_drop_num = 0;
     if(!double_buffering){
-        dbuf_mutex[0] = NULL;
-        dbuf_mutex[1] = NULL;
-        double_buffer = NULL;
+        dbuf_pool = NULL;
+        dbuf_full = NULL;
+        dbuf_free = NULL;
     }else{
-        double_buffer = (char *)malloc(frame_bytes * sizeof(char));
-        dbuf_mutex[0] = new MutexManager();
-        dbuf_mutex[1] = new MutexManager();
-        terminate = new bool;
+        dbuf_pool = (char *)malloc((size_t)frame_bytes * DBUF_FRAME_NUM * sizeof(char));
+        dbuf_full = new SpscQueue<char *>(DBUF_FRAME_NUM);
+        dbuf_free = new SpscQueue<char *>(DBUF_FRAME_NUM);
+        //every buffer starts out empty
+        for(int i = 0; i < DBUF_FRAME_NUM; i++){
+            dbuf_free->push(dbuf_pool + (size_t)frame_bytes * i);
+        }
+        terminate = new bool(false);
     }
 
     //don't init CIS related params right now
@@ -69,18 +82,26 @@ DVS::DVS( // crop_roi constructor
     uintptr_t rdy_baseaddr, uintptr_t frame_baseaddr,
     int buffer_num,
     const char *c2h_dev, const char *h2c_dev,
-    MutexManager &display_mutex, Bbox *bbox, MutexManager *thread_mutex,
+    MutexManager &display_mutex, SharedBbox *bbox, MutexManager *thread_mutex,
     bool* terminate)
-    : frame_h(frame_h), frame_w(frame_w), accum_num(accum_num),
-      is_header(is_header), header_bytes(8),
-      rdy_baseaddr(rdy_baseaddr), frame_baseaddr(frame_baseaddr),
+    : pcie(c2h_dev, h2c_dev),
+      frame_h(frame_h),
+      frame_w(frame_w),
+      is_header(is_header),
+      header_bytes(8),
+      accum_num(accum_num),
       buffer_num(buffer_num),
-      pcie(c2h_dev, h2c_dev),
+      rdy_baseaddr(rdy_baseaddr),
+      frame_baseaddr(frame_baseaddr),
       rd_ptr(0),
       display_mutex(display_mutex),
-      bbox(bbox),
       thread_mutex(thread_mutex),
-      terminate(terminate)
+      send_pool(NULL),
+      bbox(bbox),
+      read_frame_num(0),
+      terminate(terminate),
+      replay(NULL),
+      presenter(NULL)
 {
     //set total frame bytes
     frame_bytes = (is_header) ? (frame_h * frame_w) / 4 + 8 : (frame_h * frame_w) / 4;
@@ -106,9 +127,10 @@ DVS::DVS( // crop_roi constructor
     frame_start = (is_header) ? buffer + header_bytes : buffer;
 
     //disable double buffering
-    double_buffer = NULL;
-    dbuf_mutex[0] = NULL;
-    dbuf_mutex[1] = NULL;
+    dbuf_pool = NULL;
+    dbuf_full = NULL;
+    dbuf_free = NULL;
+    dbuf_drop_num = 0;
 
     //don't init CIS related params right now
     convert_cis = false;
@@ -247,7 +269,48 @@ void DVS::decode_header(const char *buffer, int &frame_num, uint32_t &timestamp)
                  static_cast<unsigned char>(buffer[0]));
 }
 
+void DVS::set_replay(ReplaySource* replay){
+    this->replay = replay;
+}
+
+void DVS::set_presenter(Presenter* presenter){
+    this->presenter = presenter;
+}
+
+void DVS::show_frame(const char* window, cv::Mat& img){
+    if (presenter != NULL)
+    {
+        presenter->post(window, img);
+        return;
+    }
+    display_mutex.lock_display();
+    cv::imshow(window, img);
+    display_mutex.unlock_display();
+}
+
+bool DVS::is_esc_pressed(){
+    if (presenter != NULL)
+    {
+        return presenter->is_closed();
+    }
+    display_mutex.lock_display();
+    bool is_esc = (cv::waitKey(1) == 27);
+    display_mutex.unlock_display();
+    return is_esc;
+}
+
 void DVS::read_frame(char* dvs_buffer){
+    //recorded frames instead of PCIE
+    if (replay != NULL)
+    {
+        if (!replay->read(dvs_buffer) && terminate != NULL)
+        {
+            *terminate = true;
+        }
+        read_frame_num++;
+        return;
+    }
+
     // wait for ready flag 
     // by polling through PCIE connection 
     while (true)
@@ -267,6 +330,7 @@ void DVS::read_frame(char* dvs_buffer){
 
     //change the address for ready flag and DVS frame
     rd_ptr = (rd_ptr == buffer_num - 1) ? 0 : rd_ptr + 1;
+    read_frame_num++;
 }
 
 void DVS::calc_fps(double &fps, int &frameCount, double &startTime, cv::Mat &frame) {
@@ -316,32 +380,25 @@ void DVS::display_stream(bool is_flip)
         calc_fps(fps, frameCount, startTime, frame);
 
         
-        //display using mutex locking 
-        display_mutex.lock_display();
-        
-        cv::imshow("DVS camera", frame);
+        //display, through the presenter if set
+        show_frame("DVS camera", frame);
 
         //press ESC to quit
-        if (cv::waitKey(1) == 27)
+        if (is_esc_pressed())
         {
-            display_mutex.unlock_display();
-
             //free frame 
             frame.release();
             break;
         }
-        display_mutex.unlock_display();
     }
 }
 
 void DVS::double_buf_display_fps_writer()
-// note : thread_mutex needs to be an array like thread_mutex[2]
 {
     int prev_frame_num;
     int prev_timestamp;
     int check_init = 0;
     int error_num = 0;
-    int double_buffer_idx = 0;
     int frame_num;
     uint32_t timestamp;
     char *dvs_buffer;
@@ -352,16 +409,12 @@ void DVS::double_buf_display_fps_writer()
         {
             check_init++;
         }
-        //maintain 2 buffers and 2 mutexes for double buffering
-        if (double_buffer_idx == 0)
+        //take an empty buffer, or read into the scratch buffer if the display holds all of them
+        bool is_queued = dbuf_free->try_pop(dvs_buffer);
+        if (!is_queued)
         {
-            dbuf_mutex[0]->lock_single_writer();
             dvs_buffer = buffer;
-        }
-        else
-        {
-            dbuf_mutex[1]->lock_single_writer();
-            dvs_buffer = double_buffer;
+            dbuf_drop_num++;
         }
         for(int i= 0; i<3; i++){
             //read raw data
@@ -383,19 +436,15 @@ void DVS::double_buf_display_fps_writer()
         }
 
 
-        //alternate between the two per every loop
-        if (double_buffer_idx == 0)
+        //hand the frame over to the display thread
+        if (is_queued)
         {
-            dbuf_mutex[0]->unlock_single_writer(1);
-            double_buffer_idx = 1;
-        }
-        else
-        {
-            dbuf_mutex[1]->unlock_single_writer(1);
-            double_buffer_idx = 0;
+            dbuf_full->push(dvs_buffer);
         }
         if(*terminate) break;
     }
+    //wake up the display thread
+    dbuf_full->close();
 }
 
 void DVS::double_buf_display_fps_reader(bool is_flip)
@@ -403,18 +452,23 @@ void DVS::double_buf_display_fps_reader(bool is_flip)
     double fps = 0.0;
     int frameCount = 0;
     double startTime = cv::getTickCount();
+    char *dvs_buffer;
     while (1)
     {
         
         //initialize cv::Mat frame
         frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
         
-        //stack frames using member functions
-        for (int frame_grp_num = 0; frame_grp_num < (accum_num / 6); frame_grp_num++)
+        //stack frames using member functions, every queued frame keeps 1 of 3 sensor frames
+        for (int frame_grp_num = 0; frame_grp_num < (accum_num / 3); frame_grp_num++)
         {
-            //lock mutex, write from buffer 0
-            dbuf_mutex[0]->lock_multiple_reader();
-           
+            //wait for the next frame, stop once the writer is gone
+            if (!dbuf_full->pop(dvs_buffer))
+            {
+                *terminate = true;
+                break;
+            }
+            frame_start = (is_header) ? dvs_buffer + header_bytes : dvs_buffer;
             if (frame_grp_num == 0)
             {
                 convert2BitTo8Bit();
@@ -423,14 +477,8 @@ void DVS::double_buf_display_fps_reader(bool is_flip)
             {
                 convert2BitTo8Bit_accum();
             }
-            dbuf_mutex[0]->unlock_multiple_reader();
-            
-            //lock mutex, write from buffer 1
-            dbuf_mutex[1]->lock_multiple_reader();
-            frame_start = (is_header) ? double_buffer + header_bytes : double_buffer;
-            convert2BitTo8Bit_accum();
             frame_start = (is_header) ? buffer + header_bytes : buffer;
-            dbuf_mutex[1]->unlock_multiple_reader();
+            dbuf_free->push(dvs_buffer);
         }
 
 
@@ -441,20 +489,15 @@ void DVS::double_buf_display_fps_reader(bool is_flip)
         calc_fps(fps, frameCount, startTime, frame);
 
         
-        //display using mutex locking 
-        display_mutex.lock_display();
-        
-        cv::imshow("DVS camera", frame);
+        show_frame("DVS camera", frame);
 
-        if (*terminate || cv::waitKey(1) == 27)
+        if (*terminate || is_esc_pressed())
         {
             *terminate = true;
             //cleanup
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        display_mutex.unlock_display();
         
     }
 
@@ -522,13 +565,11 @@ void DVS::fps_count(){
     }
 }
 void *DVS::double_buf_reader()
-// note : thread_mutex needs to be an array like thread_mutex[2]
 {
     int prev_frame_num;
     int prev_timestamp;
     int check_init = 0;
     int error_num = 0;
-    int double_buffer_idx = 0;
     int frame_num;
     uint32_t timestamp;
     char *dvs_buffer;
@@ -541,16 +582,12 @@ void *DVS::double_buf_reader()
             check_init++;
         }
 
-        //maintain 2 buffers and 2 mutexes for double buffering
-        if (double_buffer_idx == 0)
+        //take an empty buffer, or read into the scratch buffer if the writer holds all of them
+        bool is_queued = dbuf_free->try_pop(dvs_buffer);
+        if (!is_queued)
         {
-            dbuf_mutex[0]->lock_single_writer();
             dvs_buffer = buffer;
-        }
-        else
-        {
-            dbuf_mutex[1]->lock_single_writer();
-            dvs_buffer = double_buffer;
+            dbuf_drop_num++;
         }
         //read raw data
         read_frame(dvs_buffer);
@@ -569,18 +606,16 @@ void *DVS::double_buf_reader()
         prev_frame_num = frame_num;
         prev_timestamp = timestamp;
 
-        //alternate between the two per every loop
-        if (double_buffer_idx == 0)
+        //hand the frame over to the writer thread
+        if (is_queued)
         {
-            dbuf_mutex[0]->unlock_single_writer(1);
-            double_buffer_idx = 1;
-        }
-        else
-        {
-            dbuf_mutex[1]->unlock_single_writer(1);
-            double_buffer_idx = 0;
+            dbuf_full->push(dvs_buffer);
         }
+        if(*terminate) break;
     }
+    //let the writer drain the queue and finish
+    dbuf_full->close();
+    return nullptr;
 }
 
 void *DVS::double_buf_bin_writer()
@@ -613,17 +648,11 @@ void *DVS::double_buf_bin_writer()
         return nullptr;
     }
 
-    while (1)
+    char *dvs_buffer;
+    while (dbuf_full->pop(dvs_buffer))
     {
-        //lock mutex, write from buffer 0
-        dbuf_mutex[0]->lock_multiple_reader();
-        file.write(buffer, frame_bytes);
-        dbuf_mutex[0]->unlock_multiple_reader();
-
-        //lock mutex, write from buffer 1
-        dbuf_mutex[1]->lock_multiple_reader();
-        file.write(double_buffer, frame_bytes);
-        dbuf_mutex[1]->unlock_multiple_reader();
+        file.write(dvs_buffer, frame_bytes);
+        dbuf_free->push(dvs_buffer);
     }
 
     file.close();
@@ -635,12 +664,15 @@ void DVS::crop_coord(int img_show, int is_update, bool is_flip)
 {
     
 
+    //event counters per column and row, cleared every window
+    int *x_count = (int *)malloc(frame_w * sizeof(int));
+    int *y_count = (int *)malloc(frame_h * sizeof(int));
     while (true)
     {
         frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
-        //buffers to count the number of events per column and row
-        int *x_count = (int *)calloc(frame_w, sizeof(int));
-        int *y_count = (int *)calloc(frame_h, sizeof(int));
+        //clear the event counters of the previous window
+        memset(x_count, 0, frame_w * sizeof(int));
+        memset(y_count, 0, frame_h * sizeof(int));
 
         //total number of events accumulated throughout several frames
         int sum = 0;
@@ -664,33 +696,16 @@ void DVS::crop_coord(int img_show, int is_update, bool is_flip)
         //calculate event ROI in the form of a bounding box
         int is_roi = event_roi(x_count, y_count, sum, &b_box_dvs, &b_box_cis);
 
-        //cleanup
-        free(x_count);
-        free(y_count);
-        x_count = NULL;
-        y_count = NULL;
-
-        //acquire mutex 
-        thread_mutex->lock_single_writer();
-
-        //if there are enough events to draw a ROI
-        //write bounding box information in a shared struct variable
+        //if there are enough events to draw a ROI, publish the bounding box
+        //readers never block on this, and see the frame number it was calculated from
         if (is_roi)
         {
-            bbox->lx = b_box_cis.lx;
-            bbox->ly = b_box_cis.ly;
-            bbox->hx = b_box_cis.hx;
-            bbox->hy = b_box_cis.hy;
+            bbox->publish(b_box_cis, true, read_frame_num);
         }else if(!is_update){
-            bbox->lx = -1;
-            bbox->ly = -1;
-            bbox->hx = -1;
-            bbox->hy = -1;
+            bbox->invalidate(read_frame_num);
         }
-        thread_mutex->unlock_single_writer(1); //is_roi || is_update);
 
         //display DVS video and ROI if img_show == 1
-        display_mutex.lock_display();
         if (img_show)
         {
             if(is_flip){
@@ -699,28 +714,37 @@ void DVS::crop_coord(int img_show, int is_update, bool is_flip)
             cv::Point p1(b_box_dvs.lx, b_box_dvs.ly);
             cv::Point p2(b_box_dvs.hx, b_box_dvs.hy);
             cv::rectangle(frame, p1, p2, cv::Scalar(255), 2, cv::LINE_8);
-            cv::imshow("DVS camera", frame);
+            show_frame("DVS camera", frame);
         }
 
         //if ESC pressed, exit... 
         //or some other thread detects ESC press, exit.
-        if (*terminate || cv::waitKey(1) == 27)
+        if (*terminate || is_esc_pressed())
         {
             *terminate = true;
             //wake up any waiting threads
             thread_mutex->terminate();
             //cleanup
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        display_mutex.unlock_display();
     }
+    free(x_count);
+    free(y_count);
 }
 
-void DVS::send_frame(cv::Mat* dest_frame, bool is_flip)
+void DVS::send_frame(FrameHandle& dest_frame, bool is_flip)
 {
-    frame = cv::Mat::zeros(frame_h, frame_w, CV_8UC3);
+    if (send_pool == NULL){
+        send_pool = new FramePool(frame_h, frame_w, CV_8UC3, DVS_SEND_FRAME_NUM);
+    }
+    //waits only if the receiver still holds every pooled frame
+    if (!send_pool->acquire(dest_frame)){
+        return;
+    }
+    //convert straight into the pooled frame
+    frame = dest_frame.mat();
+    frame.setTo(cv::Scalar::all(0));
     //stack several frames and count their number of events 
     for (int frame_grp_num = 0; frame_grp_num < accum_num; frame_grp_num++)
     {
@@ -737,10 +761,8 @@ void DVS::send_frame(cv::Mat* dest_frame, bool is_flip)
     if(is_flip){
         cv::flip(frame, frame,0);
     }
-    thread_mutex->lock_single_writer();
-    //clone image to send to CIs
-    *dest_frame = frame.clone();
-    thread_mutex->unlock_single_writer(1);
+    //detach the header, so no later write to frame lands in a frame CIS holds
+    frame.release();
 }
 int DVS::event_accum(int *x_count, int *y_count, bool is_flip)
 {
@@ -1146,28 +1168,16 @@ void DVS::crop_new_ROI(int img_show, int is_update, bool is_flip)
         //calculate event ROI in the form of a bounding box
         int is_roi = new_ROI(&b_box_dvs, &b_box_cis);
     
-        //acquire mutex 
-        thread_mutex->lock_single_writer();
-
-        //if there are enough events to draw a ROI
-        //write bounding box information in a shared struct variable
+        //if there are enough events to draw a ROI, publish the bounding box
+        //readers never block on this, and see the frame number it was calculated from
         if (is_roi)
         {
-            bbox->lx = b_box_cis.lx;
-            bbox->ly = b_box_cis.ly;
-            bbox->hx = b_box_cis.hx;
-            bbox->hy = b_box_cis.hy;
-            // printf("%d %d %d %d\n", bbox->lx, bbox->ly, bbox->hx, bbox->hy);
+            bbox->publish(b_box_cis, true, read_frame_num);
         }else if(!is_update){
-            bbox->lx = -1;
-            bbox->ly = -1;
-            bbox->hx = -1;
-            bbox->hy = -1;
+            bbox->invalidate(read_frame_num);
         }
-        thread_mutex->unlock_single_writer(1); //is_roi || is_update);
 
         //display DVS video and ROI if img_show == 1
-        display_mutex.lock_display();
         if (img_show)
         {
             if(is_roi){
@@ -1175,35 +1185,38 @@ void DVS::crop_new_ROI(int img_show, int is_update, bool is_flip)
                 cv::Point p2(b_box_dvs.hx, b_box_dvs.hy);
                 cv::rectangle(frame, p1, p2, cv::Scalar(255), 2, cv::LINE_8);
             }
-            cv::imshow("DVS camera", frame);
+            show_frame("DVS camera", frame);
         }
 
         //if ESC pressed, exit... 
         //or some other thread detects ESC press, exit.
-        if (*terminate || cv::waitKey(1) == 27)
+        if (*terminate || is_esc_pressed())
         {
             *terminate = true;
             //wake up any waiting threads
             thread_mutex->terminate();
             //cleanup
             frame.release();
-            display_mutex.unlock_display();
             break;
         }
-        frame.release();
-        display_mutex.unlock_display();
     }
 }
 DVS::~DVS()
 {
-    if (double_buffer != NULL){
-        free(double_buffer);
-        delete dbuf_mutex[0];
-        delete dbuf_mutex[1];
+    if (dbuf_pool != NULL){
+        dbuf_full->print_stats("DVS frame queue");
+        printf("DVS frames dropped by reader : %llu\n", (unsigned long long)dbuf_drop_num);
+        free(dbuf_pool);
+        delete dbuf_full;
+        delete dbuf_free;
         if(terminate !=NULL){
             delete terminate;
         }
     }
+    if (send_pool != NULL){
+        send_pool->print_stats("DVS send frames");
+        delete send_pool;
+    }
     free(buffer);
     free(buffer_rdy);
     free(buffer_done);
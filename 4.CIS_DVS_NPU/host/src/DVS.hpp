@@ -28,7 +28,17 @@
 #include <condition_variable>
 #include "PCIe.hpp"
 #include "MutexManager.hpp"
+#include "FrameQueue.hpp"
+#include "ReplaySource.hpp"
+#include "Presenter.hpp"
 #include "bbox.hpp"
+#include "SharedBbox.hpp"
+#include "FramePool.hpp"
+
+//number of frame buffers between the PCIE reader and the consumer thread
+#define DBUF_FRAME_NUM 8
+//number of pooled frames handed out by send_frame
+#define DVS_SEND_FRAME_NUM 4
 
 //class to manage DVS object
 class DVS
@@ -48,8 +58,6 @@ private:
     // Frame data
     //raw sensor data buffer
     char *buffer;
-    //double buffering raw sensor data buffer
-    char *double_buffer;
     //frame for opencv display
     cv::Mat frame;
     //pointer to skip header and go to actual sensor data
@@ -82,14 +90,38 @@ private:
     //if true, calculate ROI bbox from CIS viewpoint
     bool convert_cis;
 
-    //bounding box shared memory
-    Bbox *bbox;
+    //BGR frames handed to CIS by send_frame, allocated on first use
+    FramePool *send_pool;
+
+    //ROI bounding box published to CIS threads
+    SharedBbox *bbox;
+    //DVS frames read so far, stamps every published bounding box
+    uint64_t read_frame_num;
 
     //pointer to multithreading termination flag
     bool *terminate;
+
+    //recorded frame source replacing PCIE, NULL for live sensor
+    ReplaySource *replay;
+    //display thread showing posted frames, NULL to call cv::imshow directly
+    Presenter *presenter;
+    /**
+    * shows img in window, through the presenter if set
+    */
+    void show_frame(const char* window, cv::Mat& img);
+    /**
+    * @return true if ESC was pressed
+    */
+    bool is_esc_pressed();
     
-    //mutex for write-to-bin file double buffering 
-    MutexManager* dbuf_mutex[2];
+    //frame buffers handed from the PCIE reader thread to the consumer thread
+    char *dbuf_pool;
+    //filled frame buffers, waiting for the consumer
+    SpscQueue<char *> *dbuf_full;
+    //empty frame buffers, returned by the consumer
+    SpscQueue<char *> *dbuf_free;
+    //frames read while the consumer held every buffer
+    uint64_t dbuf_drop_num;
 
     //DVS to CIS relative frame size scale (0~1)
     float cis_x_scale;
@@ -117,7 +149,7 @@ public:
     * @param c2h_dev ("/dev/xdma_dvs0_c2h_0") c2h port alias of xdma driver
     * @param h2c_dev ("/dev/xdma_dvs0_h2c_0") h2c port alias of xdma driver
     * @param display_mutex mutex object for opencv display
-    * @param double_buffering true if double buffering is enabled for write-to-bin purposes
+    * @param double_buffering true to allocate frame queues between reader and writer threads (DBUF_FRAME_NUM buffers)
     */
     DVS(
         int frame_h, int frame_w,
@@ -138,7 +170,7 @@ public:
     * @param c2h_dev ("/dev/xdma_dvs0_c2h_0") c2h port alias of xdma driver
     * @param h2c_dev ("/dev/xdma_dvs0_h2c_0") h2c port alias of xdma driver
     * @param display_mutex mutex object for opencv display
-    * @param bbox bounding box shared memory between CIS and DVS
+    * @param bbox ROI bounding box published to CIS
     * @param thread_mutex mutex object for DVS-CIS multithreading
     * @param terminate pointer to shared terminate flag for terminating multithreading properly
     */
@@ -148,7 +180,7 @@ public:
         uintptr_t rdy_baseaddr, uintptr_t frame_baseaddr,
         int buffer_num,
         const char *c2h_dev, const char *h2c_dev,
-        MutexManager &display_mutex,Bbox *bbox, MutexManager *thread_mutex = NULL,
+        MutexManager &display_mutex,SharedBbox *bbox, MutexManager *thread_mutex = NULL,
         bool *terminate = NULL);
 
    /**
@@ -237,13 +269,13 @@ public:
     */
     void display_stream(bool is_flip = false);
     /**
-    * writes sensor data to double buffer
-    * skips 1 frame for every 2 frames to match convert2bitto8bit latency
+    * writes sensor data to the frame queue
+    * keeps 1 frame for every 3 frames to match convert2bitto8bit latency
     */
     void double_buf_display_fps_writer();
 
     /**
-    * reads data from double buffer and displays DVS screen.
+    * reads data from the frame queue and displays DVS screen.
     * @param is_flip horizontal flip image. 
     */
     void double_buf_display_fps_reader(bool is_flip = false);
@@ -259,6 +291,17 @@ public:
     * @param dvs_buffer buffer to write sensor data to
     */
     void read_frame(char* dvs_buffer);
+   /**
+    * replaces the PCIE connection with a recorded frame source.
+    * once a non-looping replay is finished, *terminate is set (if available)
+    * @param replay opened replay source, NULL to go back to the live sensor
+    */
+    void set_replay(ReplaySource* replay);
+   /**
+    * routes every window of this object through a presenter thread
+    * @param presenter started presenter, NULL to display from the calling thread
+    */
+    void set_presenter(Presenter* presenter);
    /**
     prints error message to console whenever DVS experiences a frame drop.
     */
@@ -268,11 +311,12 @@ public:
     */
     void fps_count();
    /**
-    * thread to put DVS sensor data in 2 buffers using double buffering
+    * thread to put DVS sensor data in the frame queue.
+    * never waits for the consumer : if every buffer is taken, the frame is dropped and counted
     */
     void *double_buf_reader();
     /* 
-    * thread to read from double buffer and write to bin file 
+    * thread to read from the frame queue and write to bin file 
     * inside directory ./bin_files
     */
     void *double_buf_bin_writer();
@@ -298,11 +342,12 @@ public:
     */
     void crop_coord(int img_show = 1, int is_update = 0, bool is_flip = false);
     /**
-    *sends DVS frame data to dest_frame.
-    *@param[out] dest_frame pointer to write DVS frame to
+    *reads DVS frames straight into a pooled BGR frame and hands it over without copying.
+    *the frame returns to the pool once every handle to it is released.
+    *@param[out] dest_frame receives the new frame, its previous frame is released
     *@param is_flip send horizontally flipped image to CIS
     */
-    void send_frame(cv::Mat* dest_frame, bool is_flip = false);
+    void send_frame(FrameHandle& dest_frame, bool is_flip = false);
    /**
     * counts the number of events per frame row and column.
     * 
@@ -0,0 +1,152 @@
+#include "FramePool.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+FrameHandle::FrameHandle() : pool(NULL), idx(-1)
+{
+}
+
+FrameHandle::FrameHandle(const FrameHandle &other) : pool(other.pool), idx(other.idx)
+{
+    if (pool != NULL)
+        pool->retain(idx);
+}
+
+FrameHandle &FrameHandle::operator=(const FrameHandle &other)
+{
+    if (this == &other)
+        return *this;
+    // take the new reference first, other may share our frame
+    if (other.pool != NULL)
+        other.pool->retain(other.idx);
+    release();
+    pool = other.pool;
+    idx = other.idx;
+    return *this;
+}
+
+FrameHandle::~FrameHandle()
+{
+    release();
+}
+
+void FrameHandle::release()
+{
+    if (pool != NULL)
+        pool->unref(idx);
+    pool = NULL;
+    idx = -1;
+}
+
+bool FrameHandle::empty() const
+{
+    return pool == NULL;
+}
+
+cv::Mat FrameHandle::mat() const
+{
+    // header copy : an opencv call reallocating it cannot detach the pool slot
+    if (pool == NULL)
+        return cv::Mat();
+    return pool->slots[idx].mat;
+}
+
+FramePool::FramePool(int frame_h, int frame_w, int mat_type, int slot_num)
+    : slot_num(slot_num), acquire_num(0), exhausted_num(0)
+{
+    // keep every frame on its own cache lines
+    size_t row_bytes = (size_t)frame_w * CV_ELEM_SIZE(mat_type);
+    frame_bytes = ((row_bytes * frame_h) + 63) & ~(size_t)63;
+    memory = (char *)malloc(frame_bytes * slot_num);
+    if (memory == NULL)
+    {
+        perror("FramePool malloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(memory, 0, frame_bytes * slot_num);
+
+    slots = new Slot[slot_num];
+    free_slots = new MpmcQueue<int>(slot_num);
+    for (int i = 0; i < slot_num; i++)
+    {
+        slots[i].mat = cv::Mat(frame_h, frame_w, mat_type, memory + frame_bytes * i);
+        slots[i].ref_num.store(0);
+        free_slots->push(i);
+    }
+}
+
+void FramePool::retain(int idx)
+{
+    slots[idx].ref_num.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FramePool::unref(int idx)
+{
+    // acq_rel : writes through every handle happen before the slot is reused
+    if (slots[idx].ref_num.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        free_slots->push(idx);
+    }
+}
+
+bool FramePool::try_acquire(FrameHandle &handle)
+{
+    int idx;
+    if (!free_slots->try_pop(idx))
+    {
+        exhausted_num.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    handle.release();
+    slots[idx].ref_num.store(1, std::memory_order_relaxed);
+    handle.pool = this;
+    handle.idx = idx;
+    acquire_num.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool FramePool::acquire(FrameHandle &handle)
+{
+    int idx;
+    if (!free_slots->try_pop(idx))
+    {
+        exhausted_num.fetch_add(1, std::memory_order_relaxed);
+        // the handle may hold the last free frame
+        handle.release();
+        if (!free_slots->pop(idx))
+            return false;
+    }
+    handle.release();
+    slots[idx].ref_num.store(1, std::memory_order_relaxed);
+    handle.pool = this;
+    handle.idx = idx;
+    acquire_num.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void FramePool::close()
+{
+    free_slots->close();
+}
+
+size_t FramePool::available()
+{
+    return free_slots->size();
+}
+
+void FramePool::print_stats(const char *name)
+{
+    printf("%s : %d frames, acquired %llu, pool exhausted %llu\n",
+           name, slot_num,
+           (unsigned long long)acquire_num.load(),
+           (unsigned long long)exhausted_num.load());
+}
+
+FramePool::~FramePool()
+{
+    delete free_slots;
+    delete[] slots;
+    free(memory);
+}
@@ -0,0 +1,136 @@
+#include "FrameQueue.hpp"
+
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+
+static void futex_wait(std::atomic<uint32_t> *addr, uint32_t expected)
+{
+    // returns immediately if *addr != expected, spurious wake-ups are rechecked by the caller
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t> *addr, int num)
+{
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, num, NULL, NULL, 0);
+}
+
+QueueWaiter::QueueWaiter() : seq(0), waiter_num(0)
+{
+}
+
+uint32_t QueueWaiter::prepare()
+{
+    // register before reading seq, so a notify after our recheck always sees us
+    waiter_num.fetch_add(1);
+    return seq.load();
+}
+
+void QueueWaiter::cancel()
+{
+    waiter_num.fetch_sub(1);
+}
+
+void QueueWaiter::wait(uint32_t ticket)
+{
+    futex_wait(&seq, ticket);
+    waiter_num.fetch_sub(1);
+}
+
+void QueueWaiter::notify_one()
+{
+    seq.fetch_add(1);
+    if (waiter_num.load() > 0)
+    {
+        futex_wake(&seq, 1);
+    }
+}
+
+void QueueWaiter::notify_all()
+{
+    seq.fetch_add(1);
+    if (waiter_num.load() > 0)
+    {
+        futex_wake(&seq, INT_MAX);
+    }
+}
+
+QueueCounters::QueueCounters()
+    : push_num(0), pop_num(0), full_num(0),
+      push_wait_num(0), pop_wait_num(0), max_occupancy(0),
+      latency_sum_us(0), latency_max_us(0)
+{
+}
+
+int64_t QueueCounters::now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void QueueCounters::on_push(uint64_t occupancy)
+{
+    push_num.fetch_add(1, std::memory_order_relaxed);
+    uint64_t prev = max_occupancy.load(std::memory_order_relaxed);
+    while (occupancy > prev && !max_occupancy.compare_exchange_weak(prev, occupancy, std::memory_order_relaxed))
+        ;
+}
+
+void QueueCounters::on_pop(int64_t push_us)
+{
+    pop_num.fetch_add(1, std::memory_order_relaxed);
+    int64_t latency = now_us() - push_us;
+    if (latency < 0)
+        latency = 0;
+    latency_sum_us.fetch_add(latency, std::memory_order_relaxed);
+    uint64_t prev = latency_max_us.load(std::memory_order_relaxed);
+    while ((uint64_t)latency > prev && !latency_max_us.compare_exchange_weak(prev, latency, std::memory_order_relaxed))
+        ;
+}
+
+void QueueCounters::on_full()
+{
+    full_num.fetch_add(1, std::memory_order_relaxed);
+}
+
+void QueueCounters::on_push_wait()
+{
+    push_wait_num.fetch_add(1, std::memory_order_relaxed);
+}
+
+void QueueCounters::on_pop_wait()
+{
+    pop_wait_num.fetch_add(1, std::memory_order_relaxed);
+}
+
+QueueStats QueueCounters::snapshot()
+{
+    QueueStats stats;
+    stats.push_num = push_num.load(std::memory_order_relaxed);
+    stats.pop_num = pop_num.load(std::memory_order_relaxed);
+    stats.full_num = full_num.load(std::memory_order_relaxed);
+    stats.push_wait_num = push_wait_num.load(std::memory_order_relaxed);
+    stats.pop_wait_num = pop_wait_num.load(std::memory_order_relaxed);
+    stats.max_occupancy = max_occupancy.load(std::memory_order_relaxed);
+    stats.latency_sum_us = latency_sum_us.load(std::memory_order_relaxed);
+    stats.latency_max_us = latency_max_us.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void QueueCounters::print(const char *name)
+{
+    QueueStats stats = snapshot();
+    double mean_us = stats.pop_num ? (double)stats.latency_sum_us / stats.pop_num : 0.0;
+    printf("%s : pushed %llu, popped %llu, full %llu, push waits %llu, pop waits %llu, max occupancy %llu, latency mean %.1f us max %llu us\n",
+           name,
+           (unsigned long long)stats.push_num, (unsigned long long)stats.pop_num,
+           (unsigned long long)stats.full_num,
+           (unsigned long long)stats.push_wait_num, (unsigned long long)stats.pop_wait_num,
+           (unsigned long long)stats.max_occupancy,
+           mean_us, (unsigned long long)stats.latency_max_us);
+}
@@ -13,7 +13,8 @@ NPU::NPU(
                                                                                                                   demo_classes(demo_classes),
                                                                                                                   demo_ext_output(demo_ext_output),
                                                                                                                   display_mutex(display_mutex),
-                                                                                                                  terminate(terminate)
+                                                                                                                  terminate(terminate),
+                                                                                                                  presenter(NULL)
 {
     // darknet init code
     net = parse_network_cfg_custom(cfgfile, 1, 1); // set batch=1
@@ -32,13 +33,9 @@ NPU::NPU(
     calculate_binary_weights(net);
     parse_network_cfg_npu(&net, "");
 
-    // set mutexes for each member function, for pipelining purposes
-    pre_mutex = new MutexManager();
-    pre_mutex->setReady(1);
-    run_mutex = new MutexManager();
-    run_mutex->setReady(1);
-    post_mutex = new MutexManager();
-    post_mutex->setReady(1);
+    // NPU input buffer, 416x416 pixels with 8 bytes per pixel, allocated once
+    in_bytes = 416 * 416 * 8;
+    in_buffer = (char *)calloc(in_bytes, sizeof(char));
 
     // set FPS counters
     frameCount = 0;
@@ -55,13 +52,9 @@ NPU::NPU(
 }
 void NPU::preprocess(frame_data &frame, Bbox *bbox_cis, cv::Mat *CIS_frame, bool is_update)
 {
-    // lock the pipeline
-    pre_mutex->lock_pipeline();
     size_t in_c = 3;
     size_t in_h = 416;
     size_t in_w = 416;
-    int in_bytes = in_w * in_h * ((in_c + 7) / 8) * 8;
-    char *in_buffer = (char *)calloc(in_bytes, sizeof(char));
     // if no valid ROI, pass resizing
     if (is_update)
     {
@@ -73,7 +66,6 @@ void NPU::preprocess(frame_data &frame, Bbox *bbox_cis, cv::Mat *CIS_frame, bool
         // resize to 416x416
         if (img_roi.size().width != 416 || img_roi.size().height != 416)
         {
-            cv::Mat img_resize;
             cv::resize(img_roi, img_resize, cv::Size(416, 416));
             frame.sized = mat_to_image(img_resize);
             for (int c_idx = 0; c_idx < in_c; c_idx++)
@@ -86,7 +78,6 @@ void NPU::preprocess(frame_data &frame, Bbox *bbox_cis, cv::Mat *CIS_frame, bool
                 }
             }
             img_roi.release();
-            img_resize.release();
         }
         else
         {
@@ -103,6 +94,11 @@ void NPU::preprocess(frame_data &frame, Bbox *bbox_cis, cv::Mat *CIS_frame, bool
             img_roi.release();
         }
     }
+    else
+    {
+        // no input this frame, send zeros as before
+        memset(in_buffer, 0, in_bytes);
+    }
     frame.im = mat_to_image(*CIS_frame);
     // change to darknet format
 
@@ -110,15 +106,9 @@ void NPU::preprocess(frame_data &frame, Bbox *bbox_cis, cv::Mat *CIS_frame, bool
 
     write_from_buffer(npu_h2c_fname, npu_h2c_fd, in_buffer,
                       in_bytes, YOLOv3_INPUT_IMAGE);
-    free(in_buffer);
-    // unlock the pipeline
-    pre_mutex->unlock_pipeline();
 }
 void NPU::run_NPU(frame_data &frame, Bbox *bbox, bool is_update)
 {
-    // lock the pipeline
-    run_mutex->lock_pipeline();
-
     // if no valid ROI, pass resizing
     if (is_update)
     {
@@ -129,15 +119,15 @@ void NPU::run_NPU(frame_data &frame, Bbox *bbox, bool is_update)
         frame.nboxes = 0;
         frame.dets = get_network_boxes(&net, bbox->hx - bbox->lx, bbox->hy - bbox->ly, demo_thresh, 0.5, 0, 1, &frame.nboxes, letter_box);
     }
-    // unlock the pipeline
-    run_mutex->unlock_pipeline();
 }
 
-int NPU::postprocess(frame_data &frame, Bbox *bbox, float inv_frame_w, float inv_frame_h, bool is_update, bool show_dvs_view)
+void NPU::set_presenter(Presenter *presenter)
 {
-    // lock the pipeline
-    post_mutex->lock_pipeline();
+    this->presenter = presenter;
+}
 
+int NPU::postprocess(frame_data &frame, Bbox *bbox, float inv_frame_w, float inv_frame_h, bool is_update, bool show_dvs_view)
+{
     // if no valid ROI, skip running NPU
     if (is_update)
     {
@@ -159,9 +149,25 @@ int NPU::postprocess(frame_data &frame, Bbox *bbox, float inv_frame_w, float inv
     {
         skipFrameCount++;
     }
-    // display image
-    display_mutex.lock_display();
-    show_image_cv(frame.im, "Demo");
+    // display image, the presenter gets a BGR copy so this thread never waits for the display
+    bool is_esc;
+    if (presenter != NULL)
+    {
+        image copy = copy_image(frame.im);
+        constrain_image(copy);
+        cv::Mat mat = image_to_mat(copy);
+        cv::cvtColor(mat, mat, cv::COLOR_RGB2BGR);
+        presenter->post("Demo", mat);
+        free_image(copy);
+        is_esc = presenter->is_closed();
+    }
+    else
+    {
+        display_mutex.lock_display();
+        show_image_cv(frame.im, "Demo");
+        is_esc = (cv::waitKey(1) == 27);
+        display_mutex.unlock_display();
+    }
 
     // cleanup
     if (is_update)
@@ -172,27 +178,18 @@ int NPU::postprocess(frame_data &frame, Bbox *bbox, float inv_frame_w, float inv
     free_image(frame.im);
 
     // exit when ESC is pressed or other threads terminate
-    if (*terminate || cv::waitKey(1) == 27)
+    if (*terminate || is_esc)
     {
         *terminate = 1;
 
-        // wake up other threads
-        pre_mutex->terminate();
-        run_mutex->terminate();
-        post_mutex->terminate();
-
         // cleanup
         npu_h2c_fname = NULL;
-        display_mutex.unlock_display();
-        post_mutex->unlock_pipeline();
         return 1;
     }
     else
     {
         // cleanup
         npu_h2c_fname = NULL;
-        display_mutex.unlock_display();
-        post_mutex->unlock_pipeline();
         return 0;
     }
 
@@ -203,7 +200,5 @@ NPU::~NPU()
     free_ptrs((void **)demo_names, net.layers[net.n - 1].classes);
     free_alphabet(demo_alphabet);
     free_network(net);
-    delete pre_mutex;
-    delete run_mutex;
-    delete post_mutex;
+    free(in_buffer);
 }
\ No newline at end of file
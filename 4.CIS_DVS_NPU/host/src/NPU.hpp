@@ -2,6 +2,8 @@
 #define NPU_HPP
 #include "image.h"
 #include "MutexManager.hpp"
+#include "FrameQueue.hpp"
+#include "Presenter.hpp"
 #include "bbox.hpp"
 #include "network.h"
 #include "parser.h"
@@ -35,14 +37,10 @@ private:
     layer l;
     // mutex for opencv display
     MutexManager &display_mutex;
-    // mutex for NPU input preprocessing
-    MutexManager *pre_mutex;
-    // mutex for running NPU
-    MutexManager *run_mutex;
-    // mutex for NPU output postprocessing
-    MutexManager *post_mutex;
     // pointer to multithreading termination flag
     bool *terminate;
+    // display thread showing the demo window, NULL to call cv::imshow directly
+    Presenter *presenter;
     // frame count shared between threads
     int frameCount;
     int skipFrameCount;
@@ -54,6 +52,11 @@ private:
     // device
     char *npu_h2c_fname;
     int npu_h2c_fd;
+    // NPU input, written by preprocess for every frame (only the preprocess thread touches it)
+    char *in_buffer;
+    int in_bytes;
+    // resized ROI, reused by preprocess
+    cv::Mat img_resize;
 
 public:
     /**
@@ -91,6 +94,12 @@ public:
      * @param is_update give false to not run img through NPU
      */
     void run_NPU(frame_data &frame, Bbox *bbox, bool is_update = true);
+    /**
+     * routes the demo window through a presenter thread
+     *
+     * @param presenter started presenter, NULL to display from the postprocess thread
+     */
+    void set_presenter(Presenter *presenter);
 
     /**
      * postprocesses bounding boxes, and displays it on the original CIS opencv video.
@@ -0,0 +1,137 @@
+#include "Presenter.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <utility>
+#include "ThreadTopology.hpp"
+
+Presenter::Presenter(double display_fps, bool *terminate)
+    : display_fps(display_fps),
+      stop_presenter(false), closed(false),
+      terminate(terminate)
+{
+}
+
+void Presenter::start()
+{
+    present_thread = start_role_thread("display", [this]()
+                                       { present_loop(); });
+}
+
+Presenter::Mailbox *Presenter::find_mailbox(const char *window)
+{
+    std::lock_guard<std::mutex> lock(mailbox_mutex);
+    for (size_t i = 0; i < mailboxes.size(); i++)
+    {
+        if (strcmp(mailboxes[i]->window.c_str(), window) == 0)
+            return mailboxes[i];
+    }
+    Mailbox *mailbox = new Mailbox();
+    mailbox->window = window;
+    mailbox->is_new = false;
+    mailbox->posted_num = 0;
+    mailbox->presented_num = 0;
+    mailbox->dropped_num = 0;
+    mailboxes.push_back(mailbox);
+    return mailbox;
+}
+
+void Presenter::post(const char *window, const cv::Mat &frame)
+{
+    Mailbox *mailbox = find_mailbox(window);
+    std::lock_guard<std::mutex> lock(mailbox->mutex);
+    if (mailbox->is_new)
+    {
+        mailbox->dropped_num++;
+    }
+    // reuses the buffer handed back by the presenter, no allocation once sizes settle
+    frame.copyTo(mailbox->pending);
+    mailbox->is_new = true;
+    mailbox->posted_num++;
+}
+
+bool Presenter::is_closed()
+{
+    return closed.load();
+}
+
+void Presenter::present_loop()
+{
+    std::chrono::microseconds period((int64_t)(1e6 / display_fps));
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    std::vector<Mailbox *> snapshot;
+    while (!stop_presenter.load())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mailbox_mutex);
+            snapshot = mailboxes;
+        }
+        for (size_t i = 0; i < snapshot.size(); i++)
+        {
+            Mailbox *mailbox = snapshot[i];
+            bool is_new;
+            {
+                // take the newest frame, leave the old one for the next post
+                std::lock_guard<std::mutex> lock(mailbox->mutex);
+                is_new = mailbox->is_new;
+                if (is_new)
+                {
+                    std::swap(mailbox->pending, mailbox->shown);
+                    mailbox->is_new = false;
+                    mailbox->presented_num++;
+                }
+            }
+            if (is_new)
+            {
+                cv::imshow(mailbox->window, mailbox->shown);
+            }
+        }
+
+        // press ESC to quit
+        if (cv::waitKey(1) == 27)
+        {
+            closed.store(true);
+            if (terminate != NULL)
+            {
+                *terminate = true;
+            }
+        }
+
+        // present at a fixed rate, skip ahead instead of catching up after a stall
+        next += period;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (next < now)
+        {
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void Presenter::stop()
+{
+    if (!present_thread.joinable())
+        return;
+    stop_presenter.store(true);
+    present_thread.join();
+
+    std::lock_guard<std::mutex> lock(mailbox_mutex);
+    for (size_t i = 0; i < mailboxes.size(); i++)
+    {
+        printf("%s : posted %llu, presented %llu, dropped for display %llu\n",
+               mailboxes[i]->window.c_str(),
+               (unsigned long long)mailboxes[i]->posted_num,
+               (unsigned long long)mailboxes[i]->presented_num,
+               (unsigned long long)mailboxes[i]->dropped_num);
+    }
+}
+
+Presenter::~Presenter()
+{
+    stop();
+    for (size_t i = 0; i < mailboxes.size(); i++)
+    {
+        delete mailboxes[i];
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef PRESENTER_HPP
+#define PRESENTER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * display thread owning every opencv window.
+ *
+ * capture threads post frames instead of calling cv::imshow / cv::waitKey themselves.
+ * every window has a single-slot mailbox holding the newest posted frame,
+ * a frame that is replaced before it was presented is counted as dropped for display.
+ * the presenter shows the mailboxes at a fixed rate and handles the ESC key.
+ */
+class Presenter
+{
+private:
+    struct Mailbox
+    {
+        std::string window;
+        // guards pending and is_new only, never held during imshow
+        std::mutex mutex;
+        // newest posted frame
+        cv::Mat pending;
+        bool is_new;
+        // frame currently on screen, only touched by the presenter thread
+        cv::Mat shown;
+        // statistics
+        uint64_t posted_num;
+        uint64_t presented_num;
+        uint64_t dropped_num;
+    };
+
+    // presentation rate
+    double display_fps;
+    // one mailbox per window, created on the first post
+    std::vector<Mailbox *> mailboxes;
+    std::mutex mailbox_mutex;
+
+    std::thread present_thread;
+    std::atomic<bool> stop_presenter;
+    // set once ESC was pressed
+    std::atomic<bool> closed;
+    // pointer to multithreading termination flag, set together with closed (may be NULL)
+    bool *terminate;
+
+    Mailbox *find_mailbox(const char *window);
+    void present_loop();
+
+public:
+    /**
+     * @param display_fps presentation rate (DISPLAY_FPS)
+     * @param terminate termination flag to set when ESC is pressed, NULL if not shared
+     */
+    Presenter(double display_fps, bool *terminate = NULL);
+    /**
+     * launches the presenter thread
+     */
+    void start();
+    /**
+     * copies frame into the mailbox of window, never waits for the display
+     * multithreading-safe
+     */
+    void post(const char *window, const cv::Mat &frame);
+    /**
+     * @return true once ESC was pressed in any window
+     */
+    bool is_closed();
+    /**
+     * stops the presenter thread and prints per-window statistics
+     */
+    void stop();
+    ~Presenter();
+};
+
+#endif // PRESENTER_HPP
@@ -0,0 +1,57 @@
+#ifndef RECORDINGFORMAT_HPP
+#define RECORDINGFORMAT_HPP
+
+#include <stdint.h>
+
+/*
+ * file format of a CIS / DVS recording, written by SyncRecorder (3.CIS_DVS) and read by ReplaySource.
+ * a RecordingHeader, then every frame as a RecordHeader followed by its payload, in arrival order.
+ */
+
+// first bytes of a recording file
+#define RECORDING_MAGIC "CDVSREC1"
+#define RECORDING_VERSION 1
+
+// record types
+#define RECORD_CIS 0
+#define RECORD_DVS 1
+#define RECORD_TYPE_NUM 2
+
+/**
+ * header at the start of a recording file
+ */
+struct RecordingHeader
+{
+    // RECORDING_MAGIC, not null terminated
+    char magic[8];
+    // RECORDING_VERSION
+    uint32_t version;
+    // CIS frame format, payload is BGR as read from PCIE
+    uint32_t cis_frame_h;
+    uint32_t cis_frame_w;
+    uint32_t cis_frame_bytes;
+    // DVS frame format, payload is the raw 2-bit frame including its header
+    uint32_t dvs_frame_h;
+    uint32_t dvs_frame_w;
+    uint32_t dvs_frame_bytes;
+    uint32_t reserved;
+};
+
+/**
+ * header in front of every frame in a recording file
+ */
+struct RecordHeader
+{
+    // RECORD_CIS or RECORD_DVS
+    uint32_t type;
+    // number of bytes following this header
+    uint32_t payload_bytes;
+    // frame number, from DVS header or counted on host for CIS
+    uint32_t frame_num;
+    // timestamp from DVS header, 0 for CIS
+    uint32_t timestamp;
+    // arrival time on host in microseconds since the recording started, same clock for both sensors
+    int64_t arrival_us;
+};
+
+#endif // RECORDINGFORMAT_HPP
@@ -0,0 +1,192 @@
+#include "ReplaySource.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+
+ReplaySource::ReplaySource(int frame_bytes)
+    : base(NULL), file_bytes(0), frame_bytes(frame_bytes),
+      read_idx(0), speed(1.0), is_loop(false), is_finished(false), is_started(false),
+      delivered_num(0), loop_num(0)
+{
+}
+
+bool ReplaySource::open(const char *path, int record_type, double timestamp_tick_us, double nominal_fps)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Error opening replay file");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        fprintf(stderr, "replay file %s is empty\n", path);
+        close(fd);
+        return false;
+    }
+    file_bytes = st.st_size;
+    void *addr = mmap(NULL, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap replay file");
+        return false;
+    }
+    madvise(addr, file_bytes, MADV_SEQUENTIAL);
+    base = (const char *)addr;
+
+    bool ok;
+    if (file_bytes >= sizeof(RecordingHeader) && memcmp(base, RECORDING_MAGIC, 8) == 0)
+    {
+        ok = index_recording(record_type);
+    }
+    else if (record_type == RECORD_DVS)
+    {
+        ok = index_bin(8, timestamp_tick_us, nominal_fps);
+    }
+    else
+    {
+        fprintf(stderr, "%s is not a CIS-DVS recording, it holds no CIS frames\n", path);
+        ok = false;
+    }
+    if (!ok || offsets.empty())
+    {
+        munmap((void *)base, file_bytes);
+        base = NULL;
+        return false;
+    }
+    printf("replaying %d %s frames from %s, %.2f s\n", (int)offsets.size(),
+           record_type == RECORD_CIS ? "CIS" : "DVS", path, times_us.back() * 1e-6);
+    return true;
+}
+
+bool ReplaySource::index_bin(int header_bytes, double timestamp_tick_us, double nominal_fps)
+{
+    size_t frame_num = file_bytes / frame_bytes;
+    int64_t nominal_us = (int64_t)(1e6 / nominal_fps);
+    int64_t max_gap_us = 1000000;
+
+    offsets.reserve(frame_num);
+    times_us.reserve(frame_num);
+    uint32_t prev_timestamp = 0;
+    int64_t time_us = 0;
+    for (size_t i = 0; i < frame_num; i++)
+    {
+        const unsigned char *header = (const unsigned char *)(base + i * frame_bytes);
+        uint32_t timestamp = (header[3] << 24) | (header[2] << 16) | (header[1] << 8) | header[0];
+        if (i > 0)
+        {
+            // unsigned difference also covers a wrapped counter
+            int64_t delta_us = (int64_t)((uint32_t)(timestamp - prev_timestamp) * timestamp_tick_us);
+            // frames without headers or after a recording gap fall back to the nominal rate
+            if (header_bytes == 0 || delta_us <= 0 || delta_us > max_gap_us)
+                delta_us = nominal_us;
+            time_us += delta_us;
+        }
+        prev_timestamp = timestamp;
+        offsets.push_back(i * frame_bytes);
+        times_us.push_back(time_us);
+    }
+    return true;
+}
+
+bool ReplaySource::index_recording(int record_type)
+{
+    const RecordingHeader *header = (const RecordingHeader *)base;
+    uint32_t expected = (record_type == RECORD_CIS) ? header->cis_frame_bytes : header->dvs_frame_bytes;
+    if ((int)expected != frame_bytes)
+    {
+        fprintf(stderr, "frame size of recording (%u) does not match (%d)\n", expected, frame_bytes);
+        return false;
+    }
+
+    size_t offset = sizeof(RecordingHeader);
+    int64_t first_us = 0;
+    while (offset + sizeof(RecordHeader) <= file_bytes)
+    {
+        const RecordHeader *record = (const RecordHeader *)(base + offset);
+        size_t payload = offset + sizeof(RecordHeader);
+        if (payload + record->payload_bytes > file_bytes)
+            break;
+        if ((int)record->type == record_type)
+        {
+            if (offsets.empty())
+                first_us = record->arrival_us;
+            offsets.push_back(payload);
+            times_us.push_back(record->arrival_us - first_us);
+        }
+        offset = payload + record->payload_bytes;
+    }
+    return true;
+}
+
+void ReplaySource::set_speed(double speed)
+{
+    this->speed = speed;
+}
+
+void ReplaySource::set_loop(bool loop)
+{
+    is_loop = loop;
+}
+
+bool ReplaySource::read(char *dst)
+{
+    std::unique_lock<std::mutex> lock(replay_mutex);
+    if (base == NULL || is_finished)
+        return false;
+
+    if (read_idx == offsets.size())
+    {
+        if (!is_loop)
+        {
+            is_finished = true;
+            return false;
+        }
+        read_idx = 0;
+        loop_num++;
+        is_started = false;
+    }
+    if (!is_started)
+    {
+        start_time = std::chrono::steady_clock::now();
+        is_started = true;
+    }
+
+    // wait for the presentation time of this frame
+    if (speed > 0)
+    {
+        std::chrono::microseconds offset_us((int64_t)(times_us[read_idx] / speed));
+        std::this_thread::sleep_until(start_time + offset_us);
+    }
+    memcpy(dst, base + offsets[read_idx], frame_bytes);
+    read_idx++;
+    delivered_num++;
+    return true;
+}
+
+bool ReplaySource::finished()
+{
+    std::lock_guard<std::mutex> lock(replay_mutex);
+    return is_finished;
+}
+
+int ReplaySource::get_frame_num()
+{
+    return offsets.size();
+}
+
+ReplaySource::~ReplaySource()
+{
+    if (base != NULL)
+    {
+        printf("replayed %llu frames, %d loops\n", (unsigned long long)delivered_num, loop_num);
+        munmap((void *)base, file_bytes);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef SHAREDBBOX_HPP
+#define SHAREDBBOX_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include "bbox.hpp"
+
+/**
+ * consistent copy of the shared ROI bounding box
+ */
+struct BboxSnapshot
+{
+    // bounding box, all -1 when invalidated
+    Bbox bbox;
+    // false if the publisher had no ROI for this frame
+    bool is_valid;
+    // number of DVS frames read by the publisher when the ROI was calculated
+    uint64_t frame_num;
+    // monotonic publish time in microseconds
+    int64_t timestamp_us;
+    // number of publishes so far, 0 if nothing was published yet
+    uint64_t version;
+};
+
+/**
+ * ROI bounding box published by the DVS thread and read by CIS / NPU threads (seqlock).
+ *
+ * the writer never waits, readers never block : a read only retries
+ * while a publish is in progress, and always returns the latest complete box.
+ * readers compare frame_num / timestamp_us with their own clock to see how stale the box is.
+ * single writer only.
+ */
+class SharedBbox
+{
+private:
+    // odd while a publish is in progress
+    std::atomic<uint32_t> seq;
+    // payload, written between the two seq updates
+    std::atomic<int> lx;
+    std::atomic<int> ly;
+    std::atomic<int> hx;
+    std::atomic<int> hy;
+    std::atomic<bool> is_valid;
+    std::atomic<uint64_t> frame_num;
+    std::atomic<int64_t> timestamp_us;
+    std::atomic<uint64_t> version;
+    // statistics
+    std::atomic<uint64_t> read_num;
+    std::atomic<uint64_t> retry_num;
+
+public:
+    SharedBbox();
+    /**
+     * publishes a new bounding box, never waits for readers
+     * @param bbox bounding box to publish
+     * @param is_valid false to publish "no ROI"
+     * @param frame_num DVS frame number the box was calculated from
+     */
+    void publish(const Bbox &bbox, bool is_valid, uint64_t frame_num);
+    /**
+     * publishes "no ROI" with all coordinates set to -1
+     * @param frame_num DVS frame number the decision was made on
+     */
+    void invalidate(uint64_t frame_num);
+    /**
+     * copies the latest complete bounding box, never blocks
+     * @param[out] snapshot latest published box
+     */
+    void read(BboxSnapshot &snapshot);
+    /**
+     * @return microseconds since snapshot was published, -1 if nothing was published yet
+     */
+    static int64_t age_us(const BboxSnapshot &snapshot);
+    /**
+     * @return monotonic time in microseconds, same clock as timestamp_us
+     */
+    static int64_t now_us();
+    /**
+     * prints publish / read counters in one line
+     * @param name name shown in the line
+     */
+    void print_stats(const char *name);
+};
+
+#endif // SHAREDBBOX_HPP
@@ -0,0 +1,481 @@
+#include "ThreadTopology.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// priority value standing for sched_get_priority_max of the policy
+#define PRIORITY_MAX -2
+// field left unchanged
+#define UNCHANGED -1
+// nodes a single unsigned long node mask can name
+#define NUMA_NODE_LIMIT (int)(sizeof(unsigned long) * 8)
+
+struct ThreadProfile
+{
+    std::string role;
+    bool has_cpus;
+    cpu_set_t cpus;
+    int policy;
+    int priority;
+    int numa_node;
+};
+
+// achieved placement of one thread
+struct ThreadPlacement
+{
+    std::string role;
+    std::string profile;
+    long tid;
+    std::string cpus;
+    int cpu;
+    int node;
+    int policy;
+    int priority;
+    std::string errors;
+};
+
+// result of one place_thread_buffer call, pages read back from the kernel after the move
+struct BufferPlacement
+{
+    std::string role;
+    size_t bytes;
+    // requested node
+    int node;
+    int page_num;
+    // pages on the requested node
+    int node_page_num;
+    // pages not allocated yet, they go to the requested node when first touched
+    int absent_page_num;
+    // a node holding the other pages, -1 if none
+    int other_node;
+    std::string error;
+};
+
+static std::mutex topology_mutex;
+static std::vector<ThreadProfile> profiles;
+static bool is_loaded = false;
+static std::vector<ThreadPlacement> placements;
+static std::vector<BufferPlacement> buffer_placements;
+
+static void load_builtin_profile()
+{
+    // same as the former setThreadPriority on the PCIE reader threads
+    ThreadProfile profile;
+    profile.role = "dvs_reader";
+    profile.has_cpus = false;
+    CPU_ZERO(&profile.cpus);
+    profile.policy = SCHED_FIFO;
+    profile.priority = PRIORITY_MAX;
+    profile.numa_node = UNCHANGED;
+    profiles.push_back(profile);
+    is_loaded = true;
+}
+
+static bool parse_cpus(const char *text, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    const char *p = text;
+    while (*p != '\0')
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first || last >= CPU_SETSIZE)
+                return false;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return false;
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+static bool parse_policy(const char *text, int *policy)
+{
+    if (strcmp(text, "-") == 0)
+        *policy = UNCHANGED;
+    else if (strcmp(text, "other") == 0)
+        *policy = SCHED_OTHER;
+    else if (strcmp(text, "batch") == 0)
+        *policy = SCHED_BATCH;
+    else if (strcmp(text, "idle") == 0)
+        *policy = SCHED_IDLE;
+    else if (strcmp(text, "fifo") == 0)
+        *policy = SCHED_FIFO;
+    else if (strcmp(text, "rr") == 0)
+        *policy = SCHED_RR;
+    else
+        return false;
+    return true;
+}
+
+static const char *policy_name(int policy)
+{
+    switch (policy)
+    {
+    case SCHED_OTHER:
+        return "other";
+    case SCHED_BATCH:
+        return "batch";
+    case SCHED_IDLE:
+        return "idle";
+    case SCHED_FIFO:
+        return "fifo";
+    case SCHED_RR:
+        return "rr";
+    default:
+        return "?";
+    }
+}
+
+static std::string format_cpus(const cpu_set_t *cpus)
+{
+    std::string text;
+    char range[32];
+    int cpu = 0;
+    while (cpu < CPU_SETSIZE)
+    {
+        if (!CPU_ISSET(cpu, cpus))
+        {
+            cpu++;
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+            last++;
+        if (last == cpu)
+            snprintf(range, sizeof(range), "%s%d", text.empty() ? "" : ",", cpu);
+        else
+            snprintf(range, sizeof(range), "%s%d-%d", text.empty() ? "" : ",", cpu, last);
+        text += range;
+        cpu = last + 1;
+    }
+    return text;
+}
+
+/**
+ * @return NUMA node of cpu from sysfs, -1 if unknown (no NUMA support)
+ */
+static int cpu_node(int cpu)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return -1;
+    int node = -1;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9')
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/**
+ * @return explicit node of the profile, else node of its first CPU, -1 if none or not below NUMA_NODE_LIMIT
+ */
+static int profile_node(const ThreadProfile &profile)
+{
+    if (profile.numa_node != UNCHANGED)
+        return profile.numa_node;
+    if (!profile.has_cpus)
+        return -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &profile.cpus))
+        {
+            // beyond the node mask, left to the kernel
+            int node = cpu_node(cpu);
+            return (node < NUMA_NODE_LIMIT) ? node : -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @return profile of role, else of fallback, else "default", NULL if none. topology_mutex held
+ */
+static const ThreadProfile *find_profile(const char *role, const char *fallback)
+{
+    if (!is_loaded)
+        load_builtin_profile();
+    const char *names[3] = {role, fallback, "default"};
+    for (int i = 0; i < 3; i++)
+    {
+        if (names[i] == NULL)
+            continue;
+        for (size_t j = 0; j < profiles.size(); j++)
+        {
+            if (profiles[j].role == names[i])
+                return &profiles[j];
+        }
+    }
+    return NULL;
+}
+
+static void add_error(std::string &errors, const char *error)
+{
+    if (!errors.empty())
+        errors += ", ";
+    errors += error;
+}
+
+bool load_thread_topology(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror("Failed to open thread topology");
+        return false;
+    }
+
+    std::vector<ThreadProfile> loaded;
+    char line[256];
+    int line_num = 0;
+    bool is_ok = true;
+    while (is_ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_num++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        char role[64], cpus[128], policy[16], priority[16], node[16];
+        int field_num = sscanf(line, "%63s %127s %15s %15s %15s", role, cpus, policy, priority, node);
+        if (field_num <= 0)
+            continue;
+
+        ThreadProfile profile;
+        profile.role = role;
+        profile.has_cpus = (field_num >= 2 && strcmp(cpus, "-") != 0);
+        CPU_ZERO(&profile.cpus);
+        profile.policy = UNCHANGED;
+        profile.priority = UNCHANGED;
+        profile.numa_node = UNCHANGED;
+        is_ok = (field_num == 5);
+        if (is_ok && profile.has_cpus)
+            is_ok = parse_cpus(cpus, &profile.cpus);
+        if (is_ok)
+            is_ok = parse_policy(policy, &profile.policy);
+        if (is_ok && strcmp(priority, "max") == 0)
+            profile.priority = PRIORITY_MAX;
+        else if (is_ok && strcmp(priority, "-") != 0)
+            profile.priority = atoi(priority);
+        if (is_ok && strcmp(node, "-") != 0)
+        {
+            char *end;
+            long node_id = strtol(node, &end, 10);
+            if (end == node || *end != '\0' || node_id < 0 || node_id >= NUMA_NODE_LIMIT)
+            {
+                fprintf(stderr, "%s:%d: numa node must be 0-%d or -\n", path, line_num, NUMA_NODE_LIMIT - 1);
+                is_ok = false;
+                break;
+            }
+            profile.numa_node = (int)node_id;
+        }
+        if (!is_ok)
+        {
+            fprintf(stderr, "%s:%d: expected <role> <cpus> <policy> <priority> <numa node>\n", path, line_num);
+            break;
+        }
+        loaded.push_back(profile);
+    }
+    fclose(file);
+    if (!is_ok)
+        return false;
+
+    std::lock_guard<std::mutex> lock(topology_mutex);
+    profiles = loaded;
+    is_loaded = true;
+    return true;
+}
+
+void apply_thread_role(const char *role, const char *fallback)
+{
+    std::unique_lock<std::mutex> lock(topology_mutex);
+    const ThreadProfile *found = find_profile(role, fallback);
+    ThreadProfile profile;
+    if (found != NULL)
+        profile = *found;
+    lock.unlock();
+
+    ThreadPlacement placement;
+    placement.role = role;
+    placement.profile = (found != NULL) ? profile.role : "-";
+    placement.tid = syscall(SYS_gettid);
+    pthread_t self = pthread_self();
+    char error[96];
+
+    if (found != NULL && profile.has_cpus)
+    {
+        int rc = pthread_setaffinity_np(self, sizeof(cpu_set_t), &profile.cpus);
+        if (rc != 0)
+        {
+            snprintf(error, sizeof(error), "affinity %s: %s", format_cpus(&profile.cpus).c_str(), strerror(rc));
+            add_error(placement.errors, error);
+        }
+    }
+
+    // prefer the node of the role for everything this thread allocates from now on
+    int node = (found != NULL) ? profile_node(profile) : -1;
+    if (node >= 0)
+    {
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) != 0)
+        {
+            snprintf(error, sizeof(error), "numa node %d: %s", node, strerror(errno));
+            add_error(placement.errors, error);
+        }
+    }
+
+    if (found != NULL && profile.policy != UNCHANGED)
+    {
+        sched_param sch;
+        if (profile.priority == PRIORITY_MAX)
+            sch.sched_priority = sched_get_priority_max(profile.policy);
+        else if (profile.priority == UNCHANGED)
+            sch.sched_priority = sched_get_priority_min(profile.policy);
+        else
+            sch.sched_priority = profile.priority;
+        int rc = pthread_setschedparam(self, profile.policy, &sch);
+        if (rc != 0)
+        {
+            snprintf(error, sizeof(error), "%s %d: %s", policy_name(profile.policy), sch.sched_priority, strerror(rc));
+            add_error(placement.errors, error);
+        }
+    }
+
+    // read back what the kernel actually gave us
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    pthread_getaffinity_np(self, sizeof(cpu_set_t), &cpus);
+    placement.cpus = format_cpus(&cpus);
+    placement.cpu = sched_getcpu();
+    placement.node = (placement.cpu >= 0) ? cpu_node(placement.cpu) : -1;
+    sched_param sch;
+    pthread_getschedparam(self, &placement.policy, &sch);
+    placement.priority = sch.sched_priority;
+
+    if (!placement.errors.empty())
+    {
+        fprintf(stderr, "thread %s : could not apply %s\n", role, placement.errors.c_str());
+    }
+    lock.lock();
+    placements.push_back(placement);
+}
+
+/**
+ * counts where the pages of [start, end) are, move_pages without target nodes only queries them
+ */
+static void read_buffer_nodes(uintptr_t start, uintptr_t end, uintptr_t page, BufferPlacement &placement)
+{
+    placement.page_num = (int)((end - start) / page);
+    std::vector<void *> pages(placement.page_num);
+    std::vector<int> status(placement.page_num);
+    for (int i = 0; i < placement.page_num; i++)
+        pages[i] = (void *)(start + page * i);
+    if (syscall(SYS_move_pages, 0, (unsigned long)placement.page_num, pages.data(), NULL, status.data(), 0) != 0)
+    {
+        placement.error = std::string("read back: ") + strerror(errno);
+        return;
+    }
+    for (int i = 0; i < placement.page_num; i++)
+    {
+        if (status[i] == placement.node)
+            placement.node_page_num++;
+        else if (status[i] == -ENOENT)
+            placement.absent_page_num++;
+        else if (status[i] >= 0 && placement.other_node < 0)
+            placement.other_node = status[i];
+    }
+}
+
+void place_thread_buffer(void *buffer, size_t bytes, const char *role)
+{
+    std::lock_guard<std::mutex> lock(topology_mutex);
+    const ThreadProfile *profile = find_profile(role, NULL);
+    int node = (profile != NULL) ? profile_node(*profile) : -1;
+    if (node < 0 || buffer == NULL || bytes == 0)
+        return;
+
+    BufferPlacement placement;
+    placement.role = role;
+    placement.bytes = bytes;
+    placement.node = node;
+    placement.page_num = 0;
+    placement.node_page_num = 0;
+    placement.absent_page_num = 0;
+    placement.other_node = -1;
+
+    // mbind works on whole pages
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)buffer & ~(page - 1);
+    uintptr_t end = ((uintptr_t)buffer + bytes + page - 1) & ~(page - 1);
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, &mask, sizeof(mask) * 8, MPOL_MF_MOVE) != 0)
+    {
+        placement.error = strerror(errno);
+        fprintf(stderr, "buffer of %s : could not move to numa node %d: %s\n", role, node, placement.error.c_str());
+    }
+    else
+    {
+        read_buffer_nodes(start, end, page, placement);
+    }
+    buffer_placements.push_back(placement);
+}
+
+void print_thread_topology()
+{
+    std::lock_guard<std::mutex> lock(topology_mutex);
+    if (placements.empty() && buffer_placements.empty())
+        return;
+    printf("thread placement :\n");
+    for (size_t i = 0; i < placements.size(); i++)
+    {
+        ThreadPlacement &p = placements[i];
+        printf("  %-12s tid %-7ld profile %-12s cpus %-10s on cpu %d node %d, %s %d%s%s\n",
+               p.role.c_str(), p.tid, p.profile.c_str(), p.cpus.c_str(), p.cpu, p.node,
+               policy_name(p.policy), p.priority,
+               p.errors.empty() ? "" : ", failed : ", p.errors.c_str());
+    }
+    for (size_t i = 0; i < buffer_placements.size(); i++)
+    {
+        BufferPlacement &b = buffer_placements[i];
+        printf("  buffer of %-12s %zu bytes for numa node %d", b.role.c_str(), b.bytes, b.node);
+        if (b.error.empty())
+        {
+            int other_page_num = b.page_num - b.node_page_num - b.absent_page_num;
+            printf(" : %d of %d pages there, %d not allocated yet", b.node_page_num, b.page_num, b.absent_page_num);
+            if (other_page_num > 0)
+                printf(", %d on node %d and others", other_page_num, b.other_node);
+        }
+        printf("%s%s\n", b.error.empty() ? "" : ", failed : ", b.error.c_str());
+    }
+}
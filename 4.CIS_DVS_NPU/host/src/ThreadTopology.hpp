@@ -0,0 +1,66 @@
+#ifndef THREADTOPOLOGY_HPP
+#define THREADTOPOLOGY_HPP
+
+#include <stddef.h>
+#include <thread>
+
+/**
+ * thread placement by role : CPU affinity, scheduler policy / priority and NUMA node.
+ *
+ * every long-running thread names its role when it starts (dvs_reader, roi, display, ...)
+ * and gets the profile of that role. buffers filled by a role can be moved to its NUMA node.
+ * the achieved placement is read back from the kernel and kept for print_thread_topology,
+ * so a profile that could not be applied (no root for SCHED_FIFO, offline CPU) shows up.
+ *
+ * profile file, one role per line, # starts a comment, - leaves a field unchanged :
+ *   <role> <cpus> <policy> <priority> <numa node>
+ *   dvs_reader  2      fifo   max  0
+ *   roi         3      fifo   80   -
+ *   display     0-1    other  -    -
+ *   default     0-1,4  -      -    -
+ * cpus : list of CPU ranges, policy : other | batch | idle | fifo | rr, priority : number or max.
+ * numa node : 0-63, - means the node of the first CPU of the role.
+ * threads whose role has no line use "default" if present, else they are left alone.
+ *
+ * without a profile file, dvs_reader threads run SCHED_FIFO at the highest priority.
+ */
+
+/**
+ * replaces the built-in profile with a profile file
+ * @param path profile file
+ * @return false if the file cannot be read or has an invalid line (reported with its line)
+ */
+bool load_thread_topology(const char *path);
+/**
+ * applies the profile of role to the calling thread and records the achieved placement
+ * @param role role of the calling thread
+ * @param fallback role used if role has no profile, NULL for none
+ */
+void apply_thread_role(const char *role, const char *fallback = NULL);
+/**
+ * moves the pages of a buffer to the NUMA node of role, pages not touched yet are allocated there
+ * @param buffer start of the buffer
+ * @param bytes size of the buffer
+ * @param role role of the thread filling the buffer
+ */
+void place_thread_buffer(void *buffer, size_t bytes, const char *role);
+/**
+ * prints the achieved placement of every thread and buffer placed so far
+ */
+void print_thread_topology();
+
+/**
+ * starts f on a new thread that applies the profile of role first
+ * @param role role of the new thread
+ * @param f function to run
+ */
+template <typename F>
+std::thread start_role_thread(const char *role, F f)
+{
+    return std::thread([role, f]() mutable
+                       {
+                           apply_thread_role(role);
+                           f(); });
+}
+
+#endif // THREADTOPOLOGY_HPP
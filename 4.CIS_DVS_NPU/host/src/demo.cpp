@@ -27,8 +27,10 @@
 #include <opencv2/video/video.hpp>
 
 #include "http_stream.h"
+#include "ThreadTopology.hpp"
 #include <pthread.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <time.h>
 
@@ -59,92 +61,143 @@ static double image_fetch_time = 0;
 static int image_counter = 0;
 static double npu_process_time = 0;
 
-// function to pipeline CIS, DVS synchronization, preprocess, NPU and postprocess.
-// There are 4 threads. (excluding stage for synchronization with DVS)
-void CIS_NPU_thread(CIS *cis, NPU *npu, bool always_run_npu, bool full_frame_inference)
+// one CIS frame travelling through the staged NPU pipeline
+typedef struct
 {
-    if (full_frame_inference)
-        always_run_npu = true;
-    frame_data frame;
+    // frame order, assigned by the CIS read stage
+    uint64_t seq;
+    // OpenCV cv::Mat CIS frame
+    cv::Mat CIS_frame;
     // bounding box information from DVS thread
     Bbox bbox_cis;
+    // false to pass the frame through without running the NPU
+    bool is_update;
+    // NPU input and output of this frame
+    frame_data frame;
+} npu_job;
+
+// bounded queues between the pipeline stages, every stage has one thread
+// so every queue is single-producer single-consumer and frames stay in order
+typedef struct
+{
+    // empty jobs, postprocess -> CIS read
+    SpscQueue<npu_job *> *free_jobs;
+    // CIS read -> ROI fetch
+    SpscQueue<npu_job *> *to_roi;
+    // ROI fetch -> preprocess
+    SpscQueue<npu_job *> *to_pre;
+    // preprocess -> NPU run
+    SpscQueue<npu_job *> *to_run;
+    // NPU run -> postprocess
+    SpscQueue<npu_job *> *to_post;
+} npu_pipeline;
+
+// stage 1 : read CIS frame thru PCIE and number it
+void CIS_read_stage(CIS *cis, npu_pipeline *pipe, bool *terminate)
+{
+    npu_job *job;
+    uint64_t seq = 0;
+    while (!*terminate && pipe->free_jobs->pop(job))
+    {
+        cis->read_frame(job->CIS_frame);
+        job->seq = seq++;
+        if (!pipe->to_roi->push(job))
+            break;
+    }
+    pipe->to_roi->close();
+}
+
+// stage 2 : receive CIS bounding box information from DVS thread
+void ROI_stage(CIS *cis, npu_pipeline *pipe, bool use_dvs_roi, bool always_run_npu)
+{
+    npu_job *job;
+    // last valid bounding box, starts as the centered square
+    Bbox bbox_cis;
     bbox_cis.lx = (cis->get_frame_w() - cis->get_frame_h()) / 2;
     bbox_cis.hx = (cis->get_frame_w() + cis->get_frame_h()) / 2;
     bbox_cis.ly = 0;
     bbox_cis.hy = cis->get_frame_h() - 1;
-    bool roi_exist;
-    // OpenCV cv::Mat CIS frame
-    cv::Mat CIS_frame = cv::Mat::zeros(cis->get_frame_h(), cis->get_frame_w(), CV_8UC3);
-    float inv_frame_h = 1.0 / cis->get_frame_h();
-    float inv_frame_w = 1.0 / cis->get_frame_w();
-    // while loop
-    while (1)
+    bool roi_exist = false;
+    // age of the DVS ROI when it was attached to a CIS frame
+    BboxSnapshot roi_info;
+    int64_t roi_age_sum_us = 0, roi_age_max_us = 0;
+    uint64_t roi_num = 0;
+    while (pipe->to_roi->pop(job))
     {
-        // each stage is protected thru mutexes
-        //---------------------------------------------------------------------------------
-        // read CIS frame thru PCIE
-        cis->read_frame(CIS_frame);
-        //----------------------------------------------------------------------------------
-        // receive CIS bounding box information from DVS thread
-        if (!full_frame_inference)
-            roi_exist = cis->scale_bbox(&bbox_cis);
-        //----------------------------------------------------------------------------------
-        // crop and resize image for loading into NPU
-        npu->preprocess(frame, &bbox_cis, &CIS_frame, always_run_npu || roi_exist);
-        //----------------------------------------------------------------------------------
-        // run NPU on the ZCU106 board
-        npu->run_NPU(frame, &bbox_cis, always_run_npu || roi_exist);
-        //----------------------------------------------------------------------------------
-        // postprocess to obtain and display bounding boxes
-        if (npu->postprocess(frame, &bbox_cis, inv_frame_w, inv_frame_h, always_run_npu || roi_exist))
+        // latest published ROI, never waits for the DVS thread
+        if (use_dvs_roi)
         {
-            break;
+            roi_exist = cis->scale_bbox(&bbox_cis, &roi_info);
+            if (roi_exist)
+            {
+                int64_t age = SharedBbox::age_us(roi_info);
+                roi_age_sum_us += age;
+                roi_age_max_us = (age > roi_age_max_us) ? age : roi_age_max_us;
+                roi_num++;
+            }
         }
-        //----------------------------------------------------------------------------------
+        job->bbox_cis = bbox_cis;
+        job->is_update = always_run_npu || roi_exist;
+        if (!pipe->to_pre->push(job))
+            break;
     }
-    // free all buffers
-    CIS_frame.release();
+    pipe->to_pre->close();
+    if (roi_num > 0)
+        printf("DVS ROI age : mean %.1f us, max %lld us over %llu frames\n",
+               (double)roi_age_sum_us / roi_num, (long long)roi_age_max_us, (unsigned long long)roi_num);
 }
 
-void CIS_only_thread(CIS *cis, NPU *npu)
+// stage 3 : crop and resize image for loading into NPU
+void preprocess_stage(NPU *npu, npu_pipeline *pipe)
 {
+    npu_job *job;
+    while (pipe->to_pre->pop(job))
+    {
+        npu->preprocess(job->frame, &job->bbox_cis, &job->CIS_frame, job->is_update);
+        if (!pipe->to_run->push(job))
+            break;
+    }
+    pipe->to_run->close();
+}
 
-    frame_data frame;
-    // bounding box information from DVS thread
-    Bbox bbox_cis;
-    int offset = (cis->get_frame_w() - cis->get_frame_h()) / 2;
-    bbox_cis.lx = offset;
-    bbox_cis.hx = offset + (cis->get_frame_h() - 1);
-    bbox_cis.ly = 0;
-    bbox_cis.hy = cis->get_frame_h() - 1;
-    bool roi_exist;
-    // OpenCV cv::Mat CIS frame
-    cv::Mat CIS_frame = cv::Mat::zeros(cis->get_frame_h(), cis->get_frame_w(), CV_8UC3);
+// stage 4 : run NPU on the ZCU106 board
+void NPU_run_stage(NPU *npu, npu_pipeline *pipe)
+{
+    npu_job *job;
+    while (pipe->to_run->pop(job))
+    {
+        npu->run_NPU(job->frame, &job->bbox_cis, job->is_update);
+        if (!pipe->to_post->push(job))
+            break;
+    }
+    pipe->to_post->close();
+}
+
+// stage 5 : postprocess to obtain and display bounding boxes, in frame order
+void postprocess_stage(CIS *cis, NPU *npu, npu_pipeline *pipe, bool show_dvs_view)
+{
+    npu_job *job;
     float inv_frame_h = 1.0 / cis->get_frame_h();
     float inv_frame_w = 1.0 / cis->get_frame_w();
-    // while loop
-    while (1)
+    uint64_t next_seq = 0;
+    int out_of_order = 0;
+    while (pipe->to_post->pop(job))
     {
-        // each stage is protected thru mutexes
-        //---------------------------------------------------------------------------------
-        // read CIS frame thru PCIE
-        cis->read_frame(CIS_frame);
-        //----------------------------------------------------------------------------------
-        // crop and resize image for loading into NPU
-        npu->preprocess(frame, &bbox_cis, &CIS_frame, true);
-        //----------------------------------------------------------------------------------
-        // run NPU on the ZCU106 board
-        npu->run_NPU(frame, &bbox_cis, true);
-        //----------------------------------------------------------------------------------
-        // postprocess to obtain and display bounding boxes
-        if (npu->postprocess(frame, &bbox_cis, inv_frame_w, inv_frame_h, true, false))
-        {
+        if (job->seq != next_seq)
+            out_of_order++;
+        next_seq = job->seq + 1;
+        int is_exit = npu->postprocess(job->frame, &job->bbox_cis, inv_frame_w, inv_frame_h, job->is_update, show_dvs_view);
+        pipe->free_jobs->push(job);
+        if (is_exit)
             break;
-        }
-        //----------------------------------------------------------------------------------
     }
-    // free all buffers
-    CIS_frame.release();
+    // release every stage still waiting on a queue
+    pipe->free_jobs->close();
+    pipe->to_roi->close();
+    pipe->to_pre->close();
+    pipe->to_run->close();
+    pipe->to_post->close();
+    printf("displayed %llu frames, %d out of order\n", (unsigned long long)next_seq, out_of_order);
 }
 
 void demo(char *cfgfile, char *weightfile, float thresh, float hier_thresh, int cam_index, const char *filename, char **names, int classes, int avgframes,
@@ -157,10 +210,13 @@ void demo(char *cfgfile, char *weightfile, float thresh, float hier_thresh, int
 
     // mutex for shared Bbox struct
     MutexManager cis_dvs_mutex;
-    Bbox bbox;
+    SharedBbox bbox;
 
     // shared bool variable for terminating in unison
-    bool terminate;
+    bool terminate = false;
+    if (access(THREAD_TOPOLOGY_FILE, R_OK) == 0 && !load_thread_topology(THREAD_TOPOLOGY_FILE))
+        exit(EXIT_FAILURE);
+    apply_thread_role("main");
     std::vector<std::thread>
         threads;
     printf("Demo\n");
@@ -187,38 +243,78 @@ void demo(char *cfgfile, char *weightfile, float thresh, float hier_thresh, int
     dvs = new DVS(DVS_FRAME_H, DVS_FRAME_W, true, (2000 / 60), DVS_FRAME_RDY_BASEADDR, DVS_FRAME_BASEADDR, DVS_BUFFER_NUM, C2H_DEVICE_DVS, H2C_DEVICE_DVS, display_mutex, &bbox, &cis_dvs_mutex, &terminate);
     dvs->set_CIS(CIS_DVS_SCALE_X * CIS_FRAME_W / DVS_FRAME_W, CIS_DVS_SCALE_Y * CIS_FRAME_H / DVS_FRAME_H, CIS_DVS_OFFSET_X, CIS_DVS_OFFSET_Y, CIS_FRAME_W, CIS_FRAME_H, ROI_EVENT_SCORE, ROI_MIN_SCORE, ROI_LINE_WIDTH, CIS_ROI_MIN_SIZE, ROI_INFLATION);
 
+    // replay a DVS bin file or a CIS_DVS_RECORD recording instead of the sensors
+    // paced at the recorded rate, or as fast as possible with -benchmark
+    ReplaySource *cis_replay = NULL;
+    ReplaySource *dvs_replay = NULL;
+    if (filename && strlen(filename) > 0)
+    {
+        dvs_replay = new ReplaySource(DVS_FRAME_SIZE);
+        if (dvs_replay->open(filename, RECORD_DVS, DVS_TIMESTAMP_TICK_US, DVS_FPS))
+        {
+            dvs_replay->set_speed(benchmark ? 0 : 1);
+            dvs->set_replay(dvs_replay);
+        }
+        cis_replay = new ReplaySource(CIS_FRAME_SIZE);
+        if (cis_replay->open(filename, RECORD_CIS, DVS_TIMESTAMP_TICK_US, DVS_FPS))
+        {
+            cis_replay->set_speed(benchmark ? 0 : 1);
+            cis->set_replay(cis_replay);
+        }
+    }
+
     srand(2222222);
 
     // display window
     create_window_cv("Demo", 0, CIS_FRAME_W, CIS_FRAME_H);
 
+    // one thread owns every window, the pipeline only posts frames
+    Presenter presenter(DISPLAY_FPS, &terminate);
+    presenter.start();
+    npu->set_presenter(&presenter);
+    cis->set_presenter(&presenter);
+    dvs->set_presenter(&presenter);
+
     time_t start_time = time(NULL);
 
-    // launch threads
+    // pipeline jobs, all CIS frames allocated up front
+    npu_pipeline pipe;
+    pipe.free_jobs = new SpscQueue<npu_job *>(NPU_PIPELINE_SLOT_NUM);
+    pipe.to_roi = new SpscQueue<npu_job *>(NPU_PIPELINE_SLOT_NUM);
+    pipe.to_pre = new SpscQueue<npu_job *>(NPU_PIPELINE_SLOT_NUM);
+    pipe.to_run = new SpscQueue<npu_job *>(NPU_PIPELINE_SLOT_NUM);
+    pipe.to_post = new SpscQueue<npu_job *>(NPU_PIPELINE_SLOT_NUM);
+    std::vector<npu_job> jobs(NPU_PIPELINE_SLOT_NUM);
+    for (int i = 0; i < NPU_PIPELINE_SLOT_NUM; i++)
+    {
+        jobs[i].CIS_frame = cv::Mat::zeros(CIS_FRAME_H, CIS_FRAME_W, CV_8UC3);
+        pipe.free_jobs->push(&jobs[i]);
+    }
+
+    // launch threads, one per pipeline stage
     if (cis && npu)
     {
-        if (dvs)
-        {
-            for (int i = 0; i < 4; i++)
-            {
-                threads.emplace_back([cis, npu, always_run_npu, full_frame_inference]()
-                                     { CIS_NPU_thread(cis, npu, always_run_npu, full_frame_inference); });
-            }
-        }
-        else
-        {
-            for (int i = 0; i < 4; i++)
-            {
-                threads.emplace_back([cis, npu]()
-                                     { CIS_only_thread(cis, npu); });
-            }
-        }
+        if (full_frame_inference)
+            always_run_npu = true;
+        bool use_dvs_roi = (dvs != NULL) && !full_frame_inference;
+        bool show_dvs_view = (dvs != NULL);
+        npu_pipeline *p = &pipe;
+        threads.push_back(start_role_thread("cis_reader", [cis, p, &terminate]()
+                                                          { CIS_read_stage(cis, p, &terminate); }));
+        threads.push_back(start_role_thread("roi", [cis, p, use_dvs_roi, always_run_npu]()
+                                                   { ROI_stage(cis, p, use_dvs_roi, always_run_npu); }));
+        threads.push_back(start_role_thread("preprocess", [npu, p]()
+                                                          { preprocess_stage(npu, p); }));
+        threads.push_back(start_role_thread("npu", [npu, p]()
+                                                   { NPU_run_stage(npu, p); }));
+        threads.push_back(start_role_thread("postprocess", [cis, npu, p, show_dvs_view]()
+                                                           { postprocess_stage(cis, npu, p, show_dvs_view); }));
     }
 
     if (dvs)
     {
-        threads.emplace_back([dvs]()
-                             { dvs->crop_new_ROI(1, 1, true); });
+        threads.push_back(start_role_thread("dvs_roi", [dvs]()
+                                                       { dvs->crop_new_ROI(1, 1, true); }));
     }
 
     // Wait for all threads to complete
@@ -229,8 +325,22 @@ void demo(char *cfgfile, char *weightfile, float thresh, float hier_thresh, int
             t.join();
         }
     }
+    presenter.stop();
     printf("Demo finished!\n");
 
+    // stage occupancy : a queue that stays full sits in front of the slowest stage
+    pipe.to_roi->print_stats("CIS read -> ROI");
+    pipe.to_pre->print_stats("ROI -> preprocess");
+    pipe.to_run->print_stats("preprocess -> NPU run");
+    pipe.to_post->print_stats("NPU run -> postprocess");
+    bbox.print_stats("DVS ROI bbox");
+    print_thread_topology();
+    delete pipe.free_jobs;
+    delete pipe.to_roi;
+    delete pipe.to_pre;
+    delete pipe.to_run;
+    delete pipe.to_post;
+
     // cleanup
     delete cis;
     delete dvs;
@@ -239,6 +349,9 @@ void demo(char *cfgfile, char *weightfile, float thresh, float hier_thresh, int
 
     delete npu;
     npu = NULL;
+
+    delete cis_replay;
+    delete dvs_replay;
 }
 
 #else
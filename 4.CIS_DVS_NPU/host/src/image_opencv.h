@@ -54,7 +54,7 @@ extern "C"
     // image ipl_to_image(mat_cv* src_ptr)
     // cv::Mat ipl_to_mat(IplImage *ipl)
     // IplImage *mat_to_ipl(cv::Mat mat)
-    // Mat image_to_mat(image img)
+    cv::Mat image_to_mat(image img);
     image mat_to_image(cv::Mat mat);
     image mat_to_image_cv(mat_cv *mat);
 
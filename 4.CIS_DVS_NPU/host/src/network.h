@@ -243,6 +243,8 @@ extern "C"
 #define DVS_FRAME_SIZE ((DVS_FRAME_W * DVS_FRAME_H * 2) / 8 + FRAME_HEADER_BYTES)
 #define DVS_FRAME_RDY_BASEADDR (DDR_BASEADDR + 0x2000000)
 #define DVS_FRAME_BASEADDR (DDR_BASEADDR + 0x30000000)
+// duration of one header timestamp tick, used to pace replayed bin files
+#define DVS_TIMESTAMP_TICK_US 1.0
 
 /******************* DISPLAY Setting ******************************/
 #define DVS_FPS 2000
@@ -260,6 +262,11 @@ extern "C"
 #define CIS_DVS_SCALE_Y 1.129
 #define DMA_BUFFER_GRP_NUM (DVS_FPS / DISPLAY_FPS)
 #define waitkey_delay (1000 / DISPLAY_FPS)
+// frames in flight in the staged NPU pipeline (CIS read, ROI, preprocess, NPU run, postprocess)
+#define NPU_PIPELINE_SLOT_NUM 5
+// CPU affinity, scheduler and NUMA node of every pipeline stage, see ThreadTopology.hpp
+// loaded if present, stages : cis_reader, roi, preprocess, npu, postprocess, dvs_roi, display
+#define THREAD_TOPOLOGY_FILE "thread_topology.cfg"
 
 /******************* PCIE Setting ******************************/
 #define H2C_DEVICE "/dev/xdma_zcu1060_h2c_0"
@@ -0,0 +1,556 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "bbox.hpp"
+#include "dvs_roi_alg.hpp"
+#include "dvs_roi_packed.hpp"
+#include "roi_engine.hpp"
+
+namespace fs = std::filesystem;
+
+// flags the benchmark and the library were built with, set by the Makefile
+#ifndef BENCH_BUILD_FLAGS
+#define BENCH_BUILD_FLAGS "unknown"
+#endif
+
+/**
+ * benchmark and accuracy harness of the ROI algorithms.
+ * every algorithm runs on every image of the dataset through one RoiEngine,
+ * warmup untimed calls then reps timed calls per image.
+ * images with a YOLO-format label (same name, .txt) also score the ROI against the label.
+ *
+ * --verify checks the optimized scans against their straightforward versions instead,
+ * on the dataset and on random frames, and fails on the first mismatch :
+ * > dvs_roi_proposed_packed against dvs_roi_proposed
+ * > detect_streaks against one scan per row / column / diagonal (the scans before the
+ *   single-pass version, without the frame rotation)
+ */
+
+typedef struct
+{
+    fs::path path;
+    cv::Mat frame;
+    bool has_gt;
+    Bbox gt;
+} BenchImage;
+
+typedef struct
+{
+    const char *name;
+    // latency of every timed call
+    std::vector<double> latency_ms;
+    double total_ms;
+    // images with at least one ROI
+    int detected;
+    // images with a label
+    int labeled;
+    double sum_iou;
+    double sum_ciou;
+} BenchResult;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--dataset DIR] [--warmup N] [--reps N] [--json FILE]\n", prog);
+    fprintf(stderr, "       %s --verify [--dataset DIR] [--frames N] [--seed N]\n", prog);
+}
+
+/**
+ * collects every .png under dataset_pth (sorted, so runs are comparable) with its label
+ */
+static std::vector<BenchImage> load_dataset(const std::string &dataset_pth)
+{
+    std::vector<fs::path> image_list;
+    for (auto &p : fs::recursive_directory_iterator(
+             dataset_pth,
+             fs::directory_options::skip_permission_denied))
+    {
+        std::string ext = p.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext == ".png")
+            image_list.emplace_back(p.path());
+    }
+    std::sort(image_list.begin(), image_list.end());
+
+    std::vector<BenchImage> images;
+    for (const auto &img_path : image_list)
+    {
+        BenchImage image;
+        image.path = img_path;
+        image.frame = cv::imread(img_path.string(), cv::IMREAD_GRAYSCALE);
+        if (image.frame.empty())
+        {
+            std::cerr << "Cannot open: " << img_path << '\n';
+            continue;
+        }
+        fs::path label_path = img_path;
+        label_path.replace_extension(".txt");
+        image.has_gt = load_gt_one(label_path.string(), image.frame.cols, image.frame.rows, image.gt);
+        images.push_back(image);
+    }
+    return images;
+}
+
+/**
+ * @return latency at percentile p (0 - 100) of sorted, nearest rank
+ */
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.5);
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1];
+}
+
+static BenchResult run_algorithm(RoiAlgorithm algorithm, const std::vector<BenchImage> &images,
+                                 const RoiParams &params, int warmup, int reps)
+{
+    BenchResult result = {roi_algorithm_name(algorithm), {}, 0.0, 0, 0, 0.0, 0.0};
+    result.latency_ms.reserve(images.size() * reps);
+
+    RoiEngine *engine = NULL;
+    int engine_w = 0, engine_h = 0;
+    std::vector<Bbox> rois;
+    for (const auto &image : images)
+    {
+        // one engine per frame size, the dataset is usually one size
+        if (engine == NULL || engine_w != image.frame.cols || engine_h != image.frame.rows)
+        {
+            delete engine;
+            engine_w = image.frame.cols;
+            engine_h = image.frame.rows;
+            engine = new RoiEngine(engine_w, engine_h, algorithm, params);
+        }
+
+        for (int i = 0; i < warmup; i++)
+            engine->compute(image.frame, rois);
+        for (int i = 0; i < reps; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            engine->compute(image.frame, rois);
+            auto end = std::chrono::steady_clock::now();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
+            result.latency_ms.push_back(elapsed_ms);
+            result.total_ms += elapsed_ms;
+        }
+
+        if (!rois.empty())
+            result.detected++;
+        if (!image.has_gt)
+            continue;
+
+        // no ROI scores as the all zero box like the TEST_ROI modes
+        Bbox pred = closest_roi(rois, image.gt);
+        result.labeled++;
+        result.sum_iou += iou(pred, image.gt);
+        result.sum_ciou += ciou(pred, image.gt);
+    }
+    delete engine;
+
+    std::sort(result.latency_ms.begin(), result.latency_ms.end());
+    return result;
+}
+
+/**
+ * score of one pixel of the max-segment scans
+ */
+static int pixel_score(const cv::Mat &frame, int x, int y, int roi_event_score)
+{
+    return (frame.ptr<uchar>(y)[x] != 128) ? roi_event_score : -1;
+}
+
+/**
+ * reference of detect_streaks : every row, column and diagonal is scanned on its own
+ */
+static void detect_streaks_reference(const cv::Mat &frame, ScanDirection direction,
+                                     int roi_event_score, int row_score_threshold,
+                                     std::vector<Streak> &out_streaks)
+{
+    const int frame_w = frame.cols, frame_h = frame.rows;
+    if (direction == ScanDirection::Horizontal)
+    {
+        // streaks closer than max_merge_gap on a row are merged
+        const int max_merge_gap = 3;
+        for (int y = 0; y < frame_h; ++y)
+        {
+            int score = 0, streak_start = 0;
+            bool has_pending_streak = false;
+            int streak_start_prev = 0, last_streak_end = -10;
+            for (int x = 0; x < frame_w; ++x)
+            {
+                score += pixel_score(frame, x, y, roi_event_score);
+                if (score < 0)
+                {
+                    score = 0;
+                    streak_start = x + 1;
+                }
+                else if (score >= row_score_threshold && x - streak_start > 5)
+                {
+                    if (has_pending_streak && streak_start - last_streak_end <= max_merge_gap)
+                    {
+                        last_streak_end = x;
+                    }
+                    else
+                    {
+                        if (has_pending_streak)
+                            out_streaks.push_back({{streak_start_prev, y}, {last_streak_end, y}});
+                        streak_start_prev = streak_start;
+                        last_streak_end = x;
+                        has_pending_streak = true;
+                    }
+                    score = 0;
+                    streak_start = x + 1;
+                }
+            }
+            if (has_pending_streak)
+                out_streaks.push_back({{streak_start_prev, y}, {last_streak_end, y}});
+        }
+    }
+    else if (direction == ScanDirection::Vertical)
+    {
+        for (int x = 0; x < frame_w; ++x)
+        {
+            int score = 0, streak_start = 0;
+            for (int y = 0; y < frame_h; ++y)
+            {
+                score += pixel_score(frame, x, y, roi_event_score);
+                if (score < 0)
+                {
+                    score = 0;
+                    streak_start = y + 1;
+                }
+                else if (score >= row_score_threshold && y - streak_start > 5)
+                {
+                    out_streaks.push_back({{x, streak_start}, {x, y}});
+                    score = 0;
+                    streak_start = y + 1;
+                }
+            }
+        }
+    }
+    else
+    {
+        // diagonals start on the top row, then on the left (45) / right (135) column
+        const bool is_45 = direction == ScanDirection::Diagonal45;
+        const int step_x = is_45 ? 1 : -1;
+        for (int i = 0; i < frame_w + frame_h - 1; ++i)
+        {
+            int x = (i < frame_w) ? (is_45 ? i : frame_w - 1 - i) : (is_45 ? 0 : frame_w - 1);
+            int y = (i < frame_w) ? 0 : i - frame_w + 1;
+            int score = 0, streak_len = 0;
+            cv::Point streak_start(-1, -1);
+            for (; x >= 0 && x < frame_w && y < frame_h; x += step_x, ++y)
+            {
+                score += pixel_score(frame, x, y, roi_event_score);
+                if (score < 0)
+                {
+                    score = 0;
+                    streak_start = cv::Point(-1, -1);
+                    continue;
+                }
+                if (streak_start.x < 0)
+                {
+                    streak_start = cv::Point(x, y);
+                    streak_len = 0;
+                }
+                streak_len++;
+                if (is_45 && score >= row_score_threshold && score > 5)
+                {
+                    // the 45 degree streak is as long as its score
+                    out_streaks.push_back({{x - score + 1, y - score + 1}, {x, y}});
+                    score = 0;
+                    streak_start = cv::Point(-1, -1);
+                }
+                else if (!is_45 && score >= row_score_threshold && streak_len > 5)
+                {
+                    out_streaks.push_back({streak_start, {x, y}});
+                    score = 0;
+                    streak_start = cv::Point(-1, -1);
+                }
+            }
+        }
+    }
+}
+
+static bool streak_less(const Streak &a, const Streak &b)
+{
+    return std::make_tuple(a.start.y, a.start.x, a.end.y, a.end.x) <
+           std::make_tuple(b.start.y, b.start.x, b.end.y, b.end.x);
+}
+
+static bool is_same_bbox(const Bbox &a, const Bbox &b)
+{
+    return a.lx == b.lx && a.ly == b.ly && a.hx == b.hx && a.hy == b.hy;
+}
+
+/**
+ * compares the optimized scans with their references on one frame
+ * @return false on a mismatch, reported on stderr
+ */
+static bool verify_frame(const cv::Mat &frame, const std::string &name, const RoiParams &params)
+{
+    std::vector<uint8_t> packed;
+    pack_dvs_frame(frame, packed);
+    Bbox expected = dvs_roi_proposed(frame, params.roi_event_score, params.row_score_threshold,
+                                     params.roi_height_min_threshold, params.roi_min_size,
+                                     params.roi_inflation_ratio);
+    Bbox actual = dvs_roi_proposed_packed(packed.data(), frame.cols, frame.rows, params.roi_event_score,
+                                          params.row_score_threshold, params.roi_height_min_threshold,
+                                          params.roi_min_size, params.roi_inflation_ratio);
+    if (!is_same_bbox(expected, actual))
+    {
+        fprintf(stderr, "%s : proposed (%d, %d, %d, %d), packed (%d, %d, %d, %d)\n", name.c_str(),
+                expected.lx, expected.ly, expected.hx, expected.hy, actual.lx, actual.ly, actual.hx, actual.hy);
+        return false;
+    }
+
+    static const char *direction_names[4] = {"horizontal", "vertical", "diagonal45", "diagonal135"};
+    for (int d = 0; d < 4; d++)
+    {
+        std::vector<Streak> expected_streaks, actual_streaks;
+        detect_streaks_reference(frame, static_cast<ScanDirection>(d), params.roi_event_score,
+                                 params.row_score_threshold, expected_streaks);
+        detect_streaks(frame, static_cast<ScanDirection>(d), params.roi_event_score,
+                       params.row_score_threshold, actual_streaks);
+        // same streaks, the single-pass scan gives them in another order
+        std::sort(expected_streaks.begin(), expected_streaks.end(), streak_less);
+        std::sort(actual_streaks.begin(), actual_streaks.end(), streak_less);
+        bool is_same = expected_streaks.size() == actual_streaks.size();
+        for (size_t i = 0; is_same && i < expected_streaks.size(); i++)
+        {
+            is_same = !streak_less(expected_streaks[i], actual_streaks[i]) &&
+                      !streak_less(actual_streaks[i], expected_streaks[i]);
+        }
+        if (!is_same)
+        {
+            fprintf(stderr, "%s : %s streaks differ, %zu expected, %zu detected\n", name.c_str(),
+                    direction_names[d], expected_streaks.size(), actual_streaks.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * random DVS frame : sparse noise and a few dense rectangles, any width (not only multiples of 32)
+ */
+static void random_frame(std::mt19937 &rng, cv::Mat &frame)
+{
+    const int frame_w = 8 + rng() % 1273;
+    const int frame_h = 8 + rng() % 713;
+    frame.create(frame_h, frame_w, CV_8UC1);
+    const int noise_permille = rng() % 200;
+    for (int y = 0; y < frame_h; y++)
+    {
+        uchar *row_ptr = frame.ptr<uchar>(y);
+        for (int x = 0; x < frame_w; x++)
+            row_ptr[x] = (static_cast<int>(rng() % 1000) < noise_permille) ? ((rng() & 1) ? 255 : 0) : 128;
+    }
+    const int object_num = rng() % 6;
+    for (int i = 0; i < object_num; i++)
+    {
+        const int x0 = rng() % frame_w, y0 = rng() % frame_h;
+        const int x1 = std::min(frame_w, x0 + 1 + static_cast<int>(rng() % 300));
+        const int y1 = std::min(frame_h, y0 + 1 + static_cast<int>(rng() % 300));
+        const int fill_percent = 30 + rng() % 71;
+        for (int y = y0; y < y1; y++)
+        {
+            uchar *row_ptr = frame.ptr<uchar>(y);
+            for (int x = x0; x < x1; x++)
+            {
+                if (static_cast<int>(rng() % 100) < fill_percent)
+                    row_ptr[x] = 224;
+            }
+        }
+    }
+}
+
+/**
+ * --verify : default parameters on the dataset, random parameters on random frames
+ * @return number of mismatching frames
+ */
+static int verify(const std::vector<BenchImage> &images, int frame_num, unsigned int seed)
+{
+    int mismatch_num = 0;
+    RoiParams params;
+    for (const auto &image : images)
+    {
+        if (!verify_frame(image.frame, image.path.string(), params))
+            mismatch_num++;
+    }
+    printf("verify : %zu dataset images, %d mismatches\n", images.size(), mismatch_num);
+
+    std::mt19937 rng(seed);
+    cv::Mat frame;
+    int random_mismatch_num = 0;
+    for (int i = 0; i < frame_num; i++)
+    {
+        random_frame(rng, frame);
+        RoiParams random_params;
+        random_params.roi_event_score = 1 + rng() % 8;
+        random_params.row_score_threshold = rng() % 60;
+        random_params.roi_height_min_threshold = 1 + rng() % 20;
+        random_params.roi_min_size = rng() % 40;
+        random_params.roi_inflation_ratio = 1.0f + (rng() % 100) / 100.0f;
+        if (!verify_frame(frame, "random frame " + std::to_string(i) + " (seed " + std::to_string(seed) + ")",
+                          random_params))
+            random_mismatch_num++;
+    }
+    printf("verify : %d random frames, %d mismatches\n", frame_num, random_mismatch_num);
+    return mismatch_num + random_mismatch_num;
+}
+
+static void write_json(FILE *fp, const std::string &dataset_pth, const std::vector<BenchImage> &images,
+                       int warmup, int reps, const std::vector<BenchResult> &results)
+{
+    int labeled = 0;
+    for (const auto &image : images)
+        labeled += image.has_gt ? 1 : 0;
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"dataset\": \"%s\",\n", dataset_pth.c_str());
+    fprintf(fp, "  \"images\": %zu,\n", images.size());
+    fprintf(fp, "  \"labeled\": %d,\n", labeled);
+    fprintf(fp, "  \"warmup\": %d,\n", warmup);
+    fprintf(fp, "  \"reps\": %d,\n", reps);
+    fprintf(fp, "  \"compiler\": \"%s\",\n", __VERSION__);
+    fprintf(fp, "  \"build_flags\": \"%s\",\n", BENCH_BUILD_FLAGS);
+    fprintf(fp, "  \"algorithms\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        const double mean_ms = r.latency_ms.empty() ? 0.0 : r.total_ms / r.latency_ms.size();
+        fprintf(fp, "    {\n");
+        fprintf(fp, "      \"name\": \"%s\",\n", r.name);
+        fprintf(fp, "      \"samples\": %zu,\n", r.latency_ms.size());
+        fprintf(fp, "      \"latency_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+                mean_ms, percentile(r.latency_ms, 50), percentile(r.latency_ms, 90),
+                percentile(r.latency_ms, 99), r.latency_ms.empty() ? 0.0 : r.latency_ms.back());
+        fprintf(fp, "      \"throughput_fps\": %.2f,\n", (r.total_ms > 0) ? 1000.0 * r.latency_ms.size() / r.total_ms : 0.0);
+        fprintf(fp, "      \"detected\": %d,\n", r.detected);
+        if (r.labeled > 0)
+        {
+            fprintf(fp, "      \"mean_iou\": %.4f,\n", r.sum_iou / r.labeled);
+            fprintf(fp, "      \"mean_ciou\": %.4f\n", r.sum_ciou / r.labeled);
+        }
+        else
+        {
+            fprintf(fp, "      \"mean_iou\": null,\n");
+            fprintf(fp, "      \"mean_ciou\": null\n");
+        }
+        fprintf(fp, "    }%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dataset_pth = "./examples";
+    std::string json_pth = "roi_bench.json";
+    int warmup = 3;
+    int reps = 10;
+    bool is_verify = false;
+    int verify_frame_num = 1000;
+    unsigned int seed = 1;
+
+    struct option long_options[] = {
+        {"dataset", required_argument, nullptr, 'd'},
+        {"warmup", required_argument, nullptr, 'w'},
+        {"reps", required_argument, nullptr, 'r'},
+        {"json", required_argument, nullptr, 'j'},
+        {"verify", no_argument, nullptr, 'v'},
+        {"frames", required_argument, nullptr, 'f'},
+        {"seed", required_argument, nullptr, 's'},
+        {nullptr, 0, nullptr, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:w:r:j:vf:s:", long_options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            dataset_pth = optarg;
+            break;
+        case 'w':
+            warmup = std::max(0, atoi(optarg));
+            break;
+        case 'r':
+            reps = std::max(1, atoi(optarg));
+            break;
+        case 'j':
+            json_pth = optarg;
+            break;
+        case 'v':
+            is_verify = true;
+            break;
+        case 'f':
+            verify_frame_num = std::max(0, atoi(optarg));
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!fs::is_directory(dataset_pth))
+    {
+        std::cerr << "Dataset not found: " << dataset_pth << '\n';
+        exit(EXIT_FAILURE);
+    }
+    std::vector<BenchImage> images = load_dataset(dataset_pth);
+    if (images.empty())
+    {
+        std::cerr << "No *.png found under " << dataset_pth << '\n';
+        exit(EXIT_FAILURE);
+    }
+
+    if (is_verify)
+    {
+        return (verify(images, verify_frame_num, seed) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    RoiParams params;
+    std::vector<BenchResult> results;
+    printf("%-24s %10s %10s %10s %10s %10s %10s\n", "algorithm", "p50 ms", "p90 ms", "p99 ms", "fps", "mean IoU", "mean CIoU");
+    for (int a = 0; a < ROI_ALGORITHM_NUM; a++)
+    {
+        results.push_back(run_algorithm(static_cast<RoiAlgorithm>(a), images, params, warmup, reps));
+        const BenchResult &r = results.back();
+        printf("%-24s %10.3f %10.3f %10.3f %10.1f", r.name,
+               percentile(r.latency_ms, 50), percentile(r.latency_ms, 90), percentile(r.latency_ms, 99),
+               (r.total_ms > 0) ? 1000.0 * r.latency_ms.size() / r.total_ms : 0.0);
+        if (r.labeled > 0)
+            printf(" %10.4f %10.4f\n", r.sum_iou / r.labeled, r.sum_ciou / r.labeled);
+        else
+            printf(" %10s %10s\n", "-", "-");
+    }
+
+    FILE *fp = (json_pth == "-") ? stdout : fopen(json_pth.c_str(), "w");
+    if (fp == NULL)
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    write_json(fp, dataset_pth, images, warmup, reps, results);
+    if (fp != stdout)
+    {
+        fclose(fp);
+        printf("results written to %s\n", json_pth.c_str());
+    }
+
+    return 0;
+}
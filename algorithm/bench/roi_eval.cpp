@@ -0,0 +1,300 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bbox.hpp"
+#include "dvs_roi_packed.hpp"
+#include "frame_cache.hpp"
+#include "roi_engine.hpp"
+
+/**
+ * parallel accuracy evaluation of the ROI algorithms over one or more datasets.
+ * every dataset is decoded once into a packed 2-bit FrameCache, later runs map the cache.
+ * worker threads take images from a shared counter and run every algorithm on them,
+ * the per-image results are summed in image order, so the report does not depend on
+ * the thread count or scheduling.
+ */
+
+typedef struct
+{
+    uint8_t evaluated;
+    uint8_t detected;
+    uint8_t labeled;
+    double iou;
+    double ciou;
+} ImageResult;
+
+typedef struct
+{
+    int images;
+    int detected;
+    int labeled;
+    double sum_iou;
+    double sum_ciou;
+} EvalSum;
+
+typedef struct
+{
+    std::string dataset_pth;
+    int images;
+    int labeled;
+    double load_ms;
+    double eval_ms;
+    EvalSum sums[ROI_ALGORITHM_NUM];
+} DatasetReport;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--threads N] [--cache_dir DIR] [--json FILE] [DATASET_DIR ...]\n", prog);
+}
+
+/**
+ * runs every algorithm on every image of cache with thread_num threads
+ * @param[out] results ROI_ALGORITHM_NUM results per image
+ */
+static void evaluate(const FrameCache &cache, const RoiParams &params, int thread_num,
+                     std::vector<ImageResult> &results)
+{
+    const int image_num = cache.size();
+    results.assign(static_cast<size_t>(image_num) * ROI_ALGORITHM_NUM, ImageResult());
+
+    std::atomic<int> next_idx(0);
+    auto work = [&]()
+    {
+        // per-thread engine and frame, an engine is not thread-safe
+        RoiEngine *engine = NULL;
+        int engine_w = 0, engine_h = 0;
+        cv::Mat frame;
+        std::vector<Bbox> rois;
+        for (int i = next_idx++; i < image_num; i = next_idx++)
+        {
+            const CacheEntry &entry = cache.entry(i);
+            if (entry.frame_w == 0 || entry.frame_h == 0)
+                continue;
+            if (engine == NULL || engine_w != entry.frame_w || engine_h != entry.frame_h)
+            {
+                delete engine;
+                engine_w = entry.frame_w;
+                engine_h = entry.frame_h;
+                engine = new RoiEngine(engine_w, engine_h, RoiAlgorithm::Proposed, params);
+            }
+            // the packed scan reads the cached frame as is, the others share one unpacked image
+            bool is_unpacked = false;
+            for (int a = 0; a < ROI_ALGORITHM_NUM; a++)
+            {
+                engine->set_algorithm(static_cast<RoiAlgorithm>(a));
+                if (engine->is_packed_input())
+                {
+                    engine->compute(cache.packed(i), rois);
+                }
+                else
+                {
+                    if (!is_unpacked)
+                    {
+                        unpack_dvs_frame(cache.packed(i), entry.frame_w, entry.frame_h, frame);
+                        is_unpacked = true;
+                    }
+                    engine->compute(frame, rois);
+                }
+
+                ImageResult &r = results[static_cast<size_t>(i) * ROI_ALGORITHM_NUM + a];
+                r.evaluated = 1;
+                r.detected = rois.empty() ? 0 : 1;
+                r.labeled = entry.has_gt ? 1 : 0;
+                if (entry.has_gt)
+                {
+                    Bbox pred = closest_roi(rois, entry.gt);
+                    r.iou = iou(pred, entry.gt);
+                    r.ciou = ciou(pred, entry.gt);
+                }
+            }
+        }
+        delete engine;
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < thread_num; t++)
+        workers.emplace_back(work);
+    work();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+static void add_result(EvalSum &sum, const ImageResult &r)
+{
+    if (!r.evaluated)
+        return;
+    sum.images++;
+    sum.detected += r.detected;
+    if (r.labeled)
+    {
+        sum.labeled++;
+        sum.sum_iou += r.iou;
+        sum.sum_ciou += r.ciou;
+    }
+}
+
+static void add_sum(EvalSum &sum, const EvalSum &other)
+{
+    sum.images += other.images;
+    sum.detected += other.detected;
+    sum.labeled += other.labeled;
+    sum.sum_iou += other.sum_iou;
+    sum.sum_ciou += other.sum_ciou;
+}
+
+static void print_sums(const EvalSum *sums)
+{
+    for (int a = 0; a < ROI_ALGORITHM_NUM; a++)
+    {
+        const EvalSum &s = sums[a];
+        printf("  %-24s %8d/%-8d", roi_algorithm_name(static_cast<RoiAlgorithm>(a)), s.detected, s.images);
+        if (s.labeled > 0)
+            printf(" %10.4f %10.4f\n", s.sum_iou / s.labeled, s.sum_ciou / s.labeled);
+        else
+            printf(" %10s %10s\n", "-", "-");
+    }
+}
+
+static void write_json_sums(FILE *fp, const EvalSum *sums, const char *indent)
+{
+    fprintf(fp, "%s\"algorithms\": [\n", indent);
+    for (int a = 0; a < ROI_ALGORITHM_NUM; a++)
+    {
+        const EvalSum &s = sums[a];
+        fprintf(fp, "%s  {\"name\": \"%s\", \"images\": %d, \"detected\": %d, \"labeled\": %d, ",
+                indent, roi_algorithm_name(static_cast<RoiAlgorithm>(a)), s.images, s.detected, s.labeled);
+        if (s.labeled > 0)
+            fprintf(fp, "\"mean_iou\": %.6f, \"mean_ciou\": %.6f}", s.sum_iou / s.labeled, s.sum_ciou / s.labeled);
+        else
+            fprintf(fp, "\"mean_iou\": null, \"mean_ciou\": null}");
+        fprintf(fp, "%s\n", (a + 1 < ROI_ALGORITHM_NUM) ? "," : "");
+    }
+    fprintf(fp, "%s]\n", indent);
+}
+
+static void write_json(FILE *fp, int thread_num, const std::vector<DatasetReport> &reports, const EvalSum *total)
+{
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"threads\": %d,\n", thread_num);
+    fprintf(fp, "  \"datasets\": [\n");
+    for (size_t i = 0; i < reports.size(); i++)
+    {
+        const DatasetReport &r = reports[i];
+        fprintf(fp, "    {\n");
+        fprintf(fp, "      \"dataset\": \"%s\",\n", r.dataset_pth.c_str());
+        fprintf(fp, "      \"images\": %d,\n", r.images);
+        fprintf(fp, "      \"labeled\": %d,\n", r.labeled);
+        fprintf(fp, "      \"load_ms\": %.3f,\n", r.load_ms);
+        fprintf(fp, "      \"eval_ms\": %.3f,\n", r.eval_ms);
+        write_json_sums(fp, r.sums, "      ");
+        fprintf(fp, "    }%s\n", (i + 1 < reports.size()) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"total\": {\n");
+    write_json_sums(fp, total, "    ");
+    fprintf(fp, "  }\n");
+    fprintf(fp, "}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int thread_num = std::max(1u, std::thread::hardware_concurrency());
+    std::string cache_dir;
+    std::string json_pth = "roi_eval.json";
+
+    struct option long_options[] = {
+        {"threads", required_argument, nullptr, 't'},
+        {"cache_dir", required_argument, nullptr, 'c'},
+        {"json", required_argument, nullptr, 'j'},
+        {nullptr, 0, nullptr, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:c:j:", long_options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            thread_num = std::max(1, atoi(optarg));
+            break;
+        case 'c':
+            cache_dir = optarg;
+            break;
+        case 'j':
+            json_pth = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::vector<std::string> datasets;
+    for (int i = optind; i < argc; i++)
+        datasets.push_back(argv[i]);
+    if (datasets.empty())
+        datasets.push_back("./examples");
+
+    RoiParams params;
+    std::vector<DatasetReport> reports;
+    EvalSum total[ROI_ALGORITHM_NUM] = {};
+    std::vector<ImageResult> results;
+    printf("%-26s %17s %10s %10s\n", "algorithm", "detected/images", "mean IoU", "mean CIoU");
+    for (const auto &dataset_pth : datasets)
+    {
+        DatasetReport report = {dataset_pth, 0, 0, 0.0, 0.0, {}};
+
+        auto start = std::chrono::steady_clock::now();
+        FrameCache cache;
+        if (!cache.open(dataset_pth, frame_cache_path(dataset_pth, cache_dir), thread_num))
+        {
+            std::cerr << "Skipping dataset: " << dataset_pth << '\n';
+            continue;
+        }
+        auto loaded = std::chrono::steady_clock::now();
+        evaluate(cache, params, thread_num, results);
+        auto end = std::chrono::steady_clock::now();
+        report.load_ms = std::chrono::duration<double, std::milli>(loaded - start).count();
+        report.eval_ms = std::chrono::duration<double, std::milli>(end - loaded).count();
+
+        // aggregate in image order
+        report.images = cache.size();
+        for (int i = 0; i < cache.size(); i++)
+        {
+            report.labeled += cache.entry(i).has_gt ? 1 : 0;
+            for (int a = 0; a < ROI_ALGORITHM_NUM; a++)
+                add_result(report.sums[a], results[static_cast<size_t>(i) * ROI_ALGORITHM_NUM + a]);
+        }
+        for (int a = 0; a < ROI_ALGORITHM_NUM; a++)
+            add_sum(total[a], report.sums[a]);
+
+        printf("%s : %d images, %d labeled, load %.1f ms, eval %.1f ms\n",
+               dataset_pth.c_str(), report.images, report.labeled, report.load_ms, report.eval_ms);
+        print_sums(report.sums);
+        reports.push_back(report);
+    }
+    printf("total :\n");
+    print_sums(total);
+
+    FILE *fp = (json_pth == "-") ? stdout : fopen(json_pth.c_str(), "w");
+    if (fp == NULL)
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    write_json(fp, thread_num, reports, total);
+    if (fp != stdout)
+    {
+        fclose(fp);
+        printf("results written to %s\n", json_pth.c_str());
+    }
+
+    return 0;
+}
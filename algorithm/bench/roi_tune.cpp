@@ -0,0 +1,548 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <getopt.h>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bbox.hpp"
+#include "dvs_roi_packed.hpp"
+#include "frame_cache.hpp"
+#include "roi_engine.hpp"
+
+/**
+ * hyper-parameter tuner of the ROI algorithms.
+ * every candidate parameter set runs over all labelled images of the datasets, candidates
+ * are spread over the threads. the result of an algorithm is its accuracy (mean CIoU) /
+ * latency (mean ms per frame) Pareto front.
+ * > grid : every combination of the parameter grids
+ * > random : half the budget sampled uniformly from the grids, the other half perturbs
+ *            the points of the current Pareto front by one grid step
+ */
+
+/**
+ * tunable parameter of RoiParams on a grid min, min + step, ... <= max
+ * @param macro_3 macro of 3.CIS_DVS/host/src/config.hpp, NULL if none
+ * @param macro_4 macro of 4.CIS_DVS_NPU/host/src/network.h, NULL if none
+ */
+typedef struct
+{
+    const char *name;
+    const char *macro_3;
+    const char *macro_4;
+    double min;
+    double max;
+    double step;
+} TuneParam;
+
+enum TuneParamIdx
+{
+    P_EVENT_SCORE,
+    P_ROW_SCORE,
+    P_HEIGHT_MIN,
+    P_LINE_MIN,
+    P_VERTICAL_GAP,
+    P_MIN_WIDTH,
+    P_MIN_HEIGHT,
+    P_MIN_SIZE,
+    P_INFLATION,
+    TUNE_PARAM_NUM
+};
+
+static TuneParam tune_params[TUNE_PARAM_NUM] = {
+    {"roi_event_score", "ROI_EVENT_SCORE", "ROI_EVENT_SCORE", 1, 9, 2},
+    {"row_score_threshold", "ROW_SCORE_THRESHOLD", "ROI_MIN_SCORE", 10, 60, 10},
+    {"roi_height_min_threshold", "ROI_HEIGHT_MIN_THRESHOLD", "ROI_LINE_WIDTH", 4, 16, 4},
+    {"roi_line_min_threshold", NULL, NULL, 2, 30, 4},
+    {"max_vertical_gap", NULL, NULL, 2, 26, 8},
+    {"min_roi_width", NULL, NULL, 10, 50, 20},
+    {"min_roi_height", NULL, NULL, 10, 50, 20},
+    {"roi_min_size", "DVS_ROI_MIN_SIZE", "DVS_ROI_MIN_SIZE", 10, 250, 80},
+    {"roi_inflation_ratio", "ROI_INFLATION", "ROI_INFLATION", 1.0, 2.0, 0.4}};
+
+/**
+ * @return true if algorithm reads parameter p
+ */
+static bool uses_param(RoiAlgorithm algorithm, int p)
+{
+    switch (algorithm)
+    {
+    case RoiAlgorithm::AverageBased:
+        return p == P_LINE_MIN || p == P_MIN_SIZE || p == P_INFLATION;
+    case RoiAlgorithm::Proposed:
+        return p == P_EVENT_SCORE || p == P_ROW_SCORE || p == P_HEIGHT_MIN || p == P_MIN_SIZE || p == P_INFLATION;
+    case RoiAlgorithm::ProposedAngled:
+        // no ROIs until the streak clustering is done
+        return false;
+    case RoiAlgorithm::ProposedMultiObject:
+    case RoiAlgorithm::ProposedMultiContour:
+        return p == P_EVENT_SCORE || p == P_ROW_SCORE || p == P_HEIGHT_MIN || p == P_VERTICAL_GAP ||
+               p == P_MIN_WIDTH || p == P_MIN_HEIGHT;
+    }
+    return false;
+}
+
+static int grid_size(int p)
+{
+    return static_cast<int>((tune_params[p].max - tune_params[p].min) / tune_params[p].step + 1e-6) + 1;
+}
+
+static double grid_value(int p, int idx)
+{
+    return tune_params[p].min + idx * tune_params[p].step;
+}
+
+/**
+ * grid index of every parameter, 0 for the parameters the algorithm does not read
+ */
+typedef std::vector<int> Candidate;
+
+typedef struct
+{
+    Candidate candidate;
+    double mean_ciou;
+    double mean_iou;
+    double mean_ms;
+    int detected;
+} TuneResult;
+
+typedef struct
+{
+    cv::Mat frame;
+    Bbox gt;
+} TuneFrame;
+
+static RoiParams candidate_params(const Candidate &c)
+{
+    RoiParams params;
+    params.roi_event_score = static_cast<int>(grid_value(P_EVENT_SCORE, c[P_EVENT_SCORE]));
+    params.row_score_threshold = static_cast<int>(grid_value(P_ROW_SCORE, c[P_ROW_SCORE]));
+    params.roi_height_min_threshold = static_cast<int>(grid_value(P_HEIGHT_MIN, c[P_HEIGHT_MIN]));
+    params.roi_line_min_threshold = static_cast<int>(grid_value(P_LINE_MIN, c[P_LINE_MIN]));
+    params.max_vertical_gap = static_cast<int>(grid_value(P_VERTICAL_GAP, c[P_VERTICAL_GAP]));
+    params.min_roi_width = static_cast<int>(grid_value(P_MIN_WIDTH, c[P_MIN_WIDTH]));
+    params.min_roi_height = static_cast<int>(grid_value(P_MIN_HEIGHT, c[P_MIN_HEIGHT]));
+    params.roi_min_size = static_cast<int>(grid_value(P_MIN_SIZE, c[P_MIN_SIZE]));
+    params.roi_inflation_ratio = static_cast<float>(grid_value(P_INFLATION, c[P_INFLATION]));
+    return params;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--algorithm NAME] [--search grid|random] [--budget N] [--seed N]\n"
+            "          [--range NAME=MIN:MAX:STEP] [--threads N] [--cache_dir DIR] [--json FILE] [DATASET_DIR ...]\n",
+            prog);
+}
+
+/**
+ * parses NAME=MIN:MAX:STEP into the grid of parameter NAME
+ */
+static bool parse_range(const char *arg)
+{
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL)
+        return false;
+    std::string name(arg, eq - arg);
+    double min, max, step;
+    if (sscanf(eq + 1, "%lf:%lf:%lf", &min, &max, &step) != 3 || step <= 0 || max < min)
+        return false;
+    for (int p = 0; p < TUNE_PARAM_NUM; p++)
+    {
+        if (name == tune_params[p].name)
+        {
+            tune_params[p].min = min;
+            tune_params[p].max = max;
+            tune_params[p].step = step;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * evaluates candidates[begin, end) with thread_num threads, every thread has its own engine
+ */
+static void evaluate(RoiAlgorithm algorithm, const std::vector<TuneFrame> &frames,
+                     const std::vector<Candidate> &candidates, int thread_num,
+                     std::vector<TuneResult> &results)
+{
+    const size_t begin = results.size();
+    const int candidate_num = static_cast<int>(candidates.size() - begin);
+    results.resize(candidates.size());
+
+    std::atomic<int> next_idx(0);
+    auto work = [&]()
+    {
+        RoiEngine *engine = NULL;
+        int engine_w = 0, engine_h = 0;
+        std::vector<Bbox> rois;
+        for (int i = next_idx++; i < candidate_num; i = next_idx++)
+        {
+            const Candidate &c = candidates[begin + i];
+            RoiParams params = candidate_params(c);
+            TuneResult &r = results[begin + i];
+            r.candidate = c;
+            double sum_ciou = 0.0, sum_iou = 0.0, sum_ms = 0.0;
+            int detected = 0;
+            for (const auto &f : frames)
+            {
+                if (engine == NULL || engine_w != f.frame.cols || engine_h != f.frame.rows)
+                {
+                    delete engine;
+                    engine_w = f.frame.cols;
+                    engine_h = f.frame.rows;
+                    engine = new RoiEngine(engine_w, engine_h, algorithm, params);
+                }
+                engine->set_params(params);
+
+                auto start = std::chrono::steady_clock::now();
+                engine->compute(f.frame, rois);
+                auto end = std::chrono::steady_clock::now();
+                sum_ms += std::chrono::duration<double, std::milli>(end - start).count();
+
+                detected += rois.empty() ? 0 : 1;
+                Bbox pred = closest_roi(rois, f.gt);
+                sum_iou += iou(pred, f.gt);
+                sum_ciou += ciou(pred, f.gt);
+            }
+            r.mean_ciou = sum_ciou / frames.size();
+            r.mean_iou = sum_iou / frames.size();
+            r.mean_ms = sum_ms / frames.size();
+            r.detected = detected;
+        }
+        delete engine;
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < thread_num; t++)
+        workers.emplace_back(work);
+    work();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+/**
+ * indices of the results no other result beats in both accuracy and latency, fastest first
+ */
+static std::vector<int> pareto_front(const std::vector<TuneResult> &results)
+{
+    std::vector<int> order(results.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = static_cast<int>(i);
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b)
+              {
+                  if (results[a].mean_ms != results[b].mean_ms)
+                      return results[a].mean_ms < results[b].mean_ms;
+                  return results[a].mean_ciou > results[b].mean_ciou;
+              });
+
+    std::vector<int> front;
+    double best_ciou = -2.0;
+    for (int i : order)
+    {
+        if (results[i].mean_ciou > best_ciou)
+        {
+            best_ciou = results[i].mean_ciou;
+            front.push_back(i);
+        }
+    }
+    return front;
+}
+
+/**
+ * every grid point of the parameters of algorithm
+ */
+static void grid_candidates(RoiAlgorithm algorithm, std::vector<Candidate> &candidates)
+{
+    Candidate c(TUNE_PARAM_NUM, 0);
+    while (true)
+    {
+        candidates.push_back(c);
+        // mixed-radix increment over the parameters the algorithm reads
+        int p = 0;
+        for (; p < TUNE_PARAM_NUM; p++)
+        {
+            if (!uses_param(algorithm, p))
+                continue;
+            if (++c[p] < grid_size(p))
+                break;
+            c[p] = 0;
+        }
+        if (p == TUNE_PARAM_NUM)
+            break;
+    }
+}
+
+static void tune_random(RoiAlgorithm algorithm, const std::vector<TuneFrame> &frames, int budget,
+                        int thread_num, std::mt19937 &rng, std::vector<Candidate> &candidates,
+                        std::vector<TuneResult> &results)
+{
+    std::set<Candidate> seen;
+    size_t space = 1;
+    for (int p = 0; p < TUNE_PARAM_NUM; p++)
+        space *= uses_param(algorithm, p) ? grid_size(p) : 1;
+    budget = static_cast<int>(std::min<size_t>(budget, space));
+
+    // candidates of one batch run in parallel, the front is updated between batches
+    const int batch = std::max(8, 2 * thread_num);
+    while (static_cast<int>(candidates.size()) < budget)
+    {
+        const bool explore = static_cast<int>(candidates.size()) < budget / 2 || results.empty();
+        std::vector<int> front = pareto_front(results);
+        int attempts = 0;
+        int batch_end = std::min(budget, static_cast<int>(candidates.size()) + batch);
+        while (static_cast<int>(candidates.size()) < batch_end && attempts++ < 100 * batch)
+        {
+            Candidate c(TUNE_PARAM_NUM, 0);
+            if (explore)
+            {
+                for (int p = 0; p < TUNE_PARAM_NUM; p++)
+                {
+                    if (uses_param(algorithm, p))
+                        c[p] = std::uniform_int_distribution<int>(0, grid_size(p) - 1)(rng);
+                }
+            }
+            else
+            {
+                // one grid step away from a front point, in one or two parameters
+                c = results[front[std::uniform_int_distribution<int>(0, front.size() - 1)(rng)]].candidate;
+                int moves = std::uniform_int_distribution<int>(1, 2)(rng);
+                for (int m = 0; m < moves; m++)
+                {
+                    int p = std::uniform_int_distribution<int>(0, TUNE_PARAM_NUM - 1)(rng);
+                    if (!uses_param(algorithm, p))
+                        continue;
+                    c[p] = std::min(grid_size(p) - 1, std::max(0, c[p] + ((rng() & 1) ? 1 : -1)));
+                }
+            }
+            if (seen.insert(c).second)
+                candidates.push_back(c);
+        }
+        if (static_cast<int>(candidates.size()) == static_cast<int>(results.size()))
+            break; // no new candidate left around the front
+        evaluate(algorithm, frames, candidates, thread_num, results);
+    }
+}
+
+static void print_params(FILE *fp, RoiAlgorithm algorithm, const Candidate &c, bool json)
+{
+    bool first = true;
+    for (int p = 0; p < TUNE_PARAM_NUM; p++)
+    {
+        if (!uses_param(algorithm, p))
+            continue;
+        if (json)
+            fprintf(fp, "%s\"%s\": %g", first ? "" : ", ", tune_params[p].name, grid_value(p, c[p]));
+        else
+            fprintf(fp, " %s=%g", tune_params[p].name, grid_value(p, c[p]));
+        first = false;
+    }
+}
+
+/**
+ * host macros of the most accurate front point
+ */
+static void print_macros(RoiAlgorithm algorithm, const Candidate &c)
+{
+    const char *targets[2] = {"3.CIS_DVS/host/src/config.hpp", "4.CIS_DVS_NPU/host/src/network.h"};
+    for (int t = 0; t < 2; t++)
+    {
+        bool header = false;
+        for (int p = 0; p < TUNE_PARAM_NUM; p++)
+        {
+            const char *macro = (t == 0) ? tune_params[p].macro_3 : tune_params[p].macro_4;
+            if (!uses_param(algorithm, p) || macro == NULL)
+                continue;
+            if (!header)
+                printf("  %s :\n", targets[t]);
+            header = true;
+            if (p == P_INFLATION)
+                printf("    #define %s (float)(%g)\n", macro, grid_value(p, c[p]));
+            else
+                printf("    #define %s %g\n", macro, grid_value(p, c[p]));
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int thread_num = std::max(1u, std::thread::hardware_concurrency());
+    std::string cache_dir;
+    std::string json_pth = "roi_tune.json";
+    std::string search = "grid";
+    std::string algorithm_name;
+    int budget = 200;
+    unsigned seed = 1;
+
+    struct option long_options[] = {
+        {"algorithm", required_argument, nullptr, 'a'},
+        {"search", required_argument, nullptr, 's'},
+        {"budget", required_argument, nullptr, 'b'},
+        {"seed", required_argument, nullptr, 'S'},
+        {"range", required_argument, nullptr, 'r'},
+        {"threads", required_argument, nullptr, 't'},
+        {"cache_dir", required_argument, nullptr, 'c'},
+        {"json", required_argument, nullptr, 'j'},
+        {nullptr, 0, nullptr, 0}};
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "a:s:b:S:r:t:c:j:", long_options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            algorithm_name = optarg;
+            break;
+        case 's':
+            search = optarg;
+            break;
+        case 'b':
+            budget = std::max(1, atoi(optarg));
+            break;
+        case 'S':
+            seed = static_cast<unsigned>(strtoul(optarg, NULL, 10));
+            break;
+        case 'r':
+            if (!parse_range(optarg))
+            {
+                fprintf(stderr, "Error: invalid range %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 't':
+            thread_num = std::max(1, atoi(optarg));
+            break;
+        case 'c':
+            cache_dir = optarg;
+            break;
+        case 'j':
+            json_pth = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (search != "grid" && search != "random")
+    {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> datasets;
+    for (int i = optind; i < argc; i++)
+        datasets.push_back(argv[i]);
+    if (datasets.empty())
+        datasets.push_back("./examples");
+
+    // only labelled images can score a candidate, they are unpacked once and shared by the threads
+    std::vector<TuneFrame> frames;
+    for (const auto &dataset_pth : datasets)
+    {
+        FrameCache cache;
+        if (!cache.open(dataset_pth, frame_cache_path(dataset_pth, cache_dir), thread_num))
+        {
+            std::cerr << "Skipping dataset: " << dataset_pth << '\n';
+            continue;
+        }
+        for (int i = 0; i < cache.size(); i++)
+        {
+            const CacheEntry &entry = cache.entry(i);
+            if (!entry.has_gt || entry.frame_w == 0 || entry.frame_h == 0)
+                continue;
+            frames.push_back(TuneFrame());
+            unpack_dvs_frame(cache.packed(i), entry.frame_w, entry.frame_h, frames.back().frame);
+            frames.back().gt = entry.gt;
+        }
+    }
+    if (frames.empty())
+    {
+        std::cerr << "No labelled images found\n";
+        exit(EXIT_FAILURE);
+    }
+    printf("%zu labelled images, %d threads, %s search\n", frames.size(), thread_num, search.c_str());
+    printf("latency is measured with all threads busy, compare it between candidates only\n");
+
+    FILE *fp = (json_pth == "-") ? stdout : fopen(json_pth.c_str(), "w");
+    if (fp == NULL)
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+    fprintf(fp, "{\n  \"images\": %zu,\n  \"threads\": %d,\n  \"search\": \"%s\",\n  \"algorithms\": [",
+            frames.size(), thread_num, search.c_str());
+
+    std::mt19937 rng(seed);
+    bool first_algorithm = true;
+    for (int a = 0; a < ROI_ALGORITHM_NUM; a++)
+    {
+        RoiAlgorithm algorithm = static_cast<RoiAlgorithm>(a);
+        const char *name = roi_algorithm_name(algorithm);
+        if (!algorithm_name.empty() && algorithm_name != name)
+            continue;
+        bool tunable = false;
+        for (int p = 0; p < TUNE_PARAM_NUM; p++)
+            tunable |= uses_param(algorithm, p);
+        if (!tunable)
+        {
+            printf("\n%s : nothing to tune\n", name);
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Candidate> candidates;
+        std::vector<TuneResult> results;
+        if (search == "grid")
+        {
+            grid_candidates(algorithm, candidates);
+            evaluate(algorithm, frames, candidates, thread_num, results);
+        }
+        else
+        {
+            tune_random(algorithm, frames, budget, thread_num, rng, candidates, results);
+        }
+        double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<int> front = pareto_front(results);
+        printf("\n%s : %zu candidates in %.1f s, Pareto front :\n", name, results.size(), elapsed_s);
+        printf("  %10s %10s %10s %9s  params\n", "ms", "CIoU", "IoU", "detected");
+        for (int i : front)
+        {
+            const TuneResult &r = results[i];
+            printf("  %10.3f %10.4f %10.4f %4d/%-4zu ", r.mean_ms, r.mean_ciou, r.mean_iou, r.detected, frames.size());
+            print_params(stdout, algorithm, r.candidate, false);
+            printf("\n");
+        }
+        print_macros(algorithm, results[front.back()].candidate);
+
+        fprintf(fp, "%s\n    {\n      \"name\": \"%s\",\n      \"evaluated\": %zu,\n      \"elapsed_s\": %.3f,\n      \"front\": [",
+                first_algorithm ? "" : ",", name, results.size(), elapsed_s);
+        for (size_t k = 0; k < front.size(); k++)
+        {
+            const TuneResult &r = results[front[k]];
+            fprintf(fp, "%s\n        {\"latency_ms\": %.4f, \"mean_ciou\": %.6f, \"mean_iou\": %.6f, \"detected\": %d, \"params\": {",
+                    k ? "," : "", r.mean_ms, r.mean_ciou, r.mean_iou, r.detected);
+            print_params(fp, algorithm, r.candidate, true);
+            fprintf(fp, "}}");
+        }
+        fprintf(fp, "\n      ]\n    }");
+        first_algorithm = false;
+    }
+    fprintf(fp, "\n  ]\n}\n");
+    if (fp != stdout)
+    {
+        fclose(fp);
+        printf("\nresults written to %s\n", json_pth.c_str());
+    }
+
+    return 0;
+}
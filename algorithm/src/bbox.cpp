@@ -81,4 +81,20 @@ bool load_gt_one(const std::string &path,
         return true;
     }
     return false;
-}
\ No newline at end of file
+}
+
+Bbox closest_roi(const std::vector<Bbox> &rois, const Bbox &gt)
+{
+    Bbox best = {0, 0, 0, 0};
+    double best_iou = -1.0;
+    for (const auto &roi : rois)
+    {
+        double roi_iou = iou(roi, gt);
+        if (roi_iou > best_iou)
+        {
+            best_iou = roi_iou;
+            best = roi;
+        }
+    }
+    return best;
+}
@@ -66,4 +66,10 @@ bool load_gt_one(
     int img_w, int img_h,
     Bbox &bbox_out);
 
+/**
+ * ROI of rois closest (highest IoU) to gt, the all zero box if rois is empty
+ * (a missed ROI scores like the single-ROI algorithms returning no ROI)
+ */
+Bbox closest_roi(const std::vector<Bbox> &rois, const Bbox &gt);
+
 #endif
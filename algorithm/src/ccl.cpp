@@ -0,0 +1,149 @@
+#include "ccl.hpp"
+
+RunLabeler::RunLabeler(int max_row_dist, int max_col_gap)
+    : max_row_dist(std::max(1, max_row_dist)), max_col_gap(std::max(0, max_col_gap))
+{
+}
+
+void RunLabeler::set_gaps(int max_row_dist, int max_col_gap)
+{
+    this->max_row_dist = std::max(1, max_row_dist);
+    this->max_col_gap = std::max(0, max_col_gap);
+}
+
+int RunLabeler::find(int run)
+{
+    // path halving
+    while (parent[run] != run)
+    {
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+void RunLabeler::unite(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    // the earlier run stays the root, so components come out in order of their first run
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+void RunLabeler::label(
+    const std::vector<RowStreak> &runs,
+    std::vector<Component> &components,
+    std::vector<int> *run_labels)
+{
+    const int run_num = static_cast<int>(runs.size());
+    components.clear();
+    parent.resize(run_num);
+    rows.clear();
+
+    // 1. group runs by row, same-row runs closer than max_col_gap are connected
+    for (int i = 0; i < run_num; ++i)
+    {
+        parent[i] = i;
+        if (rows.empty() || rows.back().row != runs[i].row)
+        {
+            rows.push_back({runs[i].row, i, i + 1});
+            continue;
+        }
+        rows.back().end = i + 1;
+        if (runs[i].left - runs[i - 1].right - 1 <= max_col_gap)
+            unite(i - 1, i);
+    }
+
+    // 2. connect every row to the rows at most max_row_dist above it
+    //    both rows are sorted by left, so one merge-like sweep per row pair is enough
+    for (int r = 1; r < static_cast<int>(rows.size()); ++r)
+    {
+        for (int p = r - 1; p >= 0 && rows[r].row - rows[p].row <= max_row_dist; --p)
+        {
+            int i = rows[p].begin, i_end = rows[p].end;
+            int j = rows[r].begin, j_end = rows[r].end;
+            while (i < i_end && j < j_end)
+            {
+                const RowStreak &a = runs[i];
+                const RowStreak &b = runs[j];
+                if (a.left <= b.right + max_col_gap && b.left <= a.right + max_col_gap)
+                    unite(i, j);
+                // advance the run that ends first, it cannot overlap anything further right
+                if (a.right < b.right)
+                    ++i;
+                else
+                    ++j;
+            }
+        }
+    }
+
+    // 3. per-component bbox, area and centroid
+    component_idx.assign(run_num, -1);
+    weighted_sum.clear();
+    if (run_labels != NULL)
+        run_labels->resize(run_num);
+    for (int i = 0; i < run_num; ++i)
+    {
+        const RowStreak &run = runs[i];
+        int root = find(i);
+        if (component_idx[root] < 0)
+        {
+            component_idx[root] = static_cast<int>(components.size());
+            Component c;
+            c.bbox = {run.left, run.row, run.right, run.row};
+            c.area = 0;
+            c.run_num = 0;
+            components.push_back(c);
+            weighted_sum.push_back(cv::Point2d(0, 0));
+        }
+        int idx = component_idx[root];
+        Component &c = components[idx];
+        int len = run.right - run.left + 1;
+        c.bbox.lx = std::min(c.bbox.lx, run.left);
+        c.bbox.hx = std::max(c.bbox.hx, run.right);
+        c.bbox.ly = std::min(c.bbox.ly, run.row);
+        c.bbox.hy = std::max(c.bbox.hy, run.row);
+        c.area += len;
+        c.run_num++;
+        weighted_sum[idx].x += 0.5 * (run.left + run.right) * len;
+        weighted_sum[idx].y += static_cast<double>(run.row) * len;
+        if (run_labels != NULL)
+            (*run_labels)[i] = idx;
+    }
+    for (size_t k = 0; k < components.size(); ++k)
+    {
+        components[k].centroid = cv::Point2f(weighted_sum[k].x / components[k].area,
+                                             weighted_sum[k].y / components[k].area);
+    }
+}
+
+void extract_event_runs(
+    const cv::Mat &frame,
+    int max_col_gap,
+    std::vector<RowStreak> &runs)
+{
+    runs.clear();
+    for (int h = 0; h < frame.rows; ++h)
+    {
+        const uchar *row_ptr = frame.ptr<uchar>(h);
+        int left = -1, right = -1;
+        for (int w = 0; w < frame.cols; ++w)
+        {
+            if (row_ptr[w] == 128)
+                continue;
+            if (left >= 0 && w - right - 1 <= max_col_gap)
+            {
+                right = w;
+                continue;
+            }
+            if (left >= 0)
+                runs.push_back({h, left, right});
+            left = right = w;
+        }
+        if (left >= 0)
+            runs.push_back({h, left, right});
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef DVS_CCL_HPP_
+#define DVS_CCL_HPP_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "bbox.hpp"
+
+/**
+ * connected component of row runs.
+ * @param bbox bounding box of the runs
+ * @param centroid mean position of the pixels covered by the runs
+ * @param area pixels covered by the runs
+ * @param run_num number of runs in the component
+ */
+typedef struct
+{
+    Bbox bbox;
+    cv::Point2f centroid;
+    int area;
+    int run_num;
+} Component;
+
+/**
+ * connected-component labeling on run-length encoded rows.
+ *
+ * runs are merged with union-find while sweeping the rows once, so labeling is linear
+ * in the number of runs (times max_row_dist) instead of runs x clusters.
+ * two runs are connected if
+ *   > they are on the same row with at most max_col_gap pixels between them, or
+ *   > their rows are at most max_row_dist apart and their columns overlap
+ *     once both are widened by max_col_gap.
+ * the labeler keeps its buffers, so labeling every frame with one object does not allocate.
+ */
+class RunLabeler
+{
+private:
+    int max_row_dist;
+    int max_col_gap;
+    // union-find parent of every run
+    std::vector<int> parent;
+    // runs [begin, end) of one row
+    struct RowRange
+    {
+        int row;
+        int begin;
+        int end;
+    };
+    // every row with runs, in row order
+    std::vector<RowRange> rows;
+    // component index of every root run
+    std::vector<int> component_idx;
+    // pixel-weighted position sum of every component
+    std::vector<cv::Point2d> weighted_sum;
+
+    int find(int run);
+    void unite(int a, int b);
+
+public:
+    /**
+     * @param max_row_dist runs up to this many rows apart may connect (1 : adjacent rows only)
+     * @param max_col_gap columns bridged between runs (0 : overlapping or touching runs only)
+     */
+    RunLabeler(int max_row_dist = 1, int max_col_gap = 0);
+    /**
+     * changes the connectivity of the next label calls, the buffers are kept
+     */
+    void set_gaps(int max_row_dist, int max_col_gap);
+    /**
+     * labels runs sorted by row, then by left
+     * @param runs row runs
+     * @param[out] components one entry per connected component, in order of their first run
+     * @param[out] run_labels component index of every run, NULL if not needed
+     */
+    void label(
+        const std::vector<RowStreak> &runs,
+        std::vector<Component> &components,
+        std::vector<int> *run_labels = NULL);
+};
+
+/**
+ * run-length encodes the event pixels (value != 128) of a DVS image, row by row
+ * @param frame 8-bit DVS image
+ * @param max_col_gap non-event pixels bridged inside one run
+ * @param[out] runs runs sorted by row, then by left
+ */
+void extract_event_runs(
+    const cv::Mat &frame,
+    int max_col_gap,
+    std::vector<RowStreak> &runs);
+
+#endif
@@ -2,85 +2,89 @@
 #include "dvs_roi_alg.hpp"
 #include "bbox.hpp"
 
-std::vector<Bbox> dvs_roi_cluster_tracker(
+void dvs_roi_cluster_tracker(
     const cv::Mat &frame,
-    std::vector<std::vector<cv::Point>> &clusters,
     int max_dist,
-    int min_cluster_size)
+    int min_cluster_size,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<std::vector<cv::Point>> *clusters)
 {
-    clusters.clear();
-    std::vector<Cluster> tracked;
-    std::vector<Bbox> bboxes;
-
-    for (int y = 0; y < frame.rows; ++y)
+    rois.clear();
+    if (clusters != NULL)
+        clusters->clear();
+
+    // events closer than max_dist along a row share a run,
+    // runs up to max_dist rows apart with overlapping columns share a component
+    std::vector<RowStreak> &runs = scratch.runs;
+    std::vector<Component> &components = scratch.components;
+    std::vector<int> &run_labels = scratch.run_labels;
+    extract_event_runs(frame, max_dist, runs);
+    scratch.labeler.set_gaps(max_dist, max_dist);
+    scratch.labeler.label(runs, components, &run_labels);
+
+    // event pixels of every component, in scan order
+    // (only counted unless the clusters are asked for, runs may bridge non-event pixels)
+    std::vector<int> &event_num = scratch.event_num;
+    event_num.assign(components.size(), 0);
+    std::vector<std::vector<cv::Point>> &points = scratch.points;
+    if (clusters != NULL)
+    {
+        if (points.size() < components.size())
+            points.resize(components.size());
+        for (size_t k = 0; k < components.size(); ++k)
+            points[k].clear();
+    }
+    for (size_t i = 0; i < runs.size(); ++i)
     {
-        for (int x = 0; x < frame.cols; ++x)
+        const RowStreak &run = runs[i];
+        const uchar *row_ptr = frame.ptr<uchar>(run.row);
+        for (int x = run.left; x <= run.right; ++x)
         {
-            uchar pix = frame.at<uchar>(y, x);
-            if (pix != 128)
-            {
-                cv::Point pt(x, y);
-                bool matched = false;
-                for (auto &cluster : tracked)
-                {
-                    float dx = cluster.centroid.x - x;
-                    float dy = cluster.centroid.y - y;
-                    if (std::sqrt(dx * dx + dy * dy) <= max_dist)
-                    {
-                        cluster.points.push_back(pt);
-                        cluster.centroid.x = (cluster.centroid.x * (cluster.points.size() - 1) + x) / cluster.points.size();
-                        cluster.centroid.y = (cluster.centroid.y * (cluster.points.size() - 1) + y) / cluster.points.size();
-                        cluster.bbox.lx = std::min(cluster.bbox.lx, x);
-                        cluster.bbox.hx = std::max(cluster.bbox.hx, x);
-                        cluster.bbox.ly = std::min(cluster.bbox.ly, y);
-                        cluster.bbox.hy = std::max(cluster.bbox.hy, y);
-                        matched = true;
-                        break;
-                    }
-                }
-                if (!matched)
-                {
-                    Cluster new_cluster;
-                    new_cluster.centroid = cv::Point2f(x, y);
-                    new_cluster.points.push_back(pt);
-                    new_cluster.bbox = {x, y, x, y};
-                    tracked.push_back(new_cluster);
-                }
-            }
+            if (row_ptr[x] == 128)
+                continue;
+            event_num[run_labels[i]]++;
+            if (clusters != NULL)
+                points[run_labels[i]].push_back(cv::Point(x, run.row));
         }
     }
 
-    for (const auto &cluster : tracked)
+    for (size_t k = 0; k < components.size(); ++k)
     {
-        if (cluster.points.size() >= min_cluster_size)
+        if (event_num[k] >= min_cluster_size)
         {
-            clusters.push_back(cluster.points);
-            bboxes.push_back(cluster.bbox);
+            rois.push_back(components[k].bbox);
+            if (clusters != NULL)
+                clusters->push_back(points[k]);
         }
     }
-
-    return bboxes;
 }
 
 Bbox dvs_roi_average_based(
     const cv::Mat &frame,
-    int roi_line_min_threshold)
+    int roi_line_min_threshold,
+    RoiScratch &scratch,
+    int roi_min_size,
+    float roi_inflation_ratio)
 {
-    int frame_h = 720, frame_w = 960;
+    const int frame_h = frame.rows, frame_w = frame.cols;
 
     Bbox b_box_dvs = {0, 0, 0, 0};
 
     // buffers to count the number of events per column and row
-    int *x_count = (int *)calloc(frame_w, sizeof(int));
-    int *y_count = (int *)calloc(frame_h, sizeof(int));
+    scratch.x_count.assign(frame_w, 0);
+    scratch.y_count.assign(frame_h, 0);
+    int *x_count = scratch.x_count.data();
+    int *y_count = scratch.y_count.data();
 
     int sum = 0;
     // calculate distribution
     for (int h = 0; h < frame_h; h++)
     {
+        const uchar *row_ptr = frame.ptr<uchar>(h);
         for (int w = 0; w < frame_w; w++)
         {
-            if (frame.at<uchar>(h, w) != 128)
+            if (row_ptr[w] != 128)
             {
                 x_count[w]++;
                 y_count[h]++;
@@ -160,7 +164,8 @@ Bbox dvs_roi_average_based(
     if (x_min != 0 && y_min != 0)
     {
         // if valid ROI is detected
-        draw_square_roi(&b_box_dvs, x_min, y_min, x_max, y_max, frame_w, frame_h);
+        draw_square_roi(&b_box_dvs, x_min, y_min, x_max, y_max, frame_w, frame_h,
+                        roi_min_size, roi_inflation_ratio);
     }
 
     // //---------------------------------------------------------
@@ -251,12 +256,23 @@ Bbox dvs_roi_average_based(
     return b_box_dvs;
 }
 
+/**
+ * @return true if the 8 pixels at row_ptr have no event
+ */
+static bool is_empty_word(const uchar *row_ptr)
+{
+    uint64_t pixels;
+    memcpy(&pixels, row_ptr, 8);
+    return pixels == 0x8080808080808080ULL;
+}
+
 void detect_streaks(
     const cv::Mat &frame,
     ScanDirection direction,
     int roi_event_score,
     int row_score_threshold,
-    std::vector<Streak> &out_streaks)
+    std::vector<Streak> &out_streaks,
+    StreakLines *lines)
 {
     const int frame_w = frame.cols;
     const int frame_h = frame.rows;
@@ -278,6 +294,14 @@ void detect_streaks(
 
             for (int w = 0; w < frame_w; ++w)
             {
+                // at score 0 every empty pixel restarts the segment, skip 8 of them at once
+                if (score == 0 && w + 8 <= frame_w && is_empty_word(row_ptr + w))
+                {
+                    streak_start = w + 8;
+                    w += 7;
+                    continue;
+                }
+
                 score += (row_ptr[w] != 128) ? roi_event_score : -1;
 
                 if (score < 0)
@@ -314,228 +338,225 @@ void detect_streaks(
             }
         }
     }
-    else if (direction == ScanDirection::Vertical)
+    else
     {
-        // 1. Rotate input 90° CCW → vertical streaks become horizontal
-        cv::Mat rotated;
-        cv::rotate(frame, rotated, cv::ROTATE_90_COUNTERCLOCKWISE);
-        int rotated_h = rotated.rows; // same as original width
-        int rotated_w = rotated.cols; // same as original height
-
-        // 2. Apply horizontal scan to rotated image
-        for (int h = 0; h < rotated_h; ++h)
+        // one scan line per column (Vertical), diagonal x - y (Diagonal45) or anti-diagonal
+        // x + y (Diagonal135). all lines advance together row by row, so the frame is read
+        // in memory order without a rotated copy, and the lines of a row are independent :
+        // every row first updates all its lines without branches (vectorizable), then emits
+        // the few streaks that ended on it.
+        const int line_num = (direction == ScanDirection::Vertical) ? frame_w : frame_w + frame_h - 1;
+        // current score and first row of the segment of every line
+        // (Diagonal135 : -1 if the line has no segment)
+        const int no_start = (direction == ScanDirection::Diagonal135) ? -1 : 0;
+        StreakLines temp_lines;
+        StreakLines &l = (lines != NULL) ? *lines : temp_lines;
+        l.score.assign(line_num, 0);
+        l.start.assign(line_num, no_start);
+        // lines of the row whose streak ended on it
+        l.emit.assign(frame_w + 8, 0);
+
+        for (int y = 0; y < frame_h; ++y)
         {
-            const uchar *row_ptr = rotated.ptr<uchar>(h);
-
-            int score = 0;
-            int streak_start = 0;
-
-            for (int w = 0; w < rotated_w; ++w)
+            const uchar *row_ptr = frame.ptr<uchar>(y);
+            // offset of the line through (x, y) is x + line_offset
+            const int line_offset = (direction == ScanDirection::Vertical)     ? 0
+                                    : (direction == ScanDirection::Diagonal45) ? frame_h - 1 - y
+                                                                               : y;
+            int *score = l.score.data() + line_offset;
+            int *start = l.start.data() + line_offset;
+            uint8_t *row_emit = l.emit.data();
+
+            if (direction == ScanDirection::Vertical)
             {
-                score += (row_ptr[w] != 128) ? roi_event_score : -1;
-
-                if (score < 0)
-                {
-                    score = 0;
-                    streak_start = w + 1;
-                }
-                else if (score >= row_score_threshold && w - streak_start > 5)
+                for (int x = 0; x < frame_w; ++x)
                 {
-                    // 3. Convert (rotated_w = H) and (rotated_h = W) back to original coordinates
-                    int x1 = rotated_h - 1 - h;
-                    int y1 = streak_start;
-                    int x2 = rotated_h - 1 - h;
-                    int y2 = w;
-
-                    out_streaks.push_back({{x1, y1}, {x2, y2}});
-
-                    score = 0;
-                    streak_start = w + 1;
+                    int s = score[x] + ((row_ptr[x] != 128) ? roi_event_score : -1);
+                    const bool restart = s < 0;
+                    score[x] = restart ? 0 : s;
+                    start[x] = restart ? y + 1 : start[x];
+                    row_emit[x] = !restart & (s >= row_score_threshold) & (y - start[x] > 5);
                 }
             }
-        }
-    }
-    else if (direction == ScanDirection::Diagonal45) // ↘
-    {
-        // Start from top row
-        for (int x0 = 0; x0 < frame_w; ++x0)
-        {
-            int x = x0, y = 0;
-            int score = 0, streak_start = -1;
-
-            while (x < frame_w && y < frame_h)
+            else if (direction == ScanDirection::Diagonal45)
             {
-                uchar pixel = frame.at<uchar>(y, x);
-                score += (pixel != 128) ? roi_event_score : -1;
-
-                if (score < 0)
-                {
-                    score = 0;
-                    streak_start = -1;
-                }
-                else
+                for (int x = 0; x < frame_w; ++x)
                 {
-                    if (streak_start < 0)
-                        streak_start = 0;
-
-                    if (score >= row_score_threshold && (score > 5))
-                    {
-                        int dx = score; // or use a safe segment length
-                        out_streaks.push_back({{x - dx + 1, y - dx + 1},
-                                               {x, y}});
-                        score = 0;
-                        streak_start = -1;
-                    }
+                    int s = score[x] + ((row_ptr[x] != 128) ? roi_event_score : -1);
+                    s = (s < 0) ? 0 : s;
+                    score[x] = s;
+                    row_emit[x] = (s >= row_score_threshold) & (s > 5);
                 }
-
-                ++x;
-                ++y;
             }
-        }
-
-        // Start from left column (excluding [0][0] which is already handled)
-        for (int y0 = 1; y0 < frame_h; ++y0)
-        {
-            int x = 0, y = y0;
-            int score = 0, streak_start = -1;
-
-            while (x < frame_w && y < frame_h)
+            else
             {
-                uchar pixel = frame.at<uchar>(y, x);
-                score += (pixel != 128) ? roi_event_score : -1;
-
-                if (score < 0)
-                {
-                    score = 0;
-                    streak_start = -1;
-                }
-                else
+                for (int x = 0; x < frame_w; ++x)
                 {
-                    if (streak_start < 0)
-                        streak_start = 0;
-
-                    if (score >= row_score_threshold && (score > 5))
-                    {
-                        int dx = score;
-                        out_streaks.push_back({{x - dx + 1, y - dx + 1},
-                                               {x, y}});
-                        score = 0;
-                        streak_start = -1;
-                    }
+                    int s = score[x] + ((row_ptr[x] != 128) ? roi_event_score : -1);
+                    const bool restart = s < 0;
+                    score[x] = restart ? 0 : s;
+                    start[x] = restart ? -1 : (start[x] < 0) ? y
+                                                             : start[x];
+                    // the segment has y - start + 1 pixels
+                    row_emit[x] = !restart & (s >= row_score_threshold) & (y - start[x] + 1 > 5);
                 }
-
-                ++x;
-                ++y;
             }
-        }
-    }
-    else if (direction == ScanDirection::Diagonal135) // ↙
-    {
-        // Start from top row (top-right to top-left)
-        for (int x0 = frame_w - 1; x0 >= 0; --x0)
-        {
-            int x = x0, y = 0;
-            int score = 0;
-            int streak_len = 0;
-            int streak_start_x = -1, streak_start_y = -1;
 
-            while (x < frame_w && y < frame_h && x >= 0)
+            for (int x = 0; x < frame_w; x += 8)
             {
-                uchar pixel = frame.ptr<uchar>(y)[x];
-                score += (pixel != 128) ? roi_event_score : -1;
-
-                if (score < 0)
-                {
-                    score = 0;
-                    streak_len = 0;
-                    streak_start_x = -1;
-                    streak_start_y = -1;
-                }
-                else
+                uint64_t flags;
+                memcpy(&flags, row_emit + x, 8);
+                if (flags == 0)
+                    continue;
+                for (int i = x; i < std::min(x + 8, frame_w); ++i)
                 {
-                    if (streak_start_x < 0)
+                    if (!row_emit[i])
+                        continue;
+                    if (direction == ScanDirection::Vertical)
                     {
-                        streak_start_x = x;
-                        streak_start_y = y;
-                        streak_len = 0;
+                        out_streaks.push_back({{i, start[i]}, {i, y}});
+                        start[i] = y + 1;
                     }
-
-                    streak_len++;
-
-                    if (score >= row_score_threshold && streak_len > 5)
+                    else if (direction == ScanDirection::Diagonal45)
                     {
-                        out_streaks.push_back({{streak_start_x, streak_start_y},
-                                               {x, y}});
-                        score = 0;
-                        streak_len = 0;
-                        streak_start_x = -1;
-                        streak_start_y = -1;
+                        int dx = score[i]; // or use a safe segment length
+                        out_streaks.push_back({{i - dx + 1, y - dx + 1},
+                                               {i, y}});
                     }
+                    else
+                    {
+                        // the streak started on the same anti-diagonal, at row start
+                        out_streaks.push_back({{i + y - start[i], start[i]},
+                                               {i, y}});
+                        start[i] = -1;
+                    }
+                    score[i] = 0;
                 }
-
-                --x;
-                ++y;
             }
         }
+    }
+}
 
-        // Start from right column (excluding top-right corner)
-        for (int y0 = 1; y0 < frame_h; ++y0)
-        {
-            int x = frame_w - 1;
-            int y = y0;
-            int score = 0;
-            int streak_len = 0;
-            int streak_start_x = -1, streak_start_y = -1;
+StreakWorkers::StreakWorkers(int thread_num)
+    : generation(0), remaining(0), is_stopped(false), job(NULL), context(NULL), job_num(0)
+{
+    for (int i = 0; i < thread_num; ++i)
+    {
+        threads.emplace_back(&StreakWorkers::work, this, i + 1);
+    }
+}
 
-            while (x < frame_w && y < frame_h && x >= 0)
-            {
-                uchar pixel = frame.ptr<uchar>(y)[x];
-                score += (pixel != 128) ? roi_event_score : -1;
+StreakWorkers::~StreakWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopped = true;
+    }
+    start.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+}
 
-                if (score < 0)
-                {
-                    score = 0;
-                    streak_len = 0;
-                    streak_start_x = -1;
-                    streak_start_y = -1;
-                }
-                else
-                {
-                    if (streak_start_x < 0)
-                    {
-                        streak_start_x = x;
-                        streak_start_y = y;
-                        streak_len = 0;
-                    }
+void StreakWorkers::work(int index)
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        start.wait(lock, [&]
+                   { return is_stopped || generation != seen; });
+        if (is_stopped)
+            return;
+        seen = generation;
+        if (index >= job_num)
+            continue;
+        lock.unlock();
+        job(context, index);
+        lock.lock();
+        if (--remaining == 0)
+            done.notify_one();
+    }
+}
 
-                    streak_len++;
+void StreakWorkers::run(int job_num, void (*job)(void *context, int index), void *context)
+{
+    assert(job_num <= static_cast<int>(threads.size()) + 1);
+    if (job_num <= 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->job = job;
+        this->context = context;
+        this->job_num = job_num;
+        remaining = job_num - 1;
+        generation++;
+    }
+    start.notify_all();
+    job(context, 0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]
+              { return remaining == 0; });
+}
 
-                    if (score >= row_score_threshold && streak_len > 5)
-                    {
-                        out_streaks.push_back({{streak_start_x, streak_start_y},
-                                               {x, y}});
-                        score = 0;
-                        streak_len = 0;
-                        streak_start_x = -1;
-                        streak_start_y = -1;
-                    }
-                }
+/**
+ * arguments of one detect_streaks_parallel call, shared by its direction jobs
+ */
+typedef struct
+{
+    const cv::Mat *frame;
+    const std::vector<ScanDirection> *directions;
+    int roi_event_score;
+    int row_score_threshold;
+    RoiScratch *scratch;
+} StreakJob;
+
+static void run_streak_job(void *context, int index)
+{
+    // every direction has its own streak list and scan lines in the scratch
+    StreakJob *streak_job = static_cast<StreakJob *>(context);
+    ScanDirection direction = (*streak_job->directions)[index];
+    int d = static_cast<int>(direction);
+    streak_job->scratch->direction_streaks[d].clear();
+    detect_streaks(*streak_job->frame, direction, streak_job->roi_event_score, streak_job->row_score_threshold,
+                   streak_job->scratch->direction_streaks[d], &streak_job->scratch->direction_lines[d]);
+}
 
-                --x;
-                ++y;
-            }
-        }
+void detect_streaks_parallel(
+    const cv::Mat &frame,
+    const std::vector<ScanDirection> &directions,
+    int roi_event_score,
+    int row_score_threshold,
+    RoiScratch &scratch,
+    std::vector<Streak> &out_streaks)
+{
+    StreakJob streak_job = {&frame, &directions, roi_event_score, row_score_threshold, &scratch};
+    const int direction_num = static_cast<int>(directions.size());
+    if (scratch.streak_workers != NULL)
+    {
+        scratch.streak_workers->run(direction_num, run_streak_job, &streak_job);
+    }
+    else
+    {
+        for (int i = 0; i < direction_num; ++i)
+            run_streak_job(&streak_job, i);
+    }
+
+    for (auto direction : directions)
+    {
+        const std::vector<Streak> &s = scratch.direction_streaks[static_cast<int>(direction)];
+        out_streaks.insert(out_streaks.end(), s.begin(), s.end());
     }
 }
 
 Bbox dvs_roi_proposed(
     const cv::Mat &frame,
-    const int roi_event_score,         // Event Score for each events
-    const int row_score_threshold,     // Minimum number of events for a row to be considered active
-    const int roi_height_min_threshold // Minimum height of the ROI in rows
-)
+    const int roi_event_score,          // Event Score for each events
+    const int row_score_threshold,      // Minimum number of events for a row to be considered active
+    const int roi_height_min_threshold, // Minimum height of the ROI in rows
+    const int roi_min_size,
+    const float roi_inflation_ratio)
 {
-    const int frame_h = 720, frame_w = 960;
+    const int frame_h = frame.rows, frame_w = frame.cols;
     Bbox b_box_dvs = {0, 0, 0, 0};
 
     // //---------------------------------------------------
@@ -628,7 +649,8 @@ Bbox dvs_roi_proposed(
     if (global_y_max != -1)
     {
         // roi detected!!
-        draw_square_roi(&b_box_dvs, global_x_min, global_y_min, global_x_max, global_y_max, frame_w, frame_h);
+        draw_square_roi(&b_box_dvs, global_x_min, global_y_min, global_x_max, global_y_max, frame_w, frame_h,
+                        roi_min_size, roi_inflation_ratio);
     }
 
     // //---------------------------------------------------
@@ -658,71 +680,34 @@ Bbox dvs_roi_proposed(
     // cv::imshow("Max Score", y_plot);
     // cv::waitKey(0);
 
-    // --------------------------------------------------
-    // Draw the ROI rectangle on the image (in white)
-    cv::Point p1(b_box_dvs.lx, b_box_dvs.ly);
-    cv::Point p2(b_box_dvs.hx, b_box_dvs.hy);
-    // Draw the ROI rectangle on the image (in white)
-    cv::rectangle(frame, p1, p2, cv::Scalar(255), 2, cv::LINE_8);
-
-    // Show the image in a window
-    cv::imshow("DVS ROI", frame);
-    cv::waitKey(0); // Wait for a key press to close the window
-    cv::destroyAllWindows();
-    //---------------------------------------------------
-
     return b_box_dvs;
 }
 
-std::vector<Bbox> dvs_roi_proposed_angled(
+void dvs_roi_proposed_angled(
     const cv::Mat &frame,
     const int roi_event_score,
     const int row_score_threshold,
     const int roi_height_min_threshold,
     const int max_vertical_gap,
     const int min_roi_width,
-    const int min_roi_height)
+    const int min_roi_height,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<Streak> *streaks)
 {
-    auto start = std::chrono::high_resolution_clock::now();
-    const int frame_h = frame.rows;
-    const int frame_w = frame.cols;
+    rois.clear();
 
-    std::vector<Bbox> rois;
-
-    std::vector<Streak> all_streaks;
-    std::vector<ScanDirection> directions = {
-        // ScanDirection::Horizontal,
-        // ScanDirection::Vertical,
+    std::vector<Streak> &all_streaks = scratch.streaks;
+    all_streaks.clear();
+    static const std::vector<ScanDirection> directions = {
+        ScanDirection::Horizontal,
+        ScanDirection::Vertical,
         ScanDirection::Diagonal45,
-        // ScanDirection::Diagonal135
-    };
-
-    for (auto dir : directions)
-    {
-        std::vector<Streak> streaks;
-        detect_streaks(frame, dir, roi_event_score, row_score_threshold, streaks);
-        all_streaks.insert(all_streaks.end(), streaks.begin(), streaks.end());
-    }
-    auto end = std::chrono::high_resolution_clock::now();
-    double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
-    std::cout << "Algorithm took " << elapsed_ms << " ms" << std::endl;
-    //--------------------------------------------------------
-    // 2. Visualize all streaks
-    cv::Mat vis;
-    cv::cvtColor(frame, vis, cv::COLOR_GRAY2BGR); // Convert to BGR for colored drawing
+        ScanDirection::Diagonal135};
 
-    for (const auto &streak : all_streaks)
-    {
-        cv::line(vis,
-                 streak.start,
-                 streak.end,
-                 cv::Scalar(0, 0, 255), // red
-                 1,                     // thickness
-                 cv::LINE_AA);          // anti-aliasing
-    }
-    cv::imshow("Detected Streaks", vis);
-    cv::waitKey(0);
-    //--------------------------------------------------------
+    detect_streaks_parallel(frame, directions, roi_event_score, row_score_threshold, scratch, all_streaks);
+    if (streaks != NULL)
+        *streaks = all_streaks;
 
     // double max_point_dist = 15.0; // tune for object size
 
@@ -782,150 +767,77 @@ std::vector<Bbox> dvs_roi_proposed_angled(
     //     }
     // }
 
-    return rois;
 }
 
-std::vector<Bbox> dvs_roi_proposed_multiobject(
+void dvs_roi_proposed_multiobject(
     const cv::Mat &frame,
     const int roi_event_score,
     const int row_score_threshold,
     const int roi_height_min_threshold,
     const int max_vertical_gap,
     const int min_roi_width,
-    const int min_roi_height)
+    const int min_roi_height,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<Streak> *streaks)
 {
-    const int frame_h = frame.rows;
-    const int frame_w = frame.cols;
-
-    std::vector<Bbox> rois;
+    rois.clear();
 
     // 1. Detect horizontal streaks
-    std::vector<Streak> all_streaks;
+    std::vector<Streak> &all_streaks = scratch.streaks;
+    all_streaks.clear();
     detect_streaks(frame, ScanDirection::Horizontal, roi_event_score, row_score_threshold, all_streaks);
-
-    //----------------------------------------------------
-    cv::Mat colorFrame;
-    cv::cvtColor(frame, colorFrame, cv::COLOR_GRAY2BGR);
-
-    // Visualize each detected streak in red on the color frame.
-    for (const auto &streak : all_streaks)
-    {
-        // Draw the streak as a red line (BGR: 0, 0, 255) with thickness 2.
-        cv::line(colorFrame, streak.start, streak.end, cv::Scalar(0, 0, 255), 2);
-
-        // Optionally, mark the start point with a red circle.
-        cv::circle(colorFrame, streak.start, 3, cv::Scalar(0, 0, 255), -1);
-    }
-
-    // Display the color visualization.
-    cv::imshow("Streak Visualization", colorFrame);
-    cv::waitKey(0);
-    //----------------------------------------------------
+    if (streaks != NULL)
+        *streaks = all_streaks;
 
     // 2. Group streaks by vertical proximity and horizontal overlap
-    std::vector<std::vector<Streak>> clusters;
+    std::vector<RowStreak> &runs = scratch.runs;
+    runs.clear();
     for (const auto &streak : all_streaks)
     {
-        std::vector<int> overlapping_clusters;
-
-        for (int i = 0; i < static_cast<int>(clusters.size()); ++i)
-        {
-            const auto &cluster = clusters[i];
-            if (cluster.empty())
-                continue;
-
-            int last_row = cluster.back().end.y;
-
-            if (std::abs(streak.start.y - last_row) > max_vertical_gap)
-                continue;
-
-            for (const auto &s : cluster)
-            {
-                int s_left = std::min(s.start.x, s.end.x);
-                int s_right = std::max(s.start.x, s.end.x);
-                int c_left = std::min(streak.start.x, streak.end.x);
-                int c_right = std::max(streak.start.x, streak.end.x);
-
-                if (s_right >= c_left && s_left <= c_right)
-                {
-                    overlapping_clusters.push_back(i);
-                    break;
-                }
-            }
-        }
-
-        if (overlapping_clusters.empty())
-        {
-            clusters.push_back({streak});
-        }
-        else
-        {
-            int target_idx = overlapping_clusters[0];
-            auto &target_cluster = clusters[target_idx];
-
-            // Merge all overlapping clusters into target
-            for (int j = 1; j < static_cast<int>(overlapping_clusters.size()); ++j)
-            {
-                int idx = overlapping_clusters[j];
-                auto &src_cluster = clusters[idx];
-                target_cluster.insert(target_cluster.end(), src_cluster.begin(), src_cluster.end());
-                src_cluster.clear();
-            }
-
-            target_cluster.push_back(streak);
-
-            // Remove empty clusters
-            clusters.erase(
-                std::remove_if(clusters.begin(), clusters.end(),
-                               [](const std::vector<Streak> &c)
-                               { return c.empty(); }),
-                clusters.end());
-        }
+        runs.push_back({streak.start.y,
+                        std::min(streak.start.x, streak.end.x),
+                        std::max(streak.start.x, streak.end.x)});
     }
+    // detect_streaks emits the streaks row by row, left to right
+    std::vector<Component> &components = scratch.components;
+    scratch.labeler.set_gaps(max_vertical_gap, 0);
+    scratch.labeler.label(runs, components);
 
     // 3. Generate bounding boxes from valid clusters
-    for (const auto &cluster : clusters)
+    for (const auto &c : components)
     {
-        if (cluster.size() < roi_height_min_threshold)
+        if (c.run_num < roi_height_min_threshold)
             continue;
 
-        int x_min = frame_w, x_max = 0;
-        int y_min = frame_h, y_max = 0;
-
-        for (const auto &s : cluster)
-        {
-            x_min = std::min({x_min, s.start.x, s.end.x});
-            x_max = std::max({x_max, s.start.x, s.end.x});
-            y_min = std::min({y_min, s.start.y, s.end.y});
-            y_max = std::max({y_max, s.start.y, s.end.y});
-        }
-
-        int box_width = x_max - x_min + 1;
-        int box_height = y_max - y_min + 1;
+        int box_width = c.bbox.hx - c.bbox.lx + 1;
+        int box_height = c.bbox.hy - c.bbox.ly + 1;
 
         if (box_width >= min_roi_width && box_height >= min_roi_height)
         {
-            rois.push_back({x_min, y_min, x_max, y_max});
+            rois.push_back(c.bbox);
         }
     }
-
-    return rois;
 }
 
-std::vector<Bbox> dvs_roi_proposed_multi_contour(
+void dvs_roi_proposed_multi_contour(
     const cv::Mat &frame,
     const int roi_event_score,
     const int row_score_threshold,
     const int roi_height_min_threshold,
     const int max_vertical_gap,
     const int min_roi_width,
-    const int min_roi_height)
+    const int min_roi_height,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<std::vector<cv::Point>> *contours)
 {
-    auto start = std::chrono::high_resolution_clock::now();
     const int frame_h = frame.rows;
     const int frame_w = frame.cols;
+    rois.clear();
 
-    std::vector<RowStreak> all_streaks;
+    std::vector<RowStreak> &all_streaks = scratch.runs;
+    all_streaks.clear();
 
     // 1. Extract horizontal streaks from each row
     for (int h = 0; h < frame_h; h++)
@@ -972,83 +884,46 @@ std::vector<Bbox> dvs_roi_proposed_multi_contour(
     // cv::waitKey(0);
     // //-------------------------------------------------------
 
-    // 2. Group streaks by horizontal overlap
-    std::vector<std::vector<RowStreak>> clusters;
+    // 2. Group streaks by horizontal overlap, allowing vertical continuation within max_vertical_gap
+    std::vector<Component> &components = scratch.components;
+    std::vector<int> &run_labels = scratch.run_labels;
+    scratch.labeler.set_gaps(max_vertical_gap, 0);
+    scratch.labeler.label(all_streaks, components, &run_labels);
 
-    for (const auto &streak : all_streaks)
+    // 3. Build bounding boxes from clusters
+    for (const auto &c : components)
     {
-        std::vector<int> overlapping_clusters;
-
-        for (int i = 0; i < clusters.size(); ++i)
+        if (c.run_num >= roi_height_min_threshold)
         {
-            const auto &cluster = clusters[i];
-            if (cluster.empty())
-                continue;
-
-            int last_row = cluster.back().row;
-
-            // Allow vertical continuation within max_vertical_gap
-            if (streak.row - last_row > max_vertical_gap)
-                continue;
-
-            for (const auto &s : cluster)
-            {
-                if (streak.row > s.row + max_vertical_gap)
-                    continue;
-
-                if (streak.right >= s.left && streak.left <= s.right)
-                {
-                    overlapping_clusters.push_back(i);
-                    break;
-                }
-            }
-        }
+            int box_width = c.bbox.hx - c.bbox.lx + 1;
+            int box_height = c.bbox.hy - c.bbox.ly + 1;
 
-        if (overlapping_clusters.empty())
-        {
-            clusters.push_back({streak});
-        }
-        else
-        {
-            int target_idx = overlapping_clusters[0];
-            auto &target_cluster = clusters[target_idx];
-            for (int j = 1; j < overlapping_clusters.size(); ++j)
+            if (box_width >= min_roi_width && box_height >= min_roi_height)
             {
-                int idx = overlapping_clusters[j];
-                auto &src_cluster = clusters[idx];
-                target_cluster.insert(
-                    target_cluster.end(),
-                    src_cluster.begin(),
-                    src_cluster.end());
-                src_cluster.clear(); // mark as empty
+                rois.push_back(c.bbox);
             }
-
-            target_cluster.push_back(streak); // add to target
-
-            clusters.erase(
-                std::remove_if(clusters.begin(), clusters.end(),
-                               [](const std::vector<RowStreak> &c)
-                               { return c.empty(); }),
-                clusters.end());
         }
     }
 
-    // 3. Build contours from clusters
-    std::vector<std::vector<cv::Point>> contours;
-    cv::Mat roi_mask = cv::Mat::zeros(frame_h, frame_w, CV_8UC1);
+    if (contours == NULL)
+        return;
 
-    for (const auto &cluster : clusters)
+    // 4. Build contours from clusters
+    contours->clear();
+    cv::Mat &roi_mask = scratch.mask;
+    roi_mask.create(frame_h, frame_w, CV_8UC1);
+    roi_mask.setTo(cv::Scalar(0));
+
+    for (size_t i = 0; i < all_streaks.size(); ++i)
     {
-        if (cluster.size() >= roi_height_min_threshold)
+        if (components[run_labels[i]].run_num >= roi_height_min_threshold)
         {
             // Draw streaks into binary mask
-            for (const auto &streak : cluster)
-            {
-                cv::line(roi_mask,
-                         cv::Point(streak.left, streak.row),
-                         cv::Point(streak.right, streak.row),
-                         cv::Scalar(255), 1);
-            }
+            const RowStreak &streak = all_streaks[i];
+            cv::line(roi_mask,
+                     cv::Point(streak.left, streak.row),
+                     cv::Point(streak.right, streak.row),
+                     cv::Scalar(255), 1);
         }
     }
 
@@ -1067,57 +942,17 @@ std::vector<Bbox> dvs_roi_proposed_multi_contour(
             std::vector<cv::Point> smoothed;
             double epsilon = 3.0; // adjust for smoothness
             cv::approxPolyDP(c, smoothed, epsilon, true);
-            contours.push_back(smoothed);
-        }
-    }
-
-    auto end = std::chrono::high_resolution_clock::now();
-    double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
-    std::cout << "Algorithm took " << elapsed_ms << " ms" << std::endl;
-    //---------------------------------------------------------
-    cv::Mat vis;
-    cv::cvtColor(frame, vis, cv::COLOR_GRAY2BGR);
-    cv::drawContours(vis, contours, -1, cv::Scalar(0, 255, 0), 1);
-    cv::imshow("Smooth Contour from Streak-Based Mask", vis);
-    cv::waitKey(0);
-    //---------------------------------------------------------
-
-    // 3. Build bounding boxes from clusters
-    std::vector<Bbox> rois;
-    for (const auto &cluster : clusters)
-    {
-        if (cluster.size() >= roi_height_min_threshold)
-        {
-            int x_min = frame_w, x_max = 0;
-            int y_min = cluster.front().row;
-            int y_max = cluster.back().row;
-
-            for (const auto &streak : cluster)
-            {
-                x_min = std::min(x_min, streak.left);
-                x_max = std::max(x_max, streak.right);
-            }
-
-            int box_width = x_max - x_min + 1;
-            int box_height = y_max - y_min + 1;
-
-            if (box_width >= min_roi_width && box_height >= min_roi_height)
-            {
-                rois.push_back({x_min, y_min, x_max, y_max});
-            }
+            contours->push_back(smoothed);
         }
     }
-
-    return rois;
 }
 
 void draw_square_roi(Bbox *b_box, int x_min, int y_min,
-                     int x_max, int y_max, int width, int height)
+                     int x_max, int y_max, int width, int height,
+                     int roi_min_size, float roi_inflation_ratio)
 {
     // draw square ROI around given x and y coordinate ranges
     // while making sure ROI doesn't exceed the entire frame
-    int roi_min_size = 10;
-    float roi_inflation_ratio = 1.0;
 
     // move coordinates to inside the frame
     if (x_min < 0)
@@ -26,64 +26,230 @@
 #include <chrono>
 
 #include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 #include <algorithm> // for std::sort, std::move
 
 #include "bbox.hpp"
+#include "ccl.hpp"
+#include "dvs_roi_packed.hpp"
 
-std::vector<Bbox> dvs_roi_cluster_tracker(
+/*
+ * compute API of the DVS ROI algorithms.
+ * > no window, console or file I/O : drawing lives in visualize.hpp
+ * > the frame size is the size of the input frame (8-bit DVS image, 128 : no event)
+ * > results go to caller-provided storage, scratch buffers come from RoiScratch,
+ *   so once the buffers fit the frames the algorithms do not allocate
+ * > intermediate results (streaks, clusters, contours) are only produced if asked for
+ */
+
+/**
+ * per-line state of detect_streaks (Vertical, Diagonal45, Diagonal135)
+ */
+typedef struct
+{
+    std::vector<int> score;
+    std::vector<int> start;
+    std::vector<uint8_t> emit;
+} StreakLines;
+
+/**
+ * threads started once and parked between frames, they run the per-direction jobs of
+ * detect_streaks_parallel so that a frame costs a wake-up instead of a thread creation.
+ * one caller at a time.
+ */
+class StreakWorkers
+{
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    // workers wait on start for a new generation, the caller on done for remaining == 0
+    std::condition_variable start;
+    std::condition_variable done;
+    uint64_t generation;
+    int remaining;
+    bool is_stopped;
+    // job of the current generation
+    void (*job)(void *context, int index);
+    void *context;
+    int job_num;
+
+    void work(int index);
+
+public:
+    /**
+     * @param thread_num threads besides the caller
+     */
+    StreakWorkers(int thread_num);
+    ~StreakWorkers();
+    StreakWorkers(const StreakWorkers &) = delete;
+    StreakWorkers &operator=(const StreakWorkers &) = delete;
+    /**
+     * runs job(context, i) for i in [0, job_num) and returns once all are done.
+     * job 0 runs on the calling thread, job i on worker i - 1, job_num must be at most thread_num + 1
+     */
+    void run(int job_num, void (*job)(void *context, int index), void *context);
+};
+
+/**
+ * reusable scratch buffers of the ROI algorithms.
+ * the buffers grow on the first frames and keep their capacity afterwards.
+ * a scratch must not be shared by algorithms running at the same time.
+ */
+typedef struct
+{
+    // events per column / row (average based)
+    std::vector<int> x_count;
+    std::vector<int> y_count;
+    // row streaks or event runs, and their connected components
+    std::vector<RowStreak> runs;
+    std::vector<Component> components;
+    std::vector<int> run_labels;
+    RunLabeler labeler;
+    // events and event pixels of every component (cluster tracker)
+    std::vector<int> event_num;
+    std::vector<std::vector<cv::Point>> points;
+    // streaks and scan lines of every ScanDirection
+    std::vector<Streak> streaks;
+    std::vector<Streak> direction_streaks[4];
+    StreakLines direction_lines[4];
+    // runs the directions of detect_streaks_parallel, NULL to run them one after the other
+    StreakWorkers *streak_workers = NULL;
+    // 2-bit frame of dvs_roi_proposed_packed
+    std::vector<uint8_t> packed;
+    // streak mask (multi contour)
+    cv::Mat mask;
+} RoiScratch;
+
+/**
+ * event clusters, single linkage on event runs (RunLabeler) :
+ * two event pixels are connected if at most max_dist rows apart and at most max_dist
+ * non-event columns apart, and a cluster is everything connected through such chains.
+ * max_dist is the gap between neighbouring events, not the radius around the cluster centroid
+ * of the earlier greedy tracker, so a chain of events is one cluster however long it is.
+ * ROIs (and roi_eval / roi_tune scores) of the two versions are not comparable.
+ * @param max_dist rows / non-event columns bridged between events of one cluster
+ * @param min_cluster_size minimum event pixels of a cluster
+ * @param[out] rois bounding box of every cluster with at least min_cluster_size events
+ * @param[out] clusters event pixels of every cluster in rois, NULL if not needed
+ */
+void dvs_roi_cluster_tracker(
     const cv::Mat &frame,
-    std::vector<std::vector<cv::Point>> &clusters,
-    int max_dist = 10,
-    int min_cluster_size = 20);
+    int max_dist,
+    int min_cluster_size,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<std::vector<cv::Point>> *clusters = NULL);
 
 Bbox dvs_roi_average_based(
     const cv::Mat &frame,
-    int roi_line_min_threshold);
+    int roi_line_min_threshold,
+    RoiScratch &scratch,
+    int roi_min_size = 10,
+    float roi_inflation_ratio = 1.0);
 
 Bbox dvs_roi_proposed(
     const cv::Mat &frame,
-    const int roi_event_score,         // Event Score for each events
-    const int row_score_threshold,     // Minimum number of events for a row to be considered active
-    const int roi_height_min_threshold // Minimum height of the ROI in rows
-);
+    const int roi_event_score,          // Event Score for each events
+    const int row_score_threshold,      // Minimum number of events for a row to be considered active
+    const int roi_height_min_threshold, // Minimum height of the ROI in rows
+    const int roi_min_size = 10,        // Minimum side of the square ROI
+    const float roi_inflation_ratio = 1.0);
 
+/**
+ * finds streaks of events along one direction, every scan line runs the max-segment scan
+ * of dvs_roi_proposed. every direction reads the frame row by row, the lines of the
+ * vertical and diagonal directions keep their state in an array indexed by column / diagonal.
+ * @param[out] out_streaks streaks are appended in order of their last row
+ * @param lines scan line buffers, NULL to use temporary ones
+ */
 void detect_streaks(
     const cv::Mat &frame,
     ScanDirection direction,
     int roi_event_score,
     int row_score_threshold,
+    std::vector<Streak> &out_streaks,
+    StreakLines *lines = NULL);
+
+/**
+ * detect_streaks for several directions, on scratch.streak_workers if set
+ * (at least directions.size() - 1 threads), else one direction after the other
+ * @param[out] out_streaks streaks are appended, grouped in the order of directions
+ */
+void detect_streaks_parallel(
+    const cv::Mat &frame,
+    const std::vector<ScanDirection> &directions,
+    int roi_event_score,
+    int row_score_threshold,
+    RoiScratch &scratch,
     std::vector<Streak> &out_streaks);
 
-std::vector<Bbox> dvs_roi_proposed_angled(
+/**
+ * streaks in all four directions. the streak clustering is not done yet, so rois stays empty.
+ * @param[out] rois ROIs
+ * @param[out] streaks detected streaks, NULL if not needed
+ */
+void dvs_roi_proposed_angled(
     const cv::Mat &frame,
     const int roi_event_score,
     const int row_score_threshold,
     const int roi_height_min_threshold,
     const int max_vertical_gap,
     const int min_roi_width,
-    const int min_roi_height);
+    const int min_roi_height,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<Streak> *streaks = NULL);
 
-std::vector<Bbox> dvs_roi_proposed_multiobject(
+/**
+ * horizontal streaks grouped into objects by RunLabeler, single linkage :
+ * two streaks are connected if at most max_vertical_gap rows apart and their columns overlap
+ * or touch, whichever streaks of the objects they belong to. the earlier greedy grouping only
+ * compared against the last row of a cluster, so roi_eval / roi_tune scores from before
+ * this change are not comparable.
+ * @param max_vertical_gap rows bridged between connected streaks
+ * @param[out] rois ROI of every object
+ * @param[out] streaks detected streaks, NULL if not needed
+ */
+void dvs_roi_proposed_multiobject(
     const cv::Mat &frame,
     const int roi_event_score,
     const int row_score_threshold,
     const int roi_height_min_threshold,
     const int max_vertical_gap,
     const int min_roi_width,
-    const int min_roi_height);
+    const int min_roi_height,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<Streak> *streaks = NULL);
 
-std::vector<Bbox> dvs_roi_proposed_multi_contour(
+/**
+ * dvs_roi_proposed_multiobject with its own streak scan, optionally tracing the object outlines
+ * @param[out] rois ROI of every object
+ * @param[out] contours smoothed outline of every object with at least min_roi_width * min_roi_height
+ *             pixels, NULL if not needed (the outlines cost more than the ROIs)
+ */
+void dvs_roi_proposed_multi_contour(
     const cv::Mat &frame,
     const int roi_event_score,
     const int row_score_threshold,
     const int roi_height_min_threshold,
     const int max_vertical_gap,
     const int min_roi_width,
-    const int min_roi_height);
+    const int min_roi_height,
+    RoiScratch &scratch,
+    std::vector<Bbox> &rois,
+    std::vector<std::vector<cv::Point>> *contours = NULL);
 
+/**
+ * square ROI around (x_min, y_min) - (x_max, y_max), kept inside the frame
+ * @param roi_min_size minimum side of the ROI (DVS_ROI_MIN_SIZE of the host)
+ * @param roi_inflation_ratio enlarges the ROI around its center (ROI_INFLATION of the host)
+ */
 void draw_square_roi(
     Bbox *b_box, int x_min, int y_min,
-    int x_max, int y_max, int width, int height);
+    int x_max, int y_max, int width, int height,
+    int roi_min_size = 10, float roi_inflation_ratio = 1.0);
 
 #endif
\ No newline at end of file
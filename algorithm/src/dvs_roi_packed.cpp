@@ -0,0 +1,245 @@
+#include "dvs_roi_packed.hpp"
+#include "dvs_roi_alg.hpp"
+
+#include <string.h>
+
+void pack_dvs_frame(
+    const cv::Mat &frame,
+    std::vector<uint8_t> &packed)
+{
+    const int row_bytes = (frame.cols + 3) / 4;
+    packed.assign(static_cast<size_t>(row_bytes) * frame.rows, 0);
+    for (int h = 0; h < frame.rows; ++h)
+    {
+        const uchar *row_ptr = frame.ptr<uchar>(h);
+        uint8_t *out = packed.data() + static_cast<size_t>(h) * row_bytes;
+        for (int w = 0; w < frame.cols; ++w)
+        {
+            uint8_t pixel = (row_ptr[w] > 128) ? 1 : (row_ptr[w] < 128) ? 2
+                                                                         : 0;
+            out[w >> 2] |= pixel << ((w & 3) << 1);
+        }
+    }
+}
+
+void unpack_dvs_frame(
+    const uint8_t *packed,
+    const int frame_w,
+    const int frame_h,
+    cv::Mat &frame)
+{
+    // pixel value of every 2-bit code (3 does not occur)
+    static const uchar value[4] = {128, 255, 0, 128};
+    const int row_bytes = (frame_w + 3) / 4;
+    frame.create(frame_h, frame_w, CV_8UC1);
+    for (int h = 0; h < frame_h; ++h)
+    {
+        const uint8_t *in = packed + static_cast<size_t>(h) * row_bytes;
+        uchar *row_ptr = frame.ptr<uchar>(h);
+        for (int w = 0; w < frame_w; ++w)
+        {
+            row_ptr[w] = value[(in[w >> 2] >> ((w & 3) << 1)) & 3];
+        }
+    }
+}
+
+/**
+ * events of pixel_num (<= 32) packed pixels, bit 2i set if pixel i has an event
+ */
+static uint64_t load_events(const uint8_t *src, int pixel_num)
+{
+    uint64_t x = 0;
+    // a fixed size copy compiles to one load
+    if (pixel_num == 32)
+        memcpy(&x, src, 8);
+    else
+        memcpy(&x, src, (pixel_num + 3) / 4);
+    // any non-zero 2-bit pixel is an event, keep one bit per pixel (the even bits)
+    x = (x | (x >> 1)) & 0x5555555555555555ULL;
+    if (pixel_num < 32)
+        x &= (1ULL << (pixel_num * 2)) - 1;
+    return x;
+}
+
+/**
+ * number of events in a word of load_events
+ * (SWAR count, __builtin_popcountll is a library call without -mpopcnt)
+ */
+static int count_events(uint64_t x)
+{
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<int>((x * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * gathers the even bits of events into a 32-bit mask, bit i set if pixel i has an event
+ */
+static uint32_t compact_events(uint64_t x)
+{
+    x = (x | (x >> 1)) & 0x3333333333333333ULL;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+    return static_cast<uint32_t>(x);
+}
+
+Bbox dvs_roi_proposed_packed(
+    const uint8_t *packed,
+    const int frame_w,
+    const int frame_h,
+    const int roi_event_score,
+    const int row_score_threshold,
+    const int roi_height_min_threshold,
+    const int roi_min_size,
+    const float roi_inflation_ratio)
+{
+    Bbox b_box_dvs = {0, 0, 0, 0};
+    const int row_bytes = (frame_w + 3) / 4;
+    const int word_num = (frame_w + 31) / 32;
+    // per-word events and bounds of the current row, on the stack up to 2048 pixels wide
+    uint64_t events_stack[64];
+    int start_bound_stack[64];
+    std::vector<uint64_t> events_heap;
+    std::vector<int> start_bound_heap;
+    uint64_t *events = events_stack;
+    int *start_bound = start_bound_stack;
+    if (word_num > 64)
+    {
+        events_heap.resize(word_num);
+        start_bound_heap.resize(word_num);
+        events = events_heap.data();
+        start_bound = start_bound_heap.data();
+    }
+
+    // global (x_min, x_max, y_min, y_max)
+    int global_x_min = frame_w, global_x_max = 0;
+    int global_y_min = 0, global_y_max = -1;
+    // candiate (x_min, x_max)
+    int candidate_x_min = frame_w, candidate_x_max = 0;
+
+    int roi_row_streak = 0;
+    for (int h = 0; h < frame_h; h++)
+    {
+        const uint8_t *row = packed + static_cast<size_t>(h) * row_bytes;
+
+        // coarse : upper bound of the best score of a segment starting in every word, from
+        // the event count of the words. a segment scores at most events * roi_event_score in
+        // its first and last word and exactly events * roi_event_score - empty pixels in every
+        // word between them.
+        int best_bound = 0, after_bound = 0;
+        for (int i = word_num - 1; i >= 0; i--)
+        {
+            const int pixel_num = std::min(32, frame_w - i * 32);
+            events[i] = load_events(row + i * 8, pixel_num);
+            const int event_num = count_events(events[i]);
+            const int end_score = event_num * roi_event_score;
+            const int full_score = end_score - (pixel_num - event_num);
+            start_bound[i] = end_score + std::max(0, after_bound);
+            best_bound = std::max(best_bound, start_bound[i]);
+            // after_bound : best bound of a segment starting at the first pixel of word i
+            after_bound = std::max(end_score, full_score + after_bound);
+        }
+
+        // local max score
+        int local_max_score = 0;
+        int local_max_left = frame_w, local_max_right = 0;
+
+        // refine : max-segment scan over runs, only if the row can reach the threshold
+        // (with roi_event_score <= 0 no segment scores above 0)
+        if (roi_event_score > 0 && best_bound >= row_score_threshold)
+        {
+            // local current score
+            int local_cur_score = 0;
+            int local_cur_left = 0;
+            for (int i = 0; i < word_num; i++)
+            {
+                const int base = i * 32;
+                const int pixel_num = std::min(32, frame_w - base);
+                if (local_cur_score == 0 &&
+                    (start_bound[i] < row_score_threshold || start_bound[i] <= local_max_score))
+                {
+                    // no segment starting in this word can be the ROI segment of the row,
+                    // the scan continues as if it restarted at the last pixel of the word
+                    local_cur_left = base + pixel_num - 1 + 3;
+                    continue;
+                }
+                // a word without events is one empty run
+                const uint32_t mask = (events[i] == 0) ? 0 : compact_events(events[i]);
+                int pos = 0;
+                while (pos < pixel_num)
+                {
+                    uint32_t rest = mask >> pos;
+                    int len;
+                    if (rest & 1)
+                    {
+                        // event run : the score only grows, the run end is the best right end
+                        len = (~rest == 0) ? 32 - pos : __builtin_ctz(~rest);
+                        local_cur_score += len * roi_event_score;
+                        if (local_cur_score > local_max_score)
+                        {
+                            local_max_score = local_cur_score;
+                            local_max_left = local_cur_left;
+                            local_max_right = base + pos + len;
+                        }
+                    }
+                    else
+                    {
+                        // empty run : the score drops by len, or restarts inside the run
+                        len = (rest == 0) ? pixel_num - pos : __builtin_ctz(rest);
+                        if (local_cur_score >= len)
+                        {
+                            local_cur_score -= len;
+                        }
+                        else
+                        {
+                            // same left end as dvs_roi_proposed restarting at the last pixel of the run
+                            local_cur_score = 0;
+                            local_cur_left = base + pos + len - 1 + 3;
+                        }
+                    }
+                    pos += len;
+                }
+            }
+        }
+
+        if (local_max_score >= row_score_threshold)
+        {
+            roi_row_streak++;
+            if (local_max_left < candidate_x_min)
+                candidate_x_min = local_max_left;
+            if (local_max_right > candidate_x_max)
+                candidate_x_max = local_max_right;
+
+            if (roi_row_streak >= roi_height_min_threshold)
+            {
+                if (global_y_min == 0)
+                    global_y_min = h - roi_height_min_threshold + 1;
+                global_y_max = h;
+
+                if (candidate_x_min < global_x_min)
+                    global_x_min = candidate_x_min;
+                if (candidate_x_max > global_x_max)
+                    global_x_max = candidate_x_max;
+            }
+        }
+        else
+        {
+            // if roi_row_streak cannot reach
+            // roi_height_min_threshold
+            candidate_x_min = frame_w;
+            candidate_x_max = 0;
+            roi_row_streak = 0;
+        }
+    }
+
+    if (global_y_max != -1)
+    {
+        // roi detected!!
+        draw_square_roi(&b_box_dvs, global_x_min, global_y_min, global_x_max, global_y_max, frame_w, frame_h,
+                        roi_min_size, roi_inflation_ratio);
+    }
+
+    return b_box_dvs;
+}
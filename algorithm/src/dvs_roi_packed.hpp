@@ -0,0 +1,62 @@
+#ifndef DVS_ROI_PACKED_HPP_
+#define DVS_ROI_PACKED_HPP_
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+#include <vector>
+
+#include "bbox.hpp"
+
+/**
+ * packs an 8-bit DVS image into the 2-bit frame layout read from the FPGA.
+ * every byte holds 4 pixels, the first pixel in the lowest 2 bits.
+ * pixel > 128 : 1 (positive event), pixel < 128 : 2 (negative event), 128 : 0 (no event)
+ * @param frame 8-bit DVS image
+ * @param[out] packed (frame.cols + 3) / 4 bytes per row
+ */
+void pack_dvs_frame(
+    const cv::Mat &frame,
+    std::vector<uint8_t> &packed);
+
+/**
+ * unpacks a 2-bit frame of pack_dvs_frame back into an 8-bit DVS image.
+ * 1 : 255, 2 : 0, 0 : 128 (the polarity survives, the event intensity does not)
+ * @param packed 2-bit frame, (frame_w + 3) / 4 bytes per row
+ * @param[out] frame 8-bit DVS image, reallocated only if its size changes
+ */
+void unpack_dvs_frame(
+    const uint8_t *packed,
+    const int frame_w,
+    const int frame_h,
+    cv::Mat &frame);
+
+/**
+ * dvs_roi_proposed on a packed 2-bit frame, with the same result as on the unpacked image.
+ *
+ * every row is read 32 pixels (one 64-bit word) at a time.
+ * > coarse : the event count (popcount) of every word bounds the score of the segments
+ *            starting in it, rows that cannot reach row_score_threshold are skipped.
+ * > refine : the remaining rows run the max-segment scan on runs of event / empty pixels
+ *            (count trailing zeros) instead of on every pixel, and skip the words where no
+ *            segment can start that reaches the threshold or beats the best one so far.
+ * @param packed 2-bit frame, (frame_w + 3) / 4 bytes per row
+ * @param frame_w width of DVS frame
+ * @param frame_h height of DVS frame
+ * @param roi_event_score score of an event pixel, an empty pixel scores -1
+ * @param row_score_threshold minimum segment score of an active row
+ * @param roi_height_min_threshold minimum number of consecutive active rows of the ROI
+ * @param roi_min_size minimum side of the square ROI
+ * @param roi_inflation_ratio enlarges the ROI around its center
+ * @return ROI, all zero if none detected
+ */
+Bbox dvs_roi_proposed_packed(
+    const uint8_t *packed,
+    const int frame_w,
+    const int frame_h,
+    const int roi_event_score,
+    const int row_score_threshold,
+    const int roi_height_min_threshold,
+    const int roi_min_size = 10,
+    const float roi_inflation_ratio = 1.0);
+
+#endif
@@ -0,0 +1,347 @@
+#include "frame_cache.hpp"
+#include "dvs_roi_packed.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const char cache_magic[8] = {'D', 'V', 'S', 'F', 'R', 'M', '0', '2'};
+
+typedef struct
+{
+    char magic[8];
+    uint32_t image_num;
+    uint32_t string_size;
+} CacheHeader;
+
+/**
+ * image of the dataset directory
+ */
+typedef struct
+{
+    std::string rel_path;
+    fs::path png_path;
+    fs::path label_path;
+    int64_t png_mtime;
+    int64_t label_mtime;
+} DatasetImage;
+
+/**
+ * @return modification time of path in ns, -1 if it does not exist
+ */
+static int64_t file_mtime(const fs::path &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return -1;
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+/**
+ * every .png under dataset_pth sorted by path, with the mtimes of the image and its label
+ */
+static std::vector<DatasetImage> list_dataset(const std::string &dataset_pth)
+{
+    std::vector<DatasetImage> images;
+    for (auto &p : fs::recursive_directory_iterator(
+             dataset_pth,
+             fs::directory_options::skip_permission_denied))
+    {
+        std::string ext = p.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (ext != ".png")
+            continue;
+        DatasetImage image;
+        image.png_path = p.path();
+        image.label_path = p.path();
+        image.label_path.replace_extension(".txt");
+        image.rel_path = fs::relative(p.path(), dataset_pth).string();
+        // kept apart, a label added or removed with an older mtime than its image is still noticed
+        image.png_mtime = file_mtime(image.png_path);
+        image.label_mtime = file_mtime(image.label_path);
+        images.push_back(image);
+    }
+    std::sort(images.begin(), images.end(),
+              [](const DatasetImage &a, const DatasetImage &b)
+              { return a.rel_path < b.rel_path; });
+    return images;
+}
+
+/**
+ * writes len bytes, retrying short writes
+ */
+static bool write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(buf);
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("write");
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * decodes the images with thread_num threads and writes the cache to cache_pth
+ * (through a temporary file, so a reader never maps a half-written cache)
+ */
+static bool build_cache(const std::vector<DatasetImage> &images, const std::string &cache_pth, int thread_num)
+{
+    const int image_num = static_cast<int>(images.size());
+    std::vector<CacheEntry> entries(image_num);
+    std::vector<std::vector<uint8_t>> frames(image_num);
+
+    // every thread takes the next image, results go to the slot of the image
+    std::atomic<int> next_idx(0);
+    auto decode = [&]()
+    {
+        for (int i = next_idx++; i < image_num; i = next_idx++)
+        {
+            CacheEntry &entry = entries[i];
+            memset(&entry, 0, sizeof(entry));
+            // an unreadable image stays in the cache as a 0 x 0 frame, so it is not decoded every run
+            entry.png_mtime = images[i].png_mtime;
+            entry.label_mtime = images[i].label_mtime;
+            cv::Mat frame = cv::imread(images[i].png_path.string(), cv::IMREAD_GRAYSCALE);
+            if (frame.empty())
+            {
+                std::cerr << "Cannot open: " << images[i].png_path << '\n';
+                continue;
+            }
+            entry.frame_w = frame.cols;
+            entry.frame_h = frame.rows;
+            entry.has_gt = load_gt_one(images[i].label_path.string(), frame.cols, frame.rows, entry.gt) ? 1 : 0;
+            pack_dvs_frame(frame, frames[i]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int t = 1; t < thread_num; t++)
+        workers.emplace_back(decode);
+    decode();
+    for (auto &worker : workers)
+        worker.join();
+
+    // string table, then frames aligned to 8 bytes
+    std::string strings;
+    for (int i = 0; i < image_num; i++)
+    {
+        entries[i].path_offset = static_cast<uint32_t>(strings.size());
+        entries[i].path_len = static_cast<uint32_t>(images[i].rel_path.size());
+        strings += images[i].rel_path;
+    }
+    uint64_t offset = sizeof(CacheHeader) + sizeof(CacheEntry) * image_num + strings.size();
+    for (int i = 0; i < image_num; i++)
+    {
+        offset = (offset + 7) & ~7ULL;
+        entries[i].data_offset = offset;
+        offset += frames[i].size();
+    }
+
+    CacheHeader header;
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.image_num = image_num;
+    header.string_size = static_cast<uint32_t>(strings.size());
+
+    std::string tmp_pth = cache_pth + ".tmp";
+    int fd = ::open(tmp_pth.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("open");
+        return false;
+    }
+    bool ok = write_all(fd, &header, sizeof(header)) &&
+              write_all(fd, entries.data(), sizeof(CacheEntry) * image_num) &&
+              write_all(fd, strings.data(), strings.size());
+    uint64_t written = sizeof(CacheHeader) + sizeof(CacheEntry) * image_num + strings.size();
+    static const uint8_t padding[8] = {0};
+    for (int i = 0; ok && i < image_num; i++)
+    {
+        ok = write_all(fd, padding, entries[i].data_offset - written) &&
+             write_all(fd, frames[i].data(), frames[i].size());
+        written = entries[i].data_offset + frames[i].size();
+    }
+    close(fd);
+    if (!ok || rename(tmp_pth.c_str(), cache_pth.c_str()) != 0)
+    {
+        if (ok)
+            perror("rename");
+        unlink(tmp_pth.c_str());
+        return false;
+    }
+    return true;
+}
+
+FrameCache::FrameCache()
+    : fd(-1), map(NULL), map_size(0), image_num(0), entries(NULL), strings(NULL)
+{
+}
+
+FrameCache::~FrameCache()
+{
+    unmap();
+}
+
+void FrameCache::unmap()
+{
+    if (map != NULL)
+        munmap(map, map_size);
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    map = NULL;
+    map_size = 0;
+    image_num = 0;
+    entries = NULL;
+    strings = NULL;
+}
+
+bool FrameCache::map_file(const std::string &cache_pth)
+{
+    unmap();
+    fd = ::open(cache_pth.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CacheHeader))
+    {
+        unmap();
+        return false;
+    }
+    map_size = st.st_size;
+    void *addr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        perror("mmap");
+        map = NULL;
+        unmap();
+        return false;
+    }
+    map = static_cast<uint8_t *>(addr);
+
+    // the header, table and every frame must lie inside the file
+    const CacheHeader *header = reinterpret_cast<const CacheHeader *>(map);
+    size_t table_end = sizeof(CacheHeader) + sizeof(CacheEntry) * static_cast<size_t>(header->image_num);
+    if (memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0 ||
+        table_end + header->string_size > map_size)
+    {
+        unmap();
+        return false;
+    }
+    image_num = header->image_num;
+    entries = reinterpret_cast<const CacheEntry *>(map + sizeof(CacheHeader));
+    strings = reinterpret_cast<const char *>(map + table_end);
+    for (uint32_t i = 0; i < image_num; i++)
+    {
+        const CacheEntry &e = entries[i];
+        size_t frame_size = static_cast<size_t>((e.frame_w + 3) / 4) * e.frame_h;
+        if (e.frame_w < 0 || e.frame_h < 0 ||
+            e.path_offset + static_cast<size_t>(e.path_len) > header->string_size ||
+            e.data_offset + frame_size > map_size)
+        {
+            unmap();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FrameCache::open(const std::string &dataset_pth, const std::string &cache_pth, int thread_num)
+{
+    std::error_code ec;
+    if (!fs::is_directory(dataset_pth, ec))
+    {
+        std::cerr << "Dataset not found: " << dataset_pth << '\n';
+        return false;
+    }
+    std::vector<DatasetImage> images = list_dataset(dataset_pth);
+    if (images.empty())
+    {
+        std::cerr << "No *.png found under " << dataset_pth << '\n';
+        return false;
+    }
+
+    // up to date : same images in the same order, none modified since the cache was built
+    if (map_file(cache_pth) && image_num == images.size())
+    {
+        bool fresh = true;
+        for (uint32_t i = 0; fresh && i < image_num; i++)
+        {
+            fresh = entries[i].png_mtime == images[i].png_mtime &&
+                    entries[i].label_mtime == images[i].label_mtime &&
+                    path(i) == images[i].rel_path;
+        }
+        if (fresh)
+            return true;
+    }
+
+    unmap();
+    if (!build_cache(images, cache_pth, std::max(1, thread_num)))
+        return false;
+    return map_file(cache_pth);
+}
+
+int FrameCache::size() const
+{
+    return static_cast<int>(image_num);
+}
+
+const CacheEntry &FrameCache::entry(int idx) const
+{
+    return entries[idx];
+}
+
+const uint8_t *FrameCache::packed(int idx) const
+{
+    return map + entries[idx].data_offset;
+}
+
+std::string FrameCache::path(int idx) const
+{
+    return std::string(strings + entries[idx].path_offset, entries[idx].path_len);
+}
+
+/**
+ * @return $XDG_CACHE_HOME/dvs_roi, else ~/.cache/dvs_roi, else dvs_roi in the temporary directory
+ */
+static std::string default_cache_dir()
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg != NULL && xdg[0] == '/')
+        return std::string(xdg) + "/dvs_roi";
+    const char *home = getenv("HOME");
+    if (home != NULL && home[0] != '\0')
+        return std::string(home) + "/.cache/dvs_roi";
+    std::error_code ec;
+    return (fs::temp_directory_path(ec) / "dvs_roi").string();
+}
+
+std::string frame_cache_path(const std::string &dataset_pth, const std::string &cache_dir)
+{
+    // never inside the dataset, which may be checked in (algorithm/examples)
+    std::string dir = cache_dir.empty() ? default_cache_dir() : cache_dir;
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    std::string name = fs::absolute(dataset_pth).lexically_normal().string();
+    std::replace(name.begin(), name.end(), '/', '_');
+    return dir + "/" + name + ".cache";
+}
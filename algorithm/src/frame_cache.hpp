@@ -0,0 +1,90 @@
+#ifndef DVS_FRAME_CACHE_HPP_
+#define DVS_FRAME_CACHE_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "bbox.hpp"
+
+/**
+ * one image of a FrameCache
+ * @param data_offset file offset of the packed 2-bit frame
+ * @param png_mtime modification time (ns) of the image
+ * @param label_mtime modification time (ns) of the label, -1 if the image has no label file
+ * @param path_offset offset of the image path (relative to the dataset) in the string table
+ * @param path_len length of the image path
+ * @param frame_w width of the frame
+ * @param frame_h height of the frame
+ * @param has_gt 1 if the image has a YOLO-format label
+ * @param gt label bounding box
+ */
+typedef struct
+{
+    uint64_t data_offset;
+    int64_t png_mtime;
+    int64_t label_mtime;
+    uint32_t path_offset;
+    uint32_t path_len;
+    int32_t frame_w;
+    int32_t frame_h;
+    int32_t has_gt;
+    Bbox gt;
+} CacheEntry;
+
+/**
+ * decoded DVS dataset in one file : every .png under the dataset directory packed to
+ * 2 bits per pixel (pack_dvs_frame) together with its label.
+ *
+ * file layout : header, CacheEntry table, path string table, packed frames (8-byte aligned).
+ * the first open decodes the PNGs (thread_num threads) and writes the file, later opens
+ * only list the directory and memory-map the file. the cache is rebuilt if an image or
+ * label was added, removed or modified.
+ */
+class FrameCache
+{
+private:
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    uint32_t image_num;
+    const CacheEntry *entries;
+    const char *strings;
+
+    bool map_file(const std::string &cache_pth);
+    void unmap();
+
+public:
+    FrameCache();
+    ~FrameCache();
+    FrameCache(const FrameCache &) = delete;
+    FrameCache &operator=(const FrameCache &) = delete;
+
+    /**
+     * maps cache_pth if it is up to date with dataset_pth, otherwise decodes the dataset into it
+     * @param dataset_pth directory searched recursively for .png images
+     * @param cache_pth cache file
+     * @param thread_num decoding threads
+     * @return false on error (no images, unreadable dataset, I/O error)
+     */
+    bool open(const std::string &dataset_pth, const std::string &cache_pth, int thread_num);
+
+    int size() const;
+    const CacheEntry &entry(int idx) const;
+    /**
+     * @return packed 2-bit frame of image idx, (frame_w + 3) / 4 bytes per row
+     */
+    const uint8_t *packed(int idx) const;
+    /**
+     * @return image path relative to the dataset
+     */
+    std::string path(int idx) const;
+};
+
+/**
+ * @return cache file of dataset_pth in cache_dir, named after the absolute dataset path.
+ *         an empty cache_dir means $XDG_CACHE_HOME/dvs_roi (else ~/.cache/dvs_roi), created if missing
+ */
+std::string frame_cache_path(const std::string &dataset_pth, const std::string &cache_dir);
+
+#endif
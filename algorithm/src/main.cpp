@@ -23,6 +23,7 @@
 
 #include "visualize.hpp"
 #include "dvs_roi_alg.hpp"
+#include "roi_engine.hpp"
 
 using namespace cv;
 using namespace std;
@@ -37,7 +38,8 @@ enum Mode
     DVS_ROI_PROPOSED = 6,
     DVS_ROI_PROPOSED_MULTIOBJECT = 7,
     DVS_ROI_PROPOSED_ANGLED = 8,
-    DVS_ROI_PROPOSED_MULTI_CONTOUR = 9
+    DVS_ROI_PROPOSED_MULTI_CONTOUR = 9,
+    DVS_ROI_ENGINE = 10
 };
 
 void handleMode(Mode mode);
@@ -67,11 +69,12 @@ Mode parseArguments(int argc, char *argv[])
         {"roi_proposed_angled", no_argument, nullptr, 'A'},
         {"roi_proposed_multi", no_argument, nullptr, 'm'},
         {"roi_proposed_multi_contour", no_argument, nullptr, 'M'},
+        {"roi_engine", no_argument, nullptr, 'e'},
         {nullptr, 0, nullptr, 0}};
 
     // Parse command-line arguments
     int opt;
-    while ((opt = getopt_long(argc, argv, "OPvcapAmM", long_options, nullptr)) != -1)
+    while ((opt = getopt_long(argc, argv, "OPvcapAmMe", long_options, nullptr)) != -1)
     {
         switch (opt)
         {
@@ -107,8 +110,12 @@ Mode parseArguments(int argc, char *argv[])
             // proposed ROI multi contour algorithm
             mode = DVS_ROI_PROPOSED_MULTI_CONTOUR;
             break;
+        case 'e':
+            // every ROI algorithm on one RoiEngine
+            mode = DVS_ROI_ENGINE;
+            break;
         default:
-            fprintf(stderr, "Usage: %s [--roi_clustering | --roi_avg | --roi_proposed]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [--roi_clustering | --roi_avg | --roi_proposed | --roi_engine]\n", argv[0]);
             exit(EXIT_FAILURE);
         }
     }
@@ -131,6 +138,9 @@ void handleMode(Mode mode)
 
     const char *dataset_pth = "/home/nrvfpga01/xsrc/DATASET/60fps/LL/vaccume";
 
+    // working buffers of the ROI algorithms, reused over all frames of a mode
+    RoiScratch scratch;
+
     switch (mode)
     {
     case TEST_ROI_AVG:
@@ -177,7 +187,7 @@ void handleMode(Mode mode)
             if (!load_gt_one(label_path.string(), img.cols, img.rows, gt))
                 continue; // GT 없으면 skip
 
-            Bbox pred = dvs_roi_average_based(img, 10);
+            Bbox pred = dvs_roi_average_based(img, 10, scratch);
 
             sum_ciou += ciou(pred, gt); // ★ IoU → CIoU
             ++cnt;
@@ -291,43 +301,31 @@ void handleMode(Mode mode)
 
         // Run algorithm...
         std::vector<std::vector<cv::Point>> clusters;
-        std::vector<Bbox> rois = dvs_roi_cluster_tracker(
+        std::vector<Bbox> rois;
+        dvs_roi_cluster_tracker(
             frame,
-            clusters,
             200,
-            1000);
+            1000,
+            scratch,
+            rois,
+            &clusters);
 
         auto end = std::chrono::high_resolution_clock::now();
         double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
         std::cout << "Algorithm took " << elapsed_ms << " ms" << std::endl;
 
         std::cout << clusters.size() << std::endl;
-        // Convert grayscale to color for visualization
-        cv::cvtColor(frame, frame, cv::COLOR_GRAY2BGR);
-        // Assign white color to background pixels (128 in grayscale)
-        frame.setTo(cv::Scalar(255, 255, 255), frame == 128);
-
-        // Assign random colors to each cluster
-        cv::RNG rng(12345);
-        for (const auto &cluster : clusters)
-        {
-            if (cluster.size() < 20)
-                continue; // skip small clusters
-            cv::Scalar color(rng.uniform(50, 255), rng.uniform(50, 255), rng.uniform(50, 255));
-            for (const auto &pt : cluster)
-            {
-                frame.at<cv::Vec3b>(pt.y, pt.x) = cv::Vec3b(color[0], color[1], color[2]);
-            }
-        }
+        cv::Mat visual_out;
+        dvs_to_bgr(frame, visual_out);
+        draw_clusters(visual_out, clusters, 20);
 
         // Draw all ROIs
         for (const auto &box : rois)
         {
             printf("bbox: (%d, %d), (%d, %d) \n", box.lx, box.hx, box.ly, box.hy);
-            cv::rectangle(frame, cv::Point(box.lx, box.ly), cv::Point(box.hx, box.hy), cv::Scalar(255), 2);
         }
-        cv::imshow("DVS Cluster Tracker ROI", frame);
-        cv::waitKey(0);
+        draw_rois(visual_out, rois, cv::Scalar(255), 2);
+        show_and_wait("DVS Cluster Tracker ROI", visual_out);
 
         break;
     }
@@ -339,7 +337,8 @@ void handleMode(Mode mode)
 
         Bbox bbox = dvs_roi_average_based(
             frame,
-            10 /* roi_line_min_threshold */);
+            10 /* roi_line_min_threshold */,
+            scratch);
 
         auto end = std::chrono::high_resolution_clock::now();
         double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
@@ -362,10 +361,15 @@ void handleMode(Mode mode)
     case DVS_ROI_PROPOSED:
     {
         printf("DVS ROI PROPOSED mode\n");
+        // the FPGA sends 2-bit frames, the ROI is calculated on them without unpacking
+        std::vector<uint8_t> packed;
+        pack_dvs_frame(frame, packed);
         auto start = std::chrono::high_resolution_clock::now();
 
-        Bbox bbox = dvs_roi_proposed(
-            frame,
+        Bbox bbox = dvs_roi_proposed_packed(
+            packed.data(),
+            frame.cols,
+            frame.rows,
             5,  /* roi_event_score */
             25, /* row_score_threshold */
             10 /* roi_height_min_threshold */);
@@ -398,33 +402,33 @@ void handleMode(Mode mode)
         printf("DVS ROI PROPOSED ANGLED mode\n");
         auto start = std::chrono::high_resolution_clock::now();
 
-        auto rois = dvs_roi_proposed_angled(
+        std::vector<Bbox> rois;
+        std::vector<Streak> streaks;
+        dvs_roi_proposed_angled(
             frame,
             5,  // roi_event_score
             20, // row_score_threshold
             10, // roi_height_min_threshold
             10, // max_vertical_gap
             20, // min_roi_width
-            20  // min_roi_height
-        );
+            20, // min_roi_height
+            scratch,
+            rois,
+            &streaks);
 
         auto end = std::chrono::high_resolution_clock::now();
         double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
         std::cout << "Algorithm took " << elapsed_ms << " ms" << std::endl;
 
-        cv::Mat visual_out = cv::Mat(frame.size(), CV_8UC3);
-        cv::cvtColor(frame, visual_out, cv::COLOR_GRAY2BGR);
-
-        for (const auto &roi : rois)
-        {
-            cv::rectangle(visual_out,
-                          cv::Point(roi.lx, roi.ly),
-                          cv::Point(roi.hx, roi.hy),
-                          cv::Scalar(0, 255, 0), 2);
-        }
+        cv::Mat streak_vis;
+        dvs_to_bgr(frame, streak_vis);
+        draw_streaks(streak_vis, streaks, cv::Scalar(0, 0, 255), 1);
+        show_and_wait("Detected Streaks", streak_vis);
 
-        cv::imshow("Multi ROI Visualization", visual_out);
-        cv::waitKey(0);
+        cv::Mat visual_out;
+        dvs_to_bgr(frame, visual_out);
+        draw_rois(visual_out, rois, cv::Scalar(0, 255, 0), 2);
+        show_and_wait("Multi ROI Visualization", visual_out);
 
         cv::destroyAllWindows();
         break;
@@ -435,42 +439,44 @@ void handleMode(Mode mode)
         printf("DVS ROI PROPOSED MULTI mode\n");
         auto start = std::chrono::high_resolution_clock::now();
 
-        auto rois = dvs_roi_proposed_multiobject(
+        std::vector<Bbox> rois;
+        std::vector<Streak> streaks;
+        dvs_roi_proposed_multiobject(
             frame,
             5,  // roi_event_score
             20, // row_score_threshold
             10, // roi_height_min_threshold
             10, // max_vertical_gap
             20, // min_roi_width
-            20  // min_roi_height
-        );
-        // auto rois = dvs_roi_proposed_multiobject(
+            20, // min_roi_height
+            scratch,
+            rois,
+            &streaks);
+        // dvs_roi_proposed_multiobject(
         //     frame,
         //     50, // roi_event_score
         //     60, // row_score_threshold
         //     20, // roi_height_min_threshold
         //     30, // max_vertical_gap
         //     20, // min_roi_width
-        //     20  // min_roi_height
-        // );
+        //     20, // min_roi_height
+        //     scratch,
+        //     rois,
+        //     &streaks);
 
         auto end = std::chrono::high_resolution_clock::now();
         double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
         std::cout << "Algorithm took " << elapsed_ms << " ms" << std::endl;
 
-        cv::Mat visual_out = cv::Mat(frame.size(), CV_8UC3);
-        cv::cvtColor(frame, visual_out, cv::COLOR_GRAY2BGR);
+        cv::Mat streak_vis;
+        dvs_to_bgr(frame, streak_vis);
+        draw_streaks(streak_vis, streaks, cv::Scalar(0, 0, 255), 2, true);
+        show_and_wait("Streak Visualization", streak_vis);
 
-        for (const auto &roi : rois)
-        {
-            cv::rectangle(visual_out,
-                          cv::Point(roi.lx, roi.ly),
-                          cv::Point(roi.hx, roi.hy),
-                          cv::Scalar(0, 255, 0), 2);
-        }
-
-        cv::imshow("Multi ROI Visualization", visual_out);
-        cv::waitKey(0);
+        cv::Mat visual_out;
+        dvs_to_bgr(frame, visual_out);
+        draw_rois(visual_out, rois, cv::Scalar(0, 255, 0), 2);
+        show_and_wait("Multi ROI Visualization", visual_out);
 
         cv::destroyAllWindows();
         break;
@@ -481,34 +487,67 @@ void handleMode(Mode mode)
         printf("DVS ROI PROPOSED MULTI CONTOUR mode\n");
         auto start = std::chrono::high_resolution_clock::now();
 
-        auto rois = dvs_roi_proposed_multi_contour(
+        std::vector<Bbox> rois;
+        std::vector<std::vector<cv::Point>> contours;
+        dvs_roi_proposed_multi_contour(
             frame,
             5,  // roi_event_score
             20, // row_score_threshold
             10, // roi_height_min_threshold
             10, // max_vertical_gap
             20, // min_roi_width
-            20  // min_roi_height
-        );
+            20, // min_roi_height
+            scratch,
+            rois,
+            &contours);
 
         auto end = std::chrono::high_resolution_clock::now();
         double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
         std::cout << "Algorithm took " << elapsed_ms << " ms" << std::endl;
 
-        cv::Mat visual_out = cv::Mat(frame.size(), CV_8UC3);
-        cv::cvtColor(frame, visual_out, cv::COLOR_GRAY2BGR);
+        cv::Mat contour_vis;
+        dvs_to_bgr(frame, contour_vis);
+        draw_contours(contour_vis, contours, cv::Scalar(0, 255, 0));
+        show_and_wait("Smooth Contour from Streak-Based Mask", contour_vis);
+
+        cv::Mat visual_out;
+        dvs_to_bgr(frame, visual_out);
+        draw_rois(visual_out, rois, cv::Scalar(0, 255, 0), 2);
+        show_and_wait("Multi ROI Visualization", visual_out);
+
+        cv::destroyAllWindows();
+        break;
+    }
 
-        for (const auto &roi : rois)
+    case DVS_ROI_ENGINE:
+    {
+        printf("DVS ROI ENGINE mode\n");
+        const std::pair<RoiAlgorithm, const char *> algorithms[] = {
+            {RoiAlgorithm::AverageBased, "average based"},
+            {RoiAlgorithm::Proposed, "proposed"},
+            {RoiAlgorithm::ProposedAngled, "proposed angled"},
+            {RoiAlgorithm::ProposedMultiObject, "proposed multiobject"},
+            {RoiAlgorithm::ProposedMultiContour, "proposed multi contour"}};
+
+        RoiEngine engine(frame.cols, frame.rows);
+        std::vector<Bbox> rois;
+        for (const auto &algorithm : algorithms)
         {
-            cv::rectangle(visual_out,
-                          cv::Point(roi.lx, roi.ly),
-                          cv::Point(roi.hx, roi.hy),
-                          cv::Scalar(0, 255, 0), 2);
+            engine.set_algorithm(algorithm.first);
+            // the first frame sizes the buffers
+            engine.compute(frame, rois);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            int roi_num = engine.compute(frame, rois);
+            auto end = std::chrono::high_resolution_clock::now();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
+            std::cout << algorithm.second << ": " << roi_num << " ROIs, took " << elapsed_ms << " ms" << std::endl;
         }
 
-        cv::imshow("Multi ROI Visualization", visual_out);
-        cv::waitKey(0);
-
+        cv::Mat visual_out;
+        dvs_to_bgr(frame, visual_out);
+        draw_rois(visual_out, rois, cv::Scalar(0, 255, 0), 2);
+        show_and_wait("Multi ROI Visualization", visual_out);
         cv::destroyAllWindows();
         break;
     }
@@ -0,0 +1,149 @@
+#include "roi_engine.hpp"
+
+const char *roi_algorithm_name(RoiAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case RoiAlgorithm::AverageBased:
+        return "average_based";
+    case RoiAlgorithm::Proposed:
+        return "proposed";
+    case RoiAlgorithm::ProposedAngled:
+        return "proposed_angled";
+    case RoiAlgorithm::ProposedMultiObject:
+        return "proposed_multiobject";
+    case RoiAlgorithm::ProposedMultiContour:
+        return "proposed_multi_contour";
+    }
+    return "unknown";
+}
+
+RoiEngine::RoiEngine(int frame_w, int frame_h, RoiAlgorithm algorithm, const RoiParams &params)
+    : frame_w(frame_w), frame_h(frame_h), algorithm(algorithm), params(params), streak_workers(NULL)
+{
+    scratch.x_count.reserve(frame_w);
+    scratch.y_count.reserve(frame_h);
+
+    // scan lines of detect_streaks : one per column or diagonal, emit flags padded to 8 pixels
+    for (int d = 0; d < 4; d++)
+    {
+        const int line_num = (d == static_cast<int>(ScanDirection::Vertical)) ? frame_w : frame_w + frame_h - 1;
+        scratch.direction_lines[d].score.reserve(line_num);
+        scratch.direction_lines[d].start.reserve(line_num);
+        scratch.direction_lines[d].emit.reserve(frame_w + 8);
+        scratch.direction_streaks[d].reserve(frame_h);
+    }
+    // a few streaks per row, the lists grow further on busy frames and keep their capacity
+    scratch.streaks.reserve(4 * frame_h);
+    scratch.runs.reserve(frame_h);
+    scratch.run_labels.reserve(frame_h);
+    scratch.components.reserve(frame_h);
+    scratch.packed.reserve(((frame_w + 3) / 4) * frame_h);
+    scratch.mask.create(frame_h, frame_w, CV_8UC1);
+}
+
+RoiEngine::~RoiEngine()
+{
+    delete streak_workers;
+}
+
+void RoiEngine::set_algorithm(RoiAlgorithm algorithm)
+{
+    this->algorithm = algorithm;
+}
+
+RoiAlgorithm RoiEngine::get_algorithm() const
+{
+    return algorithm;
+}
+
+void RoiEngine::set_params(const RoiParams &params)
+{
+    this->params = params;
+}
+
+const RoiParams &RoiEngine::get_params() const
+{
+    return params;
+}
+
+/**
+ * @return true if b_box is the all zero box of "no ROI"
+ */
+static bool is_empty_bbox(const Bbox &b_box)
+{
+    return b_box.lx == 0 && b_box.ly == 0 && b_box.hx == 0 && b_box.hy == 0;
+}
+
+int RoiEngine::compute(const cv::Mat &frame, std::vector<Bbox> &rois)
+{
+    assert(frame.cols == frame_w && frame.rows == frame_h);
+    rois.clear();
+
+    switch (algorithm)
+    {
+    case RoiAlgorithm::AverageBased:
+    {
+        Bbox b_box = dvs_roi_average_based(frame, params.roi_line_min_threshold, scratch,
+                                            params.roi_min_size, params.roi_inflation_ratio);
+        if (!is_empty_bbox(b_box))
+            rois.push_back(b_box);
+        break;
+    }
+    case RoiAlgorithm::Proposed:
+    {
+        // the packed scan skips the rows and words that cannot reach the threshold, same ROI
+        pack_dvs_frame(frame, scratch.packed);
+        Bbox b_box = dvs_roi_proposed_packed(scratch.packed.data(), frame_w, frame_h, params.roi_event_score,
+                                             params.row_score_threshold, params.roi_height_min_threshold,
+                                             params.roi_min_size, params.roi_inflation_ratio);
+        if (!is_empty_bbox(b_box))
+            rois.push_back(b_box);
+        break;
+    }
+    case RoiAlgorithm::ProposedAngled:
+        if (streak_workers == NULL)
+        {
+            // one thread per direction besides the caller
+            streak_workers = new StreakWorkers(3);
+            scratch.streak_workers = streak_workers;
+        }
+        dvs_roi_proposed_angled(frame, params.roi_event_score, params.row_score_threshold,
+                                params.roi_height_min_threshold, params.max_vertical_gap,
+                                params.min_roi_width, params.min_roi_height, scratch, rois);
+        break;
+    case RoiAlgorithm::ProposedMultiObject:
+        dvs_roi_proposed_multiobject(frame, params.roi_event_score, params.row_score_threshold,
+                                     params.roi_height_min_threshold, params.max_vertical_gap,
+                                     params.min_roi_width, params.min_roi_height, scratch, rois);
+        break;
+    case RoiAlgorithm::ProposedMultiContour:
+        dvs_roi_proposed_multi_contour(frame, params.roi_event_score, params.row_score_threshold,
+                                       params.roi_height_min_threshold, params.max_vertical_gap,
+                                       params.min_roi_width, params.min_roi_height, scratch, rois);
+        break;
+    }
+
+    return static_cast<int>(rois.size());
+}
+
+int RoiEngine::compute(const uint8_t *packed, std::vector<Bbox> &rois)
+{
+    if (!is_packed_input())
+    {
+        unpack_dvs_frame(packed, frame_w, frame_h, unpacked);
+        return compute(unpacked, rois);
+    }
+    rois.clear();
+    Bbox b_box = dvs_roi_proposed_packed(packed, frame_w, frame_h, params.roi_event_score,
+                                         params.row_score_threshold, params.roi_height_min_threshold,
+                                         params.roi_min_size, params.roi_inflation_ratio);
+    if (!is_empty_bbox(b_box))
+        rois.push_back(b_box);
+    return static_cast<int>(rois.size());
+}
+
+bool RoiEngine::is_packed_input() const
+{
+    return algorithm == RoiAlgorithm::Proposed;
+}
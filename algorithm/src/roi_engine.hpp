@@ -0,0 +1,116 @@
+#ifndef DVS_ROI_ENGINE_HPP_
+#define DVS_ROI_ENGINE_HPP_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "bbox.hpp"
+#include "dvs_roi_alg.hpp"
+
+/**
+ * ROI algorithms selectable in RoiEngine
+ */
+enum class RoiAlgorithm
+{
+    AverageBased,
+    Proposed,
+    ProposedAngled,
+    ProposedMultiObject,
+    ProposedMultiContour
+};
+// number of RoiAlgorithm values, RoiAlgorithm(0) ... RoiAlgorithm(ROI_ALGORITHM_NUM - 1)
+const int ROI_ALGORITHM_NUM = 5;
+
+/**
+ * @return snake_case name of algorithm, as used in reports
+ */
+const char *roi_algorithm_name(RoiAlgorithm algorithm);
+
+/**
+ * parameters of the ROI algorithms, every algorithm reads the ones it needs
+ * @param roi_line_min_threshold minimum events of an ROI row / column (average based)
+ * @param roi_event_score score of an event pixel, an empty pixel scores -1
+ * @param row_score_threshold minimum segment score of an active row
+ * @param roi_height_min_threshold minimum number of consecutive active rows of an ROI
+ * @param max_vertical_gap rows bridged between the streaks of one object (multi-object variants)
+ * @param min_roi_width minimum ROI width (multi-object variants)
+ * @param min_roi_height minimum ROI height (multi-object variants)
+ * @param roi_min_size minimum side of the square ROI (single-ROI algorithms)
+ * @param roi_inflation_ratio enlarges the square ROI around its center (single-ROI algorithms)
+ */
+typedef struct
+{
+    int roi_line_min_threshold = 10;
+    int roi_event_score = 5;
+    int row_score_threshold = 20;
+    int roi_height_min_threshold = 10;
+    int max_vertical_gap = 10;
+    int min_roi_width = 20;
+    int min_roi_height = 20;
+    int roi_min_size = 10;
+    float roi_inflation_ratio = 1.0;
+} RoiParams;
+
+/**
+ * runs one of the ROI algorithms on a stream of equally sized DVS frames.
+ *
+ * the engine owns the scratch buffers of all algorithms, sized for frame_w x frame_h at
+ * construction, and writes the ROIs into the caller's vector. once the buffers and the
+ * caller's vector hold the largest frame seen, compute does not allocate.
+ * ProposedAngled scans its directions on threads of the engine, started on its first frame.
+ * the algorithm and its parameters can be changed between frames.
+ * an engine is not thread-safe, use one engine per thread.
+ */
+class RoiEngine
+{
+private:
+    int frame_w;
+    int frame_h;
+    RoiAlgorithm algorithm;
+    RoiParams params;
+    RoiScratch scratch;
+    // per-direction threads of ProposedAngled, NULL until it runs
+    StreakWorkers *streak_workers;
+    // 8-bit image of a packed frame, for the algorithms that do not read packed frames
+    cv::Mat unpacked;
+
+public:
+    /**
+     * @param frame_w width of DVS frame
+     * @param frame_h height of DVS frame
+     * @param algorithm algorithm of the next compute calls
+     * @param params parameters of the algorithms
+     */
+    RoiEngine(int frame_w, int frame_h, RoiAlgorithm algorithm = RoiAlgorithm::Proposed,
+              const RoiParams &params = RoiParams());
+    ~RoiEngine();
+    RoiEngine(const RoiEngine &) = delete;
+    RoiEngine &operator=(const RoiEngine &) = delete;
+
+    void set_algorithm(RoiAlgorithm algorithm);
+    RoiAlgorithm get_algorithm() const;
+    void set_params(const RoiParams &params);
+    const RoiParams &get_params() const;
+
+    /**
+     * @param frame 8-bit DVS image of frame_w x frame_h (128 : no event)
+     * @param[out] rois ROIs of the frame, cleared first.
+     *             the single-ROI algorithms give at most one ROI
+     * @return number of ROIs
+     */
+    int compute(const cv::Mat &frame, std::vector<Bbox> &rois);
+    /**
+     * same ROIs as compute on the unpacked image
+     * @param packed 2-bit frame of pack_dvs_frame, (frame_w + 3) / 4 bytes per row
+     * @param[out] rois ROIs of the frame, cleared first
+     * @return number of ROIs
+     */
+    int compute(const uint8_t *packed, std::vector<Bbox> &rois);
+    /**
+     * @return true if the algorithm scans the packed frame itself, so compute on a packed
+     *         frame neither unpacks nor packs it
+     */
+    bool is_packed_input() const;
+};
+
+#endif
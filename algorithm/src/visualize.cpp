@@ -20,4 +20,62 @@ void visualize3D(const cv::Mat &acc)
     cv::viz::Viz3d window("3D Event Landscape");
     window.showWidget("EventCloud", point_cloud);
     window.spin(); // Shows window until user closes
-}
\ No newline at end of file
+}
+void dvs_to_bgr(const cv::Mat &frame, cv::Mat &vis)
+{
+    cv::cvtColor(frame, vis, cv::COLOR_GRAY2BGR);
+}
+
+void draw_rois(cv::Mat &vis, const std::vector<Bbox> &rois, const cv::Scalar &color, int thickness)
+{
+    for (const auto &roi : rois)
+    {
+        cv::rectangle(vis,
+                      cv::Point(roi.lx, roi.ly),
+                      cv::Point(roi.hx, roi.hy),
+                      color, thickness);
+    }
+}
+
+void draw_streaks(cv::Mat &vis, const std::vector<Streak> &streaks, const cv::Scalar &color,
+                  int thickness, bool mark_start)
+{
+    for (const auto &streak : streaks)
+    {
+        cv::line(vis, streak.start, streak.end, color, thickness, cv::LINE_AA);
+        if (mark_start)
+            cv::circle(vis, streak.start, 3, color, -1);
+    }
+}
+
+void draw_clusters(cv::Mat &vis, const std::vector<std::vector<cv::Point>> &clusters, size_t min_cluster_size)
+{
+    // Assign white color to background pixels (128 in grayscale)
+    cv::Mat background;
+    cv::inRange(vis, cv::Scalar(128, 128, 128), cv::Scalar(128, 128, 128), background);
+    vis.setTo(cv::Scalar(255, 255, 255), background);
+
+    // Assign random colors to each cluster
+    cv::RNG rng(12345);
+    for (const auto &cluster : clusters)
+    {
+        if (cluster.size() < min_cluster_size)
+            continue; // skip small clusters
+        cv::Vec3b color(rng.uniform(50, 255), rng.uniform(50, 255), rng.uniform(50, 255));
+        for (const auto &pt : cluster)
+        {
+            vis.at<cv::Vec3b>(pt.y, pt.x) = color;
+        }
+    }
+}
+
+void draw_contours(cv::Mat &vis, const std::vector<std::vector<cv::Point>> &contours, const cv::Scalar &color)
+{
+    cv::drawContours(vis, contours, -1, color, 1);
+}
+
+void show_and_wait(const std::string &window_name, const cv::Mat &image)
+{
+    cv::imshow(window_name, image);
+    cv::waitKey(0); // Wait for a key press to close the window
+}
@@ -3,7 +3,50 @@
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/viz.hpp> // Requires OpenCV with Viz module
+#include <vector>
+
+#include "bbox.hpp"
 
 void visualize3D(const cv::Mat &acc);
 
-#endif
\ No newline at end of file
+/**
+ * converts a DVS image to BGR for colored drawing
+ * @param frame 8-bit DVS image
+ * @param[out] vis BGR copy of frame
+ */
+void dvs_to_bgr(const cv::Mat &frame, cv::Mat &vis);
+
+/**
+ * @param vis BGR image
+ * @param rois ROIs to draw as rectangles
+ */
+void draw_rois(cv::Mat &vis, const std::vector<Bbox> &rois, const cv::Scalar &color, int thickness = 2);
+
+/**
+ * @param vis BGR image
+ * @param streaks streaks to draw as lines
+ * @param mark_start marks the start point of every streak with a filled circle
+ */
+void draw_streaks(cv::Mat &vis, const std::vector<Streak> &streaks, const cv::Scalar &color,
+                  int thickness = 1, bool mark_start = false);
+
+/**
+ * colors every cluster of at least min_cluster_size pixels with a random color,
+ * the background (128) is painted white
+ * @param vis BGR image of the DVS frame
+ * @param clusters event pixels of every cluster
+ */
+void draw_clusters(cv::Mat &vis, const std::vector<std::vector<cv::Point>> &clusters, size_t min_cluster_size);
+
+/**
+ * @param vis BGR image
+ * @param contours closed polygons to draw
+ */
+void draw_contours(cv::Mat &vis, const std::vector<std::vector<cv::Point>> &contours, const cv::Scalar &color);
+
+/**
+ * shows image in window_name and waits for a key press
+ */
+void show_and_wait(const std::string &window_name, const cv::Mat &image);
+
+#endif